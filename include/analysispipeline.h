@@ -0,0 +1,129 @@
+#ifndef ANALYSISPIPELINE_H
+#define ANALYSISPIPELINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+#include "fibercore.h"
+#include "analysispolicies.h"
+#include "pixelkernels.h"
+
+// Fixed-recipe analysis: center detection, defect extraction, classification
+// and grading are template parameters, so a station's configuration compiles
+// to one inlined path with no runtime switches. Triage and frame budgets are
+// left to FiberCore; this is the lean path for known-good production setups.
+template <typename PixelT,
+          typename CenterDetector,
+          typename DefectExtractor,
+          typename Classifier,
+          typename Grader>
+class AnalysisPipeline
+{
+    static_assert(std::is_same_v<PixelT, uint8_t> || std::is_same_v<PixelT, uint16_t>,
+                  "AnalysisPipeline supports 8-bit and 16-bit single channel frames");
+    
+public:
+    AnalysisPipeline() = default;
+    explicit AnalysisPipeline(Grader grader)
+        : m_grader(std::move(grader))
+    {
+    }
+    
+    static constexpr int frameType() { return std::is_same_v<PixelT, uint16_t> ? CV_16UC1 : CV_8UC1; }
+    
+    CoreAnalysisResult analyze(const cv::Mat &frame)
+    {
+        const auto start = std::chrono::steady_clock::now();
+    
+        CoreAnalysisResult result;
+        result.idealCoreCladRatio = m_grader.idealCoreCladRatio();
+    
+        try {
+            CV_Assert(frame.type() == frameType());
+    
+            // Detection runs on 8 bits; 16-bit sensors keep their top byte
+            cv::Mat gray;
+            if constexpr (std::is_same_v<PixelT, uint16_t>) {
+                scaleTo8Bit(frame, gray, 1.0 / 256.0);
+            } else {
+                gray = frame;
+            }
+    
+            result.geometry = m_centerDetector.locate(gray);
+            if (result.geometry.isValid()) {
+                result.coreCladRatio = result.geometry.coreRadius / result.geometry.claddingRadius;
+                result.concentricity = m_grader.concentricity(result.geometry);
+            }
+    
+            // Extraction and classification see only a view of the cladding square
+            result.roi = result.geometry.roi(gray.size());
+            const cv::Mat roi = gray(result.roi);
+            std::vector<cv::Rect> regions = m_extractor.extract(roi);
+            result.defects.reserve(regions.size());
+            for (const cv::Rect &region : regions) {
+                CoreDefect defect;
+                defect.type = m_classifier.classify(roi, region);
+                defect.bounds = region + result.roi.tl();
+                defect.severity = m_grader.severity(defect.type, defect.bounds);
+                result.defects.push_back(defect);
+            }
+    
+            result.isAcceptable = m_grader.isAcceptable(result.defects, result.coreCladRatio);
+            result.overallQuality = m_grader.qualityScore(result);
+        } catch (const std::exception &e) {
+            result.isAcceptable = false;
+            result.error = e.what();
+        }
+    
+        result.analysisTimeMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+    
+    CenterDetector &centerDetector() { return m_centerDetector; }
+    Grader &grader() { return m_grader; }
+    
+private:
+    CenterDetector m_centerDetector;
+    DefectExtractor m_extractor;
+    Classifier m_classifier;
+    Grader m_grader;
+};
+
+// The recipe most stations run: single frames, full resolution
+using StandardPipeline8 = AnalysisPipeline<uint8_t, HoughCenterDetector, FullResolutionExtractor,
+                                           AspectRatioClassifier, StandardGrader>;
+using StandardPipeline16 = AnalysisPipeline<uint16_t, HoughCenterDetector, FullResolutionExtractor,
+                                            AspectRatioClassifier, StandardGrader>;
+
+struct PipelineConfig {
+    int depth = CV_8U;              // CV_8U or CV_16U
+    bool tracking = false;          // Refine the previous frame's geometry (live streams)
+    bool halfResolution = false;    // Extract defects from a half resolution copy
+    double idealCoreCladRatio = 0.8;
+    double maxAllowedDefects = 5.0;
+};
+
+// Picks one of the precompiled AnalysisPipeline instantiations at run time.
+// The only indirection is a single virtual call per frame.
+class RuntimePipeline
+{
+public:
+    class Stage;
+    
+    explicit RuntimePipeline(const PipelineConfig &config = PipelineConfig());
+    ~RuntimePipeline();
+    
+    CoreAnalysisResult analyze(const cv::Mat &frame);
+    const PipelineConfig &config() const;
+    
+private:
+    PipelineConfig m_config;
+    std::unique_ptr<Stage> m_stage;
+};
+
+#endif // ANALYSISPIPELINE_H
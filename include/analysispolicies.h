@@ -0,0 +1,163 @@
+#ifndef ANALYSISPOLICIES_H
+#define ANALYSISPOLICIES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "fibercore.h"
+#include "fibertracker.h"
+
+// Interchangeable stages of the analysis pipeline. Each policy is a plain
+// class with non-virtual, mostly inline members so that a fixed combination
+// in AnalysisPipeline compiles to a direct call chain.
+
+// Center detectors: FiberGeometry locate(const cv::Mat &gray)
+
+// Full Hough search on every frame
+struct HoughCenterDetector {
+    FiberGeometry locate(const cv::Mat &gray) { return FiberTracker::detect(gray); }
+};
+
+// Refines the previous frame's circle; for live streams
+class TrackingCenterDetector
+{
+public:
+    FiberGeometry locate(const cv::Mat &gray) { return m_tracker.update(gray); }
+    void reset() { m_tracker.reset(); }
+    
+private:
+    FiberTracker m_tracker;
+};
+
+// Defect extractors: std::vector<cv::Rect> extract(const cv::Mat &gray)
+
+// Adaptive threshold and contour filtering, optionally on a half resolution copy
+template <bool HalfResolution>
+struct ThresholdDefectExtractor {
+    std::vector<cv::Rect> extract(const cv::Mat &gray) const
+    {
+        return FiberCore::detectDefectRegions(gray, HalfResolution);
+    }
+};
+
+using FullResolutionExtractor = ThresholdDefectExtractor<false>;
+using HalfResolutionExtractor = ThresholdDefectExtractor<true>;
+
+// Classifiers: DefectType classify(const cv::Mat &gray, const cv::Rect &region)
+
+// Classifies by the aspect ratio and size of the bounding box
+struct AspectRatioClassifier {
+    static DefectType classifyBounds(int width, int height)
+    {
+        double aspectRatio = static_cast<double>(width) / height;
+    
+        if (aspectRatio > 3.0) {
+            return DefectType::Scratch;
+        } else if (aspectRatio < 0.33) {
+            return DefectType::Crack;
+        } else if (width > 50) {
+            return DefectType::Chip;
+        } else {
+            return DefectType::Contamination;
+        }
+    }
+    
+    DefectType classify(const cv::Mat &, const cv::Rect &region) const
+    {
+        return classifyBounds(region.width, region.height);
+    }
+};
+
+// Graders: severity of one defect, pass/fail and overall score of a frame
+
+class StandardGrader
+{
+public:
+    explicit StandardGrader(double idealCoreCladRatio = 0.8, double maxAllowedDefects = 5.0)
+        : m_idealCoreCladRatio(idealCoreCladRatio)
+        , m_maxAllowedDefects(maxAllowedDefects)
+    {
+    }
+    
+    double idealCoreCladRatio() const { return m_idealCoreCladRatio; }
+    double maxAllowedDefects() const { return m_maxAllowedDefects; }
+    
+    // Base severity per DefectType, indexed by its value instead of switched on
+    static double baseSeverity(DefectType type)
+    {
+        static constexpr std::array<double, 5> kBaseSeverity = {
+            0.3,    // Scratch
+            0.5,    // Chip
+            0.8,    // Crack
+            0.2,    // Contamination
+            0.4     // Unknown
+        };
+        size_t index = std::min<size_t>(static_cast<size_t>(type), kBaseSeverity.size() - 1);
+        return kBaseSeverity[index];
+    }
+    
+    // Scale from 0.0 (minor) to 1.0 (severe), grown by the defect's area
+    static double severity(DefectType type, const cv::Rect &bounds)
+    {
+        double sizeFactor = std::min(1.0, bounds.area() / 1000.0);
+        return std::min(1.0, baseSeverity(type) + sizeFactor * 0.5);
+    }
+    
+    // 1.0 means the core sits on the cladding center, 0.0 means its edge
+    // touches the cladding's
+    static double concentricity(const cv::Point2f &coreCenter, double coreRadius,
+                                const cv::Point2f &claddingCenter, double claddingRadius)
+    {
+        if (claddingRadius <= 0) {
+            return 0.0;
+        }
+        if (claddingRadius - coreRadius <= 0) {
+            return 1.0;  // Core and cladding are basically the same
+        }
+    
+        double offset = cv::norm(coreCenter - claddingCenter);
+        return std::max(0.0, 1.0 - offset / (claddingRadius - coreRadius));
+    }
+    
+    // FiberGeometry holds one center for both circles, so a valid geometry
+    // grades as concentric until the core is located on its own
+    static double concentricity(const FiberGeometry &geometry)
+    {
+        return concentricity(geometry.center, geometry.coreRadius, geometry.center, geometry.claddingRadius);
+    }
+    
+    bool isAcceptable(const std::vector<CoreDefect> &defects, double coreCladRatio) const
+    {
+        int criticalDefects = 0;
+        double totalSeverity = 0.0;
+        for (const CoreDefect &defect : defects) {
+            criticalDefects += defect.severity > 0.7 ? 1 : 0;
+            totalSeverity += defect.severity;
+        }
+    
+        bool ratioAcceptable = coreCladRatio >= 0.7 * m_idealCoreCladRatio &&
+                               coreCladRatio <= 1.3 * m_idealCoreCladRatio;
+        return ratioAcceptable && totalSeverity < m_maxAllowedDefects && criticalDefects < 2;
+    }
+    
+    // Overall score from 0.0 (worst) to 1.0 (best)
+    double qualityScore(const CoreAnalysisResult &result) const
+    {
+        double score = 1.0;
+        for (const CoreDefect &defect : result.defects) {
+            score -= defect.severity * 0.1;  // Each defect can reduce up to 0.1
+        }
+        score -= (1.0 - result.concentricity) * 0.3;
+        score -= std::abs(result.coreCladRatio - m_idealCoreCladRatio) / m_idealCoreCladRatio * 0.3;
+        return std::max(0.0, std::min(1.0, score));
+    }
+    
+private:
+    double m_idealCoreCladRatio;
+    double m_maxAllowedDefects;
+};
+
+#endif // ANALYSISPOLICIES_H
@@ -0,0 +1,68 @@
+#ifndef ANNOTATIONOVERLAY_H
+#define ANNOTATIONOVERLAY_H
+
+#include <QColor>
+#include <QImage>
+#include <QPainter>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+// Layers that can be toggled independently in the viewer
+enum AnnotationLayer {
+    DefectLayer   = 0x1,
+    LabelLayer    = 0x2,
+    GeometryLayer = 0x4,
+    AllLayers     = DefectLayer | LabelLayer | GeometryLayer
+};
+
+struct AnnotationShape {
+    enum class Kind {
+        Rectangle,
+        Circle,
+        Point
+    };
+    
+    Kind kind;
+    QRect rect;             // Bounding rectangle (a circle's square bounds, a point's 1x1 cell)
+    QColor color;
+    int penWidth;
+    AnnotationLayer layer;
+};
+
+struct AnnotationLabel {
+    QRect anchor;           // Text is centred above this rectangle
+    QString text;
+    AnnotationLayer layer;
+};
+
+// Vector description of the analysis annotations, in image coordinates.
+// The viewer composites it over the frame at display time; a burned-in
+// raster is only produced on export.
+class AnnotationOverlay
+{
+public:
+    void clear();
+    bool isEmpty() const;
+    
+    void addRect(const QRect &rect, const QColor &color, int penWidth, AnnotationLayer layer);
+    void addCircle(const QPoint &center, int radius, const QColor &color, int penWidth, AnnotationLayer layer);
+    void addPoint(const QPoint &point, const QColor &color, int penWidth, AnnotationLayer layer);
+    void addLabel(const QRect &anchor, const QString &text, AnnotationLayer layer);
+    
+    const QVector<AnnotationShape> &shapes() const { return m_shapes; }
+    const QVector<AnnotationLabel> &labels() const { return m_labels; }
+    
+    // Draw onto an already scaled target; scale maps image to painter coordinates
+    void paint(QPainter &painter, int layers = AllLayers, double scale = 1.0) const;
+    
+    // Burn the overlay into a copy of the image (export only)
+    QImage render(const QImage &image, int layers = AllLayers) const;
+    
+private:
+    QVector<AnnotationShape> m_shapes;
+    QVector<AnnotationLabel> m_labels;
+};
+
+#endif // ANNOTATIONOVERLAY_H
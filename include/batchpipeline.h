@@ -0,0 +1,146 @@
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "boundedqueue.h"
+
+class MappedImageFile;
+class ResourceGovernor;
+
+struct BatchOptions {
+    int readAhead = 8;          // Files read but not yet decoded
+    int ioThreads = 4;          // Reader threads when io_uring is unavailable
+    int decodeThreads = 0;      // 0 = one per hardware thread
+    int decodedFrames = 4;      // Decoded frames waiting for the analyzer
+    int previewScale = 1;       // 2, 4 or 8 decodes at reduced resolution
+    bool useIoUring = true;
+};
+
+// One decoded frame, always 8-bit gray
+struct BatchFrame {
+    size_t index = 0;           // Position of the file in the batch
+    int page = 0;               // Page of a multi-page dump
+    std::string path;
+    cv::Mat image;
+    std::string error;          // Set (and image empty) when the file could not be read or decoded
+};
+
+// Work done by one stage. Busy and blocked times are summed over the
+// stage's threads; blocked time is backpressure from the next stage.
+struct BatchStageStats {
+    uint64_t items = 0;
+    uint64_t bytes = 0;
+    double busyMs = 0.0;
+    double blockedMs = 0.0;
+    
+    double itemsPerSecond(double elapsedMs) const { return elapsedMs > 0.0 ? items * 1000.0 / elapsedMs : 0.0; }
+    double megabytesPerSecond(double elapsedMs) const { return elapsedMs > 0.0 ? bytes / 1048.576 / elapsedMs : 0.0; }
+};
+
+struct BatchStats {
+    BatchStageStats read;
+    BatchStageStats decode;
+    BatchStageStats analysis;
+    size_t files = 0;
+    uint64_t failures = 0;
+    size_t peakReadQueue = 0;
+    size_t peakFrameQueue = 0;
+    bool ioUring = false;
+    double elapsedMs = 0.0;
+};
+
+// Overlaps file reading, decoding and analysis for batch runs over
+// directories. An I/O stage reads files ahead (io_uring when fibercore was
+// built with liburing, a reader thread pool otherwise), a decode stage turns
+// them into gray frames on several threads, and the analyzer pulls frames
+// with next() or through run(). The stages are joined by bounded queues, so
+// a slow analyzer throttles decoding and reading instead of letting frames
+// pile up. Uncompressed dumps are mapped instead of read.
+class BatchPipeline
+{
+public:
+    explicit BatchPipeline(const BatchOptions &options = BatchOptions());
+    ~BatchPipeline();
+    
+    BatchPipeline(const BatchPipeline &) = delete;
+    BatchPipeline &operator=(const BatchPipeline &) = delete;
+    
+    // Queue depths and decode threads follow the governor's plan
+    void setResourceGovernor(ResourceGovernor *governor);
+    
+    bool start(const std::vector<std::string> &files);
+    
+    // Blocks until the next frame; false once the batch is done or stopped
+    bool next(BatchFrame &frame);
+    
+    void stop();
+    bool isRunning() const;
+    
+    // Runs a whole batch: analyze is called on analysisThreads workers, each
+    // identified by its index so it can keep per-thread state
+    using AnalysisFunction = std::function<void(BatchFrame &frame, int worker)>;
+    BatchStats run(const std::vector<std::string> &files, int analysisThreads, const AnalysisFunction &analyze);
+    
+    BatchStats stats() const;
+    
+    // Image files of a directory in name order
+    static std::vector<std::string> listImages(const std::string &directory);
+    
+    static bool isIoUringAvailable();
+    
+private:
+    struct ReadItem {
+        size_t index = 0;
+        std::vector<uchar> bytes;
+        std::shared_ptr<MappedImageFile> mapped;
+        std::string error;
+    };
+    
+    void readLoop();
+    void readLoopIoUring();
+    bool claimFile(size_t &index);
+    bool prepareMapped(ReadItem &item);
+    void deliverRead(ReadItem &&item, double busyMs);
+    void finishReader();
+    void decodeLoop();
+    bool deliverFrame(BatchFrame &&frame, double busyMs);
+    int decodeFlags() const;
+    cv::Mat toAnalysisFrame(const cv::Mat &image) const;
+    void followResourcePlan();
+    void shutdown();
+    void joinThreads();
+    
+    BatchOptions m_options;
+    ResourceGovernor *m_governor;
+    
+    std::vector<std::string> m_files;
+    std::atomic<size_t> m_nextFile;
+    std::atomic<bool> m_stopping;
+    std::atomic<int> m_activeReaders;
+    std::atomic<int> m_activeDecoders;
+    bool m_running;
+    
+    BoundedQueue<ReadItem> m_readQueue;
+    BoundedQueue<BatchFrame> m_frameQueue;
+    std::vector<std::thread> m_threads;
+    std::mutex m_controlMutex;      // Serializes start() and stop() across threads
+    
+    mutable std::mutex m_statsMutex;
+    BatchStats m_stats;
+    std::chrono::steady_clock::time_point m_startTime;
+    std::chrono::steady_clock::time_point m_finishTime;
+    bool m_finished;
+};
+
+#endif // BATCHPIPELINE_H
@@ -0,0 +1,130 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Blocking multi-producer/multi-consumer queue with a capacity. Unlike
+// FrameRing, nothing is ever dropped: a full queue blocks the producer, so
+// a slow stage pushes back on the stages before it and the number of items
+// in memory stays bounded. close() ends the stream; consumers drain what is
+// left and then see false.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity = 4)
+        : m_capacity(std::max<size_t>(1, capacity))
+        , m_closed(false)
+        , m_peakSize(0)
+    {
+    }
+    
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+    
+    // Blocks while the queue is full; false if the queue was closed
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+    
+        m_items.push_back(std::move(item));
+        m_peakSize = std::max(m_peakSize, m_items.size());
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+    
+    // Blocks while the queue is empty; false once it is closed and drained
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) {
+            return false;
+        }
+    
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+    
+    // Producers fail from now on; consumers drain the remaining items
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+    
+    // Drops queued items, e.g. when a run is cancelled
+    void clear()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.clear();
+        }
+        m_notFull.notify_all();
+    }
+    
+    // Empties and reopens the queue for another run
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.clear();
+        m_closed = false;
+        m_peakSize = 0;
+    }
+    
+    // Shrinking takes effect as consumers catch up; queued items are kept
+    void setCapacity(size_t capacity)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_capacity = std::max<size_t>(1, capacity);
+        }
+        m_notFull.notify_all();
+    }
+    
+    size_t capacity() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+    
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+    
+    size_t peakSize() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_peakSize;
+    }
+    
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed;
+    size_t m_peakSize;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,73 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <cstdint>
+#include <string>
+
+// Instruction set variants of the hand-written pixel kernels, in order of
+// preference on their architecture
+enum class CpuIsa : uint8_t {
+    Baseline = 0,   // Whatever the compiler targets by default
+    SSE42,
+    AVX2,
+    AVX512,         // AVX-512 F + BW
+    NEON
+};
+
+// Word-wise operations on bit-packed masks
+enum class BitOp : uint8_t {
+    And,
+    Or,
+    AndNot          // a & ~b
+};
+
+// Table of row kernels for one instruction set. Every variant is built from
+// the same source (pixelkernelsimpl.h) with different compiler flags, so all
+// of them produce identical results.
+struct PixelKernels {
+    CpuIsa isa;
+    
+    // sum += added - removed per pixel, wrapping modulo 2^16; removed may be null
+    void (*accumulate)(uint16_t *sum, const uint8_t *added, const uint8_t *removed, int count);
+    
+    // Returns the sum of |a - b|; maxDifference is raised to the largest difference seen
+    int (*absDifference)(const uint8_t *a, const uint8_t *b, int count, int *maxDifference);
+    
+    // dst = src * scale, rounded and saturated to 8 bits
+    void (*scaleTo8Bit)(const uint16_t *src, uint8_t *dst, int count, float scale);
+    
+    // Packs count pixels into ceil(count / 64) words, bit x for pixel x (nonzero = set);
+    // unused bits of the last word are cleared
+    void (*packBits)(const uint8_t *src, uint64_t *dst, int count);
+    
+    // Expands count bits to 0 or 255 per pixel
+    void (*unpackBits)(const uint64_t *src, uint8_t *dst, int count);
+    
+    // dst = a op b over words; dst may be a
+    void (*combineBits)(uint64_t *dst, const uint64_t *a, const uint64_t *b, int words, BitOp op);
+    
+    // Set bits in a op b, or in a alone when b is null
+    uint64_t (*countBits)(const uint64_t *a, const uint64_t *b, int words, BitOp op);
+};
+
+// Kernels for the running CPU. Chosen on first use from cpuid, unless the
+// FIBERCORE_FORCE_ISA environment variable names a supported variant
+// (baseline, sse4.2, avx2, avx512 or neon).
+const PixelKernels &pixelKernels();
+
+CpuIsa activeCpuIsa();
+
+// Best variant both this CPU and this build support
+CpuIsa detectCpuIsa();
+bool isCpuIsaSupported(CpuIsa isa);
+
+// Benchmarking overrides. forceCpuIsa() returns false and keeps the current
+// selection when the variant cannot run here; resetCpuIsa() returns to the
+// detected variant.
+bool forceCpuIsa(CpuIsa isa);
+void resetCpuIsa();
+
+const char *cpuIsaName(CpuIsa isa);
+bool parseCpuIsa(const std::string &name, CpuIsa &isa);
+
+#endif // CPUDISPATCH_H
@@ -0,0 +1,80 @@
+#ifndef CRACKDETECTOR_H
+#define CRACKDETECTOR_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct CrackOptions {
+    double sigma = 1.0;             // Derivative scale at every pyramid level, in that level's pixels
+    int scales = 3;                 // Pyramid levels searched; level k covers about sigma * 2^k
+    double beta = 0.5;              // Frangi blob term: tolerance on the eigenvalue ratio
+    double structureScale = 8.0;    // Frangi contrast term: normalized curvature of a clear ridge, in gray levels
+    double sideDistance = 2.0;      // Both flanks of a ridge are sampled this many sigmas across it
+    double minResponse = 0.25;      // Ridge pixels: combined response above this (0..1)
+    int minLength = 15;             // Shortest crack reported, longer box side in pixels
+    double minElongation = 2.5;     // Major to minor axis of the ridge pixels; blob rims and rings stay below
+};
+
+struct CrackCandidate {
+    cv::Rect bounds;
+    int label = 0;                  // Component of the candidate in labels()
+    int pixels = 0;                 // Ridge pixels in the component
+    float strength = 0.0f;          // Mean ridge response over those pixels
+    float elongation = 0.0f;        // Major to minor axis of those pixels
+};
+
+// Multi-scale Hessian ridge filter (Frangi vesselness) for cracks: dark,
+// thin and possibly curved lines of any width up to a few pixels. Every
+// scale runs the same small separable Gaussian derivative kernels on its own
+// level of a Gaussian pyramid, so a coarse scale costs a fraction of the
+// finest one instead of a wider kernel on the full frame. The ridge response
+// is gated by comparing both flanks of the ridge, which keeps step edges such
+// as the core boundary from responding like one-sided valleys.
+//
+// Scales are filtered in parallel and combined by maximum at full
+// resolution; connected ridge pixels that are long and elongated enough
+// become candidates, which leaves the rims of round blobs out. Work
+// buffers are kept between frames; not thread-safe, one instance per
+// analysis thread.
+class CrackDetector
+{
+public:
+    explicit CrackDetector(const CrackOptions &options = CrackOptions());
+    
+    void setOptions(const CrackOptions &options);
+    const CrackOptions &options() const;
+    
+    // pyramid[0] is the 8-bit single channel image, possibly a view into a
+    // larger frame, and every further level a pyrDown of the one before.
+    // Levels the caller already has are reused, missing ones are built here.
+    // mask, when given, limits where ridges are searched. Candidates are in
+    // pyramid[0]'s coordinates, longest first.
+    std::vector<CrackCandidate> detect(const std::vector<cv::Mat> &pyramid, const cv::Mat &mask = cv::Mat());
+    std::vector<CrackCandidate> detect(const cv::Mat &gray, const cv::Mat &mask = cv::Mat());
+    
+    // Combined response and ridge component labels of the last detect()
+    const cv::Mat &response() const;
+    const cv::Mat &labels() const;
+    
+private:
+    void buildKernels();
+    void filterLevel(const cv::Mat &level, int scale);
+    
+    CrackOptions m_options;
+    cv::Mat m_gaussian;             // 1D kernels: Gaussian and its first and second derivatives
+    cv::Mat m_firstDerivative;
+    cv::Mat m_secondDerivative;
+    
+    std::vector<cv::Mat> m_pyramid;                         // Caller's levels, then m_builtLevels
+    std::vector<cv::Mat> m_builtLevels;
+    std::vector<cv::Mat> m_smooth, m_dxx, m_dyy, m_dxy;     // Per scale
+    std::vector<cv::Mat> m_levelResponse;
+    std::vector<cv::Mat> m_upsampled;
+    cv::Mat m_response;
+    cv::Mat m_ridges;
+    cv::Mat m_labels;
+    cv::Mat m_stats;
+    cv::Mat m_centroids;
+};
+
+#endif // CRACKDETECTOR_H
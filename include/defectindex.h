@@ -0,0 +1,69 @@
+#ifndef DEFECTINDEX_H
+#define DEFECTINDEX_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "fibercore.h"
+
+// Uniform grid over the bounding boxes of one result's defects, built once
+// per result. Boxes are registered in every cell they touch and the cells
+// are stored as one flat array with per-cell offsets, so a query only looks
+// at the boxes in the cells it covers instead of the whole list. Queries are
+// const and keep no state, so one index can serve several threads.
+class DefectIndex
+{
+public:
+    DefectIndex();
+    
+    // cellSize 0 derives the cell from the typical box size
+    void build(const std::vector<cv::Rect> &boxes, int cellSize = 0);
+    void build(const std::vector<CoreDefect> &defects, int cellSize = 0);
+    void clear();
+    
+    size_t size() const;
+    bool empty() const;
+    int cellSize() const;
+    const cv::Rect &bounds(int index) const;
+    
+    // Query results are box indices in ascending order
+    std::vector<int> intersecting(const cv::Rect &area) const;
+    
+    // Boxes with any part within radius of center
+    std::vector<int> withinRadius(const cv::Point2f &center, float radius) const;
+    
+    // Boxes whose center lies in [innerRadius, outerRadius) from center,
+    // e.g. the core disc or the cladding ring of a FiberGeometry
+    std::vector<int> withinAnnulus(const cv::Point2f &center, float innerRadius, float outerRadius) const;
+    
+    // Smallest box containing point, grown by tolerance pixels; -1 if none
+    int hitTest(const cv::Point &point, int tolerance = 0) const;
+    
+    // Groups of boxes chained by gaps of at most maxGap pixels (0 joins
+    // touching and overlapping boxes only), ordered by their first box
+    std::vector<std::vector<int>> clusters(int maxGap) const;
+    
+    // Rejoins the pieces of fragmented defects: boxes at most maxGap apart
+    // that overlap, or that are dashes continuing each other along their long
+    // axis, become the union of their boxes. Round spots stay separate however
+    // close, so dense contamination keeps its count. A negative maxGap
+    // returns the boxes unchanged.
+    static std::vector<cv::Rect> mergeFragments(const std::vector<cv::Rect> &boxes, int maxGap);
+    
+private:
+    template <typename Visitor>
+    void visit(const cv::Rect &area, Visitor visitor) const;
+    template <typename Predicate>
+    std::vector<std::vector<int>> clusters(int maxGap, Predicate joins) const;
+    cv::Rect cellSpan(const cv::Rect &box) const;
+    
+    std::vector<cv::Rect> m_bounds;
+    std::vector<int> m_cellStart;   // Boxes of cell c are m_cellItems[m_cellStart[c] .. m_cellStart[c + 1])
+    std::vector<int> m_cellItems;
+    cv::Point m_origin;
+    int m_cellSize;
+    int m_cols;
+    int m_rows;
+};
+
+#endif // DEFECTINDEX_H
@@ -0,0 +1,56 @@
+#ifndef DEFECTTRACKER_H
+#define DEFECTTRACKER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// A defect followed across consecutive live frames
+struct DefectTrack {
+    int id = 0;
+    cv::Rect bounds;
+    int label = -1;             // Classification carried across frames (-1 = not classified yet)
+    int hits = 0;               // Frames in which the defect was matched
+    int misses = 0;             // Consecutive frames without a match
+    float confidence = 0.0f;    // 0..1, grows with hits and decays with misses
+};
+
+// Frame-to-frame association of defect candidates.
+// Tracks are bucketed in a uniform grid keyed by their center cell, so each
+// candidate is only compared with tracks in the surrounding 3x3 cells.
+class DefectTracker
+{
+public:
+    DefectTracker();
+    ~DefectTracker();
+    
+    void reset();
+    void setCellSize(int pixels);
+    void setMaxMisses(int frames);
+    void setConfirmHits(int frames);
+    
+    // Matches this frame's candidates against the live tracks, creates tracks
+    // for unmatched candidates and retires tracks missed for too long.
+    // Returns the index into tracks() for every candidate.
+    std::vector<int> update(const std::vector<cv::Rect> &candidates);
+    
+    std::vector<DefectTrack> &tracks();
+    const std::vector<DefectTrack> &tracks() const;
+    
+    // Confirmed tracks are reported; single-frame flickers are not
+    bool isConfirmed(const DefectTrack &track) const;
+
+private:
+    int64_t cellKey(int cellX, int cellY) const;
+    double matchCost(const DefectTrack &track, const cv::Rect &candidate) const;
+    
+    std::vector<DefectTrack> m_tracks;
+    std::unordered_map<int64_t, std::vector<int>> m_grid;
+    int m_cellSize;
+    int m_maxMisses;
+    int m_confirmHits;
+    int m_nextId;
+};
+
+#endif // DEFECTTRACKER_H
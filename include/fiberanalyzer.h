@@ -7,36 +7,54 @@
 #include <QPoint>
 #include <QRect>
 #include <QString>
+#include <QStringList>
 #include <QMutex>
 #include <opencv2/opencv.hpp>
 
-// Struct to hold defect information
+#include "fibercore.h"
+#include "batchpipeline.h"
+#include "annotationoverlay.h"
+
+// Struct to hold defect information. Kept plain-old-data so defect arrays
+// are flat and cheap to copy; the description is a static string per type.
 struct FiberDefect {
-    enum class DefectType {
-        Scratch,
-        Chip,
-        Crack,
-        Contamination,
-        Unknown
-    };
-    
-    DefectType type;
+    using DefectType = ::DefectType;
+    
+    DefectType type = DefectType::Unknown;
     QRect boundingBox;
-    double severity;
-    QString description;
+    double severity = 0.0;
+    int trackId = 0;            // Stable identity across live frames (0 = untracked)
+    int hits = 1;               // Frames in which the defect was seen
+    float confidence = 1.0f;
+    
+    static const char *typeDescription(DefectType type) { return defectTypeDescription(type); }
+    const char *description() const { return typeDescription(type); }
 };
 
-// Analysis results
+// Analysis results. Only measurements are stored; the summary text and the
+// annotation overlay are derived on demand, so a stored result stays small.
 struct FiberAnalysisResult {
-    bool isAcceptable;
-    double coreCladRatio;
-    double concentricity;
-    double overallQuality;
+    bool isAcceptable = true;
+    bool degraded = false;          // Optional stages were downgraded to meet the frame budget
+    FrameQualityIssue qualityIssue = FrameQualityIssue::None;  // Set when analysis was skipped
+    double coreCladRatio = 0.0;
+    double idealCoreCladRatio = 0.0;
+    double concentricity = 0.0;
+    double overallQuality = 1.0;    // 1.0 is perfect, 0.0 is unusable
+    double analysisTimeMs = 0.0;
+    FiberGeometry geometry;
+    QRect roi;                      // Cladding square the defects were searched in
+    double coreCoverage = 0.0;      // Fraction of the core and cladding covered by defects
+    double claddingCoverage = 0.0;
     QVector<FiberDefect> defects;
-    QImage annotatedImage;
-    QString summary;
+    QString error;                  // Only set when the analysis failed
+    
+    QString summary() const;
+    AnnotationOverlay overlay() const;
 };
 
+// Qt adapter around FiberCore: converts QImage frames, serializes access
+// and presents results with Qt types.
 class FiberAnalyzer
 {
 public:
@@ -46,6 +64,14 @@ public:
     void setReferenceParameters(double idealCoreCladRatio, double maxAllowedDefects);
     FiberAnalysisResult analyzeImage(const QImage &processedImage);
     
+    // Stitched mosaics too large to load: streamed from disk in tiles
+    FiberAnalysisResult analyzeMosaic(const QString &filePath, int tileSize = 2048);
+    
+    // Batch runs: files are read and decoded ahead by the pipeline and analyzed
+    // on one independent core per worker. Results come back in file order,
+    // one per page of multi-page dumps.
+    QVector<FiberAnalysisResult> analyzeBatch(BatchPipeline &pipeline, const QStringList &filePaths, int workers);
+    
     // Detection methods
     QPoint detectFiberCenter(const QImage &image);
     double measureFiberDiameter(const QImage &image);
@@ -58,7 +84,38 @@ public:
     
     // Analysis methods
     bool isFiberAcceptable(const QVector<FiberDefect> &defects, double coreCladRatio);
-    QImage createAnnotatedImage(const QImage &original, const QVector<FiberDefect> &defects);
+    QImage createAnnotatedImage(const QImage &original, const FiberAnalysisResult &result, int layers = AllLayers);
+    
+    // Per-frame latency budget in milliseconds (0 = unlimited). Optional stages
+    // are downgraded or skipped when the frame would otherwise overrun it.
+    void setFrameBudget(double milliseconds);
+    double frameBudget();
+    AnalysisTimings lastTimings();
+    
+    // Live mode: match defects across frames and classify only new ones
+    void setDefectTracking(bool enable);
+    bool isDefectTrackingEnabled();
+    
+    // Fragments of one blob closer than this are merged (-1 = never)
+    void setFragmentGap(int pixels);
+    int fragmentGap();
+    
+    // Oriented line filter bank for long, faint scratches
+    void setScratchDetection(bool enable);
+    bool isScratchDetectionEnabled();
+    
+    // Multi-scale ridge filter for cracks
+    void setCrackDetection(bool enable);
+    bool isCrackDetectionEnabled();
+    
+    // Quick focus/exposure/presence triage before the full pipeline
+    void setQualityCheck(bool enable);
+    bool isQualityCheckEnabled();
+    
+    // Live mode: refine the previous frame's geometry instead of a full search
+    void setGeometryTracking(bool enable);
+    bool isGeometryTrackingEnabled();
+    FiberGeometry lastGeometry();
     
     // Linux system integration for improved performance
     void enableGPUAcceleration(bool enable);
@@ -66,19 +123,18 @@ public:
 
 private:
     QMutex m_mutex;
-    double m_idealCoreCladRatio;
-    double m_maxAllowedDefects;
+    FiberCore m_core;
     bool m_useGPUAcceleration;
     
     // OpenCV-based methods
     cv::Mat preProcessForAnalysis(const cv::Mat &inputImage);
-    std::vector<cv::Rect> detectDefectRegions(const cv::Mat &processedImage);
-    double calculateConcentricity(const cv::Point &center, double coreRadius, double claddingRadius);
+    cv::Mat toGray(const QImage &image);
+    static FiberDefect toFiberDefect(const CoreDefect &defect);
+    static FiberAnalysisResult fromCoreResult(const CoreAnalysisResult &analysis);
+    static CoreDefect toCoreDefect(const FiberDefect &defect);
     
     // Missing functions that need to be added
     cv::Mat QImage2Mat(const QImage &image);
-    QString generateSummary(const FiberAnalysisResult &result);
-    double calculateQualityScore(const FiberAnalysisResult &result);
 };
 
 #endif // FIBERANALYZER_H 
\ No newline at end of file
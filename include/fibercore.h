@@ -0,0 +1,159 @@
+#ifndef FIBERCORE_H
+#define FIBERCORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "fibertracker.h"
+#include "imagequality.h"
+#include "defecttracker.h"
+#include "scratchdetector.h"
+#include "crackdetector.h"
+
+class TileSource;
+
+// Qt-free analysis engine shared by the GUI, the test harness and the C API.
+// The hot path only touches cv::Mat and std types; FiberAnalyzer adapts it
+// to QImage and adds locking.
+
+enum class DefectType : uint8_t {
+    Scratch,
+    Chip,
+    Crack,
+    Contamination,
+    Unknown
+};
+
+const char *defectTypeDescription(DefectType type);
+
+struct CoreDefect {
+    DefectType type = DefectType::Unknown;
+    cv::Rect bounds;
+    double severity = 0.0;
+    int trackId = 0;            // Stable identity across live frames (0 = untracked)
+    int hits = 1;               // Frames in which the defect was seen
+    float confidence = 1.0f;
+};
+
+// Per-stage wall time of one analysis
+struct AnalysisTimings {
+    double qualityCheckMs = 0.0;
+    double localizationMs = 0.0;
+    double defectDetectionMs = 0.0;
+    double scratchDetectionMs = 0.0;
+    double crackDetectionMs = 0.0;
+    double classificationMs = 0.0;
+    double totalMs = 0.0;
+};
+
+struct CoreAnalysisResult {
+    bool isAcceptable = true;
+    bool degraded = false;          // Optional stages were downgraded to meet the frame budget
+    FrameQualityIssue qualityIssue = FrameQualityIssue::None;  // Set when analysis was skipped
+    double coreCladRatio = 0.0;
+    double idealCoreCladRatio = 0.0;
+    double concentricity = 0.0;
+    double overallQuality = 1.0;    // 1.0 is perfect, 0.0 is unusable
+    double analysisTimeMs = 0.0;
+    FiberGeometry geometry;
+    cv::Rect roi;                   // Region defect detection ran on (image coordinates)
+    ZoneCoverage coreCoverage;      // Core and cladding pixels covered by defects
+    ZoneCoverage claddingCoverage;
+    std::vector<ScratchSegment> scratches;  // Line segments behind the scratch detector's defects
+    std::vector<CoreDefect> defects;
+    std::string error;              // Only set when the analysis failed
+};
+
+// Not thread-safe: one instance per analysis thread, or external locking.
+class FiberCore
+{
+public:
+    FiberCore();
+    ~FiberCore();
+    
+    void setReferenceParameters(double idealCoreCladRatio, double maxAllowedDefects);
+    double idealCoreCladRatio() const;
+    double maxAllowedDefects() const;
+    
+    // Per-frame latency budget in milliseconds (0 = unlimited)
+    void setFrameBudget(double milliseconds);
+    double frameBudget() const;
+    const AnalysisTimings &lastTimings() const;
+    
+    void setQualityCheck(bool enable);
+    bool isQualityCheckEnabled() const;
+    void setGeometryTracking(bool enable);
+    bool isGeometryTrackingEnabled() const;
+    void setDefectTracking(bool enable);
+    bool isDefectTrackingEnabled() const;
+    
+    // Blobs at most this many pixels apart are reported as one defect (-1 = never merged)
+    void setFragmentGap(int pixels);
+    int fragmentGap() const;
+    
+    // Oriented line filters for long, faint scratches inside the cladding
+    void setScratchDetection(bool enable);
+    bool isScratchDetectionEnabled() const;
+    
+    // Multi-scale ridge filter for cracks inside the cladding
+    void setCrackDetection(bool enable);
+    bool isCrackDetectionEnabled() const;
+    const FiberGeometry &lastGeometry() const;
+    
+    // Analyzes an 8-bit single channel frame. The frame is only read, never copied.
+    CoreAnalysisResult analyze(const cv::Mat &gray);
+    
+    // Analyzes a mosaic too large to hold in memory, streaming it in tiles of
+    // tileSize pixels. The fiber is located on an overview; live tracking and
+    // the frame budget do not apply.
+    CoreAnalysisResult analyzeTiled(TileSource &source, int tileSize = 2048);
+    
+    // Building blocks, also used by the Qt adapter's individual entry points
+    // defectPixels, when given, receives the accepted defect blobs as a full resolution mask;
+    // halfResolution, when given, is pyrDown(gray) and spares the coarse pass building it
+    static std::vector<cv::Rect> detectDefectRegions(const cv::Mat &gray, bool coarse = false,
+                                                     cv::Mat *defectPixels = nullptr,
+                                                     const cv::Mat &halfResolution = cv::Mat());
+    static DefectType classifyBounds(int width, int height);
+    static double assessSeverity(DefectType type, const cv::Rect &bounds);
+    static CoreDefect createDefect(const cv::Rect &region, DefectType type);
+    bool isAcceptable(const std::vector<CoreDefect> &defects, double coreCladRatio) const;
+    
+private:
+    std::vector<CoreDefect> trackDefects(const cv::Rect &frameRect, const std::vector<cv::Rect> &regions,
+                                         const std::vector<int> &knownTypes);
+    const cv::Mat &searchMask(const FiberGeometry &geometry) const;
+    std::vector<cv::Mat> roiPyramid(const cv::Mat &roi, int levels);
+    std::vector<CrackCandidate> detectCracks(const cv::Mat &roi, const cv::Mat &searchMask,
+                                             const std::vector<ScratchSegment> &scratches);
+    double calculateConcentricity(const FiberGeometry &geometry) const;
+    double calculateQualityScore(const CoreAnalysisResult &result) const;
+    static void updateExpectedTiming(double &expected, double measured, bool ranAtFullDetail);
+    
+    double m_idealCoreCladRatio;
+    double m_maxAllowedDefects;
+    bool m_qualityCheck;
+    bool m_geometryTracking;
+    bool m_defectTracking;
+    int m_fragmentGap;
+    bool m_scratchDetection;
+    bool m_crackDetection;
+    double m_frameBudgetMs;
+    ImageQualityChecker m_qualityChecker;
+    FiberTracker m_tracker;
+    FiberGeometry m_lastGeometry;
+    DefectTracker m_defectTracker;
+    ScratchDetector m_scratchDetector;
+    CrackDetector m_crackDetector;
+    cv::Mat m_crackMask;
+    std::vector<cv::Mat> m_roiPyramid;  // Halved ROI levels 1.. of the current frame
+    int m_pyramidLevels;                // Of those, built so far this frame
+    ZoneBitMasks m_zoneMasks;
+    BitMask m_defectBits;
+    AnalysisTimings m_lastTimings;
+    AnalysisTimings m_expectedTimings;   // Smoothed cost of each stage at full detail
+};
+
+#endif // FIBERCORE_H
@@ -0,0 +1,90 @@
+#ifndef FIBERCOREAPI_H
+#define FIBERCOREAPI_H
+
+/*
+ * Stable C interface to the fibercore analysis engine, for embedding in
+ * acquisition software without Qt. Frames are passed as raw pixel pointers
+ * with a row stride and are analyzed in place when they are 8-bit gray.
+ * A handle must not be used from two threads at once.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIBERCORE_API_VERSION 2
+
+/* Return codes */
+#define FIBERCORE_OK                    0
+#define FIBERCORE_ERROR_INVALID_ARGUMENT -1
+#define FIBERCORE_ERROR_ANALYSIS        -2
+
+/* Pixel formats */
+#define FIBERCORE_FORMAT_GRAY8  0
+#define FIBERCORE_FORMAT_BGR8   1
+#define FIBERCORE_FORMAT_BGRA8  2
+#define FIBERCORE_FORMAT_GRAY16 3   /* Scaled to 8 bits, most significant byte kept */
+
+typedef struct fibercore_analyzer fibercore_analyzer;
+
+typedef struct {
+    int type;                   /* Defect type code, see fibercore_defect_description() */
+    int x, y, width, height;
+    double severity;            /* 0.0 (minor) .. 1.0 (severe) */
+    int track_id;               /* Stable across frames when tracking is on, otherwise 0 */
+    int hits;
+    float confidence;
+} fibercore_defect;
+
+typedef struct {
+    int is_acceptable;
+    int degraded;               /* Optional stages were downgraded to meet the frame budget */
+    int quality_issue;          /* 0 when the frame was analyzed, otherwise why it was skipped */
+    double core_clad_ratio;
+    double concentricity;
+    double overall_quality;
+    double analysis_time_ms;
+    float center_x, center_y;
+    float cladding_radius, core_radius;
+    int defect_count;           /* Total found; may exceed the capacity passed in */
+} fibercore_result;
+
+int fibercore_api_version(void);
+
+fibercore_analyzer *fibercore_create(void);
+void fibercore_destroy(fibercore_analyzer *analyzer);
+
+void fibercore_set_reference(fibercore_analyzer *analyzer, double ideal_core_clad_ratio,
+                             double max_allowed_defects);
+void fibercore_set_frame_budget(fibercore_analyzer *analyzer, double milliseconds);
+void fibercore_set_quality_check(fibercore_analyzer *analyzer, int enable);
+/* Live streams: refine geometry and keep defect identities across frames */
+void fibercore_set_tracking(fibercore_analyzer *analyzer, int enable);
+
+/*
+ * Analyzes one frame. Up to max_defects defects are written to defects (may
+ * be NULL when max_defects is 0). Returns FIBERCORE_OK, or an error code
+ * with the message available from fibercore_last_error().
+ */
+int fibercore_analyze(fibercore_analyzer *analyzer, const void *pixels, int width, int height,
+                      size_t stride, int format, fibercore_result *result,
+                      fibercore_defect *defects, int max_defects);
+
+const char *fibercore_last_error(const fibercore_analyzer *analyzer);
+const char *fibercore_defect_description(int type);
+
+/*
+ * Process-wide kernel selection, for benchmarking. name is one of "baseline",
+ * "sse4.2", "avx2", "avx512" or "neon"; NULL or "auto" restores the variant
+ * detected for this CPU. Fails if the CPU or the build lacks the variant.
+ */
+int fibercore_force_isa(const char *name);
+const char *fibercore_active_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FIBERCOREAPI_H */
@@ -0,0 +1,97 @@
+#ifndef FIBERTRACKER_H
+#define FIBERTRACKER_H
+
+#include <opencv2/opencv.hpp>
+
+#include "bitmask.h"
+
+// Fiber endface geometry in image coordinates
+struct FiberGeometry {
+    cv::Point2f center;
+    float claddingRadius = 0.0f;
+    float coreRadius = 0.0f;
+    float confidence = 0.0f;    // Fraction of the cladding edge with visible contrast (0..1)
+    
+    bool isValid() const { return claddingRadius > 0.0f; }
+    
+    // Padded square around the cladding, clipped to the frame; the whole
+    // frame when no fiber was found. Later stages work on a view of it.
+    cv::Rect roi(const cv::Size &frameSize) const;
+};
+
+// Share of a zone covered by a mask's set pixels
+struct ZoneCoverage {
+    uint64_t zonePixels = 0;
+    uint64_t coveredPixels = 0;
+    
+    double fraction() const { return zonePixels ? static_cast<double>(coveredPixels) / zonePixels : 0.0; }
+};
+
+// Bit-packed core disc and cladding annulus over an analysis ROI, for
+// per-frame zone statistics by popcount, and the 8-bit search area the line
+// and ridge detectors take: the cladding disc shrunk by searchMargin. Rebuilt
+// only when the fiber moves or the ROI changes; masks are in ROI coordinates.
+class ZoneBitMasks
+{
+public:
+    explicit ZoneBitMasks(int searchMargin = 0);
+    
+    void update(const FiberGeometry &geometry, const cv::Rect &roi);
+    
+    const BitMask &core() const;
+    const BitMask &cladding() const;
+    const cv::Mat &searchArea() const;
+    
+    // mask must cover the same ROI
+    ZoneCoverage coreCoverage(const BitMask &mask) const;
+    ZoneCoverage claddingCoverage(const BitMask &mask) const;
+
+private:
+    FiberGeometry m_geometry;
+    cv::Rect m_roi;
+    BitMask m_core;
+    BitMask m_cladding;
+    cv::Mat m_searchArea;
+    int m_searchMargin;
+    uint64_t m_corePixels;
+    uint64_t m_claddingPixels;
+};
+
+// Temporal fiber localization for live streams.
+// The first frame (and any frame where confidence drops) runs the full Hough
+// search; every other frame only refines the previous circle from edges found
+// in a narrow band around its rim. Zone masks for the geometry come from ZoneBitMasks, in
+// the coordinates of the analysis ROI.
+class FiberTracker
+{
+public:
+    FiberTracker();
+    ~FiberTracker();
+    
+    void reset();
+    void setConfidenceThreshold(double threshold);
+    void setSearchMargin(int pixels);
+    
+    // Locates the fiber in an 8-bit single channel frame
+    FiberGeometry update(const cv::Mat &gray);
+    const FiberGeometry &geometry() const;
+    bool lastUpdateWasTracked() const;
+    int fullDetectionCount() const;
+    
+    // Full-frame Hough search, independent of any tracking state
+    static FiberGeometry detect(const cv::Mat &gray);
+    
+    // Fraction of radial samples across the circle that show an edge
+    static float edgeSupport(const cv::Mat &gray, const cv::Point2f &center, float radius);
+
+private:
+    bool refine(const cv::Mat &gray, FiberGeometry &geometry);
+    
+    FiberGeometry m_geometry;
+    double m_confidenceThreshold;
+    int m_searchMargin;
+    bool m_lastUpdateTracked;
+    int m_fullDetections;
+};
+
+#endif // FIBERTRACKER_H
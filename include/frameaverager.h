@@ -0,0 +1,44 @@
+#ifndef FRAMEAVERAGER_H
+#define FRAMEAVERAGER_H
+
+#include <deque>
+#include <opencv2/opencv.hpp>
+
+// Rolling temporal average over the last N live frames.
+// Frames are shift-compensated against the first frame of the window and
+// accumulated into a 16-bit running sum, so each new frame costs one add and
+// one subtract per pixel regardless of the window size.
+class FrameAverager
+{
+public:
+    explicit FrameAverager(int windowSize = 8);
+    ~FrameAverager();
+    
+    void setWindowSize(int windowSize);
+    int windowSize() const;
+    int frameCount() const;
+    void reset();
+    
+    void setMotionCompensation(bool enable);
+    bool isMotionCompensationEnabled() const;
+    cv::Point2d lastShift() const;
+    
+    // Adds a frame and returns the average of the current window (8-bit, single channel)
+    cv::Mat addFrame(const cv::Mat &frame);
+
+private:
+    int m_windowSize;
+    bool m_motionCompensation;
+    std::deque<cv::Mat> m_frames;   // Aligned 8-bit frames currently in the window
+    cv::Mat m_sum;                  // CV_16UC1 running sum of m_frames
+    cv::Mat m_reference;            // Downsampled CV_32F anchor for phase correlation
+    cv::Mat m_hanningWindow;
+    cv::Point2d m_lastShift;
+    
+    cv::Mat toGray(const cv::Mat &frame);
+    cv::Mat toCorrelationInput(const cv::Mat &gray);
+    cv::Mat alignToReference(const cv::Mat &gray);
+    void accumulate(const cv::Mat &added, const cv::Mat *removed);
+};
+
+#endif // FRAMEAVERAGER_H
@@ -0,0 +1,49 @@
+#ifndef FRAMECHANGEGATE_H
+#define FRAMECHANGEGATE_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// Cheap pre-analysis test for "did anything change since the last analyzed frame".
+// Each frame is area-averaged into a thumbnail of square cells (8x8 pixels on
+// a 1920-line sensor, at least 240 cells on the shorter side) and compared
+// cell by cell with the thumbnail of the last frame that was actually
+// analyzed. Averaging every pixel, not a sample grid, lets debris smaller than
+// a cell move that cell by its share of the area.
+class FrameChangeGate
+{
+public:
+    FrameChangeGate();
+    ~FrameChangeGate();
+    
+    void reset();
+    
+    // Mean change over the whole frame, in gray levels
+    void setGlobalThreshold(double grayLevels);
+    // Change of any single cell, catches small local events such as new debris
+    void setCellThreshold(double grayLevels);
+    // Force a full analysis at least this often even if nothing changed (0 = never)
+    void setMaxSkippedFrames(int frames);
+    
+    // Returns true when the frame should be analyzed. The frame then becomes
+    // the new reference; skipped frames do not move the reference.
+    bool shouldAnalyze(const cv::Mat &gray);
+    
+    double lastGlobalDifference() const;
+    double lastMaxCellDifference() const;
+    uint64_t skippedCount() const;
+
+private:
+    cv::Mat thumbnail(const cv::Mat &gray) const;
+    
+    cv::Mat m_reference;
+    double m_globalThreshold;
+    double m_cellThreshold;
+    int m_maxSkippedFrames;
+    int m_skippedSinceAnalysis;
+    uint64_t m_skippedTotal;
+    double m_lastGlobalDifference;
+    double m_lastMaxCellDifference;
+};
+
+#endif // FRAMECHANGEGATE_H
@@ -0,0 +1,76 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Lock-free single-producer/single-consumer hand-off of the newest item, a
+// triple buffer. The producer fills its own slot and swaps it with the
+// shared one; the consumer swaps its slot with the shared one when that holds
+// an item it has not taken yet. Neither side ever blocks or waits for the
+// other, and the newest item always wins: when the producer publishes again
+// before the consumer took the previous item, that stale item is dropped.
+// A slow consumer therefore always gets the frame captured last, never one
+// that queued up while it was busy.
+template <typename T>
+class FrameRing
+{
+public:
+    FrameRing()
+        : m_slots(3)
+        , m_back(0)
+        , m_front(2)
+        , m_shared(1)
+        , m_dropped(0)
+    {
+    }
+    
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+    
+    // Producer side: publish item, replacing one the consumer has not taken
+    void push(T item)
+    {
+        m_slots[m_back] = std::move(item);
+        const unsigned previous = m_shared.exchange(m_back | kFresh, std::memory_order_acq_rel);
+        if (previous & kFresh) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_back = previous & kSlotMask;
+    }
+    
+    // Consumer side: take the newest item, false when nothing new was published
+    bool popLatest(T &item)
+    {
+        // Only the consumer clears the fresh flag, so it is still set below
+        if (!(m_shared.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+    
+        m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & kSlotMask;
+        item = std::move(m_slots[m_front]);
+        m_slots[m_front] = T();
+        return true;
+    }
+    
+    uint64_t droppedCount() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+    
+private:
+    static const unsigned kSlotMask = 3;
+    static const unsigned kFresh = 4;
+    
+    std::vector<T> m_slots;
+    unsigned m_back;                        // Producer's slot
+    unsigned m_front;                       // Consumer's slot
+    
+    // Shared slot index and fresh flag, away from the private indices
+    alignas(64) std::atomic<unsigned> m_shared;
+    alignas(64) std::atomic<uint64_t> m_dropped;
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,160 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "mappedimage.h"
+
+// Abstract source of live frames. Camera, video, image and directory
+// backends share this interface so file-based sources can stand in for a
+// camera in tests and on stations without hardware attached.
+class FrameSource
+{
+public:
+    FrameSource();
+    virtual ~FrameSource();
+    
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+    
+    // Blocks until the next frame is available; returns false at end of stream or on error
+    virtual bool readFrame(cv::Mat &frame) = 0;
+    
+    virtual std::string description() const = 0;
+    
+    // File-based sources are paced to this rate to emulate a camera (0 = unpaced)
+    void setFrameRate(double framesPerSecond);
+    double frameRate() const;
+    
+    void setLooping(bool loop);
+    bool isLooping() const;
+
+protected:
+    void waitForNextFrame();
+    
+    double m_frameRate;
+    bool m_loop;
+    std::chrono::steady_clock::time_point m_nextFrameTime;
+};
+
+// V4L2 camera (falls back to any cv::VideoCapture backend)
+class CameraFrameSource : public FrameSource
+{
+public:
+    explicit CameraFrameSource(int deviceIndex = 0);
+    ~CameraFrameSource() override;
+    
+    bool open() override;
+    void close() override;
+    bool isOpen() const override;
+    bool readFrame(cv::Mat &frame) override;
+    std::string description() const override;
+
+private:
+    int m_deviceIndex;
+    cv::VideoCapture m_capture;
+};
+
+// Recorded video file
+class VideoFileFrameSource : public FrameSource
+{
+public:
+    explicit VideoFileFrameSource(const std::string &filePath);
+    ~VideoFileFrameSource() override;
+    
+    bool open() override;
+    void close() override;
+    bool isOpen() const override;
+    bool readFrame(cv::Mat &frame) override;
+    std::string description() const override;
+
+private:
+    std::string m_filePath;
+    cv::VideoCapture m_capture;
+};
+
+// Single still image repeated as a constant stream
+class ImageFileFrameSource : public FrameSource
+{
+public:
+    explicit ImageFileFrameSource(const std::string &filePath);
+    ~ImageFileFrameSource() override;
+    
+    bool open() override;
+    void close() override;
+    bool isOpen() const override;
+    bool readFrame(cv::Mat &frame) override;
+    std::string description() const override;
+
+private:
+    std::string m_filePath;
+    cv::Mat m_image;
+    bool m_delivered;
+};
+
+// Directory of still images played back in name order
+class DirectoryFrameSource : public FrameSource
+{
+public:
+    explicit DirectoryFrameSource(const std::string &directoryPath);
+    ~DirectoryFrameSource() override;
+    
+    bool open() override;
+    void close() override;
+    bool isOpen() const override;
+    bool readFrame(cv::Mat &frame) override;
+    std::string description() const override;
+    
+    size_t frameCount() const;
+
+private:
+    std::string m_directoryPath;
+    std::vector<std::string> m_files;
+    size_t m_nextIndex;
+    bool m_isOpen;
+    MappedImageFile m_stack;        // Mapped dump whose remaining pages come next
+    size_t m_nextPage;
+};
+
+// Raw dump, PGM sequence or multi-page TIFF stack played back page by page.
+// Frames are views of a memory mapping rather than decoded copies.
+class MappedFileFrameSource : public FrameSource
+{
+public:
+    explicit MappedFileFrameSource(const std::string &filePath);
+    
+    // Headerless raw frames of a fixed size and type
+    MappedFileFrameSource(const std::string &filePath, cv::Size frameSize, int type);
+    ~MappedFileFrameSource() override;
+    
+    bool open() override;
+    void close() override;
+    bool isOpen() const override;
+    bool readFrame(cv::Mat &frame) override;
+    std::string description() const override;
+    
+    size_t frameCount() const;
+
+private:
+    std::string m_filePath;
+    cv::Size m_rawFrameSize;        // Empty for PGM and TIFF files
+    int m_rawType;
+    MappedImageFile m_file;
+    size_t m_nextPage;
+};
+
+// True for file names DirectoryFrameSource plays (by extension)
+bool isImageFilePath(const std::string &path);
+
+// Creates a source from a specification string:
+// "camera", "camera:N" or "/dev/videoN" for cameras, "raw:WxH:path" or
+// "raw16:WxH:path" for raw dumps, otherwise a directory, video file or image
+// file path (multi-page PGM and TIFF stacks are played page by page)
+std::unique_ptr<FrameSource> createFrameSource(const std::string &spec);
+
+#endif // FRAMESOURCE_H
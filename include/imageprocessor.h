@@ -4,7 +4,12 @@
 #include <QImage>
 #include <QString>
 #include <QMap>
+#include <QHash>
+#include <QByteArray>
 #include <QMutex>
+#include <QRect>
+
+#include <functional>
 #include <opencv2/opencv.hpp>
 
 enum class FilterType {
@@ -18,6 +23,13 @@ enum class FilterType {
     CustomFilter
 };
 
+enum class DenoiseMethod {
+    NonLocalMeansColor,   // Original colour NL-means, slowest
+    NonLocalMeansTiled,   // Grayscale NL-means over parallel tiles
+    Bilateral,            // Edge-preserving bilateral filter
+    Guided                // Box-filter guided filter, fast enough for live use
+};
+
 class ImageProcessor
 {
 public:
@@ -28,12 +40,24 @@ public:
     bool saveImage(const QString &filePath, const QImage &image);
     
     QImage applyFilter(const QImage &sourceImage, FilterType filter);
+    
+    // Filters only region, e.g. the fiber ROI of an analysis result; the
+    // rest of the frame is passed through unfiltered
+    QImage applyFilter(const QImage &sourceImage, FilterType filter, const QRect &region);
+    
+    // Filters a mosaic too large to load tile by tile into a binary PGM.
+    // Binary PGM input is streamed; other formats are decoded whole first.
+    bool filterLargeImage(const QString &inputPath, const QString &outputPath,
+                          FilterType filter, int tileSize = 2048);
     QImage adjustBrightness(const QImage &sourceImage, int value);
     QImage adjustContrast(const QImage &sourceImage, int value);
     
     // Advanced image processing methods
     QImage enhanceFiberEdges(const QImage &sourceImage);
-    QImage removeNoise(const QImage &sourceImage);
+    QImage removeNoise(const QImage &sourceImage, DenoiseMethod method = DenoiseMethod::NonLocalMeansTiled);
+    QImage removeNoise(const QImage &sourceImage, DenoiseMethod method, const QRect &region);
+    QString denoiseMethodName(DenoiseMethod method) const;
+    double lastDenoiseTimeMs() const;
     QImage highlightDefects(const QImage &sourceImage);
     
     // OpenCV integration
@@ -45,18 +69,41 @@ public:
     
     // Processing state management
     void cancelProcessing();
+    
+    // Upper bound on cached kernel spectra; set by the resource governor
+    void setCacheBudget(size_t bytes);
     bool isProcessing() const;
 
 private:
     QMutex m_mutex;
     bool m_isProcessing;
     QMap<FilterType, QString> m_filterNames;
+    QMap<DenoiseMethod, QString> m_denoiseNames;
+    double m_lastDenoiseTimeMs;
+    
+    // Runs process on a view of region and pastes the result into the frame
+    QImage processRegion(const QImage &sourceImage, const QRect &region,
+                         const std::function<QImage(const QImage &)> &process);
     
     // Helper methods for specific filters
     QImage applySobelFilter(const QImage &sourceImage);
     QImage applyCannyEdgeDetection(const QImage &sourceImage);
     QImage applySharpenFilter(const QImage &sourceImage);
     QImage applyAdaptiveThreshold(const QImage &sourceImage);
+    
+    // Helper methods for denoising (single channel 8-bit input)
+    cv::Mat denoiseNonLocalMeansTiled(const cv::Mat &gray);
+    cv::Mat denoiseGuided(const cv::Mat &gray, int radius, double eps);
+    
+    // Helper methods for custom kernels
+    bool separateKernel(const cv::Mat &kernel, cv::Mat &kernelX, cv::Mat &kernelY);
+    cv::Mat filterWithDFT(const cv::Mat &src, const cv::Mat &kernel);
+    cv::Mat kernelSpectrum(const cv::Mat &kernel, const cv::Size &dftSize);
+    
+    // Kernel spectra keyed by kernel coefficients and DFT size, reused across frames
+    QHash<QByteArray, cv::Mat> m_kernelSpectrumCache;
+    size_t m_kernelSpectrumCacheBytes;
+    size_t m_cacheBudget;
 };
 
 #endif // IMAGEPROCESSOR_H 
\ No newline at end of file
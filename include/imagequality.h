@@ -0,0 +1,52 @@
+#ifndef IMAGEQUALITY_H
+#define IMAGEQUALITY_H
+
+#include <opencv2/opencv.hpp>
+
+// Reason a frame is not worth a full analysis
+enum class FrameQualityIssue {
+    None,
+    Underexposed,
+    Overexposed,
+    NoFiber,
+    OutOfFocus
+};
+
+struct FrameQuality {
+    FrameQualityIssue issue = FrameQualityIssue::None;
+    double focusScore = 0.0;          // Laplacian variance around the fiber
+    double saturatedFraction = 0.0;   // Fraction of pixels at the top of the range
+    double brightLevel = 0.0;         // 99th percentile gray level
+    bool fiberPresent = false;
+    cv::Rect fiberBounds;             // Full resolution bounds of the fiber blob
+    double elapsedMs = 0.0;
+    
+    bool isUsable() const { return issue == FrameQualityIssue::None; }
+};
+
+// Fast triage of a frame before the full analysis pipeline. Everything runs
+// on a copy decimated to about 320 pixels wide.
+class ImageQualityChecker
+{
+public:
+    ImageQualityChecker();
+    ~ImageQualityChecker();
+    
+    void setFocusThreshold(double laplacianVariance);
+    void setSaturationThreshold(double fraction);
+    void setMinimumBrightLevel(double grayLevel);
+    
+    // Accepts 8-bit gray or BGR frames
+    FrameQuality check(const cv::Mat &image) const;
+    
+    static const char *issueDescription(FrameQualityIssue issue);
+
+private:
+    bool findFiber(const cv::Mat &small, cv::Rect &bounds) const;
+    
+    double m_focusThreshold;
+    double m_saturationThreshold;
+    double m_minimumBrightLevel;
+};
+
+#endif // IMAGEQUALITY_H
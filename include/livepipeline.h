@@ -0,0 +1,103 @@
+#ifndef LIVEPIPELINE_H
+#define LIVEPIPELINE_H
+
+#include <QImage>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <opencv2/opencv.hpp>
+
+#include "fiberanalyzer.h"
+#include "imageprocessor.h"
+#include "frameaverager.h"
+#include "framesource.h"
+#include "framering.h"
+#include "framechangegate.h"
+#include "resourcegovernor.h"
+
+// Frame handed from the capture thread to the analysis thread
+struct LiveFrame {
+    cv::Mat image;
+    uint64_t sequence = 0;
+    std::chrono::steady_clock::time_point captureTime;
+};
+
+// Analyzed frame handed from the analysis thread to the display
+struct LiveResult {
+    QImage displayImage;
+    FiberAnalysisResult analysis;
+    uint64_t sequence = 0;
+    double latencyMs = 0.0;
+    int averagedFrames = 0;
+    bool reusedAnalysis = false;    // Frame unchanged, analysis carried over from an earlier frame
+};
+
+struct LivePipelineStats {
+    uint64_t framesCaptured = 0;
+    uint64_t framesAnalyzed = 0;
+    uint64_t framesDropped = 0;
+    uint64_t framesSkipped = 0;
+    double analysisFps = 0.0;
+};
+
+// Continuous live inspection: capture and analysis run on their own threads,
+// connected by lock-free latest-frame buffers that drop stale frames. The display thread
+// polls takeLatestResult() at its own rate.
+class LivePipeline
+{
+public:
+    LivePipeline(FiberAnalyzer *analyzer, ImageProcessor *imageProcessor);
+    ~LivePipeline();
+    
+    bool start(std::unique_ptr<FrameSource> source);
+    void stop();
+    bool isRunning() const;
+    
+    // Only take effect while the pipeline is stopped
+    void setAveragingWindow(int frames);
+    void setFrameBudget(double milliseconds);
+    
+    // The analysis thread follows the governor's plan: averaged frames are
+    // capped at its in-flight image count and process limits are reapplied
+    // whenever the plan changes. Not owned; null disables governing.
+    void setResourceGovernor(ResourceGovernor *governor);
+    
+    // Display side: newest result produced since the previous call, if any
+    bool takeLatestResult(LiveResult &result);
+    
+    LivePipelineStats statistics() const;
+
+private:
+    void captureLoop();
+    void analysisLoop();
+    void followResourcePlan();
+    
+    FiberAnalyzer *m_analyzer;
+    ImageProcessor *m_imageProcessor;
+    std::unique_ptr<FrameSource> m_source;
+    FrameAverager m_frameAverager;
+    FrameChangeGate m_changeGate;
+    FiberAnalysisResult m_lastAnalysis;
+    double m_frameBudgetMs;
+    int m_averagingWindow;          // Requested window; the governor may lower the effective one
+    ResourceGovernor *m_governor;
+    ResourcePlan m_appliedPlan;
+    
+    FrameRing<LiveFrame> m_captureRing;
+    FrameRing<LiveResult> m_resultRing;
+    
+    std::thread m_captureThread;
+    std::thread m_analysisThread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_captureFinished;
+    
+    std::atomic<uint64_t> m_framesCaptured;
+    std::atomic<uint64_t> m_framesAnalyzed;
+    std::atomic<uint64_t> m_framesSkipped;
+    std::atomic<double> m_analysisFps;
+};
+
+#endif // LIVEPIPELINE_H
@@ -13,10 +13,18 @@
 #include <QMessageBox>
 #include <QSettings>
 #include <QScrollBar>
+#include <QTimer>
+
+#include <atomic>
+#include <thread>
 
 #include "imageprocessor.h"
 #include "fiberanalyzer.h"
 #include "resultsmanager.h"
+#include "livepipeline.h"
+#include "resourcegovernor.h"
+#include "batchpipeline.h"
+#include "defectindex.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -31,18 +39,36 @@ public:
     ~MainWindow();
     
     void loadImage(const QString &imagePath);
+    void setLiveSource(const QString &sourceSpec);
+    
+    // Analyzes every image of a directory in the background and writes
+    // batch_results.csv next to the images
+    void runBatch(const QString &directory);
+    
+    // Overrides the derived memory budget; 0 restores it
+    void setMemoryBudget(qint64 megabytes);
+
+protected:
+    // Hover tooltips for the defect under the cursor
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
 private slots:
     void openImage();
     void saveResults();
     void applyFilter(int filterIndex);
+    void applyDenoise(int denoiseIndex);
     void analyzeFiber();
     void adjustBrightness(int value);
     void adjustContrast(int value);
     void zoomIn();
     void zoomOut();
     void resetView();
+    void toggleAnnotations(bool visible);
     void toggleLiveMode();
+    void updateLiveDisplay();
+    void updateResourcePlan();
+    void analyzeFolder();
+    void updateBatchProgress();
     void exportReport();
     void showSettings();
     void about();
@@ -57,6 +83,7 @@ private:
     void loadSettings();
     void saveSettings();
     void updateResultsPanel();
+    void setShownDefects(const QVector<FiberDefect> &defects);
     bool checkSystemResources();
     void connectToLinuxSystemInfo();
     
@@ -67,20 +94,39 @@ private:
     ImageProcessor *m_imageProcessor;
     FiberAnalyzer *m_fiberAnalyzer;
     ResultsManager *m_resultsManager;
+    LivePipeline *m_livePipeline;
+    QTimer *m_liveDisplayTimer;
+    ResourceGovernor m_resourceGovernor;
+    QTimer *m_resourceTimer;
+    ResourcePlan m_resourcePlan;
+    BatchPipeline *m_batchPipeline;
+    std::thread m_batchThread;
+    std::atomic<bool> m_batchDone;
+    QVector<FiberAnalysisResult> m_batchResults;
+    QTimer *m_batchTimer;
+    QString m_batchDirectory;
+    int m_batchFiles;
     
     QImage m_currentImage;
     QImage m_processedImage;
+    AnnotationOverlay m_overlay;    // Composited over m_processedImage at display time
     QLabel *m_imageLabel;
     QScrollArea *m_scrollArea;
     QSlider *m_brightnessSlider;
     QSlider *m_contrastSlider;
     QComboBox *m_filterComboBox;
+    QComboBox *m_denoiseComboBox;
     QPushButton *m_analyzeButton;
     QProgressBar *m_progressBar;
     
     double m_zoomFactor;
     bool m_isLiveMode;
+    bool m_showAnnotations;
+    QString m_liveSourceSpec;
     QString m_currentFilePath;
+    QRect m_fiberRoi;               // From the last analysis; filters and denoisers stay inside it
+    QVector<FiberDefect> m_shownDefects;
+    DefectIndex m_defectIndex;      // Over m_shownDefects, for hit-testing the cursor
 };
 
 #endif // MAINWINDOW_H 
\ No newline at end of file
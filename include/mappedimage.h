@@ -0,0 +1,92 @@
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct FileMapping;
+
+enum class MappedAccess : uint8_t {
+    Normal,
+    Sequential,     // Pages are read in order: prefetch ahead, reclaim what was consumed
+    Random          // Tiles of a mosaic: no kernel read-ahead
+};
+
+// Memory-mapped sensor dump: uncompressed raw frames, one or more binary PGM
+// images, or a stripped, uncompressed multi-page TIFF stack. Pages are handed
+// out as cv::Mat views of the mapping, so ingest costs page faults instead of
+// decode and copy. A view keeps the mapping alive after the file is closed.
+//
+// The mapping is private and copy-on-write: consumers may modify a page in
+// place without touching the file. Pages that cannot be viewed in place
+// (16-bit PGM, byte-swapped TIFF, scattered strips) are assembled into a copy.
+class MappedImageFile
+{
+public:
+    MappedImageFile();
+    ~MappedImageFile();
+    
+    // Binary PGM or TIFF, recognized by content
+    bool open(const std::string &filePath);
+    
+    // Back-to-back frames in native byte order after headerBytes of header
+    bool openRaw(const std::string &filePath, cv::Size frameSize, int type, size_t headerBytes = 0);
+    
+    void close();
+    bool isOpen() const;
+    const std::string &filePath() const;
+    
+    size_t pageCount() const;
+    cv::Size pageSize(size_t index) const;
+    int pageType(size_t index) const;
+    bool isZeroCopy(size_t index) const;
+    
+    // Page as a view of the mapping, or an assembled copy (see isZeroCopy).
+    // In sequential mode this also prefetches the following pages.
+    cv::Mat page(size_t index);
+    
+    void setAccessPattern(MappedAccess access);
+    MappedAccess accessPattern() const;
+    
+    // Pages requested ahead of the one being read in sequential mode
+    void setReadAhead(int pages);
+    
+    // Asks the kernel to start reading a page in, or to reclaim it first
+    void prefetch(size_t index);
+    void release(size_t index);
+    
+    size_t mappedBytes() const;
+    
+    // True for files open() understands, judged from the first bytes
+    static bool isSupported(const std::string &filePath);
+    
+private:
+    struct Page {
+        size_t offset = 0;
+        size_t bytes = 0;
+        cv::Size size;
+        int type = CV_8UC1;
+        bool swapBytes = false;
+        std::vector<std::pair<size_t, size_t>> strips;  // Offset and length; empty when contiguous
+    };
+    
+    MappedImageFile(const MappedImageFile &) = delete;
+    MappedImageFile &operator=(const MappedImageFile &) = delete;
+    
+    bool map(const std::string &filePath);
+    bool parsePgm();
+    bool parseTiff();
+    void advise(size_t offset, size_t bytes, int advice);
+    
+    std::shared_ptr<FileMapping> m_mapping;
+    std::string m_filePath;
+    std::vector<Page> m_pages;
+    MappedAccess m_access;
+    int m_readAhead;
+};
+
+#endif // MAPPEDIMAGE_H
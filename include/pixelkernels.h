@@ -0,0 +1,21 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#include "cpudispatch.h"
+
+// cv::Mat front ends to the dispatched row kernels in cpudispatch.h.
+// Continuous images are processed as one long row.
+
+// sum (CV_16UC1) += added - removed per pixel (CV_8UC1); removed may be null
+void accumulateFrame(cv::Mat &sum, const cv::Mat &added, const cv::Mat *removed);
+
+// Sum of |a - b| over two CV_8UC1 images of the same size
+int64_t absDifference(const cv::Mat &a, const cv::Mat &b, int &maxDifference);
+
+// CV_16UC1 to CV_8UC1: dst = src * scale, rounded and saturated
+void scaleTo8Bit(const cv::Mat &src, cv::Mat &dst, double scale);
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,147 @@
+#ifndef PIXELKERNELSIMPL_H
+#define PIXELKERNELSIMPL_H
+
+// Kernel bodies shared by every instruction set variant. Each variant's
+// translation unit includes this file once and is compiled with its own
+// target flags, so the same plain loops vectorize to SSE, AVX2, AVX-512 or
+// NEON registers. Keep this free of library calls: an inline function
+// instantiated under AVX2 flags could be merged by the linker into code that
+// also runs on CPUs without AVX2.
+
+#include <cstdint>
+
+#include "cpudispatch.h"
+
+namespace {
+void accumulateRow(uint16_t *__restrict sum, const uint8_t *__restrict added,
+                   const uint8_t *__restrict removed, int count)
+{
+    if (removed) {
+        for (int x = 0; x < count; ++x) {
+            sum[x] = static_cast<uint16_t>(sum[x] + added[x] - removed[x]);
+        }
+    } else {
+        for (int x = 0; x < count; ++x) {
+            sum[x] = static_cast<uint16_t>(sum[x] + added[x]);
+        }
+    }
+}
+
+int absDifferenceRow(const uint8_t *__restrict a, const uint8_t *__restrict b, int count, int *maxDifference)
+{
+    int total = 0;
+    int largest = *maxDifference;
+    for (int x = 0; x < count; ++x) {
+        int difference = a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+        total += difference;
+        largest = difference > largest ? difference : largest;
+    }
+    *maxDifference = largest;
+    return total;
+}
+
+void scaleTo8BitRow(const uint16_t *__restrict src, uint8_t *__restrict dst, int count, float scale)
+{
+    for (int x = 0; x < count; ++x) {
+        float value = src[x] * scale + 0.5f;
+        dst[x] = static_cast<uint8_t>(value < 255.0f ? value : 255.0f);
+    }
+}
+
+uint64_t packWord(const uint8_t *__restrict pixels, int count)
+{
+    uint64_t word = 0;
+    for (int i = 0; i < count; ++i) {
+        word |= static_cast<uint64_t>(pixels[i] != 0) << i;
+    }
+    return word;
+}
+
+void packBitsRow(const uint8_t *__restrict src, uint64_t *__restrict dst, int count)
+{
+    const int fullWords = count / 64;
+    for (int w = 0; w < fullWords; ++w) {
+        dst[w] = packWord(src + w * 64, 64);
+    }
+    if (count % 64) {
+        dst[fullWords] = packWord(src + fullWords * 64, count % 64);
+    }
+}
+
+void unpackBitsRow(const uint64_t *__restrict src, uint8_t *__restrict dst, int count)
+{
+    for (int x = 0; x < count; ++x) {
+        dst[x] = static_cast<uint8_t>(0u - static_cast<unsigned>((src[x >> 6] >> (x & 63)) & 1u));
+    }
+}
+
+// Bit count of one word from shifts and adds only: no popcnt instruction
+// (not implied by the SSE4.2/AVX2 flags) and no 64-bit vector multiply, so
+// the loops below vectorize on every variant
+uint64_t popcountWord(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    v += v >> 8;
+    v += v >> 16;
+    v += v >> 32;
+    return v & 0x7Fu;
+}
+
+void combineBitsRow(uint64_t *dst, const uint64_t *a, const uint64_t *b, int words, BitOp op)
+{
+    switch (op) {
+        case BitOp::And:
+            for (int w = 0; w < words; ++w) {
+                dst[w] = a[w] & b[w];
+            }
+            break;
+        case BitOp::Or:
+            for (int w = 0; w < words; ++w) {
+                dst[w] = a[w] | b[w];
+            }
+            break;
+        case BitOp::AndNot:
+            for (int w = 0; w < words; ++w) {
+                dst[w] = a[w] & ~b[w];
+            }
+            break;
+    }
+}
+
+uint64_t countBitsRow(const uint64_t *__restrict a, const uint64_t *__restrict b, int words, BitOp op)
+{
+    uint64_t total = 0;
+    if (!b) {
+        for (int w = 0; w < words; ++w) {
+            total += popcountWord(a[w]);
+        }
+        return total;
+    }
+    
+    switch (op) {
+        case BitOp::And:
+            for (int w = 0; w < words; ++w) {
+                total += popcountWord(a[w] & b[w]);
+            }
+            break;
+        case BitOp::Or:
+            for (int w = 0; w < words; ++w) {
+                total += popcountWord(a[w] | b[w]);
+            }
+            break;
+        case BitOp::AndNot:
+            for (int w = 0; w < words; ++w) {
+                total += popcountWord(a[w] & ~b[w]);
+            }
+            break;
+    }
+    return total;
+}
+}
+
+#define FIBERCORE_PIXEL_KERNELS(isa) { isa, accumulateRow, absDifferenceRow, scaleTo8BitRow, \
+                                       packBitsRow, unpackBitsRow, combineBitsRow, countBitsRow }
+
+#endif // PIXELKERNELSIMPL_H
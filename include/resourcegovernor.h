@@ -0,0 +1,113 @@
+#ifndef RESOURCEGOVERNOR_H
+#define RESOURCEGOVERNOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// One reading of the process and container memory state. Fields the
+// platform does not expose stay zero.
+struct ResourceSample {
+    size_t rssBytes = 0;
+    size_t availableBytes = 0;      // MemAvailable of the host
+    size_t cgroupLimitBytes = 0;    // 0 when the cgroup is unlimited
+    size_t cgroupUsageBytes = 0;    // Excluding reclaimable page cache
+    bool pressureAvailable = false;
+    double pressureSome = 0.0;      // PSI avg10: % of time some task stalled on memory
+    double pressureFull = 0.0;      // PSI avg10: % of time all tasks stalled on memory
+};
+
+enum class ResourceLevel : uint8_t {
+    Normal,
+    Constrained,    // Near the budget or under memory pressure: shed parallelism and caches
+    Critical        // At the budget or thrashing: one image at a time, no caches
+};
+
+// What batch and live processing may use right now
+struct ResourcePlan {
+    ResourceLevel level = ResourceLevel::Normal;
+    int workers = 1;                // Worker and OpenCV threads
+    int inFlightImages = 1;         // Images held at once (queued, averaged or being analyzed)
+    size_t cacheBytes = 0;          // Idle buffers and caches may keep this much
+    size_t budgetBytes = 0;
+    size_t usedBytes = 0;
+    
+    bool operator==(const ResourcePlan &other) const
+    {
+        return level == other.level && workers == other.workers &&
+               inFlightImages == other.inFlightImages && cacheBytes == other.cacheBytes;
+    }
+    bool operator!=(const ResourcePlan &other) const { return !(*this == other); }
+};
+
+// Keeps batch and live processing inside a memory budget. It samples RSS,
+// the cgroup memory limit and usage, and memory PSI (/proc/pressure/memory
+// or the cgroup's memory.pressure), and turns them into a ResourcePlan. The
+// budget is configured explicitly, via FIBERCORE_MEMORY_BUDGET_MB, or derived
+// from the container limit, so a container with a tight limit degrades
+// gracefully instead of being OOM-killed.
+//
+// Escalation is immediate; relaxing needs several consecutive calm samples
+// so that the plan does not oscillate around a threshold.
+class ResourceGovernor
+{
+public:
+    ResourceGovernor();
+    
+    // 0 derives the budget from the cgroup limit or the host's memory
+    void setMemoryBudget(size_t bytes);
+    size_t configuredMemoryBudget() const;
+    
+    // Ceilings used when resources are plentiful
+    void setMaxWorkers(int workers);
+    void setMaxInFlightImages(int images);
+    void setMaxCacheBytes(size_t bytes);
+    
+    // Typical working set of one in-flight image, all temporaries included
+    void setImageBytesEstimate(size_t bytes);
+    
+    void setSampleInterval(std::chrono::milliseconds interval);
+    
+    // Reads the current state from /proc and /sys
+    ResourceSample sample() const;
+    
+    // Samples if the interval has elapsed and returns the current plan;
+    // cheap enough to call once per frame
+    ResourcePlan update();
+    
+    // Derives a plan from a given sample (advances the hysteresis state)
+    ResourcePlan evaluate(const ResourceSample &sample);
+    
+    ResourcePlan currentPlan() const;
+    ResourceSample lastSample() const;
+    
+    // Process-wide knobs: OpenCV's thread pool and the scratch pool's retain limit
+    static void applyProcessLimits(const ResourcePlan &plan);
+    
+    static const char *levelName(ResourceLevel level);
+    
+private:
+    size_t effectiveBudget(const ResourceSample &sample) const;
+    ResourcePlan makePlan(ResourceLevel level, size_t budget, size_t used) const;
+    
+    mutable std::mutex m_mutex;
+    size_t m_configuredBudget;
+    int m_maxWorkers;
+    int m_maxInFlightImages;
+    size_t m_maxCacheBytes;
+    size_t m_imageBytesEstimate;
+    std::chrono::milliseconds m_sampleInterval;
+    
+    std::string m_cgroupDir;        // Our cgroup (v2) or memory controller (v1), or empty
+    bool m_cgroupV1;
+    
+    std::chrono::steady_clock::time_point m_lastSampleTime;
+    bool m_sampled;
+    ResourceSample m_lastSample;
+    ResourcePlan m_plan;
+    int m_calmSamples;              // Consecutive samples below the current level
+};
+
+#endif // RESOURCEGOVERNOR_H
@@ -0,0 +1,111 @@
+#ifndef RESULTLOG_H
+#define RESULTLOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct LogFile;
+
+struct ResultLogOptions {
+    uint64_t segmentBytes = 64ull << 20;    // The next segment is started once a record would pass this size
+    int groupCommitRecords = 512;           // Buffered records are committed after this many...
+    double groupCommitMs = 50.0;            // ...or on the first append once the oldest is this old
+};
+
+struct ResultLogRecord {
+    uint64_t sequence = 0;
+    int64_t timestampMs = 0;                // As given to append()
+    std::vector<uint8_t> payload;
+};
+
+struct ResultLogStats {
+    uint64_t records = 0;                   // In the log, buffered ones included
+    uint32_t segments = 0;
+    uint64_t commits = 0;                   // Group commits since open()
+    uint64_t recoveredRecords = 0;          // Found in segments but missing from the index at open()
+    uint64_t truncatedBytes = 0;            // Torn or corrupt data cut off at open()
+};
+
+// Append-only log of opaque result records in one directory, replacing a
+// file per result.
+//
+// Segments (segment-00000001.log, ...) hold records back to back: a fixed
+// header with the payload length, a CRC-32C over header and payload, the
+// sequence number and a timestamp, then the payload. Segments are never
+// rewritten; the next one is started when the current one is full.
+// results.idx holds one fixed-size entry per sequence number with the
+// record's segment and offset, so a record is read without scanning.
+//
+// Appends are buffered and committed in groups: one write and one fsync of
+// the segment, then of the index, per group instead of per record. A record
+// is durable once its group is committed by the group policy, sync() or
+// close(); a crash loses at most the uncommitted group. Opening the log again
+// keeps every record whose checksum verifies, cuts a torn tail off the last
+// segment and rebuilds the index entries the crash lost.
+//
+// Not thread-safe. One writer per directory: open() takes an exclusive lock
+// on results.lock and fails while another process or ResultLog holds it.
+class ResultLog
+{
+public:
+    explicit ResultLog(const ResultLogOptions &options = ResultLogOptions());
+    ~ResultLog();
+    
+    // Creates the directory if needed, locks it and recovers what a crash left behind
+    bool open(const std::string &directory);
+    void close();
+    bool isOpen() const;
+    const std::string &directory() const;
+    
+    // Sequence number of the new record, counting from 1; 0 when the log is
+    // not open or the record could not be taken. A due commit that fails
+    // keeps the unwritten part of the group buffered for the next attempt;
+    // sync() reports whether it got through.
+    uint64_t append(const void *data, size_t size, int64_t timestampMs);
+    
+    // Commits the buffered records now
+    bool sync();
+    size_t pendingRecords() const;
+    
+    // Highest sequence number in the log, 0 when empty
+    uint64_t lastSequence() const;
+    
+    // Reading a buffered record commits it first
+    bool read(uint64_t sequence, ResultLogRecord &record);
+    
+    // Visits the records from sequence first on, in order, until visitor returns false
+    bool scan(uint64_t first, const std::function<bool(const ResultLogRecord &)> &visitor);
+    
+    const ResultLogStats &stats() const;
+    
+private:
+    ResultLog(const ResultLog &) = delete;
+    ResultLog &operator=(const ResultLog &) = delete;
+    
+    bool recover();
+    bool startSegment(uint32_t segment);
+    std::string segmentPath(uint32_t segment) const;
+    std::string indexPath() const;
+    
+    ResultLogOptions m_options;
+    std::string m_directory;
+    std::unique_ptr<LogFile> m_segmentFile;
+    std::unique_ptr<LogFile> m_indexFile;
+    std::unique_ptr<LogFile> m_lockFile;    // Held while open
+    uint32_t m_segment;                     // Segment being appended to
+    uint64_t m_segmentSize;                 // Its size, buffered records included
+    uint64_t m_lastSequence;
+    uint64_t m_committedSequence;
+    std::vector<uint8_t> m_buffer;          // Records not yet written to the segment
+    std::vector<uint8_t> m_indexBuffer;     // Their index entries
+    size_t m_pendingRecords;
+    std::chrono::steady_clock::time_point m_oldestPending;
+    ResultLogStats m_stats;
+};
+
+#endif // RESULTLOG_H
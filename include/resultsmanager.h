@@ -10,8 +10,10 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QSettings>
+#include <QTimer>
 
 #include "fiberanalyzer.h"
+#include "resultlog.h"
 
 // Structure to hold analysis session info
 struct AnalysisSession {
@@ -30,15 +32,30 @@ public:
     explicit ResultsManager(QObject *parent = nullptr);
     ~ResultsManager();
     
-    // Save/load results
+    // Save/load results. The rvalue overloads take over the analyzer's result
+    // without copying its defect array. saveResult appends to the result log in
+    // the default save location; saveResultAs writes a standalone file.
     bool saveResult(const FiberAnalysisResult &result, const QString &imagePath);
+    bool saveResult(FiberAnalysisResult &&result, const QString &imagePath);
     bool saveResultAs(const FiberAnalysisResult &result, const QString &filePath);
+    bool saveResultAs(FiberAnalysisResult &&result, const QString &filePath);
     FiberAnalysisResult loadResult(const QString &filePath);
     
+    // Result log: sequence number of the last saveResult, a logged result by
+    // its sequence number, and committing what is still buffered. Commits,
+    // from saveResult, flushResults or the commit timer, run on the thread
+    // that owns the manager, the GUI thread in the application: one
+    // fdatasync of the segment and one of the index per group, a few
+    // milliseconds on a local SSD at one result per analysis.
+    quint64 lastSavedSequence() const;
+    FiberAnalysisResult loadLoggedResult(quint64 sequence, QString *imagePath = nullptr);
+    bool flushResults();
+    
     // Session management
     void startNewSession(const QString &operatorName);
     void endSession();
     void addToSession(const FiberAnalysisResult &result, const QString &imagePath);
+    void addToSession(FiberAnalysisResult &&result, const QString &imagePath);
     QVector<AnalysisSession> getSessionHistory();
     
     // Export options
@@ -62,9 +79,12 @@ private:
     bool m_isSessionActive;
     QString m_defaultSaveLocation;
     bool m_autoSaveEnabled;
+    ResultLog m_resultLog;
+    QTimer *m_commitTimer;          // Commits a group the next save may be too late for
+    quint64 m_lastSavedSequence;
     
     // Helper methods
-    QString generateResultFilename(const QString &basePath);
+    void openResultLog();
     QJsonObject resultToJson(const FiberAnalysisResult &result);
     FiberAnalysisResult jsonToResult(const QJsonObject &json);
     bool checkFilePermissions(const QString &filePath);
@@ -0,0 +1,86 @@
+#ifndef SCRATCHDETECTOR_H
+#define SCRATCHDETECTOR_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct ScratchOptions {
+    double sigma = 1.5;             // Gaussian scale of the line filters, about the scratch half-width
+    int orientations = 8;           // Filters in the bank, spread over 180 degrees
+    double edgeRejection = 2.0;     // Weight of the gradient subtracted from the line response
+    double noiseFactor = 3.5;       // Ridge threshold in robust standard deviations of the response
+    double minResponse = 2.0;       // Threshold floor for clean, noise-free frames
+    int minLength = 30;             // Shortest segment reported, in pixels
+    int maxLineGap = 10;            // Gaps bridged inside one segment
+    int maxJoinGap = 80;            // Collinear segments closer than this are joined
+};
+
+struct ScratchSegment {
+    cv::Point start;
+    cv::Point end;
+    float angle = 0.0f;             // Degrees in [0, 180), image coordinates
+    float strength = 0.0f;          // Mean filter response along the segment
+    
+    double length() const { return cv::norm(end - start); }
+    cv::Rect bounds() const { return cv::Rect(start, cv::Size(1, 1)) | cv::Rect(end, cv::Size(1, 1)); }
+};
+
+// Sampled 1D Gaussian of scale sigma and its first and second derivatives,
+// as CV_32F column vectors of radius ceil(3 sigma) for sepFilter2D. The
+// second derivative is made zero-sum so flat regions give no response at
+// all. Shared by the scratch and crack detectors.
+void makeGaussianDerivativeKernels(double sigma, cv::Mat &gaussian, cv::Mat &firstDerivative, cv::Mat &secondDerivative);
+
+// Dedicated detector for long, faint scratches that the blob threshold
+// breaks into fragments below its area cut. Five separable Gaussian
+// derivative filters form a steerable basis; every orientation of the bank
+// is steered from them per pixel, with the gradient along the filter normal
+// subtracted so step edges such as the cladding boundary do not respond like
+// lines. The orientation-max response is thinned across the line direction,
+// thresholded against its own noise level (median and MAD, so edges and the
+// scratches themselves do not raise it) and turned into segments with a
+// probabilistic Hough transform, and collinear pieces are joined.
+//
+// Filtering, steering and thinning run on horizontal stripes in parallel.
+// Work buffers are kept between frames; not thread-safe, one instance per
+// analysis thread.
+class ScratchDetector
+{
+public:
+    explicit ScratchDetector(const ScratchOptions &options = ScratchOptions());
+    
+    void setOptions(const ScratchOptions &options);
+    const ScratchOptions &options() const;
+    
+    // gray is 8-bit single channel, possibly a view into a larger frame whose
+    // pixels then serve as filter border. mask, when given, limits where
+    // ridges are searched. Segments are in gray's coordinates, longest first.
+    std::vector<ScratchSegment> detect(const cv::Mat &gray, const cv::Mat &mask = cv::Mat());
+    
+    // Orientation-max response and winning filter of the last detect()
+    const cv::Mat &response() const;
+    const cv::Mat &orientation() const;
+    
+private:
+    void buildKernels();
+    void filterStripe(const cv::Mat &gray, const cv::Range &rows);
+    void thinStripe(const cv::Mat &mask, float threshold, const cv::Range &rows);
+    std::vector<ScratchSegment> joinCollinear(std::vector<ScratchSegment> segments) const;
+    float ridgeThreshold(const cv::Mat &mask) const;
+    float meanResponse(const cv::Point &start, const cv::Point &end) const;
+    
+    ScratchOptions m_options;
+    cv::Mat m_gaussian;             // 1D kernels: Gaussian and its first and second derivatives
+    cv::Mat m_firstDerivative;
+    cv::Mat m_secondDerivative;
+    std::vector<float> m_cos;       // Filter normals of the bank
+    std::vector<float> m_sin;
+    std::vector<cv::Point> m_normalStep;
+    
+    cv::Mat m_dx, m_dy, m_dxx, m_dyy, m_dxy;
+    cv::Mat m_response;
+    cv::Mat m_orientation;
+    cv::Mat m_ridges;
+};
+
+#endif // SCRATCHDETECTOR_H
@@ -0,0 +1,81 @@
+#ifndef SCRATCHPOOL_H
+#define SCRATCHPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#if CV_VERSION_MAJOR >= 4
+using ScratchAccessFlags = cv::AccessFlag;
+#else
+using ScratchAccessFlags = int;
+#endif
+
+struct ScratchPoolStats {
+    uint64_t hits = 0;          // Allocations served from a recycled buffer
+    uint64_t misses = 0;        // Allocations that had to reach malloc
+    uint64_t passThrough = 0;   // Allocations below the pooling threshold
+    size_t bytesInUse = 0;      // Pooled buffers currently owned by a cv::Mat
+    size_t peakBytesInUse = 0;
+    size_t retainedBytes = 0;   // Free buffers kept for reuse
+};
+
+// cv::Mat allocator that recycles image-sized buffers across frames.
+// Buffers are binned into size classes (four per power of two, so at most
+// 25% slack) and returned to their bin when the last cv::Mat referencing
+// them goes away. Once installed as the default allocator every temporary in
+// the analysis and processing code - gray copies, blurred and binary images,
+// color conversions - is served from the pool, and steady-state frames reach
+// malloc only for small matrices below the threshold.
+//
+// The pool is shared by all threads: live frames are allocated on the capture
+// thread and released on the analysis or display thread.
+class ScratchPool : public cv::MatAllocator
+{
+public:
+    static ScratchPool &instance();
+    
+    // Routes every subsequent cv::Mat allocation through the pool.
+    // Matrices allocated before keep their own allocator.
+    void install();
+    void uninstall();
+    bool isInstalled() const;
+    
+    // Free buffers beyond this many bytes are released instead of kept
+    void setRetainLimit(size_t bytes);
+    size_t retainLimit() const;
+    
+    // Releases every free buffer
+    void trim();
+    
+    ScratchPoolStats stats() const;
+    void resetStats();
+    
+    // cv::MatAllocator
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           ScratchAccessFlags flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, ScratchAccessFlags accessFlags,
+                  cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+    
+private:
+    ScratchPool();
+    ~ScratchPool() override;
+    ScratchPool(const ScratchPool &) = delete;
+    ScratchPool &operator=(const ScratchPool &) = delete;
+    
+    static int sizeClass(size_t bytes);
+    static size_t classBytes(int sizeClass);
+    
+    bool m_installed;
+    
+    // cv::MatAllocator's interface is const; the pool state is not
+    mutable std::mutex m_mutex;
+    mutable std::vector<std::vector<void *>> m_freeBuffers;     // Indexed by size class
+    mutable ScratchPoolStats m_stats;
+    size_t m_retainLimit;
+};
+
+#endif // SCRATCHPOOL_H
@@ -0,0 +1,176 @@
+#ifndef TILEDPROCESSOR_H
+#define TILEDPROCESSOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "fibercore.h"
+
+// Random access to rectangular regions of an image that may be too large to
+// hold in memory, such as a stitched endface mosaic. Implementations must
+// allow concurrent reads from several tile workers.
+class TileSource
+{
+public:
+    virtual ~TileSource() = default;
+    
+    virtual cv::Size size() const = 0;
+    virtual int type() const = 0;       // CV_8UC1 or CV_16UC1
+    
+    // Largest sample value, used to scale 16-bit mosaics to 8 bits
+    virtual double maxValue() const;
+    
+    // Fills tile with the given region, which lies inside the image
+    virtual bool read(const cv::Rect &region, cv::Mat &tile) = 0;
+};
+
+// Counterpart of TileSource for filtered output; regions never overlap, and
+// writes may come from several tile workers at once
+class TileSink
+{
+public:
+    virtual ~TileSink() = default;
+    
+    virtual bool write(const cv::Rect &region, const cv::Mat &tile) = 0;
+};
+
+// Image already in memory; tiles are views, never copies
+class MatTileSource : public TileSource
+{
+public:
+    explicit MatTileSource(const cv::Mat &image);
+    
+    cv::Size size() const override;
+    int type() const override;
+    bool read(const cv::Rect &region, cv::Mat &tile) override;
+    
+private:
+    cv::Mat m_image;
+};
+
+class MatTileSink : public TileSink
+{
+public:
+    // The destination is allocated by the caller with the source's size and type
+    explicit MatTileSink(cv::Mat &image);
+    
+    bool write(const cv::Rect &region, const cv::Mat &tile) override;
+    
+private:
+    cv::Mat m_image;
+};
+
+// Binary PGM (P5, 8 or 16 bit) or headerless raw dump streamed from disk.
+// Only the rows of the requested region are read.
+class FileTileSource : public TileSource
+{
+public:
+    // Parses a PGM header; isOpen() is false if the file is not a binary PGM
+    explicit FileTileSource(const std::string &pgmPath);
+    
+    // Raw samples in native byte order after headerBytes of header
+    FileTileSource(const std::string &rawPath, cv::Size size, int type, size_t headerBytes = 0);
+    
+    bool isOpen() const;
+    
+    cv::Size size() const override;
+    int type() const override;
+    double maxValue() const override;
+    bool read(const cv::Rect &region, cv::Mat &tile) override;
+    
+private:
+    std::mutex m_mutex;
+    std::ifstream m_file;
+    cv::Size m_size;
+    int m_type;
+    double m_maxValue;
+    size_t m_dataOffset;
+    bool m_bigEndian;           // PGM stores 16-bit samples most significant byte first
+};
+
+// Writes a binary PGM of a known size tile by tile
+class FileTileSink : public TileSink
+{
+public:
+    FileTileSink(const std::string &pgmPath, cv::Size size, int type);
+    
+    bool isOpen() const;
+    
+    bool write(const cv::Rect &region, const cv::Mat &tile) override;
+    
+private:
+    std::mutex m_mutex;
+    std::fstream m_file;
+    cv::Size m_size;
+    int m_type;
+    size_t m_dataOffset;
+};
+
+struct TiledOptions {
+    int tileSize = 2048;        // Edge length of the tile interior
+};
+
+struct TiledStats {
+    bool complete = true;       // False when a tile could not be read, processed or written
+    int tiles = 0;
+    int seamBlobs = 0;          // Blob fragments that touched a tile seam
+    int mergedBlobs = 0;        // Blobs assembled from more than one fragment
+    size_t peakTileBytes = 0;   // Largest single tile with its halo
+    double elapsedMs = 0.0;
+};
+
+// Runs the filter and defect detection stages over tiles so that a mosaic
+// many times larger than memory can be processed. Each tile is read with a
+// halo wide enough for the stage's neighborhood operations, processed, and
+// cropped back to its interior, so tiled output matches whole-image output.
+// Defect blobs cut by a seam are joined with a union-find over the labels
+// along the tile borders before the size filter and classification run.
+//
+// Tiles run on OpenCV's thread pool: peak memory is about cv::getNumThreads()
+// tiles plus the seam labels, which the resource governor bounds through the
+// worker count.
+class TiledProcessor
+{
+public:
+    explicit TiledProcessor(const TiledOptions &options = TiledOptions());
+    
+    void setOptions(const TiledOptions &options);
+    const TiledOptions &options() const;
+    const TiledStats &lastStats() const;
+    
+    // Largest tile size that keeps workers tiles of the given type in budgetBytes
+    static int tileSizeForBudget(size_t budgetBytes, int workers, int type);
+    
+    // Applies function to each tile with halo pixels of context on every side.
+    // The function returns an image of the same size as its input.
+    using TileFunction = std::function<cv::Mat(const cv::Mat &tile)>;
+    bool filter(TileSource &source, TileSink &sink, int halo, const TileFunction &function);
+    
+    // Equivalent of FiberCore::detectDefectRegions plus bounding-box
+    // classification, with blob areas measured in pixels
+    std::vector<CoreDefect> detectDefects(TileSource &source);
+    
+    // Area-averaged preview whose longer side is at most maxSide, for the
+    // geometry search on mosaics too large to load
+    cv::Mat overview(TileSource &source, int maxSide);
+    
+    // Tile interiors covering an image, in row-major order
+    static std::vector<cv::Rect> tileGrid(const cv::Size &imageSize, int tileSize);
+    
+    // 8-bit gray tile; 8-bit gray input is returned as is
+    static cv::Mat toGray8(const cv::Mat &tile, double maxValue);
+    
+private:
+    int effectiveTileSize() const;
+    
+    TiledOptions m_options;
+    TiledStats m_stats;
+};
+
+#endif // TILEDPROCESSOR_H
@@ -0,0 +1,81 @@
+#include "analysispipeline.h"
+
+class RuntimePipeline::Stage
+{
+public:
+    virtual ~Stage() = default;
+    virtual CoreAnalysisResult analyze(const cv::Mat &frame) = 0;
+};
+
+namespace {
+template <typename Pipeline>
+class PipelineStage : public RuntimePipeline::Stage
+{
+public:
+    explicit PipelineStage(const StandardGrader &grader)
+        : m_pipeline(grader)
+    {
+    }
+    
+    CoreAnalysisResult analyze(const cv::Mat &frame) override
+    {
+        return m_pipeline.analyze(frame);
+    }
+    
+private:
+    Pipeline m_pipeline;
+};
+
+// Each level of the selection fixes one policy, so every combination below
+// is instantiated once here and nowhere else
+template <typename PixelT, typename CenterDetector, typename DefectExtractor>
+std::unique_ptr<RuntimePipeline::Stage> makeStage(const PipelineConfig &config)
+{
+    using Pipeline = AnalysisPipeline<PixelT, CenterDetector, DefectExtractor, AspectRatioClassifier, StandardGrader>;
+    return std::make_unique<PipelineStage<Pipeline>>(
+        StandardGrader(config.idealCoreCladRatio, config.maxAllowedDefects));
+}
+
+template <typename PixelT, typename CenterDetector>
+std::unique_ptr<RuntimePipeline::Stage> selectExtractor(const PipelineConfig &config)
+{
+    if (config.halfResolution) {
+        return makeStage<PixelT, CenterDetector, HalfResolutionExtractor>(config);
+    }
+    return makeStage<PixelT, CenterDetector, FullResolutionExtractor>(config);
+}
+
+template <typename PixelT>
+std::unique_ptr<RuntimePipeline::Stage> selectCenterDetector(const PipelineConfig &config)
+{
+    if (config.tracking) {
+        return selectExtractor<PixelT, TrackingCenterDetector>(config);
+    }
+    return selectExtractor<PixelT, HoughCenterDetector>(config);
+}
+}
+
+RuntimePipeline::RuntimePipeline(const PipelineConfig &config)
+    : m_config(config)
+{
+    if (config.depth == CV_16U) {
+        m_stage = selectCenterDetector<uint16_t>(config);
+    } else {
+        m_config.depth = CV_8U;
+        m_stage = selectCenterDetector<uint8_t>(config);
+    }
+}
+
+RuntimePipeline::~RuntimePipeline()
+{
+}
+
+CoreAnalysisResult RuntimePipeline::analyze(const cv::Mat &frame)
+{
+    return m_stage->analyze(frame);
+}
+
+const PipelineConfig &RuntimePipeline::config() const
+{
+    return m_config;
+}
@@ -0,0 +1,94 @@
+#include "annotationoverlay.h"
+
+#include <QFont>
+#include <QPen>
+
+void AnnotationOverlay::clear()
+{
+    m_shapes.clear();
+    m_labels.clear();
+}
+
+bool AnnotationOverlay::isEmpty() const
+{
+    return m_shapes.isEmpty() && m_labels.isEmpty();
+}
+
+void AnnotationOverlay::addRect(const QRect &rect, const QColor &color, int penWidth, AnnotationLayer layer)
+{
+    m_shapes.append({AnnotationShape::Kind::Rectangle, rect, color, penWidth, layer});
+}
+
+void AnnotationOverlay::addCircle(const QPoint &center, int radius, const QColor &color, int penWidth,
+                                  AnnotationLayer layer)
+{
+    QRect bounds(center.x() - radius, center.y() - radius, 2 * radius, 2 * radius);
+    m_shapes.append({AnnotationShape::Kind::Circle, bounds, color, penWidth, layer});
+}
+
+void AnnotationOverlay::addPoint(const QPoint &point, const QColor &color, int penWidth, AnnotationLayer layer)
+{
+    m_shapes.append({AnnotationShape::Kind::Point, QRect(point, QSize(1, 1)), color, penWidth, layer});
+}
+
+void AnnotationOverlay::addLabel(const QRect &anchor, const QString &text, AnnotationLayer layer)
+{
+    m_labels.append({anchor, text, layer});
+}
+
+void AnnotationOverlay::paint(QPainter &painter, int layers, double scale) const
+{
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setBrush(Qt::NoBrush);
+    
+    // Shapes are scaled by hand so pen widths and text stay legible at any zoom
+    auto toView = [scale](const QRect &rect) {
+        return QRectF(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
+    };
+    
+    for (const AnnotationShape &shape : m_shapes) {
+        if (!(layers & shape.layer)) {
+            continue;
+        }
+    
+        painter.setPen(QPen(shape.color, shape.penWidth));
+        QRectF rect = toView(shape.rect);
+        switch (shape.kind) {
+            case AnnotationShape::Kind::Rectangle:
+                painter.drawRect(rect);
+                break;
+            case AnnotationShape::Kind::Circle:
+                painter.drawEllipse(rect);
+                break;
+            case AnnotationShape::Kind::Point:
+                painter.drawPoint(rect.topLeft());
+                break;
+        }
+    }
+    
+    QFont font = painter.font();
+    font.setPointSize(8);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    
+    for (const AnnotationLabel &label : m_labels) {
+        if (!(layers & label.layer)) {
+            continue;
+        }
+    
+        QRectF anchor = toView(label.anchor);
+        painter.drawText(anchor.adjusted(-40, -20, 40, 0), Qt::AlignTop | Qt::AlignHCenter, label.text);
+    }
+    
+    painter.restore();
+}
+
+QImage AnnotationOverlay::render(const QImage &image, int layers) const
+{
+    QImage annotated = image.convertToFormat(QImage::Format_ARGB32);
+    QPainter painter(&annotated);
+    paint(painter, layers);
+    painter.end();
+    return annotated;
+}
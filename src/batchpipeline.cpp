@@ -0,0 +1,569 @@
+#include "batchpipeline.h"
+#include "framesource.h"
+#include "mappedimage.h"
+#include "pixelkernels.h"
+#include "resourcegovernor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#ifdef FIBERCORE_HAVE_IO_URING
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Largest single read handed to io_uring; bigger files are read in chunks
+const size_t kMaxReadChunk = 64 * 1024 * 1024;
+
+// 16-bit sensor data is reduced the way imdecode reduces it
+const double kSixteenToEightBit = 1.0 / 256.0;
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+}
+
+BatchPipeline::BatchPipeline(const BatchOptions &options)
+    : m_options(options)
+    , m_governor(nullptr)
+    , m_nextFile(0)
+    , m_stopping(false)
+    , m_activeReaders(0)
+    , m_activeDecoders(0)
+    , m_running(false)
+    , m_finished(false)
+{
+    m_options.readAhead = std::max(1, m_options.readAhead);
+    m_options.ioThreads = std::max(1, m_options.ioThreads);
+    m_options.decodedFrames = std::max(1, m_options.decodedFrames);
+    
+    // Only the reductions the decoders can do natively are offered
+    if (m_options.previewScale != 2 && m_options.previewScale != 4 && m_options.previewScale != 8) {
+        m_options.previewScale = 1;
+    }
+}
+
+BatchPipeline::~BatchPipeline()
+{
+    stop();
+}
+
+void BatchPipeline::setResourceGovernor(ResourceGovernor *governor)
+{
+    if (!isRunning()) {
+        m_governor = governor;
+    }
+}
+
+bool BatchPipeline::start(const std::vector<std::string> &files)
+{
+    std::lock_guard<std::mutex> control(m_controlMutex);
+    if (isRunning()) {
+        return false;
+    }
+    
+    // Join the threads of a previous batch before reusing the queues
+    shutdown();
+    
+    m_files = files;
+    m_nextFile = 0;
+    m_stopping = false;
+    m_readQueue.reset();
+    m_frameQueue.reset();
+    m_readQueue.setCapacity(m_options.readAhead);
+    m_frameQueue.setCapacity(m_options.decodedFrames);
+    
+    int decoders = m_options.decodeThreads > 0 ? m_options.decodeThreads
+                                               : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (m_governor) {
+        decoders = std::min(decoders, std::max(1, m_governor->update().workers));
+    }
+    followResourcePlan();
+    
+    const bool ioUring = m_options.useIoUring && isIoUringAvailable();
+    const int readers = ioUring ? 1 : m_options.ioThreads;
+    
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats = BatchStats();
+        m_stats.files = m_files.size();
+        m_stats.ioUring = ioUring;
+        m_startTime = std::chrono::steady_clock::now();
+        m_finished = false;
+        m_running = true;
+    }
+    
+    m_activeReaders = readers;
+    m_activeDecoders = decoders;
+    for (int i = 0; i < readers; ++i) {
+        m_threads.emplace_back(ioUring ? &BatchPipeline::readLoopIoUring : &BatchPipeline::readLoop, this);
+    }
+    for (int i = 0; i < decoders; ++i) {
+        m_threads.emplace_back(&BatchPipeline::decodeLoop, this);
+    }
+    
+    return true;
+}
+
+bool BatchPipeline::next(BatchFrame &frame)
+{
+    if (m_frameQueue.pop(frame)) {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        ++m_stats.analysis.items;
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    if (m_running && !m_finished) {
+        m_finished = true;
+        m_finishTime = std::chrono::steady_clock::now();
+    }
+    return false;
+}
+
+void BatchPipeline::stop()
+{
+    std::lock_guard<std::mutex> control(m_controlMutex);
+    shutdown();
+}
+
+void BatchPipeline::shutdown()
+{
+    // Closed queues wake every blocked stage; cleared ones let them exit at once
+    m_stopping = true;
+    m_readQueue.close();
+    m_readQueue.clear();
+    m_frameQueue.close();
+    m_frameQueue.clear();
+    joinThreads();
+    
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    if (m_running && !m_finished) {
+        m_finished = true;
+        m_finishTime = std::chrono::steady_clock::now();
+    }
+    m_running = false;
+}
+
+bool BatchPipeline::isRunning() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_running && !m_finished;
+}
+
+BatchStats BatchPipeline::run(const std::vector<std::string> &files, int analysisThreads, const AnalysisFunction &analyze)
+{
+    if (!start(files)) {
+        return stats();
+    }
+    
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < std::max(1, analysisThreads); ++worker) {
+        workers.emplace_back([this, worker, &analyze] {
+            BatchFrame frame;
+            while (next(frame)) {
+                auto started = std::chrono::steady_clock::now();
+                bool failed = false;
+                try {
+                    analyze(frame, worker);
+                } catch (const std::exception &) {
+                    failed = true;
+                }
+    
+                std::lock_guard<std::mutex> lock(m_statsMutex);
+                m_stats.analysis.busyMs += elapsedMs(started);
+                m_stats.analysis.bytes += frame.image.total() * frame.image.elemSize();
+                if (failed) {
+                    ++m_stats.failures;
+                }
+            }
+        });
+    }
+    
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    stop();
+    return stats();
+}
+
+BatchStats BatchPipeline::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    BatchStats stats = m_stats;
+    stats.peakReadQueue = m_readQueue.peakSize();
+    stats.peakFrameQueue = m_frameQueue.peakSize();
+    if (m_running || m_finished) {
+        auto end = m_finished ? m_finishTime : std::chrono::steady_clock::now();
+        stats.elapsedMs = std::chrono::duration<double, std::milli>(end - m_startTime).count();
+    }
+    return stats;
+}
+
+std::vector<std::string> BatchPipeline::listImages(const std::string &directory)
+{
+    std::vector<std::string> files;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.is_regular_file() && isImageFilePath(entry.path().string())) {
+            files.push_back(entry.path().string());
+        }
+    }
+    
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool BatchPipeline::isIoUringAvailable()
+{
+#ifdef FIBERCORE_HAVE_IO_URING
+    // Containers and hardened kernels often refuse io_uring_setup, so probe once
+    static const bool available = [] {
+        io_uring ring;
+        if (io_uring_queue_init(2, &ring, 0) < 0) {
+            return false;
+        }
+        io_uring_queue_exit(&ring);
+        return true;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+// Read stage
+
+bool BatchPipeline::claimFile(size_t &index)
+{
+    if (m_stopping) {
+        return false;
+    }
+    
+    index = m_nextFile++;
+    return index < m_files.size();
+}
+
+bool BatchPipeline::prepareMapped(ReadItem &item)
+{
+    const std::string &path = m_files[item.index];
+    if (!MappedImageFile::isSupported(path)) {
+        return false;
+    }
+    
+    auto mapped = std::make_shared<MappedImageFile>();
+    if (!mapped->open(path)) {
+        return false;
+    }
+    
+    // Start paging the first frame in while it waits for a decoder
+    mapped->setAccessPattern(MappedAccess::Sequential);
+    mapped->prefetch(0);
+    item.mapped = std::move(mapped);
+    return true;
+}
+
+void BatchPipeline::deliverRead(ReadItem &&item, double busyMs)
+{
+    const uint64_t bytes = item.mapped ? item.mapped->mappedBytes() : item.bytes.size();
+    
+    auto started = std::chrono::steady_clock::now();
+    m_readQueue.push(std::move(item));
+    const double blockedMs = elapsedMs(started);
+    
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_stats.read.items;
+    m_stats.read.bytes += bytes;
+    m_stats.read.busyMs += busyMs;
+    m_stats.read.blockedMs += blockedMs;
+}
+
+void BatchPipeline::finishReader()
+{
+    // The last reader ends the stream for the decoders
+    if (m_activeReaders.fetch_sub(1) == 1) {
+        m_readQueue.close();
+    }
+}
+
+void BatchPipeline::readLoop()
+{
+    size_t index = 0;
+    while (claimFile(index)) {
+        auto started = std::chrono::steady_clock::now();
+        ReadItem item;
+        item.index = index;
+    
+        if (!prepareMapped(item)) {
+            const std::string &path = m_files[index];
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            const std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+            if (size <= 0) {
+                item.error = "Cannot read " + path;
+            } else {
+                item.bytes.resize(static_cast<size_t>(size));
+                file.seekg(0);
+                if (!file.read(reinterpret_cast<char *>(item.bytes.data()), size)) {
+                    item.error = "Read error in " + path;
+                    item.bytes.clear();
+                }
+            }
+        }
+    
+        deliverRead(std::move(item), elapsedMs(started));
+    }
+    
+    finishReader();
+}
+
+#ifdef FIBERCORE_HAVE_IO_URING
+void BatchPipeline::readLoopIoUring()
+{
+    const unsigned depth = static_cast<unsigned>(std::max(2, m_options.readAhead));
+    io_uring ring;
+    if (io_uring_queue_init(depth, &ring, 0) < 0) {
+        readLoop();
+        return;
+    }
+    
+    struct PendingRead {
+        ReadItem item;
+        int fd = -1;
+        size_t done = 0;
+        std::chrono::steady_clock::time_point started;
+    };
+    
+    auto submit = [&ring](PendingRead *read) {
+        const size_t remaining = std::min(read->item.bytes.size() - read->done, kMaxReadChunk);
+        io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_read(sqe, read->fd, read->item.bytes.data() + read->done,
+                           static_cast<unsigned>(remaining), read->done);
+        io_uring_sqe_set_data(sqe, read);
+    };
+    
+    unsigned inFlight = 0;
+    size_t index = 0;
+    for (;;) {
+        // Keep the ring full while files remain; each file is one read in flight
+        while (inFlight < depth && claimFile(index)) {
+            auto started = std::chrono::steady_clock::now();
+            ReadItem item;
+            item.index = index;
+            if (prepareMapped(item)) {
+                deliverRead(std::move(item), elapsedMs(started));
+                continue;
+            }
+    
+            const std::string &path = m_files[index];
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat status;
+            if (fd < 0 || ::fstat(fd, &status) != 0 || status.st_size <= 0) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                item.error = "Cannot read " + path;
+                deliverRead(std::move(item), elapsedMs(started));
+                continue;
+            }
+    
+            auto *read = new PendingRead;
+            read->item = std::move(item);
+            read->item.bytes.resize(static_cast<size_t>(status.st_size));
+            read->fd = fd;
+            read->started = started;
+            submit(read);
+            ++inFlight;
+        }
+    
+        if (inFlight == 0) {
+            break;
+        }
+    
+        io_uring_submit_and_wait(&ring, 1);
+        io_uring_cqe *cqe = nullptr;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            auto *read = static_cast<PendingRead *>(io_uring_cqe_get_data(cqe));
+            const int result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+    
+            if (result > 0) {
+                read->done += static_cast<size_t>(result);
+                if (read->done < read->item.bytes.size()) {
+                    // Short reads are normal on network filesystems; continue where it stopped
+                    submit(read);
+                    continue;
+                }
+            } else {
+                read->item.error = "Read error in " + m_files[read->item.index] +
+                                   (result < 0 ? std::string(": ") + std::strerror(-result) : std::string());
+                read->item.bytes.clear();
+            }
+    
+            std::unique_ptr<PendingRead> finished(read);
+            ::close(finished->fd);
+            --inFlight;
+            deliverRead(std::move(finished->item), elapsedMs(finished->started));
+        }
+    }
+    
+    io_uring_queue_exit(&ring);
+    finishReader();
+}
+#else
+void BatchPipeline::readLoopIoUring()
+{
+    readLoop();
+}
+#endif
+
+// Decode stage
+
+void BatchPipeline::decodeLoop()
+{
+    ReadItem item;
+    while (!m_stopping && m_readQueue.pop(item)) {
+        followResourcePlan();
+        const std::string &path = m_files[item.index];
+    
+        if (item.mapped) {
+            // Dumps are already pixels: each page is a view, at most converted
+            for (size_t page = 0; page < item.mapped->pageCount() && !m_stopping; ++page) {
+                auto started = std::chrono::steady_clock::now();
+                BatchFrame frame;
+                frame.index = item.index;
+                frame.page = static_cast<int>(page);
+                frame.path = path;
+                try {
+                    frame.image = toAnalysisFrame(item.mapped->page(page));
+                } catch (const cv::Exception &e) {
+                    frame.error = e.what();
+                }
+                if (frame.image.empty() && frame.error.empty()) {
+                    frame.error = "Cannot map page " + std::to_string(page) + " of " + path;
+                }
+    
+                if (!deliverFrame(std::move(frame), elapsedMs(started))) {
+                    break;
+                }
+            }
+            item.mapped.reset();
+            continue;
+        }
+    
+        auto started = std::chrono::steady_clock::now();
+        BatchFrame frame;
+        frame.index = item.index;
+        frame.path = path;
+        if (item.error.empty()) {
+            try {
+                frame.image = cv::imdecode(item.bytes, decodeFlags());
+            } catch (const cv::Exception &e) {
+                frame.error = e.what();
+            }
+            if (frame.image.empty() && frame.error.empty()) {
+                frame.error = "Cannot decode " + path;
+            }
+        } else {
+            frame.error = item.error;
+        }
+    
+        // Compressed bytes are not needed once decoded
+        std::vector<uchar>().swap(item.bytes);
+    
+        deliverFrame(std::move(frame), elapsedMs(started));
+    }
+    
+    // The last decoder ends the stream for the analyzers
+    if (m_activeDecoders.fetch_sub(1) == 1) {
+        m_frameQueue.close();
+    }
+}
+
+bool BatchPipeline::deliverFrame(BatchFrame &&frame, double busyMs)
+{
+    const uint64_t bytes = frame.image.total() * frame.image.elemSize();
+    const bool failed = !frame.error.empty();
+    
+    auto started = std::chrono::steady_clock::now();
+    const bool delivered = m_frameQueue.push(std::move(frame));
+    const double blockedMs = elapsedMs(started);
+    
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_stats.decode.items;
+    m_stats.decode.bytes += bytes;
+    m_stats.decode.busyMs += busyMs;
+    m_stats.decode.blockedMs += blockedMs;
+    if (failed) {
+        ++m_stats.failures;
+    }
+    return delivered;
+}
+
+int BatchPipeline::decodeFlags() const
+{
+    // JPEG decodes straight to the reduced size, skipping most of the IDCT work
+    switch (m_options.previewScale) {
+        case 2:
+            return cv::IMREAD_REDUCED_GRAYSCALE_2;
+        case 4:
+            return cv::IMREAD_REDUCED_GRAYSCALE_4;
+        case 8:
+            return cv::IMREAD_REDUCED_GRAYSCALE_8;
+        default:
+            return cv::IMREAD_GRAYSCALE;
+    }
+}
+
+cv::Mat BatchPipeline::toAnalysisFrame(const cv::Mat &image) const
+{
+    // Mapped pages arrive as stored; bring them to what imdecode would return
+    cv::Mat gray = image;
+    if (gray.channels() > 1) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    }
+    if (gray.depth() == CV_16U) {
+        cv::Mat scaled;
+        scaleTo8Bit(gray, scaled, kSixteenToEightBit);
+        gray = scaled;
+    }
+    
+    if (m_options.previewScale > 1) {
+        cv::Mat reduced;
+        cv::resize(gray, reduced, cv::Size(), 1.0 / m_options.previewScale, 1.0 / m_options.previewScale,
+                   cv::INTER_AREA);
+        return reduced;
+    }
+    return gray;
+}
+
+void BatchPipeline::followResourcePlan()
+{
+    if (!m_governor) {
+        return;
+    }
+    
+    // Read buffers and decoded frames both count as images in flight
+    const ResourcePlan plan = m_governor->update();
+    const size_t share = std::max<size_t>(1, static_cast<size_t>(std::max(1, plan.inFlightImages)) / 2);
+    m_readQueue.setCapacity(std::min<size_t>(m_options.readAhead, share));
+    m_frameQueue.setCapacity(std::min<size_t>(m_options.decodedFrames, share));
+}
+
+void BatchPipeline::joinThreads()
+{
+    for (std::thread &thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
@@ -0,0 +1,210 @@
+#include "bitmask.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Rows are padded to whole 256-bit blocks
+const int kWordsPerBlock = 4;
+const int kBitsPerBlock = 256;
+}
+
+BitMask::BitMask()
+    : m_wordsPerRow(0)
+{
+}
+
+BitMask::BitMask(const cv::Size &size)
+    : m_wordsPerRow(0)
+{
+    create(size);
+}
+
+BitMask::BitMask(const cv::Mat &mask)
+    : m_wordsPerRow(0)
+{
+    assign(mask);
+}
+
+void BitMask::create(const cv::Size &size)
+{
+    CV_Assert(size.width >= 0 && size.height >= 0);
+    
+    // The kernels take the whole buffer as one row of int-counted words
+    m_size = size;
+    m_wordsPerRow = (size.width + kBitsPerBlock - 1) / kBitsPerBlock * kWordsPerBlock;
+    CV_Assert(static_cast<int64_t>(m_wordsPerRow) * size.height <= std::numeric_limits<int>::max());
+    m_words.assign(static_cast<size_t>(m_wordsPerRow) * size.height, 0);
+}
+
+void BitMask::assign(const cv::Mat &mask)
+{
+    CV_Assert(mask.type() == CV_8UC1);
+    
+    // Padding words stay clear from create(); packBits clears the rest of each row's last word
+    create(mask.size());
+    const PixelKernels &kernels = pixelKernels();
+    for (int y = 0; y < mask.rows; ++y) {
+        kernels.packBits(mask.ptr<uint8_t>(y), row(y), mask.cols);
+    }
+}
+
+void BitMask::clear()
+{
+    std::fill(m_words.begin(), m_words.end(), 0);
+}
+
+void BitMask::toMat(cv::Mat &mask) const
+{
+    mask.create(m_size, CV_8UC1);
+    const PixelKernels &kernels = pixelKernels();
+    for (int y = 0; y < m_size.height; ++y) {
+        kernels.unpackBits(row(y), mask.ptr<uint8_t>(y), m_size.width);
+    }
+}
+
+cv::Mat BitMask::toMat() const
+{
+    cv::Mat mask;
+    toMat(mask);
+    return mask;
+}
+
+cv::Size BitMask::size() const
+{
+    return m_size;
+}
+
+bool BitMask::empty() const
+{
+    return m_words.empty();
+}
+
+bool BitMask::test(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= m_size.width || y >= m_size.height) {
+        return false;
+    }
+    return (row(y)[x >> 6] >> (x & 63)) & 1u;
+}
+
+void BitMask::set(int x, int y)
+{
+    if (x >= 0 && y >= 0 && x < m_size.width && y < m_size.height) {
+        row(y)[x >> 6] |= uint64_t(1) << (x & 63);
+    }
+}
+
+void BitMask::setSpan(int y, int begin, int end)
+{
+    begin = std::max(begin, 0);
+    end = std::min(end, m_size.width);
+    if (y < 0 || y >= m_size.height || begin >= end) {
+        return;
+    }
+    
+    uint64_t *words = row(y);
+    const int first = begin >> 6;
+    const int last = (end - 1) >> 6;
+    const uint64_t firstMask = ~uint64_t(0) << (begin & 63);
+    const uint64_t lastMask = ~uint64_t(0) >> (63 - ((end - 1) & 63));
+    if (first == last) {
+        words[first] |= firstMask & lastMask;
+        return;
+    }
+    
+    words[first] |= firstMask;
+    std::fill(words + first + 1, words + last, ~uint64_t(0));
+    words[last] |= lastMask;
+}
+
+void BitMask::fillCircle(const cv::Point2f &center, float radius)
+{
+    if (radius <= 0.0f) {
+        return;
+    }
+    
+    // One span per row: pixel centres within the radius
+    const int top = std::max(0, static_cast<int>(std::ceil(center.y - radius)));
+    const int bottom = std::min(m_size.height - 1, static_cast<int>(std::floor(center.y + radius)));
+    for (int y = top; y <= bottom; ++y) {
+        const float dy = y - center.y;
+        const float halfWidth = std::sqrt(std::max(0.0f, radius * radius - dy * dy));
+        setSpan(y, static_cast<int>(std::ceil(center.x - halfWidth)), static_cast<int>(std::floor(center.x + halfWidth)) + 1);
+    }
+}
+
+BitMask &BitMask::operator&=(const BitMask &other)
+{
+    combine(other, BitOp::And);
+    return *this;
+}
+
+BitMask &BitMask::operator|=(const BitMask &other)
+{
+    combine(other, BitOp::Or);
+    return *this;
+}
+
+BitMask &BitMask::andNot(const BitMask &other)
+{
+    combine(other, BitOp::AndNot);
+    return *this;
+}
+
+uint64_t BitMask::count() const
+{
+    return pixelKernels().countBits(m_words.data(), nullptr, static_cast<int>(m_words.size()), BitOp::And);
+}
+
+uint64_t BitMask::countAnd(const BitMask &other) const
+{
+    return countWith(other, BitOp::And);
+}
+
+uint64_t BitMask::countAndNot(const BitMask &other) const
+{
+    return countWith(other, BitOp::AndNot);
+}
+
+int BitMask::wordsPerRow() const
+{
+    return m_wordsPerRow;
+}
+
+const uint64_t *BitMask::row(int y) const
+{
+    return m_words.data() + static_cast<size_t>(y) * m_wordsPerRow;
+}
+
+uint64_t *BitMask::row(int y)
+{
+    return m_words.data() + static_cast<size_t>(y) * m_wordsPerRow;
+}
+
+void BitMask::combine(const BitMask &other, BitOp op)
+{
+    CV_Assert(other.m_size == m_size);
+    
+    // Padding bits are clear in both operands and stay clear under every operation
+    pixelKernels().combineBits(m_words.data(), m_words.data(), other.m_words.data(),
+                               static_cast<int>(m_words.size()), op);
+}
+
+uint64_t BitMask::countWith(const BitMask &other, BitOp op) const
+{
+    CV_Assert(other.m_size == m_size);
+    
+    return pixelKernels().countBits(m_words.data(), other.m_words.data(), static_cast<int>(m_words.size()), op);
+}
+
+BitMask operator&(BitMask a, const BitMask &b)
+{
+    return a &= b;
+}
+
+BitMask operator|(BitMask a, const BitMask &b)
+{
+    return a |= b;
+}
@@ -0,0 +1,247 @@
+#include "cpudispatch.h"
+#include "pixelkernelsimpl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+
+#if defined(FIBERCORE_KERNELS_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(FIBERCORE_KERNELS_NEON) && defined(__linux__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+// Variants built with their own target flags (see CMakeLists.txt)
+#if defined(FIBERCORE_KERNELS_X86)
+extern const PixelKernels sse42PixelKernels;
+extern const PixelKernels avx2PixelKernels;
+extern const PixelKernels avx512PixelKernels;
+#elif defined(FIBERCORE_KERNELS_NEON)
+extern const PixelKernels neonPixelKernels;
+#endif
+
+namespace {
+// Compiled here with the default flags, so it runs everywhere
+const PixelKernels baselinePixelKernels = FIBERCORE_PIXEL_KERNELS(CpuIsa::Baseline);
+
+std::atomic<const PixelKernels *> g_activeKernels{nullptr};
+
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;
+    bool avx512 = false;
+    bool neon = false;
+};
+
+#if defined(FIBERCORE_KERNELS_X86)
+void cpuid(unsigned leaf, unsigned subleaf, unsigned registers[4])
+{
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i) {
+        registers[i] = static_cast<unsigned>(values[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+uint64_t enabledRegisterState()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CpuFeatures queryCpuFeatures()
+{
+    CpuFeatures features;
+    
+#if defined(FIBERCORE_KERNELS_X86)
+    unsigned registers[4];
+    cpuid(0, 0, registers);
+    const unsigned maxLeaf = registers[0];
+    
+    cpuid(1, 0, registers);
+    features.sse42 = registers[2] & (1u << 20);
+    const bool osxsave = registers[2] & (1u << 27);
+    const bool avx = registers[2] & (1u << 28);
+    
+    // AVX registers are only usable when the OS has enabled their state
+    if (osxsave && avx && maxLeaf >= 7) {
+        const uint64_t state = enabledRegisterState();
+        const bool ymmEnabled = (state & 0x6) == 0x6;       // SSE + AVX
+        const bool zmmEnabled = (state & 0xE6) == 0xE6;     // + opmask and upper ZMM
+    
+        cpuid(7, 0, registers);
+        features.avx2 = ymmEnabled && (registers[1] & (1u << 5));
+        features.avx512 = zmmEnabled && (registers[1] & (1u << 16)) && (registers[1] & (1u << 30));
+    }
+#elif defined(FIBERCORE_KERNELS_NEON)
+#if defined(__aarch64__) || defined(_M_ARM64)
+    features.neon = true;   // Mandatory on 64-bit ARM
+#elif defined(__linux__)
+    features.neon = getauxval(AT_HWCAP) & (1ul << 12);   // HWCAP_NEON
+#endif
+#endif
+    
+    return features;
+}
+
+const CpuFeatures &cpuFeatures()
+{
+    static const CpuFeatures features = queryCpuFeatures();
+    return features;
+}
+
+// Kernels built into this binary for the variant, or null
+const PixelKernels *builtKernels(CpuIsa isa)
+{
+    switch (isa) {
+        case CpuIsa::Baseline:
+            return &baselinePixelKernels;
+#if defined(FIBERCORE_KERNELS_X86)
+        case CpuIsa::SSE42:
+            return &sse42PixelKernels;
+        case CpuIsa::AVX2:
+            return &avx2PixelKernels;
+        case CpuIsa::AVX512:
+            return &avx512PixelKernels;
+#elif defined(FIBERCORE_KERNELS_NEON)
+        case CpuIsa::NEON:
+            return &neonPixelKernels;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const PixelKernels *initialKernels()
+{
+    CpuIsa isa = detectCpuIsa();
+    
+    if (const char *forced = std::getenv("FIBERCORE_FORCE_ISA")) {
+        CpuIsa requested;
+        if (parseCpuIsa(forced, requested) && isCpuIsaSupported(requested)) {
+            isa = requested;
+        }
+    }
+    
+    return builtKernels(isa);
+}
+}
+
+const PixelKernels &pixelKernels()
+{
+    const PixelKernels *kernels = g_activeKernels.load(std::memory_order_acquire);
+    if (!kernels) {
+        // Concurrent first calls compute the same table; the first store wins
+        const PixelKernels *expected = nullptr;
+        kernels = initialKernels();
+        if (!g_activeKernels.compare_exchange_strong(expected, kernels, std::memory_order_acq_rel)) {
+            kernels = expected;
+        }
+    }
+    return *kernels;
+}
+
+CpuIsa activeCpuIsa()
+{
+    return pixelKernels().isa;
+}
+
+CpuIsa detectCpuIsa()
+{
+    for (CpuIsa isa : {CpuIsa::AVX512, CpuIsa::AVX2, CpuIsa::SSE42, CpuIsa::NEON}) {
+        if (isCpuIsaSupported(isa)) {
+            return isa;
+        }
+    }
+    return CpuIsa::Baseline;
+}
+
+bool isCpuIsaSupported(CpuIsa isa)
+{
+    if (!builtKernels(isa)) {
+        return false;
+    }
+    
+    const CpuFeatures &features = cpuFeatures();
+    switch (isa) {
+        case CpuIsa::Baseline:
+            return true;
+        case CpuIsa::SSE42:
+            return features.sse42;
+        case CpuIsa::AVX2:
+            return features.avx2;
+        case CpuIsa::AVX512:
+            return features.avx512;
+        case CpuIsa::NEON:
+            return features.neon;
+    }
+    return false;
+}
+
+bool forceCpuIsa(CpuIsa isa)
+{
+    if (!isCpuIsaSupported(isa)) {
+        return false;
+    }
+    
+    g_activeKernels.store(builtKernels(isa), std::memory_order_release);
+    return true;
+}
+
+void resetCpuIsa()
+{
+    g_activeKernels.store(builtKernels(detectCpuIsa()), std::memory_order_release);
+}
+
+const char *cpuIsaName(CpuIsa isa)
+{
+    switch (isa) {
+        case CpuIsa::Baseline: return "baseline";
+        case CpuIsa::SSE42:    return "sse4.2";
+        case CpuIsa::AVX2:     return "avx2";
+        case CpuIsa::AVX512:   return "avx512";
+        case CpuIsa::NEON:     return "neon";
+    }
+    return "unknown";
+}
+
+bool parseCpuIsa(const std::string &name, CpuIsa &isa)
+{
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    
+    for (CpuIsa candidate : {CpuIsa::Baseline, CpuIsa::SSE42, CpuIsa::AVX2, CpuIsa::AVX512, CpuIsa::NEON}) {
+        if (lower == cpuIsaName(candidate)) {
+            isa = candidate;
+            return true;
+        }
+    }
+    
+    // Common spellings
+    if (lower == "sse42" || lower == "sse4_2") {
+        isa = CpuIsa::SSE42;
+        return true;
+    }
+    if (lower == "avx-512" || lower == "avx512bw") {
+        isa = CpuIsa::AVX512;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,251 @@
+#include "crackdetector.h"
+#include "scratchdetector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Floor of the flank rise the symmetry is divided by, so flat ground gives 0 and not 0/0
+const float kFlatFlank = 1e-3f;
+
+// Per-component accumulators for the mean response and the pixel spread
+struct ComponentMoments {
+    double response = 0.0;
+    double x = 0.0, y = 0.0;
+    double xx = 0.0, yy = 0.0, xy = 0.0;
+};
+
+// Ratio of the principal axes of a component's pixels
+double elongation(const ComponentMoments &moments, int pixels)
+{
+    const double n = std::max(1, pixels);
+    const double mx = moments.x / n;
+    const double my = moments.y / n;
+    const double cxx = moments.xx / n - mx * mx;
+    const double cyy = moments.yy / n - my * my;
+    const double cxy = moments.xy / n - mx * my;
+    const double half = 0.5 * (cxx + cyy);
+    const double spread = std::sqrt(0.25 * (cxx - cyy) * (cxx - cyy) + cxy * cxy);
+    return std::sqrt((half + spread) / std::max(half - spread, 1.0 / 12.0));
+}
+}
+
+CrackDetector::CrackDetector(const CrackOptions &options)
+    : m_options(options)
+{
+    buildKernels();
+}
+
+void CrackDetector::setOptions(const CrackOptions &options)
+{
+    m_options = options;
+    buildKernels();
+}
+
+const CrackOptions &CrackDetector::options() const
+{
+    return m_options;
+}
+
+const cv::Mat &CrackDetector::response() const
+{
+    return m_response;
+}
+
+const cv::Mat &CrackDetector::labels() const
+{
+    return m_labels;
+}
+
+void CrackDetector::buildKernels()
+{
+    m_options.sigma = std::max(0.5, m_options.sigma);
+    m_options.scales = std::max(1, std::min(m_options.scales, 6));
+    m_options.beta = std::max(0.05, m_options.beta);
+    m_options.structureScale = std::max(0.1, m_options.structureScale);
+    m_options.minLength = std::max(1, m_options.minLength);
+    m_options.minElongation = std::max(1.0, m_options.minElongation);
+    
+    // One set of kernels serves every scale: the pyramid does the widening
+    makeGaussianDerivativeKernels(m_options.sigma, m_gaussian, m_firstDerivative, m_secondDerivative);
+    
+    m_pyramid.resize(m_options.scales);
+    m_builtLevels.resize(m_options.scales);
+    m_smooth.resize(m_options.scales);
+    m_dxx.resize(m_options.scales);
+    m_dyy.resize(m_options.scales);
+    m_dxy.resize(m_options.scales);
+    m_levelResponse.resize(m_options.scales);
+    m_upsampled.resize(m_options.scales);
+}
+
+std::vector<CrackCandidate> CrackDetector::detect(const cv::Mat &gray, const cv::Mat &mask)
+{
+    return detect(std::vector<cv::Mat>(1, gray), mask);
+}
+
+std::vector<CrackCandidate> CrackDetector::detect(const std::vector<cv::Mat> &pyramid, const cv::Mat &mask)
+{
+    CV_Assert(!pyramid.empty() && pyramid[0].type() == CV_8UC1);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == pyramid[0].size()));
+    
+    std::vector<CrackCandidate> candidates;
+    if (pyramid[0].empty()) {
+        return candidates;
+    }
+    
+    // Borrow the caller's levels, halve the last one for any still missing;
+    // levels too small for the kernels add nothing
+    const int radius = m_gaussian.rows / 2;
+    int scales = 0;
+    for (; scales < m_options.scales; ++scales) {
+        if (scales < static_cast<int>(pyramid.size())) {
+            m_pyramid[scales] = pyramid[scales];
+        } else {
+            cv::pyrDown(m_pyramid[scales - 1], m_builtLevels[scales]);
+            m_pyramid[scales] = m_builtLevels[scales];
+        }
+        if (std::min(m_pyramid[scales].rows, m_pyramid[scales].cols) <= 2 * radius) {
+            break;
+        }
+    }
+    scales = std::max(1, scales);
+    
+    // Scales are independent once the pyramid exists
+    cv::parallel_for_(cv::Range(0, scales), [&](const cv::Range &range) {
+        for (int scale = range.start; scale < range.end; ++scale) {
+            filterLevel(m_pyramid[scale], scale);
+        }
+    });
+    
+    // Maximum over scales at full resolution
+    m_levelResponse[0].copyTo(m_response);
+    for (int scale = 1; scale < scales; ++scale) {
+        cv::max(m_response, m_upsampled[scale], m_response);
+    }
+    
+    // Connected ridge pixels inside the search area
+    cv::compare(m_response, cv::Scalar(m_options.minResponse), m_ridges, cv::CMP_GT);
+    if (!mask.empty()) {
+        cv::bitwise_and(m_ridges, mask, m_ridges);
+    }
+    const int components = cv::connectedComponentsWithStats(m_ridges, m_labels, m_stats, m_centroids, 8, CV_32S);
+    
+    // Mean response and pixel spread per component in one pass over the labels
+    std::vector<ComponentMoments> moments(components);
+    for (int y = 0; y < m_labels.rows; ++y) {
+        const int *label = m_labels.ptr<int>(y);
+        const float *response = m_response.ptr<float>(y);
+        for (int x = 0; x < m_labels.cols; ++x) {
+            if (label[x] == 0) {
+                continue;
+            }
+            ComponentMoments &component = moments[label[x]];
+            component.response += response[x];
+            component.x += x;
+            component.y += y;
+            component.xx += static_cast<double>(x) * x;
+            component.yy += static_cast<double>(y) * y;
+            component.xy += static_cast<double>(x) * y;
+        }
+    }
+    
+    for (int label = 1; label < components; ++label) {
+        const int *stats = m_stats.ptr<int>(label);
+        CrackCandidate candidate;
+        candidate.bounds = cv::Rect(stats[cv::CC_STAT_LEFT], stats[cv::CC_STAT_TOP],
+                                    stats[cv::CC_STAT_WIDTH], stats[cv::CC_STAT_HEIGHT]);
+        if (std::max(candidate.bounds.width, candidate.bounds.height) < m_options.minLength) {
+            continue;
+        }
+        candidate.label = label;
+        candidate.pixels = stats[cv::CC_STAT_AREA];
+        candidate.elongation = static_cast<float>(elongation(moments[label], candidate.pixels));
+        if (candidate.elongation < m_options.minElongation) {
+            continue;
+        }
+        candidate.strength = static_cast<float>(moments[label].response / candidate.pixels);
+        candidates.push_back(candidate);
+    }
+    
+    std::sort(candidates.begin(), candidates.end(), [](const CrackCandidate &a, const CrackCandidate &b) {
+        return std::max(a.bounds.width, a.bounds.height) > std::max(b.bounds.width, b.bounds.height);
+    });
+    return candidates;
+}
+
+void CrackDetector::filterLevel(const cv::Mat &level, int scale)
+{
+    // Smoothed image for the flank test and the Hessian, all separable
+    cv::sepFilter2D(level, m_smooth[scale], CV_32F, m_gaussian, m_gaussian);
+    cv::sepFilter2D(level, m_dxx[scale], CV_32F, m_secondDerivative, m_gaussian);
+    cv::sepFilter2D(level, m_dyy[scale], CV_32F, m_gaussian, m_secondDerivative);
+    cv::sepFilter2D(level, m_dxy[scale], CV_32F, m_firstDerivative, m_firstDerivative);
+    
+    // Derivatives in level pixels times the level's sigma squared are
+    // normalized to the scale, so every level shares one contrast term
+    const float sigmaSquared = static_cast<float>(m_options.sigma * m_options.sigma);
+    const float blobTerm = static_cast<float>(-1.0 / (2.0 * m_options.beta * m_options.beta));
+    const float structureTerm = static_cast<float>(-1.0 / (2.0 * m_options.structureScale * m_options.structureScale));
+    const float side = static_cast<float>(m_options.sideDistance * m_options.sigma);
+    const cv::Mat &smooth = m_smooth[scale];
+    cv::Mat &response = m_levelResponse[scale];
+    response.create(level.size(), CV_32F);
+    for (int y = 0; y < level.rows; ++y) {
+        const float *rowDxx = m_dxx[scale].ptr<float>(y);
+        const float *rowDyy = m_dyy[scale].ptr<float>(y);
+        const float *rowDxy = m_dxy[scale].ptr<float>(y);
+        const float *rowSmooth = smooth.ptr<float>(y);
+        float *out = response.ptr<float>(y);
+        for (int x = 0; x < level.cols; ++x) {
+            const float a = sigmaSquared * rowDxx[x];
+            const float b = sigmaSquared * rowDxy[x];
+            const float d = sigmaSquared * rowDyy[x];
+    
+            // Eigenvalues of the Hessian; a dark ridge has the larger one
+            // positive and dominant, which holds exactly when the mean is positive
+            const float half = 0.5f * (a + d);
+            const float spread = std::sqrt(0.25f * (a - d) * (a - d) + b * b);
+            const float across = half + spread;
+            const float along = half - spread;
+            if (half <= 0.0f) {
+                out[x] = 0.0f;
+                continue;
+            }
+    
+            // Normal of the ridge: eigenvector of the larger eigenvalue
+            float nx = b;
+            float ny = across - a;
+            const float norm = std::sqrt(nx * nx + ny * ny);
+            if (norm > 0.0f) {
+                nx /= norm;
+                ny /= norm;
+            } else {
+                nx = a >= d ? 1.0f : 0.0f;
+                ny = a >= d ? 0.0f : 1.0f;
+            }
+    
+            // A valley rises on both flanks, an edge on one only
+            const int ox = cvRound(side * nx);
+            const int oy = cvRound(side * ny);
+            const float center = rowSmooth[x];
+            const float plus = smooth.at<float>(std::min(std::max(y + oy, 0), level.rows - 1),
+                                                std::min(std::max(x + ox, 0), level.cols - 1)) - center;
+            const float minus = smooth.at<float>(std::min(std::max(y - oy, 0), level.rows - 1),
+                                                 std::min(std::max(x - ox, 0), level.cols - 1)) - center;
+            const float symmetry = std::min(1.0f, std::max(0.0f, std::min(plus, minus) / std::max({plus, minus, kFlatFlank})));
+    
+            const float ratio = along / across;
+            const float structure = across * across + along * along;
+            out[x] = std::exp(blobTerm * ratio * ratio) * (1.0f - std::exp(structureTerm * structure)) * symmetry;
+        }
+    }
+    
+    // Coarse scales are compared at full resolution
+    if (scale > 0) {
+        cv::resize(response, m_upsampled[scale], m_pyramid[0].size(), 0, 0, cv::INTER_LINEAR);
+    }
+}
@@ -0,0 +1,334 @@
+#include "defectindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+namespace {
+// Automatic cells span about two typical boxes
+const int kMinCellSize = 8;
+const int kCellBoxes = 2;
+
+// Sparse results get coarser cells instead of a mostly empty grid
+const int64_t kMinCells = 64;
+const int64_t kCellsPerBox = 4;
+
+int floorDiv(int value, int divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+int findRoot(std::vector<int> &parent, int index)
+{
+    while (parent[index] != index) {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+cv::Rect grow(const cv::Rect &rect, int pixels)
+{
+    return cv::Rect(rect.x - pixels, rect.y - pixels, rect.width + 2 * pixels, rect.height + 2 * pixels);
+}
+
+// Long to short side of a box that counts as a dash of a line
+const int kDashElongation = 2;
+
+// Two nearby boxes are pieces of one defect when they overlap, or when both
+// are dashes along the same axis and follow each other along it, as the
+// pieces of a scratch broken by the threshold do. Round spots side by side
+// are separate defects however close they are.
+bool continuesFragment(const cv::Rect &a, const cv::Rect &b)
+{
+    if ((a & b).area() > 0) {
+        return true;
+    }
+    const bool sideBySide = std::min(a.y + a.height, b.y + b.height) > std::max(a.y, b.y);
+    const bool aboveBelow = std::min(a.x + a.width, b.x + b.width) > std::max(a.x, b.x);
+    const bool horizontalDashes = a.width >= kDashElongation * a.height && b.width >= kDashElongation * b.height;
+    const bool verticalDashes = a.height >= kDashElongation * a.width && b.height >= kDashElongation * b.width;
+    return (sideBySide && horizontalDashes) || (aboveBelow && verticalDashes);
+}
+}
+
+DefectIndex::DefectIndex()
+    : m_cellSize(kMinCellSize)
+    , m_cols(0)
+    , m_rows(0)
+{
+}
+
+void DefectIndex::build(const std::vector<cv::Rect> &boxes, int cellSize)
+{
+    clear();
+    m_bounds = boxes;
+    if (m_bounds.empty()) {
+        return;
+    }
+    
+    // Grid extent and, unless given, a cell of about two median boxes
+    cv::Rect extent = m_bounds.front();
+    std::vector<int> sides;
+    sides.reserve(m_bounds.size());
+    for (const cv::Rect &box : m_bounds) {
+        extent |= box;
+        sides.push_back(std::max(box.width, box.height));
+    }
+    if (cellSize <= 0) {
+        std::nth_element(sides.begin(), sides.begin() + sides.size() / 2, sides.end());
+        cellSize = sides[sides.size() / 2] * kCellBoxes;
+    }
+    m_cellSize = std::max(kMinCellSize, cellSize);
+    m_origin = extent.tl();
+    
+    // A few scattered boxes over a large frame would leave most cells empty
+    const int64_t maxCells = std::max(kMinCells, kCellsPerBox * static_cast<int64_t>(m_bounds.size()));
+    for (;;) {
+        m_cols = std::max(1, (extent.width + m_cellSize - 1) / m_cellSize);
+        m_rows = std::max(1, (extent.height + m_cellSize - 1) / m_cellSize);
+        if (static_cast<int64_t>(m_cols) * m_rows <= maxCells || m_cellSize > std::numeric_limits<int>::max() / 2) {
+            break;
+        }
+        m_cellSize *= 2;
+    }
+    
+    // Count the boxes per cell, then fill the flat cell array in box order
+    m_cellStart.assign(static_cast<size_t>(m_cols) * m_rows + 1, 0);
+    for (const cv::Rect &box : m_bounds) {
+        cv::Rect span = cellSpan(box);
+        for (int cy = span.y; cy < span.y + span.height; ++cy) {
+            for (int cx = span.x; cx < span.x + span.width; ++cx) {
+                ++m_cellStart[static_cast<size_t>(cy) * m_cols + cx + 1];
+            }
+        }
+    }
+    std::partial_sum(m_cellStart.begin(), m_cellStart.end(), m_cellStart.begin());
+    
+    m_cellItems.resize(m_cellStart.back());
+    std::vector<int> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+    for (int i = 0; i < static_cast<int>(m_bounds.size()); ++i) {
+        cv::Rect span = cellSpan(m_bounds[i]);
+        for (int cy = span.y; cy < span.y + span.height; ++cy) {
+            for (int cx = span.x; cx < span.x + span.width; ++cx) {
+                m_cellItems[fill[static_cast<size_t>(cy) * m_cols + cx]++] = i;
+            }
+        }
+    }
+}
+
+void DefectIndex::build(const std::vector<CoreDefect> &defects, int cellSize)
+{
+    std::vector<cv::Rect> boxes;
+    boxes.reserve(defects.size());
+    for (const CoreDefect &defect : defects) {
+        boxes.push_back(defect.bounds);
+    }
+    build(boxes, cellSize);
+}
+
+void DefectIndex::clear()
+{
+    m_bounds.clear();
+    m_cellStart.clear();
+    m_cellItems.clear();
+    m_origin = cv::Point();
+    m_cellSize = kMinCellSize;
+    m_cols = 0;
+    m_rows = 0;
+}
+
+size_t DefectIndex::size() const
+{
+    return m_bounds.size();
+}
+
+bool DefectIndex::empty() const
+{
+    return m_bounds.empty();
+}
+
+int DefectIndex::cellSize() const
+{
+    return m_cellSize;
+}
+
+const cv::Rect &DefectIndex::bounds(int index) const
+{
+    return m_bounds[index];
+}
+
+std::vector<int> DefectIndex::intersecting(const cv::Rect &area) const
+{
+    std::vector<int> found;
+    visit(area, [&](int index) { found.push_back(index); });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+std::vector<int> DefectIndex::withinRadius(const cv::Point2f &center, float radius) const
+{
+    std::vector<int> found;
+    if (radius < 0.0f) {
+        return found;
+    }
+    
+    // Distance from the center to the nearest point of each candidate box
+    const int reach = static_cast<int>(std::ceil(radius));
+    const cv::Rect area(static_cast<int>(std::floor(center.x)) - reach, static_cast<int>(std::floor(center.y)) - reach,
+                        2 * reach + 2, 2 * reach + 2);
+    const float radiusSquared = radius * radius;
+    visit(area, [&](int index) {
+        const cv::Rect &box = m_bounds[index];
+        float dx = std::max({static_cast<float>(box.x) - center.x, 0.0f, center.x - static_cast<float>(box.x + box.width)});
+        float dy = std::max({static_cast<float>(box.y) - center.y, 0.0f, center.y - static_cast<float>(box.y + box.height)});
+        if (dx * dx + dy * dy <= radiusSquared) {
+            found.push_back(index);
+        }
+    });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+std::vector<int> DefectIndex::withinAnnulus(const cv::Point2f &center, float innerRadius, float outerRadius) const
+{
+    std::vector<int> found;
+    if (outerRadius <= 0.0f || innerRadius >= outerRadius) {
+        return found;
+    }
+    
+    // A box's center lies inside the box, so boxes touching the outer square cover every candidate
+    const int reach = static_cast<int>(std::ceil(outerRadius));
+    const cv::Rect area(static_cast<int>(std::floor(center.x)) - reach, static_cast<int>(std::floor(center.y)) - reach,
+                        2 * reach + 2, 2 * reach + 2);
+    const float innerSquared = std::max(0.0f, innerRadius) * std::max(0.0f, innerRadius);
+    const float outerSquared = outerRadius * outerRadius;
+    visit(area, [&](int index) {
+        const cv::Rect &box = m_bounds[index];
+        float dx = box.x + box.width / 2.0f - center.x;
+        float dy = box.y + box.height / 2.0f - center.y;
+        float distanceSquared = dx * dx + dy * dy;
+        if (distanceSquared >= innerSquared && distanceSquared < outerSquared) {
+            found.push_back(index);
+        }
+    });
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+int DefectIndex::hitTest(const cv::Point &point, int tolerance) const
+{
+    // Nested or overlapping boxes resolve to the most specific one
+    int best = -1;
+    visit(grow(cv::Rect(point, cv::Size(1, 1)), std::max(0, tolerance)), [&](int index) {
+        if (best < 0 || m_bounds[index].area() < m_bounds[best].area() ||
+            (m_bounds[index].area() == m_bounds[best].area() && index < best)) {
+            best = index;
+        }
+    });
+    return best;
+}
+
+std::vector<std::vector<int>> DefectIndex::clusters(int maxGap) const
+{
+    return clusters(maxGap, [](int, int) { return true; });
+}
+
+template <typename Predicate>
+std::vector<std::vector<int>> DefectIndex::clusters(int maxGap, Predicate joins) const
+{
+    const int count = static_cast<int>(m_bounds.size());
+    std::vector<int> parent(count);
+    std::iota(parent.begin(), parent.end(), 0);
+    
+    // Boxes at most maxGap pixels apart overlap once one of them grows by maxGap + 1
+    if (maxGap >= 0) {
+        for (int i = 0; i < count; ++i) {
+            visit(grow(m_bounds[i], maxGap + 1), [&](int j) {
+                if (j > i && joins(i, j)) {
+                    int rootI = findRoot(parent, i);
+                    int rootJ = findRoot(parent, j);
+                    if (rootI != rootJ) {
+                        parent[std::max(rootI, rootJ)] = std::min(rootI, rootJ);
+                    }
+                }
+            });
+        }
+    }
+    
+    // Roots are the smallest index of their group, so groups come out ordered by first box
+    std::vector<std::vector<int>> groups;
+    std::vector<int> groupOfRoot(count, -1);
+    for (int i = 0; i < count; ++i) {
+        int root = findRoot(parent, i);
+        if (groupOfRoot[root] < 0) {
+            groupOfRoot[root] = static_cast<int>(groups.size());
+            groups.emplace_back();
+        }
+        groups[groupOfRoot[root]].push_back(i);
+    }
+    return groups;
+}
+
+std::vector<cv::Rect> DefectIndex::mergeFragments(const std::vector<cv::Rect> &boxes, int maxGap)
+{
+    if (maxGap < 0 || boxes.size() < 2) {
+        return boxes;
+    }
+    
+    DefectIndex index;
+    index.build(boxes);
+    
+    // Unbounded chaining of every close box would swallow dense contamination
+    // into a few large boxes that then classify as chips or scratches
+    std::vector<cv::Rect> merged;
+    const auto fragmentOf = [&](int i, int j) { return continuesFragment(boxes[i], boxes[j]); };
+    for (const std::vector<int> &group : index.clusters(maxGap, fragmentOf)) {
+        cv::Rect united = boxes[group.front()];
+        for (int member : group) {
+            united |= boxes[member];
+        }
+        merged.push_back(united);
+    }
+    return merged;
+}
+
+template <typename Visitor>
+void DefectIndex::visit(const cv::Rect &area, Visitor visitor) const
+{
+    if (m_bounds.empty() || area.width <= 0 || area.height <= 0) {
+        return;
+    }
+    
+    // A box spanning several cells is reported only from the first cell it
+    // shares with the query, so no per-query bookkeeping is needed
+    const cv::Rect span = cellSpan(area);
+    for (int cy = span.y; cy < span.y + span.height; ++cy) {
+        for (int cx = span.x; cx < span.x + span.width; ++cx) {
+            const size_t cell = static_cast<size_t>(cy) * m_cols + cx;
+            for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k) {
+                const int index = m_cellItems[k];
+                const cv::Rect &box = m_bounds[index];
+                const cv::Rect boxSpan = cellSpan(box);
+                if (std::max(boxSpan.x, span.x) != cx || std::max(boxSpan.y, span.y) != cy) {
+                    continue;
+                }
+                if ((box & area).area() > 0) {
+                    visitor(index);
+                }
+            }
+        }
+    }
+}
+
+cv::Rect DefectIndex::cellSpan(const cv::Rect &box) const
+{
+    // Cells touched by the box's pixels, clipped to the grid
+    int x0 = std::min(std::max(floorDiv(box.x - m_origin.x, m_cellSize), 0), m_cols - 1);
+    int y0 = std::min(std::max(floorDiv(box.y - m_origin.y, m_cellSize), 0), m_rows - 1);
+    int x1 = std::min(std::max(floorDiv(box.x + box.width - 1 - m_origin.x, m_cellSize), 0), m_cols - 1);
+    int y1 = std::min(std::max(floorDiv(box.y + box.height - 1 - m_origin.y, m_cellSize), 0), m_rows - 1);
+    return cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
@@ -0,0 +1,185 @@
+#include "defecttracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Candidates whose size differs from the track by more than this factor never match
+const double kMaxSizeRatio = 2.0;
+
+cv::Point2d rectCenter(const cv::Rect &rect)
+{
+    return cv::Point2d(rect.x + rect.width / 2.0, rect.y + rect.height / 2.0);
+}
+}
+
+DefectTracker::DefectTracker()
+    : m_cellSize(32)
+    , m_maxMisses(3)
+    , m_confirmHits(2)
+    , m_nextId(1)
+{
+}
+
+DefectTracker::~DefectTracker()
+{
+}
+
+void DefectTracker::reset()
+{
+    m_tracks.clear();
+    m_grid.clear();
+    m_nextId = 1;
+}
+
+void DefectTracker::setCellSize(int pixels)
+{
+    m_cellSize = std::max(4, pixels);
+}
+
+void DefectTracker::setMaxMisses(int frames)
+{
+    m_maxMisses = std::max(0, frames);
+}
+
+void DefectTracker::setConfirmHits(int frames)
+{
+    m_confirmHits = std::max(1, frames);
+}
+
+std::vector<int> DefectTracker::update(const std::vector<cv::Rect> &candidates)
+{
+    // Bucket the existing tracks by center cell
+    m_grid.clear();
+    for (int i = 0; i < static_cast<int>(m_tracks.size()); ++i) {
+        cv::Point2d center = rectCenter(m_tracks[i].bounds);
+        int cellX = static_cast<int>(std::floor(center.x / m_cellSize));
+        int cellY = static_cast<int>(std::floor(center.y / m_cellSize));
+        m_grid[cellKey(cellX, cellY)].push_back(i);
+    }
+    
+    std::vector<bool> matched(m_tracks.size(), false);
+    std::vector<int> assignment(candidates.size(), -1);
+    
+    // Greedy nearest match within the 3x3 neighbourhood of each candidate
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        const cv::Rect &candidate = candidates[c];
+        cv::Point2d center = rectCenter(candidate);
+        int cellX = static_cast<int>(std::floor(center.x / m_cellSize));
+        int cellY = static_cast<int>(std::floor(center.y / m_cellSize));
+        
+        int best = -1;
+        double bestCost = std::numeric_limits<double>::max();
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                auto cell = m_grid.find(cellKey(cellX + dx, cellY + dy));
+                if (cell == m_grid.end()) {
+                    continue;
+                }
+                for (int index : cell->second) {
+                    if (matched[index]) {
+                        continue;
+                    }
+                    double cost = matchCost(m_tracks[index], candidate);
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        best = index;
+                    }
+                }
+            }
+        }
+        
+        if (best >= 0) {
+            DefectTrack &track = m_tracks[best];
+            track.bounds = candidate;
+            ++track.hits;
+            track.misses = 0;
+            matched[best] = true;
+            assignment[c] = best;
+        }
+    }
+    
+    // Age unmatched tracks and update confidences
+    for (size_t i = 0; i < m_tracks.size(); ++i) {
+        DefectTrack &track = m_tracks[i];
+        if (!matched[i]) {
+            ++track.misses;
+        }
+        float seen = std::min(1.0f, static_cast<float>(track.hits) / (m_confirmHits + 1));
+        track.confidence = seen * (1.0f - static_cast<float>(track.misses) / (m_maxMisses + 1));
+    }
+    
+    // Retire lost tracks, keeping assignment indices valid
+    std::vector<int> remap(m_tracks.size(), -1);
+    std::vector<DefectTrack> kept;
+    kept.reserve(m_tracks.size() + candidates.size());
+    for (size_t i = 0; i < m_tracks.size(); ++i) {
+        if (m_tracks[i].misses <= m_maxMisses) {
+            remap[i] = static_cast<int>(kept.size());
+            kept.push_back(m_tracks[i]);
+        }
+    }
+    m_tracks.swap(kept);
+    for (int &index : assignment) {
+        if (index >= 0) {
+            index = remap[index];
+        }
+    }
+    
+    // New tracks for candidates nobody claimed
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (assignment[c] >= 0) {
+            continue;
+        }
+        DefectTrack track;
+        track.id = m_nextId++;
+        track.bounds = candidates[c];
+        track.hits = 1;
+        track.confidence = 1.0f / (m_confirmHits + 1);
+        assignment[c] = static_cast<int>(m_tracks.size());
+        m_tracks.push_back(track);
+    }
+    
+    return assignment;
+}
+
+std::vector<DefectTrack> &DefectTracker::tracks()
+{
+    return m_tracks;
+}
+
+const std::vector<DefectTrack> &DefectTracker::tracks() const
+{
+    return m_tracks;
+}
+
+bool DefectTracker::isConfirmed(const DefectTrack &track) const
+{
+    return track.hits >= m_confirmHits;
+}
+
+int64_t DefectTracker::cellKey(int cellX, int cellY) const
+{
+    return (static_cast<int64_t>(cellX) << 32) ^ static_cast<int64_t>(static_cast<uint32_t>(cellY));
+}
+
+double DefectTracker::matchCost(const DefectTrack &track, const cv::Rect &candidate) const
+{
+    // Position: center distance, limited to one cell
+    double distance = cv::norm(rectCenter(track.bounds) - rectCenter(candidate));
+    if (distance > m_cellSize) {
+        return std::numeric_limits<double>::max();
+    }
+    
+    // Shape: both extents must stay within kMaxSizeRatio
+    double widthRatio = static_cast<double>(std::max(track.bounds.width, candidate.width)) /
+                        std::max(1, std::min(track.bounds.width, candidate.width));
+    double heightRatio = static_cast<double>(std::max(track.bounds.height, candidate.height)) /
+                         std::max(1, std::min(track.bounds.height, candidate.height));
+    if (widthRatio > kMaxSizeRatio || heightRatio > kMaxSizeRatio) {
+        return std::numeric_limits<double>::max();
+    }
+    
+    return distance / m_cellSize + (widthRatio - 1.0) + (heightRatio - 1.0);
+}
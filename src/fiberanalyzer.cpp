@@ -1,19 +1,144 @@
 #include "fiberanalyzer.h"
+#include "defectindex.h"
+#include "tiledprocessor.h"
+#include "mappedimage.h"
 
 #include <QDebug>
 #include <QMutexLocker>
 #include <QRect>
 #include <QPoint>
-#include <QPainter>
 #include <QColor>
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+QString FiberAnalysisResult::summary() const
+{
+    // Create a human-readable summary of the analysis results
+    if (!error.isEmpty()) {
+        return QString("Analysis error: %1").arg(error);
+    }
+    if (qualityIssue != FrameQualityIssue::None) {
+        return QString("Analysis skipped: %1").arg(ImageQualityChecker::issueDescription(qualityIssue));
+    }
+    
+    QString summary;
+    
+    // Overall status
+    if (isAcceptable) {
+        summary += "PASS: Fiber meets quality standards.\n";
+    } else {
+        summary += "FAIL: Fiber does not meet quality standards.\n";
+    }
+    
+    // Add measurement information
+    summary += QString("Core-Cladding Ratio: %1 (Ideal: %2)\n")
+              .arg(coreCladRatio, 0, 'f', 3)
+              .arg(idealCoreCladRatio, 0, 'f', 3);
+    
+    summary += QString("Concentricity: %1\n")
+              .arg(concentricity, 0, 'f', 3);
+    
+    summary += QString("Overall Quality Score: %1\n")
+              .arg(overallQuality, 0, 'f', 2);
+    
+    // Add defect information
+    summary += QString("Defects found: %1\n").arg(defects.size());
+    
+    // Per-zone counts by defect center, through a grid over the defect boxes
+    if (geometry.isValid() && !defects.isEmpty()) {
+        std::vector<cv::Rect> boxes;
+        boxes.reserve(defects.size());
+        for (const FiberDefect &defect : defects) {
+            const QRect &box = defect.boundingBox;
+            boxes.emplace_back(box.x(), box.y(), box.width(), box.height());
+        }
+        DefectIndex index;
+        index.build(boxes);
+        summary += QString("Defects in core: %1, in cladding: %2\n")
+                  .arg(index.withinAnnulus(geometry.center, 0.0f, geometry.coreRadius).size())
+                  .arg(index.withinAnnulus(geometry.center, geometry.coreRadius, geometry.claddingRadius).size());
+    }
+    
+    if (!defects.isEmpty()) {
+        summary += "Defect List:\n";
+        for (int i = 0; i < defects.size(); ++i) {
+            const FiberDefect &defect = defects[i];
+            summary += QString("%1. %2 (Severity: %3)\n")
+                      .arg(i + 1)
+                      .arg(defect.description())
+                      .arg(defect.severity, 0, 'f', 2);
+        }
+    }
+    
+    return summary;
+}
+
+AnnotationOverlay FiberAnalysisResult::overlay() const
+{
+    AnnotationOverlay overlay;
+    
+    // Draw detected defects with different colors based on type and severity
+    for (const auto &defect : defects) {
+        QColor color;
+        
+        // Choose color based on defect type
+        switch (defect.type) {
+            case FiberDefect::DefectType::Scratch:
+                color = QColor(255, 165, 0);  // Orange
+                break;
+            case FiberDefect::DefectType::Chip:
+                color = QColor(255, 0, 0);    // Red
+                break;
+            case FiberDefect::DefectType::Crack:
+                color = QColor(255, 0, 255);  // Magenta
+                break;
+            case FiberDefect::DefectType::Contamination:
+                color = QColor(0, 255, 255);  // Cyan
+                break;
+            default:
+                color = QColor(128, 128, 128); // Gray
+                break;
+        }
+        
+        // Adjust opacity based on severity (more opaque = more severe)
+        color.setAlphaF(0.3 + (defect.severity * 0.7));
+        
+        // Draw the defect bounding box
+        overlay.addRect(defect.boundingBox, color, 2, DefectLayer);
+        
+        // Add label with defect type and severity
+        QString label = QString("%1 (%2)")
+                      .arg(defect.description())
+                      .arg(defect.severity, 0, 'f', 2);
+        overlay.addLabel(defect.boundingBox, label, LabelLayer);
+    }
+    
+    // Draw fiber center and measurements from the geometry found during analysis
+    if (!geometry.isValid()) {
+        return overlay;
+    }
+    QPoint center(cvRound(geometry.center.x), cvRound(geometry.center.y));
+    
+    // Draw cladding circle
+    overlay.addCircle(center, cvRound(geometry.claddingRadius), QColor(0, 255, 0), 2, GeometryLayer);
+    
+    // Draw core circle
+    overlay.addCircle(center, cvRound(geometry.coreRadius), QColor(0, 0, 255), 2, GeometryLayer);
+    
+    // Draw center point
+    overlay.addPoint(center, Qt::red, 3, GeometryLayer);
+    
+    return overlay;
+}
+
 FiberAnalyzer::FiberAnalyzer()
-    : m_idealCoreCladRatio(0.8)
-    , m_maxAllowedDefects(5.0)
-    , m_useGPUAcceleration(false)
+    : m_useGPUAcceleration(false)
 {
     // Initialize with default parameters
 }
@@ -26,8 +151,7 @@ FiberAnalyzer::~FiberAnalyzer()
 void FiberAnalyzer::setReferenceParameters(double idealCoreCladRatio, double maxAllowedDefects)
 {
     QMutexLocker locker(&m_mutex);
-    m_idealCoreCladRatio = idealCoreCladRatio;
-    m_maxAllowedDefects = maxAllowedDefects;
+    m_core.setReferenceParameters(idealCoreCladRatio, maxAllowedDefects);
 }
 
 FiberAnalysisResult FiberAnalyzer::analyzeImage(const QImage &processedImage)
@@ -36,63 +160,143 @@ FiberAnalysisResult FiberAnalyzer::analyzeImage(const QImage &processedImage)
     
     FiberAnalysisResult result;
     
-    // Initialize default result values
-    result.isAcceptable = true;
-    result.coreCladRatio = 0.0;
-    result.concentricity = 0.0;
-    result.overallQuality = 1.0; // 1.0 is perfect, 0.0 is unusable
-    result.defects.clear();
-    result.annotatedImage = processedImage.copy();
-    result.summary = "No defects detected.";
+    try {
+        // The core works on an 8-bit gray view; only color frames are converted
+        result = fromCoreResult(m_core.analyze(toGray(processedImage)));
+    } catch (const cv::Exception &e) {
+        qWarning() << "OpenCV exception during analysis: " << e.what();
+        result.isAcceptable = false;
+        result.error = QString::fromLocal8Bit(e.what());
+    }
+    
+    return result;
+}
+
+FiberAnalysisResult FiberAnalyzer::analyzeMosaic(const QString &filePath, int tileSize)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    FiberAnalysisResult result;
     
     try {
-        // Convert QImage to OpenCV Mat
-        cv::Mat cvImage = QImage2Mat(processedImage);
-        
-        // Detect fiber center
-        QPoint center = detectFiberCenter(processedImage);
-        
-        // Measure fiber properties
-        QPair<double, double> coreAndCladding = detectCoreAndCladding(processedImage);
-        double coreRadius = coreAndCladding.first;
-        double claddingRadius = coreAndCladding.second;
-        
-        // Calculate core-cladding ratio
-        if (claddingRadius > 0) {
-            result.coreCladRatio = coreRadius / claddingRadius;
-        }
-        
-        // Calculate concentricity
-        if (coreRadius > 0 && claddingRadius > 0) {
-            result.concentricity = calculateConcentricity(
-                cv::Point(center.x(), center.y()), coreRadius, claddingRadius);
+        // Mosaics that map in place are tiled straight from the page cache, other
+        // binary PGM files are streamed, and anything else has to be decoded whole
+        std::unique_ptr<TileSource> source;
+        MappedImageFile mapped;
+        auto file = std::make_unique<FileTileSource>(filePath.toStdString());
+        if (mapped.open(filePath.toStdString()) && mapped.isZeroCopy(0)) {
+            mapped.setAccessPattern(MappedAccess::Random);
+            source = std::make_unique<MatTileSource>(mapped.page(0));
+        } else if (file->isOpen()) {
+            source = std::move(file);
+        } else {
+            cv::Mat image = cv::imread(filePath.toStdString(), cv::IMREAD_GRAYSCALE);
+            if (image.empty()) {
+                result.isAcceptable = false;
+                result.error = QString("Cannot read mosaic %1").arg(filePath);
+                return result;
+            }
+            source = std::make_unique<MatTileSource>(image);
         }
         
-        // Detect defects
-        result.defects = detectDefects(processedImage);
-        
-        // Analyze results
-        result.isAcceptable = isFiberAcceptable(result.defects, result.coreCladRatio);
-        
-        // Generate annotated image
-        result.annotatedImage = createAnnotatedImage(processedImage, result.defects);
-        
-        // Generate summary
-        result.summary = generateSummary(result);
-        
-        // Calculate overall quality score
-        result.overallQuality = calculateQualityScore(result);
-        
+        result = fromCoreResult(m_core.analyzeTiled(*source, tileSize));
     } catch (const cv::Exception &e) {
-        qWarning() << "OpenCV exception during analysis: " << e.what();
+        qWarning() << "OpenCV exception during mosaic analysis: " << e.what();
         result.isAcceptable = false;
-        result.summary = QString("Analysis error: %1").arg(e.what());
-    } catch (const std::exception &e) {
-        qWarning() << "Standard exception during analysis: " << e.what();
-        result.isAcceptable = false;
-        result.summary = QString("Analysis error: %1").arg(e.what());
+        result.error = QString::fromLocal8Bit(e.what());
+    }
+    
+    return result;
+}
+
+QVector<FiberAnalysisResult> FiberAnalyzer::analyzeBatch(BatchPipeline &pipeline, const QStringList &filePaths,
+                                                         int workers)
+{
+    double idealCoreCladRatio = 0.0;
+    double maxAllowedDefects = 0.0;
+    int fragmentGap = 0;
+    bool scratchDetection = true;
+    bool crackDetection = true;
+    {
+        QMutexLocker locker(&m_mutex);
+        idealCoreCladRatio = m_core.idealCoreCladRatio();
+        maxAllowedDefects = m_core.maxAllowedDefects();
+        fragmentGap = m_core.fragmentGap();
+        scratchDetection = m_core.isScratchDetectionEnabled();
+        crackDetection = m_core.isCrackDetectionEnabled();
+    }
+    
+    // Batch frames are unrelated, so each worker gets its own untracked core
+    // and no lock is held while analyzing
+    workers = std::max(1, workers);
+    std::vector<std::unique_ptr<FiberCore>> cores;
+    for (int i = 0; i < workers; ++i) {
+        cores.push_back(std::make_unique<FiberCore>());
+        cores.back()->setReferenceParameters(idealCoreCladRatio, maxAllowedDefects);
+        cores.back()->setFragmentGap(fragmentGap);
+        cores.back()->setScratchDetection(scratchDetection);
+        cores.back()->setCrackDetection(crackDetection);
     }
     
+    std::vector<std::string> files;
+    for (const QString &filePath : filePaths) {
+        files.push_back(filePath.toStdString());
+    }
+    
+    std::mutex resultsMutex;
+    std::map<std::pair<size_t, int>, FiberAnalysisResult> results;
+    pipeline.run(files, workers, [&](BatchFrame &frame, int worker) {
+        FiberAnalysisResult result;
+        if (!frame.error.empty()) {
+            result.isAcceptable = false;
+            result.error = QString::fromStdString(frame.error);
+        } else {
+            try {
+                result = fromCoreResult(cores[worker]->analyze(frame.image));
+            } catch (const cv::Exception &e) {
+                qWarning() << "OpenCV exception analyzing" << QString::fromStdString(frame.path) << ":" << e.what();
+                result.isAcceptable = false;
+                result.error = QString::fromLocal8Bit(e.what());
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        results[std::make_pair(frame.index, frame.page)] = result;
+    });
+    
+    QVector<FiberAnalysisResult> ordered;
+    ordered.reserve(static_cast<int>(results.size()));
+    for (const auto &entry : results) {
+        ordered.append(entry.second);
+    }
+    return ordered;
+}
+
+FiberAnalysisResult FiberAnalyzer::fromCoreResult(const CoreAnalysisResult &analysis)
+{
+    FiberAnalysisResult result;
+    result.isAcceptable = analysis.isAcceptable;
+    result.degraded = analysis.degraded;
+    result.qualityIssue = analysis.qualityIssue;
+    result.coreCladRatio = analysis.coreCladRatio;
+    result.idealCoreCladRatio = analysis.idealCoreCladRatio;
+    result.concentricity = analysis.concentricity;
+    result.overallQuality = analysis.overallQuality;
+    result.analysisTimeMs = analysis.analysisTimeMs;
+    result.geometry = analysis.geometry;
+    result.roi = QRect(analysis.roi.x, analysis.roi.y, analysis.roi.width, analysis.roi.height);
+    result.coreCoverage = analysis.coreCoverage.fraction();
+    result.claddingCoverage = analysis.claddingCoverage.fraction();
+    
+    result.defects.reserve(static_cast<int>(analysis.defects.size()));
+    for (const CoreDefect &defect : analysis.defects) {
+        result.defects.append(toFiberDefect(defect));
+    }
+    
+    if (!analysis.error.empty()) {
+        qWarning() << "Exception during analysis: " << analysis.error.c_str();
+        result.error = QString::fromStdString(analysis.error);
+    }
     return result;
 }
 
@@ -186,60 +390,19 @@ QVector<FiberDefect> FiberAnalyzer::detectDefects(const QImage &image)
     QVector<FiberDefect> defects;
     
     try {
-        cv::Mat cvImage = QImage2Mat(image);
-        
-        // Convert to grayscale
-        cv::Mat gray;
-        if (cvImage.channels() > 1) {
-            cv::cvtColor(cvImage, gray, cv::COLOR_BGR2GRAY);
-        } else {
-            gray = cvImage.clone();
+        cv::Mat gray = toGray(image);
+        int fragmentGap = 0;
+        {
+            QMutexLocker locker(&m_mutex);
+            fragmentGap = m_core.fragmentGap();
         }
         
-        // Apply adaptive threshold to identify potential defects
-        cv::Mat binary;
-        cv::adaptiveThreshold(gray, binary, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, 
-                            cv::THRESH_BINARY_INV, 11, 2);
-        
-        // Find contours of potential defects
-        std::vector<std::vector<cv::Point>> contours;
-        cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-        
-        // Filter contours by size and create defects
-        for (const auto &contour : contours) {
-            double area = cv::contourArea(contour);
-            if (area > 20 && area < 500) {  // Adjust thresholds for expected defect sizes
-                cv::Rect boundingRect = cv::boundingRect(contour);
-                
-                // Create a defect
-                FiberDefect defect;
-                defect.type = classifyDefect(image.copy(
-                    QRect(boundingRect.x, boundingRect.y, boundingRect.width, boundingRect.height)));
-                defect.boundingBox = QRect(boundingRect.x, boundingRect.y, 
-                                         boundingRect.width, boundingRect.height);
-                defect.severity = assessDefectSeverity(defect);
-                
-                // Set description based on type
-                switch (defect.type) {
-                    case FiberDefect::DefectType::Scratch:
-                        defect.description = "Surface scratch";
-                        break;
-                    case FiberDefect::DefectType::Chip:
-                        defect.description = "Edge chip";
-                        break;
-                    case FiberDefect::DefectType::Crack:
-                        defect.description = "Internal crack";
-                        break;
-                    case FiberDefect::DefectType::Contamination:
-                        defect.description = "Surface contamination";
-                        break;
-                    default:
-                        defect.description = "Unknown defect";
-                        break;
-                }
-                
-                defects.append(defect);
-            }
+        // Create a defect for every candidate region, fragments of one blob merged
+        const cv::Rect frameRect(0, 0, gray.cols, gray.rows);
+        for (const cv::Rect &region : DefectIndex::mergeFragments(FiberCore::detectDefectRegions(gray), fragmentGap)) {
+            const cv::Rect clamped = region & frameRect;
+            defects.append(toFiberDefect(
+                FiberCore::createDefect(region, FiberCore::classifyBounds(clamped.width, clamped.height))));
         }
     } catch (const cv::Exception &e) {
         qWarning() << "OpenCV exception in defect detection: " << e.what();
@@ -252,155 +415,126 @@ FiberDefect::DefectType FiberAnalyzer::classifyDefect(const QImage &defectRegion
 {
     // Simulate defect classification based on aspect ratio
     // In a real application, this would use machine learning or more sophisticated algorithms
-    
-    // For demonstration, we'll just use the aspect ratio of the region to classify
-    double aspectRatio = static_cast<double>(defectRegion.width()) / defectRegion.height();
-    
-    if (aspectRatio > 3.0) {
-        return FiberDefect::DefectType::Scratch;
-    } else if (aspectRatio < 0.33) {
-        return FiberDefect::DefectType::Crack;
-    } else if (defectRegion.width() > 50) {
-        return FiberDefect::DefectType::Chip;
-    } else {
-        return FiberDefect::DefectType::Contamination;
-    }
+    return FiberCore::classifyBounds(defectRegion.width(), defectRegion.height());
 }
 
 double FiberAnalyzer::assessDefectSeverity(const FiberDefect &defect)
 {
-    // Calculate severity based on defect type and size
-    // Scale from 0.0 (minor) to 1.0 (severe)
-    
-    double baseScore = 0.0;
-    
-    // Assign base score by type
-    switch (defect.type) {
-        case FiberDefect::DefectType::Scratch:
-            baseScore = 0.3;
-            break;
-        case FiberDefect::DefectType::Chip:
-            baseScore = 0.5;
-            break;
-        case FiberDefect::DefectType::Crack:
-            baseScore = 0.8;
-            break;
-        case FiberDefect::DefectType::Contamination:
-            baseScore = 0.2;
-            break;
-        default:
-            baseScore = 0.4;
-            break;
-    }
-    
-    // Adjust by size (area)
-    double area = defect.boundingBox.width() * defect.boundingBox.height();
-    double sizeFactor = std::min(1.0, area / 1000.0);
-    
-    // Calculate final severity
-    return std::min(1.0, baseScore + (sizeFactor * 0.5));
+    return FiberCore::assessSeverity(defect.type, toCoreDefect(defect).bounds);
 }
 
 bool FiberAnalyzer::isFiberAcceptable(const QVector<FiberDefect> &defects, double coreCladRatio)
 {
-    // Check if the fiber meets quality standards
-    
-    // Count critical defects (severity > 0.7)
-    int criticalDefects = 0;
-    double totalSeverity = 0.0;
-    
-    for (const auto &defect : defects) {
-        if (defect.severity > 0.7) {
-            criticalDefects++;
-        }
-        totalSeverity += defect.severity;
+    std::vector<CoreDefect> coreDefects;
+    coreDefects.reserve(defects.size());
+    for (const FiberDefect &defect : defects) {
+        coreDefects.push_back(toCoreDefect(defect));
     }
     
-    // Check core-cladding ratio is within tolerance
-    bool ratioAcceptable = (coreCladRatio >= 0.7 * m_idealCoreCladRatio) && 
-                         (coreCladRatio <= 1.3 * m_idealCoreCladRatio);
-    
-    // Check if total severity is below threshold
-    bool severityAcceptable = totalSeverity < m_maxAllowedDefects;
-    
-    // Check if critical defects are below threshold
-    bool criticalAcceptable = criticalDefects < 2;
-    
-    // Fiber is acceptable if all criteria are met
-    return ratioAcceptable && severityAcceptable && criticalAcceptable;
+    QMutexLocker locker(&m_mutex);
+    return m_core.isAcceptable(coreDefects, coreCladRatio);
 }
 
-QImage FiberAnalyzer::createAnnotatedImage(const QImage &original, const QVector<FiberDefect> &defects)
+QImage FiberAnalyzer::createAnnotatedImage(const QImage &original, const FiberAnalysisResult &result, int layers)
 {
-    QImage annotated = original.copy();
-    QPainter painter(&annotated);
-    
-    // Draw detected defects with different colors based on type and severity
-    for (const auto &defect : defects) {
-        QColor color;
-        
-        // Choose color based on defect type
-        switch (defect.type) {
-            case FiberDefect::DefectType::Scratch:
-                color = QColor(255, 165, 0);  // Orange
-                break;
-            case FiberDefect::DefectType::Chip:
-                color = QColor(255, 0, 0);    // Red
-                break;
-            case FiberDefect::DefectType::Crack:
-                color = QColor(255, 0, 255);  // Magenta
-                break;
-            case FiberDefect::DefectType::Contamination:
-                color = QColor(0, 255, 255);  // Cyan
-                break;
-            default:
-                color = QColor(128, 128, 128); // Gray
-                break;
-        }
-        
-        // Adjust opacity based on severity (more opaque = more severe)
-        color.setAlphaF(0.3 + (defect.severity * 0.7));
-        
-        // Draw the defect bounding box
-        painter.setPen(QPen(color, 2));
-        painter.setBrush(Qt::NoBrush);
-        painter.drawRect(defect.boundingBox);
-        
-        // Add label with defect type and severity
-        QString label = QString("%1 (%.2f)")
-                      .arg(defect.description)
-                      .arg(defect.severity);
-        
-        QFont font = painter.font();
-        font.setPointSize(8);
-        painter.setFont(font);
-        
-        painter.setPen(Qt::white);
-        painter.drawText(
-            defect.boundingBox.adjusted(0, -20, 0, 0),
-            Qt::AlignTop | Qt::AlignHCenter,
-            label
-        );
-    }
-    
-    // Draw fiber center and measurements
-    QPoint center = detectFiberCenter(original);
-    QPair<double, double> radii = detectCoreAndCladding(original);
-    
-    // Draw cladding circle
-    painter.setPen(QPen(QColor(0, 255, 0), 2));
-    painter.setBrush(Qt::NoBrush);
-    painter.drawEllipse(center, static_cast<int>(radii.second), static_cast<int>(radii.second));
-    
-    // Draw core circle
-    painter.setPen(QPen(QColor(0, 0, 255), 2));
-    painter.drawEllipse(center, static_cast<int>(radii.first), static_cast<int>(radii.first));
-    
-    // Draw center point
-    painter.setPen(QPen(Qt::red, 3));
-    painter.drawPoint(center);
-    
-    return annotated;
+    // Only exports pay for a burned-in copy of the frame
+    return result.overlay().render(original, layers);
+}
+
+void FiberAnalyzer::setFrameBudget(double milliseconds)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setFrameBudget(milliseconds);
+}
+
+double FiberAnalyzer::frameBudget()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.frameBudget();
+}
+
+AnalysisTimings FiberAnalyzer::lastTimings()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.lastTimings();
+}
+
+void FiberAnalyzer::setDefectTracking(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setDefectTracking(enable);
+}
+
+bool FiberAnalyzer::isDefectTrackingEnabled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.isDefectTrackingEnabled();
+}
+
+void FiberAnalyzer::setFragmentGap(int pixels)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setFragmentGap(pixels);
+}
+
+int FiberAnalyzer::fragmentGap()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.fragmentGap();
+}
+
+void FiberAnalyzer::setScratchDetection(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setScratchDetection(enable);
+}
+
+bool FiberAnalyzer::isScratchDetectionEnabled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.isScratchDetectionEnabled();
+}
+
+void FiberAnalyzer::setCrackDetection(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setCrackDetection(enable);
+}
+
+bool FiberAnalyzer::isCrackDetectionEnabled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.isCrackDetectionEnabled();
+}
+
+void FiberAnalyzer::setQualityCheck(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setQualityCheck(enable);
+}
+
+bool FiberAnalyzer::isQualityCheckEnabled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.isQualityCheckEnabled();
+}
+
+void FiberAnalyzer::setGeometryTracking(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_core.setGeometryTracking(enable);
+}
+
+bool FiberAnalyzer::isGeometryTrackingEnabled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.isGeometryTrackingEnabled();
+}
+
+FiberGeometry FiberAnalyzer::lastGeometry()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_core.lastGeometry();
 }
 
 void FiberAnalyzer::enableGPUAcceleration(bool enable)
@@ -447,114 +581,42 @@ cv::Mat FiberAnalyzer::preProcessForAnalysis(const cv::Mat &inputImage)
     return processed;
 }
 
-std::vector<cv::Rect> FiberAnalyzer::detectDefectRegions(const cv::Mat &processedImage)
-{
-    // Use thresholding to identify potential defects
-    cv::Mat binary;
-    cv::adaptiveThreshold(processedImage, binary, 255, 
-                        cv::ADAPTIVE_THRESH_GAUSSIAN_C, 
-                        cv::THRESH_BINARY_INV, 11, 2);
-    
-    // Find contours of potential defects
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-    
-    // Convert contours to rectangles
-    std::vector<cv::Rect> defectRegions;
-    for (const auto &contour : contours) {
-        double area = cv::contourArea(contour);
-        if (area > 20 && area < 500) {  // Filter by size
-            cv::Rect boundingRect = cv::boundingRect(contour);
-            defectRegions.push_back(boundingRect);
-        }
-    }
-    
-    return defectRegions;
-}
-
-double FiberAnalyzer::calculateConcentricity(const cv::Point &center, double coreRadius, double claddingRadius)
+cv::Mat FiberAnalyzer::toGray(const QImage &image)
 {
-    // Calculate how well-centered the core is within the cladding
-    // 1.0 means perfectly centered, 0.0 means completely off-center
-    
-    if (claddingRadius <= 0) {
-        return 0.0;
-    }
-    
-    // The maximum possible distance between centers is the cladding radius
-    double maxDistance = claddingRadius - coreRadius;
-    if (maxDistance <= 0) {
-        return 1.0;  // Core and cladding are basically the same
+    // Grayscale frames are wrapped in place; anything else is converted once
+    cv::Mat cvImage = QImage2Mat(image);
+    if (cvImage.channels() == 1) {
+        return cvImage;
     }
     
-    // For this demo, we'll just return a simulated value
-    // In a real application, we would calculate the actual distance between centers
-    
-    // Simulate slight off-center with value between 0.95 and 1.0
-    return 0.95 + (rand() % 5) / 100.0;
+    cv::Mat gray;
+    cv::cvtColor(cvImage, gray, cv::COLOR_BGR2GRAY);
+    return gray;
 }
 
-QString FiberAnalyzer::generateSummary(const FiberAnalysisResult &result)
+FiberDefect FiberAnalyzer::toFiberDefect(const CoreDefect &defect)
 {
-    // Create a human-readable summary of the analysis results
-    QString summary;
-    
-    // Overall status
-    if (result.isAcceptable) {
-        summary += "PASS: Fiber meets quality standards.\n";
-    } else {
-        summary += "FAIL: Fiber does not meet quality standards.\n";
-    }
-    
-    // Add measurement information
-    summary += QString("Core-Cladding Ratio: %.3f (Ideal: %.3f)\n")
-              .arg(result.coreCladRatio)
-              .arg(m_idealCoreCladRatio);
-    
-    summary += QString("Concentricity: %.3f\n")
-              .arg(result.concentricity);
-    
-    summary += QString("Overall Quality Score: %.2f\n")
-              .arg(result.overallQuality);
-    
-    // Add defect information
-    summary += QString("Defects found: %1\n").arg(result.defects.size());
-    
-    if (!result.defects.isEmpty()) {
-        summary += "Defect List:\n";
-        for (int i = 0; i < result.defects.size(); ++i) {
-            const FiberDefect &defect = result.defects[i];
-            summary += QString("%1. %2 (Severity: %.2f)\n")
-                      .arg(i + 1)
-                      .arg(defect.description)
-                      .arg(defect.severity);
-        }
-    }
-    
-    return summary;
+    FiberDefect fiberDefect;
+    fiberDefect.type = defect.type;
+    fiberDefect.boundingBox = QRect(defect.bounds.x, defect.bounds.y, defect.bounds.width, defect.bounds.height);
+    fiberDefect.severity = defect.severity;
+    fiberDefect.trackId = defect.trackId;
+    fiberDefect.hits = defect.hits;
+    fiberDefect.confidence = defect.confidence;
+    return fiberDefect;
 }
 
-double FiberAnalyzer::calculateQualityScore(const FiberAnalysisResult &result)
+CoreDefect FiberAnalyzer::toCoreDefect(const FiberDefect &defect)
 {
-    // Calculate an overall quality score from 0.0 (worst) to 1.0 (best)
-    
-    // Start with perfect score
-    double score = 1.0;
-    
-    // Reduce score based on defects
-    for (const auto &defect : result.defects) {
-        score -= defect.severity * 0.1;  // Each defect can reduce up to 0.1
-    }
-    
-    // Reduce score based on concentricity
-    score -= (1.0 - result.concentricity) * 0.3;
-    
-    // Reduce score based on core-cladding ratio deviation
-    double ratioDifference = std::abs(result.coreCladRatio - m_idealCoreCladRatio) / m_idealCoreCladRatio;
-    score -= ratioDifference * 0.3;
-    
-    // Ensure score is between 0 and 1
-    return std::max(0.0, std::min(1.0, score));
+    CoreDefect coreDefect;
+    coreDefect.type = defect.type;
+    coreDefect.bounds = cv::Rect(defect.boundingBox.x(), defect.boundingBox.y(),
+                                 defect.boundingBox.width(), defect.boundingBox.height());
+    coreDefect.severity = defect.severity;
+    coreDefect.trackId = defect.trackId;
+    coreDefect.hits = defect.hits;
+    coreDefect.confidence = defect.confidence;
+    return coreDefect;
 }
 
 cv::Mat FiberAnalyzer::QImage2Mat(const QImage &image)
@@ -587,4 +649,4 @@ cv::Mat FiberAnalyzer::QImage2Mat(const QImage &image)
         return matNoAlpha;
     }
     }
-} 
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,642 @@
+#include "fibercore.h"
+#include "analysispolicies.h"
+#include "defectindex.h"
+#include "tiledprocessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Smoothing factor for the expected stage costs
+const double kTimingSmoothing = 0.2;
+
+// While a stage is being skipped its expected cost decays so it is retried
+const double kSkippedStageDecay = 0.95;
+
+// Longer side of the preview a mosaic's fiber is located on
+const int kMosaicOverviewSize = 2048;
+
+// Scratches broken up by the threshold leave gaps of a pixel or two
+const int kDefaultFragmentGap = 2;
+
+// Scratch search stays this far inside the cladding edge
+const int kScratchEdgeMargin = 5;
+
+// Blobs this close to a scratch line are pieces of the scratch
+const double kScratchFragmentDistance = 2.0;
+
+// Removes the regions flagged as fragments, keeping the order of the rest
+void removeFragments(std::vector<cv::Rect> &regions, const std::vector<bool> &fragment)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        if (!fragment[i]) {
+            regions[kept++] = regions[i];
+        }
+    }
+    regions.resize(kept);
+}
+
+// Drops threshold blobs lying on a detected scratch; they are its fragments
+void dropScratchFragments(std::vector<cv::Rect> &regions, const std::vector<ScratchSegment> &scratches)
+{
+    if (regions.empty() || scratches.empty()) {
+        return;
+    }
+    
+    DefectIndex index;
+    index.build(regions);
+    std::vector<bool> fragment(regions.size(), false);
+    for (const ScratchSegment &scratch : scratches) {
+        const cv::Point2f start(scratch.start);
+        const cv::Point2f direction = cv::Point2f(scratch.end) - start;
+        const float lengthSquared = std::max(1.0f, direction.dot(direction));
+        for (int i : index.intersecting(scratch.bounds())) {
+            // Distance from the blob's center to the segment, against the blob's own extent
+            const cv::Rect &region = regions[i];
+            const cv::Point2f center(region.x + region.width / 2.0f, region.y + region.height / 2.0f);
+            const float t = std::min(1.0f, std::max(0.0f, (center - start).dot(direction) / lengthSquared));
+            const double distance = cv::norm(center - (start + t * direction));
+            fragment[i] = fragment[i] || distance <= std::hypot(region.width, region.height) / 2.0 + kScratchFragmentDistance;
+        }
+    }
+    removeFragments(regions, fragment);
+}
+
+// Drops threshold blobs touching a crack's ridge pixels; they are pieces of the crack
+void dropCrackFragments(std::vector<cv::Rect> &regions, const std::vector<CrackCandidate> &cracks, const cv::Mat &labels)
+{
+    if (regions.empty() || cracks.empty()) {
+        return;
+    }
+    
+    DefectIndex index;
+    index.build(regions);
+    std::vector<bool> fragment(regions.size(), false);
+    for (const CrackCandidate &crack : cracks) {
+        for (int i : index.intersecting(crack.bounds)) {
+            const cv::Rect overlap = regions[i] & crack.bounds;
+            for (int y = overlap.y; y < overlap.y + overlap.height && !fragment[i]; ++y) {
+                const int *label = labels.ptr<int>(y);
+                fragment[i] = std::find(label + overlap.x, label + overlap.x + overlap.width, crack.label)
+                              != label + overlap.x + overlap.width;
+            }
+        }
+    }
+    removeFragments(regions, fragment);
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point &since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+}
+
+const char *defectTypeDescription(DefectType type)
+{
+    switch (type) {
+        case DefectType::Scratch:
+            return "Surface scratch";
+        case DefectType::Chip:
+            return "Edge chip";
+        case DefectType::Crack:
+            return "Internal crack";
+        case DefectType::Contamination:
+            return "Surface contamination";
+        default:
+            return "Unknown defect";
+    }
+}
+
+FiberCore::FiberCore()
+    : m_idealCoreCladRatio(0.8)
+    , m_maxAllowedDefects(5.0)
+    , m_qualityCheck(true)
+    , m_geometryTracking(false)
+    , m_defectTracking(false)
+    , m_fragmentGap(kDefaultFragmentGap)
+    , m_scratchDetection(true)
+    , m_crackDetection(true)
+    , m_frameBudgetMs(0.0)
+    , m_pyramidLevels(0)
+    , m_zoneMasks(kScratchEdgeMargin)
+{
+}
+
+FiberCore::~FiberCore()
+{
+}
+
+void FiberCore::setReferenceParameters(double idealCoreCladRatio, double maxAllowedDefects)
+{
+    m_idealCoreCladRatio = idealCoreCladRatio;
+    m_maxAllowedDefects = maxAllowedDefects;
+}
+
+double FiberCore::idealCoreCladRatio() const
+{
+    return m_idealCoreCladRatio;
+}
+
+double FiberCore::maxAllowedDefects() const
+{
+    return m_maxAllowedDefects;
+}
+
+void FiberCore::setFrameBudget(double milliseconds)
+{
+    m_frameBudgetMs = std::max(0.0, milliseconds);
+}
+
+double FiberCore::frameBudget() const
+{
+    return m_frameBudgetMs;
+}
+
+const AnalysisTimings &FiberCore::lastTimings() const
+{
+    return m_lastTimings;
+}
+
+void FiberCore::setQualityCheck(bool enable)
+{
+    m_qualityCheck = enable;
+}
+
+bool FiberCore::isQualityCheckEnabled() const
+{
+    return m_qualityCheck;
+}
+
+void FiberCore::setGeometryTracking(bool enable)
+{
+    m_geometryTracking = enable;
+    m_tracker.reset();
+}
+
+bool FiberCore::isGeometryTrackingEnabled() const
+{
+    return m_geometryTracking;
+}
+
+void FiberCore::setDefectTracking(bool enable)
+{
+    m_defectTracking = enable;
+    m_defectTracker.reset();
+}
+
+bool FiberCore::isDefectTrackingEnabled() const
+{
+    return m_defectTracking;
+}
+
+void FiberCore::setFragmentGap(int pixels)
+{
+    m_fragmentGap = std::max(-1, pixels);
+}
+
+int FiberCore::fragmentGap() const
+{
+    return m_fragmentGap;
+}
+
+void FiberCore::setScratchDetection(bool enable)
+{
+    m_scratchDetection = enable;
+}
+
+bool FiberCore::isScratchDetectionEnabled() const
+{
+    return m_scratchDetection;
+}
+
+void FiberCore::setCrackDetection(bool enable)
+{
+    m_crackDetection = enable;
+}
+
+bool FiberCore::isCrackDetectionEnabled() const
+{
+    return m_crackDetection;
+}
+
+const FiberGeometry &FiberCore::lastGeometry() const
+{
+    return m_lastGeometry;
+}
+
+CoreAnalysisResult FiberCore::analyze(const cv::Mat &gray)
+{
+    const auto frameStart = std::chrono::steady_clock::now();
+    AnalysisTimings timings;
+    
+    CoreAnalysisResult result;
+    result.idealCoreCladRatio = m_idealCoreCladRatio;
+    
+    // True when the next stage, at full detail, would push the frame past its budget
+    auto wouldOverrun = [&](double expectedStageMs) {
+        return m_frameBudgetMs > 0.0 && elapsedMs(frameStart) + expectedStageMs > m_frameBudgetMs;
+    };
+    
+    try {
+        if (gray.empty() || gray.type() != CV_8UC1) {
+            throw std::invalid_argument("FiberCore::analyze expects an 8-bit single channel frame");
+        }
+    
+        // Quick triage: blurry, badly exposed or empty frames would only report garbage defects
+        auto stageStart = std::chrono::steady_clock::now();
+        if (m_qualityCheck) {
+            FrameQuality quality = m_qualityChecker.check(gray);
+            result.qualityIssue = quality.issue;
+            timings.qualityCheckMs = elapsedMs(stageStart);
+            if (!quality.isUsable()) {
+                result.isAcceptable = false;
+                result.overallQuality = 0.0;
+                timings.totalMs = result.analysisTimeMs = elapsedMs(frameStart);
+                m_lastTimings = timings;
+                return result;
+            }
+        }
+    
+        // Locate the fiber once per frame; in live mode this refines the previous geometry
+        stageStart = std::chrono::steady_clock::now();
+        FiberGeometry geometry = m_geometryTracking ? m_tracker.update(gray) : FiberTracker::detect(gray);
+        m_lastGeometry = geometry;
+        result.geometry = geometry;
+        timings.localizationMs = elapsedMs(stageStart);
+    
+        // Calculate core-cladding ratio and concentricity
+        if (geometry.claddingRadius > 0) {
+            result.coreCladRatio = geometry.coreRadius / geometry.claddingRadius;
+        }
+        if (geometry.coreRadius > 0 && geometry.claddingRadius > 0) {
+            result.concentricity = calculateConcentricity(geometry);
+        }
+    
+        // From here on only the padded square around the cladding is touched,
+        // through a view; the rest of the sensor frame is background
+        result.roi = geometry.roi(gray.size());
+        const cv::Mat roi = gray(result.roi);
+        const cv::Point roiOffset = result.roi.tl();
+        m_pyramidLevels = 0;
+    
+        // Detect defects, at half resolution if full resolution would overrun the budget
+        stageStart = std::chrono::steady_clock::now();
+        bool coarseDefects = wouldOverrun(m_expectedTimings.defectDetectionMs);
+        cv::Mat defectPixels;
+        cv::Mat halfResolution;
+        if (coarseDefects) {
+            halfResolution = roiPyramid(roi, 2)[1];
+        }
+        std::vector<cv::Rect> regions = detectDefectRegions(roi, coarseDefects, &defectPixels, halfResolution);
+        regions = DefectIndex::mergeFragments(regions, m_fragmentGap);
+    
+        // Zone coverage by popcount over bit-packed masks of the ROI
+        if (geometry.isValid()) {
+            m_defectBits.assign(defectPixels);
+            m_zoneMasks.update(geometry, result.roi);
+            result.coreCoverage = m_zoneMasks.coreCoverage(m_defectBits);
+            result.claddingCoverage = m_zoneMasks.claddingCoverage(m_defectBits);
+        }
+        timings.defectDetectionMs = elapsedMs(stageStart);
+        updateExpectedTiming(m_expectedTimings.defectDetectionMs, timings.defectDetectionMs, !coarseDefects);
+    
+        // Scratches too faint for the threshold come from the line filter bank;
+        // the blobs along them are fragments and give way to the whole line
+        stageStart = std::chrono::steady_clock::now();
+        const cv::Mat &claddingMask = searchMask(geometry);
+        bool skipScratches = m_scratchDetection && wouldOverrun(m_expectedTimings.scratchDetectionMs);
+        std::vector<ScratchSegment> scratches;
+        if (m_scratchDetection && !skipScratches) {
+            scratches = m_scratchDetector.detect(roi, claddingMask);
+            dropScratchFragments(regions, scratches);
+            timings.scratchDetectionMs = elapsedMs(stageStart);
+        }
+        if (m_scratchDetection) {
+            updateExpectedTiming(m_expectedTimings.scratchDetectionMs, timings.scratchDetectionMs, !skipScratches);
+        }
+    
+        // Cracks, curved or wide, come from the multi-scale ridge filter as a further
+        // candidate source; blobs on a crack's ridge are its fragments
+        stageStart = std::chrono::steady_clock::now();
+        bool skipCracks = m_crackDetection && wouldOverrun(m_expectedTimings.crackDetectionMs);
+        std::vector<CrackCandidate> cracks;
+        if (m_crackDetection && !skipCracks) {
+            cracks = detectCracks(roi, claddingMask, scratches);
+            dropCrackFragments(regions, cracks, m_crackDetector.labels());
+            timings.crackDetectionMs = elapsedMs(stageStart);
+        }
+        if (m_crackDetection) {
+            updateExpectedTiming(m_expectedTimings.crackDetectionMs, timings.crackDetectionMs, !skipCracks);
+        }
+    
+        // Classify defects. Tracks must survive the ROI moving with the fiber, so they are
+        // kept in image coordinates.
+        stageStart = std::chrono::steady_clock::now();
+        if (m_defectTracking) {
+            std::vector<int> knownTypes(regions.size(), -1);
+            for (cv::Rect &region : regions) {
+                region += roiOffset;
+            }
+            for (const ScratchSegment &scratch : scratches) {
+                regions.push_back(scratch.bounds() + roiOffset);
+                knownTypes.push_back(static_cast<int>(DefectType::Scratch));
+            }
+            for (const CrackCandidate &crack : cracks) {
+                regions.push_back(crack.bounds + roiOffset);
+                knownTypes.push_back(static_cast<int>(DefectType::Crack));
+            }
+            result.defects = trackDefects(cv::Rect(0, 0, gray.cols, gray.rows), regions, knownTypes);
+        } else {
+            result.defects.reserve(regions.size() + scratches.size() + cracks.size());
+            const cv::Rect roiRect(0, 0, roi.cols, roi.rows);
+            for (const cv::Rect &region : regions) {
+                const cv::Rect clamped = region & roiRect;
+                DefectType type = classifyBounds(clamped.width, clamped.height);
+                result.defects.push_back(createDefect(region + roiOffset, type));
+            }
+            for (const ScratchSegment &scratch : scratches) {
+                result.defects.push_back(createDefect(scratch.bounds() + roiOffset, DefectType::Scratch));
+            }
+            for (const CrackCandidate &crack : cracks) {
+                result.defects.push_back(createDefect(crack.bounds + roiOffset, DefectType::Crack));
+            }
+        }
+        timings.classificationMs = elapsedMs(stageStart);
+    
+        result.scratches.reserve(scratches.size());
+        for (ScratchSegment &scratch : scratches) {
+            scratch.start += roiOffset;
+            scratch.end += roiOffset;
+            result.scratches.push_back(scratch);
+        }
+        result.isAcceptable = isAcceptable(result.defects, result.coreCladRatio);
+        result.degraded = coarseDefects || skipScratches || skipCracks;
+        result.overallQuality = calculateQualityScore(result);
+    
+    } catch (const cv::Exception &e) {
+        result.isAcceptable = false;
+        result.error = e.what();
+    } catch (const std::exception &e) {
+        result.isAcceptable = false;
+        result.error = e.what();
+    }
+    
+    timings.totalMs = result.analysisTimeMs = elapsedMs(frameStart);
+    m_lastTimings = timings;
+    
+    return result;
+}
+
+CoreAnalysisResult FiberCore::analyzeTiled(TileSource &source, int tileSize)
+{
+    const auto start = std::chrono::steady_clock::now();
+    AnalysisTimings timings;
+    
+    CoreAnalysisResult result;
+    result.idealCoreCladRatio = m_idealCoreCladRatio;
+    
+    try {
+        TiledOptions options;
+        options.tileSize = tileSize;
+        TiledProcessor tiled(options);
+    
+        // The cladding spans most of the mosaic, so a preview is enough to locate it
+        auto stageStart = std::chrono::steady_clock::now();
+        cv::Mat preview = tiled.overview(source, kMosaicOverviewSize);
+        if (preview.empty()) {
+            throw std::invalid_argument("FiberCore::analyzeTiled could not read the mosaic");
+        }
+        FiberGeometry geometry = FiberTracker::detect(preview);
+        const float scale = static_cast<float>(source.size().width) / preview.cols;
+        geometry.center *= scale;
+        geometry.claddingRadius *= scale;
+        geometry.coreRadius *= scale;
+        result.geometry = geometry;
+        result.roi = cv::Rect(cv::Point(), source.size());
+        timings.localizationMs = elapsedMs(stageStart);
+    
+        if (geometry.claddingRadius > 0) {
+            result.coreCladRatio = geometry.coreRadius / geometry.claddingRadius;
+        }
+        if (geometry.coreRadius > 0 && geometry.claddingRadius > 0) {
+            result.concentricity = calculateConcentricity(geometry);
+        }
+    
+        // Detection and bounding-box classification stream over full resolution tiles
+        stageStart = std::chrono::steady_clock::now();
+        result.defects = tiled.detectDefects(source);
+        if (!tiled.lastStats().complete) {
+            throw std::runtime_error("FiberCore::analyzeTiled could not process every tile");
+        }
+        timings.defectDetectionMs = elapsedMs(stageStart);
+    
+        result.isAcceptable = isAcceptable(result.defects, result.coreCladRatio);
+        result.overallQuality = calculateQualityScore(result);
+    
+    } catch (const cv::Exception &e) {
+        result.isAcceptable = false;
+        result.error = e.what();
+    } catch (const std::exception &e) {
+        result.isAcceptable = false;
+        result.error = e.what();
+    }
+    
+    timings.totalMs = result.analysisTimeMs = elapsedMs(start);
+    m_lastTimings = timings;
+    
+    return result;
+}
+
+std::vector<CoreDefect> FiberCore::trackDefects(const cv::Rect &frameRect, const std::vector<cv::Rect> &regions,
+                                                const std::vector<int> &knownTypes)
+{
+    std::vector<int> assignment = m_defectTracker.update(regions);
+    
+    // Candidates whose type is already known (scratch lines) label their new tracks directly
+    for (size_t c = 0; c < assignment.size(); ++c) {
+        if (assignment[c] >= 0 && knownTypes[c] >= 0 && m_defectTracker.tracks()[assignment[c]].label < 0) {
+            m_defectTracker.tracks()[assignment[c]].label = knownTypes[c];
+        }
+    }
+    
+    std::vector<CoreDefect> defects;
+    for (DefectTrack &track : m_defectTracker.tracks()) {
+        // Only new tracks are classified; existing tracks keep their class.
+        // Smoothed bounds can reach past the frame edge, so they are clamped first.
+        if (track.label < 0) {
+            const cv::Rect clamped = track.bounds & frameRect;
+            track.label = static_cast<int>(classifyBounds(clamped.width, clamped.height));
+        }
+    
+        // Single-frame flickers are not reported; briefly missed tracks are held
+        if (!m_defectTracker.isConfirmed(track)) {
+            continue;
+        }
+    
+        CoreDefect defect = createDefect(track.bounds, static_cast<DefectType>(track.label));
+        defect.trackId = track.id;
+        defect.hits = track.hits;
+        defect.confidence = track.confidence;
+        defects.push_back(defect);
+    }
+    
+    return defects;
+}
+
+const cv::Mat &FiberCore::searchMask(const FiberGeometry &geometry) const
+{
+    // Line and ridge searches stay inside the cladding: the boundary and the
+    // background beyond it are not endface. The disc is cached with the zone
+    // masks, which this frame's geometry has already updated; without a fiber
+    // the whole ROI is searched.
+    static const cv::Mat wholeRoi;
+    return geometry.isValid() ? m_zoneMasks.searchArea() : wholeRoi;
+}
+
+std::vector<cv::Mat> FiberCore::roiPyramid(const cv::Mat &roi, int levels)
+{
+    // Halved levels are built once per frame, on first use, into buffers kept across frames
+    std::vector<cv::Mat> pyramid(1, roi);
+    if (static_cast<int>(m_roiPyramid.size()) < levels - 1) {
+        m_roiPyramid.resize(levels - 1);
+    }
+    for (int level = 1; level < levels; ++level) {
+        if (level > m_pyramidLevels) {
+            cv::pyrDown(pyramid.back(), m_roiPyramid[level - 1]);
+            m_pyramidLevels = level;
+        }
+        pyramid.push_back(m_roiPyramid[level - 1]);
+    }
+    return pyramid;
+}
+
+std::vector<CrackCandidate> FiberCore::detectCracks(const cv::Mat &roi, const cv::Mat &searchMask,
+                                                    const std::vector<ScratchSegment> &scratches)
+{
+    // A scratch is a ridge too; it is cleared as wide as the coarsest scale
+    // responds, so the same line is not also reported as a crack
+    const CrackOptions &options = m_crackDetector.options();
+    cv::Mat mask = searchMask;
+    if (!scratches.empty()) {
+        if (searchMask.empty()) {
+            m_crackMask.create(roi.size(), CV_8UC1);
+            m_crackMask.setTo(cv::Scalar(255));
+        } else {
+            searchMask.copyTo(m_crackMask);
+        }
+        const int width = 2 * cvRound(3.0 * options.sigma * (1 << (options.scales - 1))) + 1;
+        for (const ScratchSegment &scratch : scratches) {
+            cv::line(m_crackMask, scratch.start, scratch.end, cv::Scalar(0), width);
+        }
+        mask = m_crackMask;
+    }
+    
+    // The coarse defect pass may already have built the first halved level
+    return m_crackDetector.detect(roiPyramid(roi, options.scales), mask);
+}
+
+std::vector<cv::Rect> FiberCore::detectDefectRegions(const cv::Mat &gray, bool coarse, cv::Mat *defectPixels,
+                                                     const cv::Mat &halfResolution)
+{
+    // Coarse mode thresholds a half resolution copy: a quarter of the pixels
+    cv::Mat source = gray;
+    int scale = 1;
+    if (coarse) {
+        if (halfResolution.empty()) {
+            cv::pyrDown(gray, source);
+        } else {
+            source = halfResolution;
+        }
+        scale = 2;
+    }
+    
+    // Use thresholding to identify potential defects
+    cv::Mat binary;
+    cv::adaptiveThreshold(source, binary, 255,
+                        cv::ADAPTIVE_THRESH_GAUSSIAN_C,
+                        cv::THRESH_BINARY_INV, 11, 2);
+    
+    // Find contours of potential defects
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    
+    // Area limits are in full resolution pixels
+    const double areaScale = scale * scale;
+    
+    // Convert contours to rectangles
+    std::vector<cv::Rect> defectRegions;
+    cv::Mat accepted;
+    if (defectPixels) {
+        accepted = cv::Mat::zeros(source.size(), CV_8UC1);
+    }
+    for (size_t i = 0; i < contours.size(); ++i) {
+        double area = cv::contourArea(contours[i]) * areaScale;
+        if (area > 20 && area < 500) {  // Filter by size
+            cv::Rect boundingRect = cv::boundingRect(contours[i]);
+            defectRegions.push_back(cv::Rect(boundingRect.x * scale, boundingRect.y * scale,
+                                             boundingRect.width * scale, boundingRect.height * scale));
+            if (defectPixels) {
+                cv::drawContours(accepted, contours, static_cast<int>(i), cv::Scalar(255), cv::FILLED);
+            }
+        }
+    }
+    
+    if (defectPixels) {
+        if (scale > 1) {
+            cv::resize(accepted, *defectPixels, gray.size(), 0, 0, cv::INTER_NEAREST);
+        } else {
+            *defectPixels = accepted;
+        }
+    }
+    
+    return defectRegions;
+}
+
+DefectType FiberCore::classifyBounds(int width, int height)
+{
+    return AspectRatioClassifier::classifyBounds(width, height);
+}
+
+double FiberCore::assessSeverity(DefectType type, const cv::Rect &bounds)
+{
+    return StandardGrader::severity(type, bounds);
+}
+
+CoreDefect FiberCore::createDefect(const cv::Rect &region, DefectType type)
+{
+    CoreDefect defect;
+    defect.type = type;
+    defect.bounds = region;
+    defect.severity = assessSeverity(type, region);
+    return defect;
+}
+
+bool FiberCore::isAcceptable(const std::vector<CoreDefect> &defects, double coreCladRatio) const
+{
+    return StandardGrader(m_idealCoreCladRatio, m_maxAllowedDefects).isAcceptable(defects, coreCladRatio);
+}
+
+double FiberCore::calculateConcentricity(const FiberGeometry &geometry) const
+{
+    return StandardGrader::concentricity(geometry);
+}
+
+double FiberCore::calculateQualityScore(const CoreAnalysisResult &result) const
+{
+    return StandardGrader(m_idealCoreCladRatio, m_maxAllowedDefects).qualityScore(result);
+}
+
+void FiberCore::updateExpectedTiming(double &expected, double measured, bool ranAtFullDetail)
+{
+    if (ranAtFullDetail) {
+        expected = (expected == 0.0) ? measured : expected + kTimingSmoothing * (measured - expected);
+    } else {
+        // Stage was downgraded: let its full cost estimate decay so it gets retried
+        expected *= kSkippedStageDecay;
+    }
+}
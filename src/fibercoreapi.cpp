@@ -0,0 +1,176 @@
+#include "fibercoreapi.h"
+#include "fibercore.h"
+#include "pixelkernels.h"
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+#include <opencv2/imgproc.hpp>
+
+struct fibercore_analyzer {
+    FiberCore core;
+    std::string lastError;
+};
+
+namespace {
+// Wraps the caller's pixels without copying; only non-gray formats are converted
+bool wrapAsGray(const void *pixels, int width, int height, size_t stride, int format, cv::Mat &gray)
+{
+    void *data = const_cast<void *>(pixels);
+    switch (format) {
+        case FIBERCORE_FORMAT_GRAY8:
+            gray = cv::Mat(height, width, CV_8UC1, data, stride);
+            return true;
+        case FIBERCORE_FORMAT_BGR8:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC3, data, stride), gray, cv::COLOR_BGR2GRAY);
+            return true;
+        case FIBERCORE_FORMAT_BGRA8:
+            cv::cvtColor(cv::Mat(height, width, CV_8UC4, data, stride), gray, cv::COLOR_BGRA2GRAY);
+            return true;
+        case FIBERCORE_FORMAT_GRAY16:
+            scaleTo8Bit(cv::Mat(height, width, CV_16UC1, data, stride), gray, 1.0 / 256.0);
+            return true;
+        default:
+            return false;
+    }
+}
+}
+
+int fibercore_api_version(void)
+{
+    return FIBERCORE_API_VERSION;
+}
+
+fibercore_analyzer *fibercore_create(void)
+{
+    return new (std::nothrow) fibercore_analyzer();
+}
+
+void fibercore_destroy(fibercore_analyzer *analyzer)
+{
+    delete analyzer;
+}
+
+void fibercore_set_reference(fibercore_analyzer *analyzer, double ideal_core_clad_ratio,
+                             double max_allowed_defects)
+{
+    if (analyzer) {
+        analyzer->core.setReferenceParameters(ideal_core_clad_ratio, max_allowed_defects);
+    }
+}
+
+void fibercore_set_frame_budget(fibercore_analyzer *analyzer, double milliseconds)
+{
+    if (analyzer) {
+        analyzer->core.setFrameBudget(milliseconds);
+    }
+}
+
+void fibercore_set_quality_check(fibercore_analyzer *analyzer, int enable)
+{
+    if (analyzer) {
+        analyzer->core.setQualityCheck(enable != 0);
+    }
+}
+
+void fibercore_set_tracking(fibercore_analyzer *analyzer, int enable)
+{
+    if (analyzer) {
+        analyzer->core.setGeometryTracking(enable != 0);
+        analyzer->core.setDefectTracking(enable != 0);
+    }
+}
+
+int fibercore_analyze(fibercore_analyzer *analyzer, const void *pixels, int width, int height,
+                      size_t stride, int format, fibercore_result *result,
+                      fibercore_defect *defects, int max_defects)
+{
+    if (!analyzer) {
+        return FIBERCORE_ERROR_INVALID_ARGUMENT;
+    }
+    if (!pixels || !result || width <= 0 || height <= 0 || max_defects < 0 || (max_defects > 0 && !defects)) {
+        analyzer->lastError = "Invalid argument";
+        return FIBERCORE_ERROR_INVALID_ARGUMENT;
+    }
+    
+    // No C++ exception may cross the C boundary
+    try {
+        cv::Mat gray;
+        if (!wrapAsGray(pixels, width, height, stride, format, gray)) {
+            analyzer->lastError = "Unsupported pixel format";
+            return FIBERCORE_ERROR_INVALID_ARGUMENT;
+        }
+    
+        CoreAnalysisResult analysis = analyzer->core.analyze(gray);
+        if (!analysis.error.empty()) {
+            analyzer->lastError = analysis.error;
+            return FIBERCORE_ERROR_ANALYSIS;
+        }
+    
+        result->is_acceptable = analysis.isAcceptable ? 1 : 0;
+        result->degraded = analysis.degraded ? 1 : 0;
+        result->quality_issue = static_cast<int>(analysis.qualityIssue);
+        result->core_clad_ratio = analysis.coreCladRatio;
+        result->concentricity = analysis.concentricity;
+        result->overall_quality = analysis.overallQuality;
+        result->analysis_time_ms = analysis.analysisTimeMs;
+        result->center_x = analysis.geometry.center.x;
+        result->center_y = analysis.geometry.center.y;
+        result->cladding_radius = analysis.geometry.claddingRadius;
+        result->core_radius = analysis.geometry.coreRadius;
+        result->defect_count = static_cast<int>(analysis.defects.size());
+    
+        int count = std::min(max_defects, result->defect_count);
+        for (int i = 0; i < count; ++i) {
+            const CoreDefect &defect = analysis.defects[i];
+            defects[i].type = static_cast<int>(defect.type);
+            defects[i].x = defect.bounds.x;
+            defects[i].y = defect.bounds.y;
+            defects[i].width = defect.bounds.width;
+            defects[i].height = defect.bounds.height;
+            defects[i].severity = defect.severity;
+            defects[i].track_id = defect.trackId;
+            defects[i].hits = defect.hits;
+            defects[i].confidence = defect.confidence;
+        }
+    } catch (const std::exception &e) {
+        analyzer->lastError = e.what();
+        return FIBERCORE_ERROR_ANALYSIS;
+    }
+    
+    analyzer->lastError.clear();
+    return FIBERCORE_OK;
+}
+
+const char *fibercore_last_error(const fibercore_analyzer *analyzer)
+{
+    return analyzer ? analyzer->lastError.c_str() : "Invalid analyzer handle";
+}
+
+const char *fibercore_defect_description(int type)
+{
+    if (type < 0 || type > static_cast<int>(DefectType::Unknown)) {
+        type = static_cast<int>(DefectType::Unknown);
+    }
+    return defectTypeDescription(static_cast<DefectType>(type));
+}
+
+int fibercore_force_isa(const char *name)
+{
+    if (!name || std::string(name) == "auto") {
+        resetCpuIsa();
+        return FIBERCORE_OK;
+    }
+    
+    CpuIsa isa;
+    if (!parseCpuIsa(name, isa) || !forceCpuIsa(isa)) {
+        return FIBERCORE_ERROR_INVALID_ARGUMENT;
+    }
+    return FIBERCORE_OK;
+}
+
+const char *fibercore_active_isa(void)
+{
+    return cpuIsaName(activeCpuIsa());
+}
@@ -0,0 +1,326 @@
+#include "fibertracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Core radius relative to cladding until a real core detector exists
+const float kCoreToCladdingRatio = 0.8f;
+
+// Radial edge test: samples around the circle and minimum step in gray levels
+const int kEdgeSamples = 64;
+const float kEdgeOffset = 3.0f;
+const int kEdgeContrast = 10;
+
+// Rays that must find the rim before a refined circle is trusted
+const float kMinRimFraction = 0.5f;
+
+// Cached zone masks are rebuilt once the fiber moves by this much
+const float kCacheTolerance = 0.5f;
+
+// Margin around the cladding in the analysis ROI: a fraction of the radius,
+// and at least enough for the defect threshold's neighbourhood at the rim
+const float kRoiPaddingFraction = 0.1f;
+const float kMinRoiPadding = 16.0f;
+
+// Mean of the 3x3 neighbourhood, so single noisy pixels do not move the rim
+float boxSample(const cv::Mat &gray, const cv::Point &p)
+{
+    int sum = 0;
+    for (int y = p.y - 1; y <= p.y + 1; ++y) {
+        const uchar *row = gray.ptr<uchar>(y);
+        sum += row[p.x - 1] + row[p.x] + row[p.x + 1];
+    }
+    return sum / 9.0f;
+}
+
+FiberGeometry circleToGeometry(const cv::Vec3f &circle)
+{
+    FiberGeometry geometry;
+    geometry.center = cv::Point2f(circle[0], circle[1]);
+    geometry.claddingRadius = circle[2];
+    geometry.coreRadius = circle[2] * kCoreToCladdingRatio;
+    return geometry;
+}
+}
+
+cv::Rect FiberGeometry::roi(const cv::Size &frameSize) const
+{
+    const cv::Rect frame(0, 0, frameSize.width, frameSize.height);
+    if (!isValid()) {
+        return frame;
+    }
+    
+    const float halfSide = claddingRadius + std::max(kMinRoiPadding, claddingRadius * kRoiPaddingFraction);
+    const cv::Point topLeft(cvFloor(center.x - halfSide), cvFloor(center.y - halfSide));
+    const cv::Point bottomRight(cvCeil(center.x + halfSide), cvCeil(center.y + halfSide));
+    const cv::Rect square = cv::Rect(topLeft, bottomRight) & frame;
+    return square.empty() ? frame : square;
+}
+
+ZoneBitMasks::ZoneBitMasks(int searchMargin)
+    : m_searchMargin(std::max(0, searchMargin))
+    , m_corePixels(0)
+    , m_claddingPixels(0)
+{
+}
+
+void ZoneBitMasks::update(const FiberGeometry &geometry, const cv::Rect &roi)
+{
+    bool moved = std::abs(geometry.center.x - m_geometry.center.x) > kCacheTolerance ||
+                 std::abs(geometry.center.y - m_geometry.center.y) > kCacheTolerance ||
+                 std::abs(geometry.claddingRadius - m_geometry.claddingRadius) > kCacheTolerance ||
+                 std::abs(geometry.coreRadius - m_geometry.coreRadius) > kCacheTolerance;
+    if (!moved && roi == m_roi && !m_core.empty()) {
+        return;
+    }
+    
+    // Drawn straight into the packed masks, one span per row
+    const cv::Point2f center = geometry.center - cv::Point2f(static_cast<float>(roi.x), static_cast<float>(roi.y));
+    m_core.create(roi.size());
+    m_core.fillCircle(center, geometry.coreRadius);
+    m_cladding.create(roi.size());
+    m_cladding.fillCircle(center, geometry.claddingRadius);
+    m_cladding.andNot(m_core);
+    
+    m_searchArea = cv::Mat::zeros(roi.size(), CV_8UC1);
+    const int searchRadius = cvRound(geometry.claddingRadius) - m_searchMargin;
+    if (searchRadius > 0) {
+        cv::circle(m_searchArea, cv::Point(cvRound(center.x), cvRound(center.y)), searchRadius, cv::Scalar(255), cv::FILLED);
+    }
+    
+    m_corePixels = m_core.count();
+    m_claddingPixels = m_cladding.count();
+    m_geometry = geometry;
+    m_roi = roi;
+}
+
+const BitMask &ZoneBitMasks::core() const
+{
+    return m_core;
+}
+
+const BitMask &ZoneBitMasks::cladding() const
+{
+    return m_cladding;
+}
+
+const cv::Mat &ZoneBitMasks::searchArea() const
+{
+    return m_searchArea;
+}
+
+ZoneCoverage ZoneBitMasks::coreCoverage(const BitMask &mask) const
+{
+    ZoneCoverage coverage;
+    coverage.zonePixels = m_corePixels;
+    coverage.coveredPixels = mask.countAnd(m_core);
+    return coverage;
+}
+
+ZoneCoverage ZoneBitMasks::claddingCoverage(const BitMask &mask) const
+{
+    ZoneCoverage coverage;
+    coverage.zonePixels = m_claddingPixels;
+    coverage.coveredPixels = mask.countAnd(m_cladding);
+    return coverage;
+}
+
+FiberTracker::FiberTracker()
+    : m_confidenceThreshold(0.6)
+    , m_searchMargin(8)
+    , m_lastUpdateTracked(false)
+    , m_fullDetections(0)
+{
+}
+
+FiberTracker::~FiberTracker()
+{
+}
+
+void FiberTracker::reset()
+{
+    m_geometry = FiberGeometry();
+    m_lastUpdateTracked = false;
+    m_fullDetections = 0;
+}
+
+void FiberTracker::setConfidenceThreshold(double threshold)
+{
+    m_confidenceThreshold = std::max(0.0, std::min(threshold, 1.0));
+}
+
+void FiberTracker::setSearchMargin(int pixels)
+{
+    m_searchMargin = std::max(2, pixels);
+}
+
+FiberGeometry FiberTracker::update(const cv::Mat &gray)
+{
+    FiberGeometry tracked = m_geometry;
+    
+    // Cheap path: refine the previous circle locally and keep it if it is still well supported
+    if (m_geometry.isValid() && refine(gray, tracked) && tracked.confidence >= m_confidenceThreshold) {
+        m_geometry = tracked;
+        m_lastUpdateTracked = true;
+        return m_geometry;
+    }
+    
+    // Lost track (or first frame): full search
+    m_geometry = detect(gray);
+    m_lastUpdateTracked = false;
+    ++m_fullDetections;
+    return m_geometry;
+}
+
+const FiberGeometry &FiberTracker::geometry() const
+{
+    return m_geometry;
+}
+
+bool FiberTracker::lastUpdateWasTracked() const
+{
+    return m_lastUpdateTracked;
+}
+
+int FiberTracker::fullDetectionCount() const
+{
+    return m_fullDetections;
+}
+
+FiberGeometry FiberTracker::detect(const cv::Mat &gray)
+{
+    cv::Mat blurred;
+    cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 0);
+    
+    std::vector<cv::Vec3f> circles;
+    cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT, 1,
+                     blurred.rows / 8, 100, 30, 0, 0);
+    
+    if (circles.empty()) {
+        // No fiber found: report the image center with no radius
+        FiberGeometry geometry;
+        geometry.center = cv::Point2f(gray.cols / 2.0f, gray.rows / 2.0f);
+        return geometry;
+    }
+    
+    // Use the largest circle as the cladding
+    cv::Vec3f largest = circles[0];
+    for (const auto &circle : circles) {
+        if (circle[2] > largest[2]) {
+            largest = circle;
+        }
+    }
+    
+    FiberGeometry geometry = circleToGeometry(largest);
+    geometry.confidence = edgeSupport(blurred, geometry.center, geometry.claddingRadius);
+    return geometry;
+}
+
+float FiberTracker::edgeSupport(const cv::Mat &gray, const cv::Point2f &center, float radius)
+{
+    if (radius <= kEdgeOffset) {
+        return 0.0f;
+    }
+    
+    const cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    int supported = 0;
+    
+    for (int i = 0; i < kEdgeSamples; ++i) {
+        double angle = 2.0 * CV_PI * i / kEdgeSamples;
+        float dx = static_cast<float>(std::cos(angle));
+        float dy = static_cast<float>(std::sin(angle));
+        
+        cv::Point inside(cvRound(center.x + dx * (radius - kEdgeOffset)), cvRound(center.y + dy * (radius - kEdgeOffset)));
+        cv::Point outside(cvRound(center.x + dx * (radius + kEdgeOffset)), cvRound(center.y + dy * (radius + kEdgeOffset)));
+        if (!bounds.contains(inside) || !bounds.contains(outside)) {
+            continue;
+        }
+        
+        int step = std::abs(static_cast<int>(gray.at<uchar>(inside)) - static_cast<int>(gray.at<uchar>(outside)));
+        if (step >= kEdgeContrast) {
+            ++supported;
+        }
+    }
+    
+    return static_cast<float>(supported) / kEdgeSamples;
+}
+
+bool FiberTracker::refine(const cv::Mat &gray, FiberGeometry &geometry)
+{
+    const float radius = geometry.claddingRadius;
+    const int margin = std::max(m_searchMargin, cvRound(radius * 0.05f));
+    const int minRadius = std::max(1, cvFloor(radius) - margin);
+    const int maxRadius = cvCeil(radius) + margin;
+    
+    // Only the annulus within the margin of the previous rim is read: along each
+    // ray the strongest step in the band is taken as the rim, and the circle is
+    // fitted to those points. The endface inside the band is never touched.
+    const cv::Rect inner(1, 1, gray.cols - 2, gray.rows - 2);
+    std::vector<float> profile(maxRadius - minRadius + 3);
+    cv::Mat fitA(0, 3, CV_64F), fitB(0, 1, CV_64F);
+    for (int i = 0; i < kEdgeSamples; ++i) {
+        double angle = 2.0 * CV_PI * i / kEdgeSamples;
+        float dx = static_cast<float>(std::cos(angle));
+        float dy = static_cast<float>(std::sin(angle));
+        
+        bool inside = true;
+        for (size_t s = 0; s < profile.size() && inside; ++s) {
+            const float r = static_cast<float>(minRadius - 1 + static_cast<int>(s));
+            const cv::Point p(cvRound(geometry.center.x + dx * r), cvRound(geometry.center.y + dy * r));
+            inside = inner.contains(p);
+            if (inside) {
+                profile[s] = boxSample(gray, p);
+            }
+        }
+        if (!inside) {
+            continue;
+        }
+        
+        size_t strongest = 0;
+        float strongestStep = 0.0f;
+        for (size_t s = 1; s + 1 < profile.size(); ++s) {
+            float step = std::abs(profile[s + 1] - profile[s - 1]);
+            if (step > strongestStep) {
+                strongest = s;
+                strongestStep = step;
+            }
+        }
+        if (strongestStep < kEdgeContrast) {
+            continue;
+        }
+        
+        // Algebraic circle fit, relative to the previous centre for conditioning
+        const double r = minRadius - 1 + static_cast<int>(strongest);
+        const double x = dx * r;
+        const double y = dy * r;
+        fitA.push_back(cv::Mat(cv::Matx13d(x, y, 1.0)));
+        fitB.push_back(-(x * x + y * y));
+    }
+    if (fitA.rows < kEdgeSamples * kMinRimFraction) {
+        return false;
+    }
+    
+    cv::Mat solution;
+    if (!cv::solve(fitA, fitB, solution, cv::DECOMP_SVD)) {
+        return false;
+    }
+    const double centerX = -solution.at<double>(0) / 2.0;
+    const double centerY = -solution.at<double>(1) / 2.0;
+    const double squaredRadius = centerX * centerX + centerY * centerY - solution.at<double>(2);
+    if (squaredRadius <= 0.0) {
+        return false;
+    }
+    const float fitted = static_cast<float>(std::sqrt(squaredRadius));
+    if (std::hypot(centerX, centerY) > margin || std::abs(fitted - radius) > margin) {
+        return false;
+    }
+    
+    const cv::Point2f center(geometry.center.x + static_cast<float>(centerX),
+                             geometry.center.y + static_cast<float>(centerY));
+    geometry = circleToGeometry(cv::Vec3f(center.x, center.y, fitted));
+    geometry.confidence = edgeSupport(gray, center, fitted);
+    return true;
+}
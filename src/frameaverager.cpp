@@ -0,0 +1,183 @@
+#include "frameaverager.h"
+#include "pixelkernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Sum of 256 8-bit frames still fits in 16 bits
+const int kMaxWindowSize = 256;
+
+// Shifts below this are treated as sensor jitter and not resampled
+const double kMinShiftPixels = 0.25;
+
+// Correlation runs on a half-resolution copy of each frame
+const int kCorrelationScale = 2;
+
+// 16-bit frames keep their high byte, as in batch and C API input
+const double kSixteenToEightBit = 1.0 / 256.0;
+}
+
+FrameAverager::FrameAverager(int windowSize)
+    : m_windowSize(std::max(1, std::min(windowSize, kMaxWindowSize)))
+    , m_motionCompensation(true)
+    , m_lastShift(0.0, 0.0)
+{
+}
+
+FrameAverager::~FrameAverager()
+{
+}
+
+void FrameAverager::setWindowSize(int windowSize)
+{
+    m_windowSize = std::max(1, std::min(windowSize, kMaxWindowSize));
+    reset();
+}
+
+int FrameAverager::windowSize() const
+{
+    return m_windowSize;
+}
+
+int FrameAverager::frameCount() const
+{
+    return static_cast<int>(m_frames.size());
+}
+
+void FrameAverager::reset()
+{
+    m_frames.clear();
+    m_sum.release();
+    m_reference.release();
+    m_lastShift = cv::Point2d(0.0, 0.0);
+}
+
+void FrameAverager::setMotionCompensation(bool enable)
+{
+    m_motionCompensation = enable;
+    reset();
+}
+
+bool FrameAverager::isMotionCompensationEnabled() const
+{
+    return m_motionCompensation;
+}
+
+cv::Point2d FrameAverager::lastShift() const
+{
+    return m_lastShift;
+}
+
+cv::Mat FrameAverager::addFrame(const cv::Mat &frame)
+{
+    if (frame.empty()) {
+        return cv::Mat();
+    }
+    
+    cv::Mat gray = toGray(frame);
+    
+    // A change of resolution invalidates the whole window
+    if (!m_sum.empty() && m_sum.size() != gray.size()) {
+        reset();
+    }
+    
+    if (m_sum.empty()) {
+        m_sum = cv::Mat::zeros(gray.size(), CV_16UC1);
+    }
+    
+    cv::Mat aligned = m_motionCompensation ? alignToReference(gray) : gray.clone();
+    
+    // O(1) per frame: add the newest frame, subtract the one leaving the window
+    if (static_cast<int>(m_frames.size()) >= m_windowSize) {
+        accumulate(aligned, &m_frames.front());
+        m_frames.pop_front();
+    } else {
+        accumulate(aligned, nullptr);
+    }
+    m_frames.push_back(aligned);
+    
+    cv::Mat average;
+    scaleTo8Bit(m_sum, average, 1.0 / m_frames.size());
+    return average;
+}
+
+cv::Mat FrameAverager::toGray(const cv::Mat &frame)
+{
+    cv::Mat gray;
+    if (frame.channels() == 4) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGRA2GRAY);
+    } else if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = frame;
+    }
+    
+    // raw16 dumps and 16-bit PGM/TIFF pages would otherwise saturate to white
+    if (gray.depth() == CV_16U) {
+        cv::Mat scaled;
+        scaleTo8Bit(gray, scaled, kSixteenToEightBit);
+        return scaled;
+    }
+    if (gray.depth() != CV_8U) {
+        cv::Mat converted;
+        gray.convertTo(converted, CV_8U);
+        return converted;
+    }
+    return gray;
+}
+
+cv::Mat FrameAverager::toCorrelationInput(const cv::Mat &gray)
+{
+    cv::Mat small, input;
+    cv::resize(gray, small, cv::Size(), 1.0 / kCorrelationScale, 1.0 / kCorrelationScale, cv::INTER_AREA);
+    small.convertTo(input, CV_32F);
+    return input;
+}
+
+cv::Mat FrameAverager::alignToReference(const cv::Mat &gray)
+{
+    cv::Mat input = toCorrelationInput(gray);
+    
+    // The first frame of a window becomes the alignment anchor
+    if (m_reference.empty() || m_frames.empty()) {
+        m_reference = input;
+        cv::createHanningWindow(m_hanningWindow, m_reference.size(), CV_32F);
+        m_lastShift = cv::Point2d(0.0, 0.0);
+        return gray.clone();
+    }
+    
+    cv::Point2d shift = cv::phaseCorrelate(m_reference, input, m_hanningWindow);
+    shift *= static_cast<double>(kCorrelationScale);
+    m_lastShift = shift;
+    
+    // Large motion means the operator moved the connector: start a new window
+    const double maxShift = std::min(gray.cols, gray.rows) / 8.0;
+    if (std::abs(shift.x) > maxShift || std::abs(shift.y) > maxShift) {
+        m_frames.clear();
+        m_sum.setTo(0);
+        m_reference = input;
+        return gray.clone();
+    }
+    
+    if (std::abs(shift.x) < kMinShiftPixels && std::abs(shift.y) < kMinShiftPixels) {
+        return gray.clone();
+    }
+    
+    // Translate the frame back onto the anchor
+    cv::Mat transform = (cv::Mat_<double>(2, 3) << 1, 0, -shift.x, 0, 1, -shift.y);
+    cv::Mat aligned;
+    cv::warpAffine(gray, aligned, transform, gray.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    return aligned;
+}
+
+void FrameAverager::accumulate(const cv::Mat &added, const cv::Mat *removed)
+{
+    // Dispatched to the widest vector unit the CPU has. Arithmetic wraps
+    // modulo 2^16, which is exact because the true sum never leaves the
+    // 16-bit range.
+    accumulateFrame(m_sum, added, removed);
+}
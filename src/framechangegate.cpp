@@ -0,0 +1,112 @@
+#include "framechangegate.h"
+#include "pixelkernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+// Cells along the shorter side of the thumbnail at least; sets the cell
+// size, which in turn sets the smallest change a cell can see
+const int kMinGridSize = 240;
+}
+
+FrameChangeGate::FrameChangeGate()
+    : m_globalThreshold(2.0)
+    , m_cellThreshold(12.0)
+    , m_maxSkippedFrames(30)
+    , m_skippedSinceAnalysis(0)
+    , m_skippedTotal(0)
+    , m_lastGlobalDifference(0.0)
+    , m_lastMaxCellDifference(0.0)
+{
+}
+
+FrameChangeGate::~FrameChangeGate()
+{
+}
+
+void FrameChangeGate::reset()
+{
+    m_reference.release();
+    m_skippedSinceAnalysis = 0;
+    m_skippedTotal = 0;
+    m_lastGlobalDifference = 0.0;
+    m_lastMaxCellDifference = 0.0;
+}
+
+void FrameChangeGate::setGlobalThreshold(double grayLevels)
+{
+    m_globalThreshold = std::max(0.0, grayLevels);
+}
+
+void FrameChangeGate::setCellThreshold(double grayLevels)
+{
+    m_cellThreshold = std::max(0.0, grayLevels);
+}
+
+void FrameChangeGate::setMaxSkippedFrames(int frames)
+{
+    m_maxSkippedFrames = std::max(0, frames);
+}
+
+bool FrameChangeGate::shouldAnalyze(const cv::Mat &gray)
+{
+    if (gray.empty() || gray.type() != CV_8UC1) {
+        return true;
+    }
+    
+    cv::Mat current = thumbnail(gray);
+    
+    bool changed = m_reference.empty() || m_reference.size() != current.size();
+    if (!changed) {
+        // A single vectorized pass over the thumbnail cells
+        int maxCell = 0;
+        int64_t total = absDifference(current, m_reference, maxCell);
+        
+        m_lastGlobalDifference = static_cast<double>(total) / current.total();
+        m_lastMaxCellDifference = maxCell;
+        
+        changed = m_lastGlobalDifference > m_globalThreshold ||
+                  m_lastMaxCellDifference > m_cellThreshold ||
+                  (m_maxSkippedFrames > 0 && m_skippedSinceAnalysis >= m_maxSkippedFrames);
+    }
+    
+    if (changed) {
+        m_reference = current;
+        m_skippedSinceAnalysis = 0;
+        return true;
+    }
+    
+    ++m_skippedSinceAnalysis;
+    ++m_skippedTotal;
+    return false;
+}
+
+double FrameChangeGate::lastGlobalDifference() const
+{
+    return m_lastGlobalDifference;
+}
+
+double FrameChangeGate::lastMaxCellDifference() const
+{
+    return m_lastMaxCellDifference;
+}
+
+uint64_t FrameChangeGate::skippedCount() const
+{
+    return m_skippedTotal;
+}
+
+cv::Mat FrameChangeGate::thumbnail(const cv::Mat &gray) const
+{
+    // True area average of square cells: every pixel counts, so a spot
+    // smaller than a cell still moves it by the spot's share of the cell
+    // (a quarter of its contrast for a 4x4 spot in an 8x8 cell). An integer
+    // factor keeps cv::resize on its fast INTER_AREA path; the few pixels
+    // past the last full cell are left out.
+    const int factor = std::max(1, std::min(gray.cols, gray.rows) / kMinGridSize);
+    const cv::Size grid(gray.cols / factor, gray.rows / factor);
+    cv::Mat result;
+    cv::resize(gray(cv::Rect(0, 0, grid.width * factor, grid.height * factor)), result, grid, 0, 0, cv::INTER_AREA);
+    return result;
+}
@@ -0,0 +1,486 @@
+#include "framesource.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+namespace {
+std::string lowerExtension(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+bool isImageExtension(const std::string &extension)
+{
+    static const char *imageExtensions[] = {
+        ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".pgm", ".ppm"
+    };
+    for (const char *candidate : imageExtensions) {
+        if (extension == candidate) {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+// FrameSource
+
+FrameSource::FrameSource()
+    : m_frameRate(0.0)
+    , m_loop(true)
+    , m_nextFrameTime(std::chrono::steady_clock::now())
+{
+}
+
+FrameSource::~FrameSource()
+{
+}
+
+void FrameSource::setFrameRate(double framesPerSecond)
+{
+    m_frameRate = std::max(0.0, framesPerSecond);
+    m_nextFrameTime = std::chrono::steady_clock::now();
+}
+
+double FrameSource::frameRate() const
+{
+    return m_frameRate;
+}
+
+void FrameSource::setLooping(bool loop)
+{
+    m_loop = loop;
+}
+
+bool FrameSource::isLooping() const
+{
+    return m_loop;
+}
+
+void FrameSource::waitForNextFrame()
+{
+    if (m_frameRate <= 0.0) {
+        return;
+    }
+    
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / m_frameRate));
+    
+    auto now = std::chrono::steady_clock::now();
+    if (m_nextFrameTime > now) {
+        std::this_thread::sleep_until(m_nextFrameTime);
+        m_nextFrameTime += interval;
+    } else {
+        // Running late: do not try to catch up with a burst of frames
+        m_nextFrameTime = now + interval;
+    }
+}
+
+// CameraFrameSource
+
+CameraFrameSource::CameraFrameSource(int deviceIndex)
+    : m_deviceIndex(deviceIndex)
+{
+}
+
+CameraFrameSource::~CameraFrameSource()
+{
+    close();
+}
+
+bool CameraFrameSource::open()
+{
+    // Prefer V4L2 directly, then let OpenCV pick any backend
+    if (!m_capture.open(m_deviceIndex, cv::CAP_V4L2)) {
+        if (!m_capture.open(m_deviceIndex, cv::CAP_ANY)) {
+            std::cerr << "Could not open camera device " << m_deviceIndex << std::endl;
+            return false;
+        }
+    }
+    
+    // Keep the driver queue short so frames are not stale on arrival
+    m_capture.set(cv::CAP_PROP_BUFFERSIZE, 1);
+    return true;
+}
+
+void CameraFrameSource::close()
+{
+    if (m_capture.isOpened()) {
+        m_capture.release();
+    }
+}
+
+bool CameraFrameSource::isOpen() const
+{
+    return m_capture.isOpened();
+}
+
+bool CameraFrameSource::readFrame(cv::Mat &frame)
+{
+    // The driver paces camera reads, so no software pacing here
+    return m_capture.isOpened() && m_capture.read(frame) && !frame.empty();
+}
+
+std::string CameraFrameSource::description() const
+{
+    return "camera:" + std::to_string(m_deviceIndex);
+}
+
+// VideoFileFrameSource
+
+VideoFileFrameSource::VideoFileFrameSource(const std::string &filePath)
+    : m_filePath(filePath)
+{
+}
+
+VideoFileFrameSource::~VideoFileFrameSource()
+{
+    close();
+}
+
+bool VideoFileFrameSource::open()
+{
+    if (!m_capture.open(m_filePath)) {
+        std::cerr << "Could not open video file " << m_filePath << std::endl;
+        return false;
+    }
+    
+    // Play back at the recorded rate unless a rate was set explicitly
+    if (m_frameRate <= 0.0) {
+        setFrameRate(m_capture.get(cv::CAP_PROP_FPS));
+    }
+    return true;
+}
+
+void VideoFileFrameSource::close()
+{
+    if (m_capture.isOpened()) {
+        m_capture.release();
+    }
+}
+
+bool VideoFileFrameSource::isOpen() const
+{
+    return m_capture.isOpened();
+}
+
+bool VideoFileFrameSource::readFrame(cv::Mat &frame)
+{
+    if (!m_capture.isOpened()) {
+        return false;
+    }
+    
+    waitForNextFrame();
+    
+    if (m_capture.read(frame) && !frame.empty()) {
+        return true;
+    }
+    
+    if (!m_loop) {
+        return false;
+    }
+    
+    // Rewind and try once more
+    m_capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+    return m_capture.read(frame) && !frame.empty();
+}
+
+std::string VideoFileFrameSource::description() const
+{
+    return "video:" + m_filePath;
+}
+
+// ImageFileFrameSource
+
+ImageFileFrameSource::ImageFileFrameSource(const std::string &filePath)
+    : m_filePath(filePath)
+    , m_delivered(false)
+{
+}
+
+ImageFileFrameSource::~ImageFileFrameSource()
+{
+    close();
+}
+
+bool ImageFileFrameSource::open()
+{
+    m_image = cv::imread(m_filePath, cv::IMREAD_UNCHANGED);
+    m_delivered = false;
+    if (m_image.empty()) {
+        std::cerr << "Could not read image file " << m_filePath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ImageFileFrameSource::close()
+{
+    m_image.release();
+}
+
+bool ImageFileFrameSource::isOpen() const
+{
+    return !m_image.empty();
+}
+
+bool ImageFileFrameSource::readFrame(cv::Mat &frame)
+{
+    if (m_image.empty() || (m_delivered && !m_loop)) {
+        return false;
+    }
+    
+    waitForNextFrame();
+    
+    // Hand out a copy so consumers may modify the frame in place
+    frame = m_image.clone();
+    m_delivered = true;
+    return true;
+}
+
+std::string ImageFileFrameSource::description() const
+{
+    return "image:" + m_filePath;
+}
+
+// DirectoryFrameSource
+
+DirectoryFrameSource::DirectoryFrameSource(const std::string &directoryPath)
+    : m_directoryPath(directoryPath)
+    , m_nextIndex(0)
+    , m_isOpen(false)
+    , m_nextPage(0)
+{
+}
+
+DirectoryFrameSource::~DirectoryFrameSource()
+{
+    close();
+}
+
+bool DirectoryFrameSource::open()
+{
+    m_files.clear();
+    m_nextIndex = 0;
+    
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(m_directoryPath, error)) {
+        if (entry.is_regular_file() && isImageExtension(lowerExtension(entry.path()))) {
+            m_files.push_back(entry.path().string());
+        }
+    }
+    
+    if (error || m_files.empty()) {
+        std::cerr << "No readable images in directory " << m_directoryPath << std::endl;
+        return false;
+    }
+    
+    std::sort(m_files.begin(), m_files.end());
+    m_isOpen = true;
+    return true;
+}
+
+void DirectoryFrameSource::close()
+{
+    m_files.clear();
+    m_stack.close();
+    m_isOpen = false;
+}
+
+bool DirectoryFrameSource::isOpen() const
+{
+    return m_isOpen;
+}
+
+bool DirectoryFrameSource::readFrame(cv::Mat &frame)
+{
+    if (!m_isOpen) {
+        return false;
+    }
+    
+    // Pages left in the current stack come before the next file
+    if (m_stack.isOpen() && m_nextPage < m_stack.pageCount()) {
+        waitForNextFrame();
+        frame = m_stack.page(m_nextPage++);
+        return true;
+    }
+    
+    // Skip unreadable files, but give up after one full pass
+    for (size_t attempts = 0; attempts < m_files.size(); ++attempts) {
+        if (m_nextIndex >= m_files.size()) {
+            if (!m_loop) {
+                return false;
+            }
+            m_nextIndex = 0;
+        }
+        
+        const std::string &path = m_files[m_nextIndex++];
+        waitForNextFrame();
+        
+        // Uncompressed dumps are mapped instead of decoded
+        if (MappedImageFile::isSupported(path) && m_stack.open(path)) {
+            m_stack.setAccessPattern(MappedAccess::Sequential);
+            frame = m_stack.page(0);
+            m_nextPage = 1;
+            return true;
+        }
+        m_stack.close();
+        
+        frame = cv::imread(path, cv::IMREAD_UNCHANGED);
+        if (!frame.empty()) {
+            return true;
+        }
+        std::cerr << "Skipping unreadable frame " << path << std::endl;
+    }
+    
+    return false;
+}
+
+std::string DirectoryFrameSource::description() const
+{
+    return "directory:" + m_directoryPath;
+}
+
+size_t DirectoryFrameSource::frameCount() const
+{
+    return m_files.size();
+}
+
+// MappedFileFrameSource
+
+MappedFileFrameSource::MappedFileFrameSource(const std::string &filePath)
+    : m_filePath(filePath)
+    , m_rawType(CV_8UC1)
+    , m_nextPage(0)
+{
+}
+
+MappedFileFrameSource::MappedFileFrameSource(const std::string &filePath, cv::Size frameSize, int type)
+    : m_filePath(filePath)
+    , m_rawFrameSize(frameSize)
+    , m_rawType(type)
+    , m_nextPage(0)
+{
+}
+
+MappedFileFrameSource::~MappedFileFrameSource()
+{
+    close();
+}
+
+bool MappedFileFrameSource::open()
+{
+    m_nextPage = 0;
+    const bool opened = m_rawFrameSize.empty() ? m_file.open(m_filePath)
+                                               : m_file.openRaw(m_filePath, m_rawFrameSize, m_rawType);
+    if (!opened) {
+        std::cerr << "Cannot map frame dump " << m_filePath << std::endl;
+        return false;
+    }
+    
+    m_file.setAccessPattern(MappedAccess::Sequential);
+    return true;
+}
+
+void MappedFileFrameSource::close()
+{
+    m_file.close();
+}
+
+bool MappedFileFrameSource::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+bool MappedFileFrameSource::readFrame(cv::Mat &frame)
+{
+    if (!m_file.isOpen()) {
+        return false;
+    }
+    
+    if (m_nextPage >= m_file.pageCount()) {
+        if (!m_loop) {
+            return false;
+        }
+        m_nextPage = 0;
+    }
+    
+    waitForNextFrame();
+    frame = m_file.page(m_nextPage++);
+    return !frame.empty();
+}
+
+std::string MappedFileFrameSource::description() const
+{
+    return "mapped:" + m_filePath;
+}
+
+size_t MappedFileFrameSource::frameCount() const
+{
+    return m_file.pageCount();
+}
+
+// Factory
+
+bool isImageFilePath(const std::string &path)
+{
+    return isImageExtension(lowerExtension(path));
+}
+
+std::unique_ptr<FrameSource> createFrameSource(const std::string &spec)
+{
+    if (spec.empty() || spec == "camera") {
+        return std::make_unique<CameraFrameSource>(0);
+    }
+    
+    const std::string cameraPrefix = "camera:";
+    if (spec.compare(0, cameraPrefix.size(), cameraPrefix) == 0) {
+        return std::make_unique<CameraFrameSource>(std::atoi(spec.substr(cameraPrefix.size()).c_str()));
+    }
+    
+    const std::string devicePrefix = "/dev/video";
+    if (spec.compare(0, devicePrefix.size(), devicePrefix) == 0) {
+        return std::make_unique<CameraFrameSource>(std::atoi(spec.substr(devicePrefix.size()).c_str()));
+    }
+    
+    // "raw:640x480:/path" (8-bit) or "raw16:640x480:/path"
+    const bool raw8 = spec.compare(0, 4, "raw:") == 0;
+    const bool raw16 = spec.compare(0, 6, "raw16:") == 0;
+    if (raw8 || raw16) {
+        const size_t sizeStart = spec.find(':') + 1;
+        const size_t pathStart = spec.find(':', sizeStart);
+        int width = 0, height = 0;
+        if (pathStart != std::string::npos &&
+            std::sscanf(spec.substr(sizeStart, pathStart - sizeStart).c_str(), "%dx%d", &width, &height) == 2) {
+            return std::make_unique<MappedFileFrameSource>(spec.substr(pathStart + 1), cv::Size(width, height),
+                                                           raw16 ? CV_16UC1 : CV_8UC1);
+        }
+    }
+    
+    std::filesystem::path path(spec);
+    if (std::filesystem::is_directory(path)) {
+        return std::make_unique<DirectoryFrameSource>(spec);
+    }
+    
+    if (isImageExtension(lowerExtension(path))) {
+        // A stack of pages plays like a recording; a single image repeats
+        MappedImageFile stack;
+        if (MappedImageFile::isSupported(spec) && stack.open(spec) && stack.pageCount() > 1) {
+            return std::make_unique<MappedFileFrameSource>(spec);
+        }
+        return std::make_unique<ImageFileFrameSource>(spec);
+    }
+    
+    return std::make_unique<VideoFileFrameSource>(spec);
+}
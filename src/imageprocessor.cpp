@@ -1,15 +1,37 @@
 #include "imageprocessor.h"
+#include "tiledprocessor.h"
+#include "mappedimage.h"
 
 #include <QDebug>
 #include <QMutexLocker>
 #include <QFile>
 #include <QFileInfo>
 
+#include <cmath>
+#include <memory>
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+namespace {
+// Non-separable kernels at least this wide are convolved in the frequency domain
+const int kDftKernelSizeThreshold = 11;
+
+// Second singular value relative to the first below which a kernel is rank-1
+const double kSeparableTolerance = 1e-5;
+
+// Upper bound on cached kernel spectra (one per recipe and frame size)
+const int kMaxCachedSpectra = 16;
+
+// Default memory allowance for cached spectra
+const size_t kDefaultCacheBudget = 128 * 1024 * 1024;
+}
+
 ImageProcessor::ImageProcessor()
     : m_isProcessing(false)
+    , m_lastDenoiseTimeMs(0.0)
+    , m_kernelSpectrumCacheBytes(0)
+    , m_cacheBudget(kDefaultCacheBudget)
 {
     // Initialize filter names map - replace tr() with plain strings since this class doesn't inherit from QObject
     m_filterNames[FilterType::None] = "No Filter";
@@ -19,6 +41,11 @@ ImageProcessor::ImageProcessor()
     m_filterNames[FilterType::Sharpen] = "Sharpen";
     m_filterNames[FilterType::MedianBlur] = "Median Blur";
     m_filterNames[FilterType::GaussianBlur] = "Gaussian Blur";
+    
+    m_denoiseNames[DenoiseMethod::NonLocalMeansColor] = "NL-Means (Color, Slow)";
+    m_denoiseNames[DenoiseMethod::NonLocalMeansTiled] = "NL-Means (Tiled)";
+    m_denoiseNames[DenoiseMethod::Bilateral] = "Bilateral";
+    m_denoiseNames[DenoiseMethod::Guided] = "Guided (Fast)";
 }
 
 ImageProcessor::~ImageProcessor()
@@ -33,6 +60,12 @@ bool ImageProcessor::loadImage(const QString &filePath)
         return false;
     }
     
+    // Uncompressed dumps are mapped, so checking them costs a header parse, not a decode
+    MappedImageFile mapped;
+    if (MappedImageFile::isSupported(filePath.toStdString()) && mapped.open(filePath.toStdString())) {
+        return true;
+    }
+    
     // Try loading with OpenCV first
     try {
         cv::Mat img = cv::imread(filePath.toStdString());
@@ -162,6 +195,51 @@ QImage ImageProcessor::applyFilter(const QImage &sourceImage, FilterType filter)
     }
 }
 
+QImage ImageProcessor::applyFilter(const QImage &sourceImage, FilterType filter, const QRect &region)
+{
+    return processRegion(sourceImage, region, [this, filter](const QImage &image) {
+        return applyFilter(image, filter);
+    });
+}
+
+QImage ImageProcessor::processRegion(const QImage &sourceImage, const QRect &region,
+                                     const std::function<QImage(const QImage &)> &process)
+{
+    QRect bounded = region & sourceImage.rect();
+    if (sourceImage.isNull() || bounded.isEmpty() || bounded == sourceImage.rect()) {
+        return process(sourceImage);
+    }
+    
+    // The region is read through a view of the frame's pixels, not a copy
+    QImage regionView = sourceImage.depth() % 8 == 0
+        ? QImage(sourceImage.constBits() + bounded.y() * sourceImage.bytesPerLine() + bounded.x() * (sourceImage.depth() / 8),
+                 bounded.width(), bounded.height(), sourceImage.bytesPerLine(), sourceImage.format())
+        : sourceImage.copy(bounded);
+    QImage processed = process(regionView);
+    if (processed.isNull()) {
+        return processed;
+    }
+    
+    try {
+        // Outside the region the frame is only copied, matching the processed channel count
+        cv::Mat processedMat = qImageToMat(processed);
+        cv::Mat frame = qImageToMat(sourceImage);
+        cv::Mat result;
+        if (frame.channels() == processedMat.channels()) {
+            result = frame.data == sourceImage.constBits() ? frame.clone() : frame;
+        } else if (processedMat.channels() == 1) {
+            cv::cvtColor(frame, result, cv::COLOR_BGR2GRAY);
+        } else {
+            cv::cvtColor(frame, result, cv::COLOR_GRAY2BGR);
+        }
+        processedMat.copyTo(result(cv::Rect(bounded.x(), bounded.y(), bounded.width(), bounded.height())));
+        return matToQImage(result);
+    } catch (const cv::Exception &e) {
+        qWarning() << "OpenCV exception when merging a processed region: " << e.what();
+        return sourceImage;
+    }
+}
+
 QImage ImageProcessor::adjustBrightness(const QImage &sourceImage, int value)
 {
     if (sourceImage.isNull()) {
@@ -239,7 +317,14 @@ QImage ImageProcessor::enhanceFiberEdges(const QImage &sourceImage)
     }
 }
 
-QImage ImageProcessor::removeNoise(const QImage &sourceImage)
+QImage ImageProcessor::removeNoise(const QImage &sourceImage, DenoiseMethod method, const QRect &region)
+{
+    return processRegion(sourceImage, region, [this, method](const QImage &image) {
+        return removeNoise(image, method);
+    });
+}
+
+QImage ImageProcessor::removeNoise(const QImage &sourceImage, DenoiseMethod method)
 {
     if (sourceImage.isNull()) {
         return QImage();
@@ -249,8 +334,39 @@ QImage ImageProcessor::removeNoise(const QImage &sourceImage)
         cv::Mat src = qImageToMat(sourceImage);
         cv::Mat dst;
         
-        // Apply non-local means denoising
-        cv::fastNlMeansDenoisingColored(src, dst, 10, 10, 7, 21);
+        cv::TickMeter timer;
+        timer.start();
+        
+        if (method == DenoiseMethod::NonLocalMeansColor) {
+            // Apply non-local means denoising on all colour channels
+            cv::fastNlMeansDenoisingColored(src, dst, 10, 10, 7, 21);
+        } else {
+            // Endface sources are monochrome, so denoise a single channel only
+            cv::Mat gray;
+            if (src.channels() == 3 || src.channels() == 4) {
+                cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+            } else {
+                gray = src;
+            }
+            
+            switch (method) {
+                case DenoiseMethod::NonLocalMeansTiled:
+                    dst = denoiseNonLocalMeansTiled(gray);
+                    break;
+                    
+                case DenoiseMethod::Bilateral:
+                    cv::bilateralFilter(gray, dst, 7, 30.0, 5.0);
+                    break;
+                    
+                case DenoiseMethod::Guided:
+                default:
+                    dst = denoiseGuided(gray, 3, 0.005);
+                    break;
+            }
+        }
+        
+        timer.stop();
+        m_lastDenoiseTimeMs = timer.getTimeMilli();
         
         return matToQImage(dst);
     } catch (const cv::Exception &e) {
@@ -259,6 +375,16 @@ QImage ImageProcessor::removeNoise(const QImage &sourceImage)
     }
 }
 
+QString ImageProcessor::denoiseMethodName(DenoiseMethod method) const
+{
+    return m_denoiseNames.value(method, "Unknown");
+}
+
+double ImageProcessor::lastDenoiseTimeMs() const
+{
+    return m_lastDenoiseTimeMs;
+}
+
 QImage ImageProcessor::highlightDefects(const QImage &sourceImage)
 {
     if (sourceImage.isNull()) {
@@ -379,13 +505,21 @@ QImage ImageProcessor::applyCustomFilter(const QImage &sourceImage, const QVecto
         cv::Mat dst;
         
         // Create kernel from provided data
-        cv::Mat kernel(kernelSize, kernelSize, CV_32F);
+        cv::Mat kernel = cv::Mat::zeros(kernelSize, kernelSize, CV_32F);
         for (int i = 0; i < kernelSize * kernelSize && i < kernelData.size(); ++i) {
             kernel.at<float>(i / kernelSize, i % kernelSize) = kernelData[i];
         }
         
-        // Apply filter
-        cv::filter2D(src, dst, -1, kernel);
+        // Pick the cheapest equivalent of filter2D for this kernel
+        cv::Mat kernelX, kernelY;
+        if (separateKernel(kernel, kernelX, kernelY)) {
+            // Rank-1 kernel: two 1-D passes, O(2k) instead of O(k^2) per pixel
+            cv::sepFilter2D(src, dst, -1, kernelX, kernelY);
+        } else if (kernelSize >= kDftKernelSizeThreshold) {
+            dst = filterWithDFT(src, kernel);
+        } else {
+            cv::filter2D(src, dst, -1, kernel);
+        }
         
         return matToQImage(dst);
     } catch (const cv::Exception &e) {
@@ -394,6 +528,116 @@ QImage ImageProcessor::applyCustomFilter(const QImage &sourceImage, const QVecto
     }
 }
 
+bool ImageProcessor::filterLargeImage(const QString &inputPath, const QString &outputPath,
+                                      FilterType filter, int tileSize)
+{
+    try {
+        std::unique_ptr<TileSource> source;
+        auto file = std::make_unique<FileTileSource>(inputPath.toStdString());
+        if (file->isOpen()) {
+            source = std::move(file);
+        } else {
+            cv::Mat image = cv::imread(inputPath.toStdString(), cv::IMREAD_GRAYSCALE);
+            if (image.empty()) {
+                qWarning() << "Cannot read" << inputPath;
+                return false;
+            }
+            source = std::make_unique<MatTileSource>(image);
+        }
+        
+        // Each filter gets the halo its neighborhood needs; thresholds and edges are 8-bit output
+        const double maxValue = source->maxValue();
+        int halo = 0;
+        int outputType = source->type();
+        TiledProcessor::TileFunction function;
+        switch (filter) {
+            case FilterType::None:
+            case FilterType::Grayscale:
+                function = [](const cv::Mat &tile) { return tile.clone(); };
+                break;
+                
+            case FilterType::Threshold:
+                halo = 5;
+                outputType = CV_8UC1;
+                function = [maxValue](const cv::Mat &tile) {
+                    cv::Mat dst;
+                    cv::adaptiveThreshold(TiledProcessor::toGray8(tile, maxValue), dst, 255,
+                                          cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 11, 2);
+                    return dst;
+                };
+                break;
+                
+            case FilterType::EdgeDetection:
+                // Hysteresis can follow a weak edge further than any halo, so
+                // edges crossing a seam may differ slightly from a whole-image run
+                halo = 32;
+                outputType = CV_8UC1;
+                function = [maxValue](const cv::Mat &tile) {
+                    cv::Mat blurred, edges;
+                    cv::GaussianBlur(TiledProcessor::toGray8(tile, maxValue), blurred, cv::Size(5, 5), 1.5);
+                    cv::Canny(blurred, edges, 50, 150);
+                    return edges;
+                };
+                break;
+                
+            case FilterType::Sharpen:
+                halo = 1;
+                function = [](const cv::Mat &tile) {
+                    cv::Mat kernel = (cv::Mat_<float>(3, 3) <<
+                                   0, -1, 0,
+                                   -1, 5, -1,
+                                   0, -1, 0);
+                    cv::Mat dst;
+                    cv::filter2D(tile, dst, -1, kernel);
+                    return dst;
+                };
+                break;
+                
+            case FilterType::MedianBlur:
+                halo = 2;
+                function = [](const cv::Mat &tile) {
+                    cv::Mat dst;
+                    cv::medianBlur(tile, dst, 5);
+                    return dst;
+                };
+                break;
+                
+            case FilterType::GaussianBlur:
+                halo = 2;
+                function = [](const cv::Mat &tile) {
+                    cv::Mat dst;
+                    cv::GaussianBlur(tile, dst, cv::Size(5, 5), 0);
+                    return dst;
+                };
+                break;
+                
+            default:
+                qWarning() << "Filter" << m_filterNames.value(filter) << "is not available for tiled processing";
+                return false;
+        }
+        
+        FileTileSink sink(outputPath.toStdString(), source->size(), outputType);
+        if (!sink.isOpen()) {
+            qWarning() << "Cannot write" << outputPath;
+            return false;
+        }
+        
+        TiledOptions options;
+        options.tileSize = tileSize;
+        TiledProcessor tiled(options);
+        if (!tiled.filter(*source, sink, halo, function)) {
+            qWarning() << "Tiled filtering of" << inputPath << "failed";
+            return false;
+        }
+        
+        qDebug() << "Filtered" << tiled.lastStats().tiles << "tiles in" << tiled.lastStats().elapsedMs << "ms";
+        return true;
+    } catch (const cv::Exception &e) {
+        qWarning() << "OpenCV exception in filterLargeImage: " << e.what();
+        return false;
+    }
+}
+
 void ImageProcessor::cancelProcessing()
 {
     QMutexLocker locker(&m_mutex);
@@ -403,6 +647,16 @@ void ImageProcessor::cancelProcessing()
     }
 }
 
+void ImageProcessor::setCacheBudget(size_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cacheBudget = bytes;
+    if (m_kernelSpectrumCacheBytes > m_cacheBudget) {
+        m_kernelSpectrumCache.clear();
+        m_kernelSpectrumCacheBytes = 0;
+    }
+}
+
 bool ImageProcessor::isProcessing() const
 {
     return m_isProcessing;
@@ -529,4 +783,182 @@ QImage ImageProcessor::applySharpenFilter(const QImage &sourceImage)
         qWarning() << "OpenCV exception in applySharpenFilter: " << e.what();
         return sourceImage;
     }
-} 
\ No newline at end of file
+}
+
+cv::Mat ImageProcessor::denoiseNonLocalMeansTiled(const cv::Mat &gray)
+{
+    // NL-means parameters match the original colour path (h=10, 7x7 template, 21x21 search)
+    const int templateWindow = 7;
+    const int searchWindow = 21;
+    const int tileSize = 256;
+    
+    // Each tile needs enough context around it for the full search and template windows
+    const int halo = searchWindow / 2 + templateWindow / 2;
+    
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < gray.rows; y += tileSize) {
+        for (int x = 0; x < gray.cols; x += tileSize) {
+            tiles.push_back(cv::Rect(x, y,
+                                     std::min(tileSize, gray.cols - x),
+                                     std::min(tileSize, gray.rows - y)));
+        }
+    }
+    
+    cv::Mat dst(gray.size(), CV_8UC1);
+    const cv::Rect imageRect(0, 0, gray.cols, gray.rows);
+    
+    // Denoise tiles in parallel, each with its halo, and keep only the tile interior
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const cv::Rect &tile = tiles[i];
+            cv::Rect padded(tile.x - halo, tile.y - halo, tile.width + 2 * halo, tile.height + 2 * halo);
+            padded &= imageRect;
+            
+            cv::Mat denoised;
+            cv::fastNlMeansDenoising(gray(padded), denoised, 10.0f, templateWindow, searchWindow);
+            
+            cv::Rect interior(tile.x - padded.x, tile.y - padded.y, tile.width, tile.height);
+            denoised(interior).copyTo(dst(tile));
+        }
+    });
+    
+    return dst;
+}
+
+cv::Mat ImageProcessor::denoiseGuided(const cv::Mat &gray, int radius, double eps)
+{
+    // Self-guided filter (He et al.): O(1) per pixel regardless of radius since
+    // it is built entirely from box filters
+    cv::Mat image;
+    gray.convertTo(image, CV_32F, 1.0 / 255.0);
+    
+    const cv::Size window(2 * radius + 1, 2 * radius + 1);
+    
+    cv::Mat mean, meanSq;
+    cv::boxFilter(image, mean, CV_32F, window);
+    cv::boxFilter(image.mul(image), meanSq, CV_32F, window);
+    
+    // Local linear model coefficients: flat regions get a ~ 0, edges get a ~ 1
+    cv::Mat variance = meanSq - mean.mul(mean);
+    cv::Mat denominator = variance + eps;
+    cv::Mat a, b;
+    cv::divide(variance, denominator, a);
+    b = mean - a.mul(mean);
+    
+    cv::boxFilter(a, a, CV_32F, window);
+    cv::boxFilter(b, b, CV_32F, window);
+    
+    cv::Mat filtered = a.mul(image) + b;
+    
+    cv::Mat dst;
+    filtered.convertTo(dst, CV_8U, 255.0);
+    return dst;
+}
+
+bool ImageProcessor::separateKernel(const cv::Mat &kernel, cv::Mat &kernelX, cv::Mat &kernelY)
+{
+    if (kernel.rows < 3) {
+        return false;
+    }
+    
+    // A kernel is separable exactly when it has rank 1, i.e. a single non-zero singular value
+    cv::Mat kernel64;
+    kernel.convertTo(kernel64, CV_64F);
+    
+    cv::Mat w, u, vt;
+    cv::SVD::compute(kernel64, w, u, vt);
+    
+    double first = w.at<double>(0);
+    double second = w.at<double>(1);
+    if (first <= 0.0 || second > kSeparableTolerance * first) {
+        return false;
+    }
+    
+    // K = sqrt(s0) * u0  x  sqrt(s0) * v0^T
+    double scale = std::sqrt(first);
+    cv::Mat column = u.col(0) * scale;
+    cv::Mat row = vt.row(0).t() * scale;
+    column.convertTo(kernelY, CV_32F);
+    row.convertTo(kernelX, CV_32F);
+    return true;
+}
+
+cv::Mat ImageProcessor::filterWithDFT(const cv::Mat &src, const cv::Mat &kernel)
+{
+    // Pad the same way filter2D does (centered anchor, BORDER_REFLECT_101) so
+    // the result matches the spatial path
+    const int anchorX = kernel.cols / 2;
+    const int anchorY = kernel.rows / 2;
+    
+    cv::Mat padded;
+    cv::copyMakeBorder(src, padded,
+                       anchorY, kernel.rows - 1 - anchorY,
+                       anchorX, kernel.cols - 1 - anchorX,
+                       cv::BORDER_REFLECT_101);
+    
+    const cv::Size dftSize(cv::getOptimalDFTSize(padded.cols), cv::getOptimalDFTSize(padded.rows));
+    cv::Mat spectrum = kernelSpectrum(kernel, dftSize);
+    
+    std::vector<cv::Mat> channels;
+    cv::split(padded, channels);
+    
+    // Valid (wrap-free) output starts at (k - 1, k - 1) of the circular convolution
+    const cv::Rect validRegion(kernel.cols - 1, kernel.rows - 1, src.cols, src.rows);
+    
+    cv::parallel_for_(cv::Range(0, static_cast<int>(channels.size())), [&](const cv::Range &range) {
+        for (int c = range.start; c < range.end; ++c) {
+            cv::Mat plane = cv::Mat::zeros(dftSize, CV_32F);
+            cv::Mat planeRegion = plane(cv::Rect(0, 0, padded.cols, padded.rows));
+            channels[c].convertTo(planeRegion, CV_32F);
+            
+            cv::dft(plane, plane, 0, padded.rows);
+            cv::mulSpectrums(plane, spectrum, plane, 0);
+            cv::dft(plane, plane, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT,
+                    validRegion.y + validRegion.height);
+            
+            plane(validRegion).convertTo(channels[c], src.depth());
+        }
+    });
+    
+    cv::Mat dst;
+    cv::merge(channels, dst);
+    return dst;
+}
+
+cv::Mat ImageProcessor::kernelSpectrum(const cv::Mat &kernel, const cv::Size &dftSize)
+{
+    // Key on the raw coefficients plus the transform size
+    cv::Mat continuous = kernel.isContinuous() ? kernel : kernel.clone();
+    QByteArray key(reinterpret_cast<const char*>(continuous.data),
+                   static_cast<int>(continuous.total() * continuous.elemSize()));
+    key.append(reinterpret_cast<const char*>(&dftSize.width), sizeof(dftSize.width));
+    key.append(reinterpret_cast<const char*>(&dftSize.height), sizeof(dftSize.height));
+    
+    QMutexLocker locker(&m_mutex);
+    
+    auto cached = m_kernelSpectrumCache.constFind(key);
+    if (cached != m_kernelSpectrumCache.constEnd()) {
+        return cached.value();
+    }
+    
+    // filter2D computes correlation, so convolve with the kernel flipped in both axes
+    cv::Mat flipped;
+    cv::flip(kernel, flipped, -1);
+    
+    cv::Mat spectrum = cv::Mat::zeros(dftSize, CV_32F);
+    flipped.copyTo(spectrum(cv::Rect(0, 0, kernel.cols, kernel.rows)));
+    cv::dft(spectrum, spectrum, 0, kernel.rows);
+    
+    const size_t spectrumBytes = spectrum.total() * spectrum.elemSize();
+    if (m_kernelSpectrumCache.size() >= kMaxCachedSpectra ||
+        m_kernelSpectrumCacheBytes + spectrumBytes > m_cacheBudget) {
+        m_kernelSpectrumCache.clear();
+        m_kernelSpectrumCacheBytes = 0;
+    }
+    if (spectrumBytes <= m_cacheBudget) {
+        m_kernelSpectrumCache.insert(key, spectrum);
+        m_kernelSpectrumCacheBytes += spectrumBytes;
+    }
+    
+    return spectrum;
+}
@@ -0,0 +1,189 @@
+#include "imagequality.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Working width of the decimated copy
+const int kDecimatedWidth = 320;
+
+// Gray level counted as saturated
+const int kSaturationLevel = 250;
+
+// Plausible fiber blob: fraction of the frame and minimum circularity
+const double kMinFiberArea = 0.002;
+const double kMaxFiberArea = 0.9;
+const double kMinCircularity = 0.5;
+}
+
+ImageQualityChecker::ImageQualityChecker()
+    : m_focusThreshold(20.0)
+    , m_saturationThreshold(0.3)
+    , m_minimumBrightLevel(40.0)
+{
+}
+
+ImageQualityChecker::~ImageQualityChecker()
+{
+}
+
+void ImageQualityChecker::setFocusThreshold(double laplacianVariance)
+{
+    m_focusThreshold = laplacianVariance;
+}
+
+void ImageQualityChecker::setSaturationThreshold(double fraction)
+{
+    m_saturationThreshold = fraction;
+}
+
+void ImageQualityChecker::setMinimumBrightLevel(double grayLevel)
+{
+    m_minimumBrightLevel = grayLevel;
+}
+
+FrameQuality ImageQualityChecker::check(const cv::Mat &image) const
+{
+    FrameQuality quality;
+    if (image.empty()) {
+        quality.issue = FrameQualityIssue::NoFiber;
+        return quality;
+    }
+    
+    cv::TickMeter timer;
+    timer.start();
+    
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else if (image.channels() == 4) {
+        cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+    } else {
+        gray = image;
+    }
+    
+    // Decimate once; every check below works on the small copy
+    double scale = std::min(1.0, static_cast<double>(kDecimatedWidth) / gray.cols);
+    cv::Mat small;
+    if (scale < 1.0) {
+        cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    } else {
+        small = gray;
+    }
+    
+    // Exposure from the histogram
+    int histSize = 256;
+    float range[] = {0.0f, 256.0f};
+    const float *ranges[] = {range};
+    int channels[] = {0};
+    cv::Mat hist;
+    cv::calcHist(&small, 1, channels, cv::Mat(), hist, 1, &histSize, ranges);
+    
+    const double total = static_cast<double>(small.total());
+    double saturated = 0.0;
+    for (int level = kSaturationLevel; level < 256; ++level) {
+        saturated += hist.at<float>(level);
+    }
+    quality.saturatedFraction = saturated / total;
+    
+    double cumulative = 0.0;
+    for (int level = 255; level >= 0; --level) {
+        cumulative += hist.at<float>(level);
+        if (cumulative >= 0.01 * total) {
+            quality.brightLevel = level;
+            break;
+        }
+    }
+    
+    if (quality.brightLevel < m_minimumBrightLevel) {
+        quality.issue = FrameQualityIssue::Underexposed;
+    } else if (quality.saturatedFraction > m_saturationThreshold) {
+        quality.issue = FrameQualityIssue::Overexposed;
+    }
+    
+    // Fiber presence: one roughly circular bright blob of plausible size
+    cv::Rect smallBounds;
+    if (quality.issue == FrameQualityIssue::None) {
+        quality.fiberPresent = findFiber(small, smallBounds);
+        if (!quality.fiberPresent) {
+            quality.issue = FrameQualityIssue::NoFiber;
+        } else {
+            quality.fiberBounds = cv::Rect(cvFloor(smallBounds.x / scale), cvFloor(smallBounds.y / scale),
+                                           cvCeil(smallBounds.width / scale), cvCeil(smallBounds.height / scale))
+                                  & cv::Rect(0, 0, gray.cols, gray.rows);
+        }
+    }
+    
+    // Focus: Laplacian variance around the fiber, where the edges are
+    if (quality.issue == FrameQualityIssue::None) {
+        int margin = std::max(2, smallBounds.width / 10);
+        cv::Rect focusRegion(smallBounds.x - margin, smallBounds.y - margin,
+                             smallBounds.width + 2 * margin, smallBounds.height + 2 * margin);
+        focusRegion &= cv::Rect(0, 0, small.cols, small.rows);
+        
+        cv::Mat laplacian;
+        cv::Laplacian(small(focusRegion), laplacian, CV_16S, 3);
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(laplacian, mean, stddev);
+        quality.focusScore = stddev[0] * stddev[0];
+        
+        if (quality.focusScore < m_focusThreshold) {
+            quality.issue = FrameQualityIssue::OutOfFocus;
+        }
+    }
+    
+    timer.stop();
+    quality.elapsedMs = timer.getTimeMilli();
+    return quality;
+}
+
+const char *ImageQualityChecker::issueDescription(FrameQualityIssue issue)
+{
+    switch (issue) {
+        case FrameQualityIssue::None:
+            return "OK";
+        case FrameQualityIssue::Underexposed:
+            return "Image too dark";
+        case FrameQualityIssue::Overexposed:
+            return "Image saturated";
+        case FrameQualityIssue::NoFiber:
+            return "No fiber in view";
+        case FrameQualityIssue::OutOfFocus:
+            return "Out of focus";
+    }
+    return "Unknown";
+}
+
+bool ImageQualityChecker::findFiber(const cv::Mat &small, cv::Rect &bounds) const
+{
+    cv::Mat binary;
+    cv::threshold(small, binary, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+    
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    
+    // The fiber is the largest bright blob
+    const std::vector<cv::Point> *largest = nullptr;
+    double largestArea = 0.0;
+    for (const auto &contour : contours) {
+        double area = cv::contourArea(contour);
+        if (area > largestArea) {
+            largestArea = area;
+            largest = &contour;
+        }
+    }
+    if (!largest) {
+        return false;
+    }
+    
+    double areaFraction = largestArea / static_cast<double>(small.total());
+    double perimeter = cv::arcLength(*largest, true);
+    double circularity = perimeter > 0.0 ? 4.0 * CV_PI * largestArea / (perimeter * perimeter) : 0.0;
+    if (areaFraction < kMinFiberArea || areaFraction > kMaxFiberArea || circularity < kMinCircularity) {
+        return false;
+    }
+    
+    bounds = cv::boundingRect(*largest);
+    return true;
+}
@@ -0,0 +1,233 @@
+#include "livepipeline.h"
+
+#include <QDebug>
+
+#include <algorithm>
+
+namespace {
+// Idle wait of the analysis thread when no frame is pending
+const std::chrono::milliseconds kIdleWait(1);
+
+// Default analysis budget per frame: keeps up with a 30 fps camera
+const double kDefaultFrameBudgetMs = 33.0;
+
+// Smoothing factor for the analysis rate estimate
+const double kFpsSmoothing = 0.1;
+}
+
+LivePipeline::LivePipeline(FiberAnalyzer *analyzer, ImageProcessor *imageProcessor)
+    : m_analyzer(analyzer)
+    , m_imageProcessor(imageProcessor)
+    , m_frameBudgetMs(kDefaultFrameBudgetMs)
+    , m_averagingWindow(m_frameAverager.windowSize())
+    , m_governor(nullptr)
+    , m_running(false)
+    , m_captureFinished(false)
+    , m_framesCaptured(0)
+    , m_framesAnalyzed(0)
+    , m_framesSkipped(0)
+    , m_analysisFps(0.0)
+{
+}
+
+LivePipeline::~LivePipeline()
+{
+    stop();
+}
+
+bool LivePipeline::start(std::unique_ptr<FrameSource> source)
+{
+    stop();
+    
+    if (!source || !source->open()) {
+        qWarning() << "Live pipeline: could not open frame source";
+        return false;
+    }
+    
+    m_source = std::move(source);
+    m_frameAverager.setWindowSize(m_averagingWindow);
+    m_appliedPlan = ResourcePlan();
+    m_changeGate.reset();
+    m_analyzer->setGeometryTracking(true);
+    m_analyzer->setDefectTracking(true);
+    m_analyzer->setFrameBudget(m_frameBudgetMs);
+    m_framesCaptured = 0;
+    m_framesAnalyzed = 0;
+    m_framesSkipped = 0;
+    m_analysisFps = 0.0;
+    m_captureFinished = false;
+    m_running = true;
+    
+    m_captureThread = std::thread(&LivePipeline::captureLoop, this);
+    m_analysisThread = std::thread(&LivePipeline::analysisLoop, this);
+    
+    qDebug() << "Live pipeline started on" << QString::fromStdString(m_source->description());
+    return true;
+}
+
+void LivePipeline::stop()
+{
+    m_running = false;
+    
+    if (m_captureThread.joinable()) {
+        m_captureThread.join();
+    }
+    if (m_analysisThread.joinable()) {
+        m_analysisThread.join();
+    }
+    
+    if (m_source) {
+        m_source->close();
+        m_source.reset();
+        m_analyzer->setGeometryTracking(false);
+        m_analyzer->setDefectTracking(false);
+        m_analyzer->setFrameBudget(0.0);
+    }
+    
+    // Drain anything left so the next session starts clean
+    LiveFrame frame;
+    while (m_captureRing.popLatest(frame)) {
+    }
+    LiveResult result;
+    while (m_resultRing.popLatest(result)) {
+    }
+}
+
+bool LivePipeline::isRunning() const
+{
+    return m_running && !m_captureFinished;
+}
+
+void LivePipeline::setAveragingWindow(int frames)
+{
+    if (!m_running) {
+        m_frameAverager.setWindowSize(frames);
+        m_averagingWindow = m_frameAverager.windowSize();
+    }
+}
+
+void LivePipeline::setFrameBudget(double milliseconds)
+{
+    if (!m_running) {
+        m_frameBudgetMs = milliseconds;
+    }
+}
+
+void LivePipeline::setResourceGovernor(ResourceGovernor *governor)
+{
+    if (!m_running) {
+        m_governor = governor;
+    }
+}
+
+bool LivePipeline::takeLatestResult(LiveResult &result)
+{
+    return m_resultRing.popLatest(result);
+}
+
+LivePipelineStats LivePipeline::statistics() const
+{
+    LivePipelineStats stats;
+    stats.framesCaptured = m_framesCaptured;
+    stats.framesAnalyzed = m_framesAnalyzed;
+    stats.framesDropped = m_captureRing.droppedCount();
+    stats.framesSkipped = m_framesSkipped;
+    stats.analysisFps = m_analysisFps;
+    return stats;
+}
+
+void LivePipeline::captureLoop()
+{
+    uint64_t sequence = 0;
+    
+    while (m_running) {
+        LiveFrame frame;
+        if (!m_source->readFrame(frame.image)) {
+            qWarning() << "Live pipeline: frame source ended";
+            break;
+        }
+        
+        frame.sequence = sequence++;
+        frame.captureTime = std::chrono::steady_clock::now();
+        ++m_framesCaptured;
+        
+        // Never block the camera: a frame analysis has not taken yet is replaced
+        m_captureRing.push(std::move(frame));
+    }
+    
+    m_captureFinished = true;
+}
+
+void LivePipeline::analysisLoop()
+{
+    auto lastFrameTime = std::chrono::steady_clock::now();
+    
+    while (m_running) {
+        LiveFrame frame;
+        if (!m_captureRing.popLatest(frame)) {
+            if (m_captureFinished) {
+                break;
+            }
+            std::this_thread::sleep_for(kIdleWait);
+            continue;
+        }
+        
+        followResourcePlan();
+        
+        // Temporal averaging replaces per-frame spatial denoising in live mode
+        cv::Mat averaged = m_frameAverager.addFrame(frame.image);
+        
+        LiveResult result;
+        result.displayImage = m_imageProcessor->matToQImage(averaged);
+        
+        // Re-emit the previous analysis while the operator holds the connector steady
+        if (m_changeGate.shouldAnalyze(averaged)) {
+            m_lastAnalysis = m_analyzer->analyzeImage(result.displayImage);
+            ++m_framesAnalyzed;
+        } else {
+            result.reusedAnalysis = true;
+            ++m_framesSkipped;
+        }
+        result.analysis = m_lastAnalysis;
+        result.sequence = frame.sequence;
+        result.averagedFrames = m_frameAverager.frameCount();
+        
+        auto now = std::chrono::steady_clock::now();
+        result.latencyMs = std::chrono::duration<double, std::milli>(now - frame.captureTime).count();
+        
+        double interval = std::chrono::duration<double>(now - lastFrameTime).count();
+        lastFrameTime = now;
+        if (interval > 0.0) {
+            double fps = m_analysisFps;
+            m_analysisFps = (fps == 0.0) ? 1.0 / interval : fps + kFpsSmoothing * (1.0 / interval - fps);
+        }
+        
+        m_resultRing.push(std::move(result));
+    }
+}
+
+void LivePipeline::followResourcePlan()
+{
+    if (!m_governor) {
+        return;
+    }
+    
+    ResourcePlan plan = m_governor->update();
+    if (plan == m_appliedPlan) {
+        return;
+    }
+    
+    if (plan.level != m_appliedPlan.level) {
+        qDebug() << "Live pipeline: memory" << ResourceGovernor::levelName(plan.level)
+                 << "-" << plan.usedBytes / (1024 * 1024) << "of" << plan.budgetBytes / (1024 * 1024) << "MB";
+    }
+    
+    // Each averaged frame is an 8-bit copy held in the window
+    int window = std::min(m_averagingWindow, plan.inFlightImages);
+    if (window != m_frameAverager.windowSize()) {
+        m_frameAverager.setWindowSize(window);
+    }
+    
+    ResourceGovernor::applyProcessLimits(plan);
+    m_appliedPlan = plan;
+}
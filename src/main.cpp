@@ -8,6 +8,8 @@
 #include <QtCore>
 
 #include "mainwindow.h"
+#include "cpudispatch.h"
+#include "scratchpool.h"
 
 // Detect if running on Linux
 #ifdef Q_OS_LINUX
@@ -79,12 +81,28 @@ int main(int argc, char *argv[])
     QCommandLineOption imageOption(QStringList() << "i" << "image", "Open image file on startup", "file");
     parser.addOption(imageOption);
     
+    QCommandLineOption sourceOption(QStringList() << "s" << "source",
+        "Live mode frame source: camera, camera:N, /dev/videoN, raw:WxH:path, raw16:WxH:path, or a video, image, stack or directory path", "source");
+    parser.addOption(sourceOption);
+    
+    QCommandLineOption batchOption(QStringList() << "b" << "batch",
+        "Analyze every image in a directory and write batch_results.csv there", "directory");
+    parser.addOption(batchOption);
+    
     QCommandLineOption fullscreenOption(QStringList() << "f" << "fullscreen", "Start in fullscreen mode");
     parser.addOption(fullscreenOption);
     
     QCommandLineOption darkModeOption(QStringList() << "d" << "dark-mode", "Use dark color theme");
     parser.addOption(darkModeOption);
     
+    QCommandLineOption isaOption("isa",
+        "Force a pixel kernel variant for benchmarking: baseline, sse4.2, avx2, avx512 or neon", "variant");
+    parser.addOption(isaOption);
+    
+    QCommandLineOption memoryBudgetOption("memory-budget",
+        "Memory budget in MB (default: derived from the container limit or FIBERCORE_MEMORY_BUDGET_MB)", "MB");
+    parser.addOption(memoryBudgetOption);
+    
     // Process the command line arguments
     parser.process(app);
     
@@ -94,6 +112,18 @@ int main(int argc, char *argv[])
     // Set up logging based on verbose flag
     setupLogging(parser.isSet(verboseOption));
     
+    if (parser.isSet(isaOption)) {
+        CpuIsa isa;
+        if (!parseCpuIsa(parser.value(isaOption).toStdString(), isa) || !forceCpuIsa(isa)) {
+            qWarning() << "Kernel variant" << parser.value(isaOption) << "is not available on this CPU";
+        }
+    }
+    qDebug() << "Pixel kernels:" << cpuIsaName(activeCpuIsa())
+             << "(detected" << cpuIsaName(detectCpuIsa()) << ")";
+    
+    // Recycle image buffers across frames instead of reaching malloc per stage
+    ScratchPool::instance().install();
+    
     // Load application style
     QFile styleFile(":/styles/dark.qss");
     if (styleFile.exists()) {
@@ -142,10 +172,28 @@ int main(int argc, char *argv[])
         mainWindow.loadImage(imagePath);
     }
     
+    if (parser.isSet(memoryBudgetOption)) {
+        mainWindow.setMemoryBudget(parser.value(memoryBudgetOption).toLongLong());
+    }
+    
+    if (parser.isSet(sourceOption)) {
+        mainWindow.setLiveSource(parser.value(sourceOption));
+    }
+    
+    if (parser.isSet(batchOption)) {
+        mainWindow.runBatch(parser.value(batchOption));
+    }
+    
     // Hide splash screen
     splash.finish(&mainWindow);
     
     qDebug() << "FiberInspector application started";
     
-    return app.exec();
+    int exitCode = app.exec();
+    
+    ScratchPoolStats poolStats = ScratchPool::instance().stats();
+    qDebug() << "Scratch pool:" << poolStats.hits << "hits," << poolStats.misses << "misses, peak"
+             << poolStats.peakBytesInUse / (1024 * 1024) << "MB";
+    
+    return exitCode;
 } 
\ No newline at end of file
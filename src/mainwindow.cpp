@@ -30,10 +30,15 @@
 #include <QMenu>
 #include <QMenuBar>
 #include <QFile>
+#include <QPainter>
+#include <QMouseEvent>
+#include <QToolTip>
+
+#include <algorithm>
+#include <cmath>
 
 // Linux-specific includes
 #ifdef Q_OS_LINUX
-#include <sys/sysinfo.h>
 #include <sys/statvfs.h>
 #include <unistd.h>
 #endif
@@ -43,6 +48,9 @@ MainWindow::MainWindow(QWidget *parent)
     , ui(new Ui::MainWindow)
     , m_zoomFactor(1.0)
     , m_isLiveMode(false)
+    , m_showAnnotations(true)
+    , m_batchDone(false)
+    , m_batchFiles(0)
 {
     ui->setupUi(this);
     
@@ -50,6 +58,26 @@ MainWindow::MainWindow(QWidget *parent)
     m_imageProcessor = new ImageProcessor();
     m_fiberAnalyzer = new FiberAnalyzer();
     m_resultsManager = new ResultsManager(this);
+    m_livePipeline = new LivePipeline(m_fiberAnalyzer, m_imageProcessor);
+    
+    // The display polls the live pipeline at screen rate, independent of the camera
+    m_liveDisplayTimer = new QTimer(this);
+    m_liveDisplayTimer->setInterval(33);
+    connect(m_liveDisplayTimer, &QTimer::timeout, this, &MainWindow::updateLiveDisplay);
+    
+    // Memory budget: live mode follows the plan on its analysis thread, the
+    // timer covers everything else
+    m_livePipeline->setResourceGovernor(&m_resourceGovernor);
+    m_resourceTimer = new QTimer(this);
+    m_resourceTimer->setInterval(2000);
+    connect(m_resourceTimer, &QTimer::timeout, this, &MainWindow::updateResourcePlan);
+    
+    // Batch runs read and decode ahead on their own threads; the timer reports progress
+    m_batchPipeline = new BatchPipeline();
+    m_batchPipeline->setResourceGovernor(&m_resourceGovernor);
+    m_batchTimer = new QTimer(this);
+    m_batchTimer->setInterval(250);
+    connect(m_batchTimer, &QTimer::timeout, this, &MainWindow::updateBatchProgress);
     
     // Initialize UI
     setupUi();
@@ -68,6 +96,7 @@ MainWindow::MainWindow(QWidget *parent)
     
     // Check system resources on startup
     checkSystemResources();
+    m_resourceTimer->start();
     
     // Connect to Linux system info if available
     connectToLinuxSystemInfo();
@@ -78,6 +107,17 @@ MainWindow::~MainWindow()
     // Save settings before closing
     saveSettings();
     
+    // Stop live threads before the components they use go away
+    m_liveDisplayTimer->stop();
+    delete m_livePipeline;
+    
+    m_batchTimer->stop();
+    m_batchPipeline->stop();
+    if (m_batchThread.joinable()) {
+        m_batchThread.join();
+    }
+    delete m_batchPipeline;
+    
     delete m_imageProcessor;
     delete m_fiberAnalyzer;
     delete ui;
@@ -99,6 +139,8 @@ void MainWindow::setupUi()
     m_imageLabel->setAlignment(Qt::AlignCenter);
     m_imageLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
     m_imageLabel->setScaledContents(true);
+    m_imageLabel->setMouseTracking(true);
+    m_imageLabel->installEventFilter(this);
     m_scrollArea->setWidget(m_imageLabel);
     
     // Create controls layout
@@ -119,6 +161,17 @@ void MainWindow::setupUi()
     
     filterLayout->addWidget(m_filterComboBox);
     
+    // Create denoising selection (index 0 leaves the image untouched)
+    m_denoiseComboBox = new QComboBox(filterGroupBox);
+    m_denoiseComboBox->addItem(tr("No Denoising"), -1);
+    const DenoiseMethod denoiseMethods[] = {DenoiseMethod::NonLocalMeansTiled, DenoiseMethod::Bilateral,
+                                            DenoiseMethod::Guided, DenoiseMethod::NonLocalMeansColor};
+    for (DenoiseMethod method : denoiseMethods) {
+        m_denoiseComboBox->addItem(m_imageProcessor->denoiseMethodName(method), static_cast<int>(method));
+    }
+    
+    filterLayout->addWidget(m_denoiseComboBox);
+    
     // Create adjustment controls
     QGroupBox *adjustmentGroupBox = new QGroupBox(tr("Adjustments"));
     QVBoxLayout *adjustmentLayout = new QVBoxLayout(adjustmentGroupBox);
@@ -162,6 +215,8 @@ void MainWindow::setupUi()
     // Connect signals and slots
     connect(m_filterComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), 
             this, &MainWindow::applyFilter);
+    connect(m_denoiseComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), 
+            this, &MainWindow::applyDenoise);
     connect(m_brightnessSlider, &QSlider::valueChanged, 
             this, &MainWindow::adjustBrightness);
     connect(m_contrastSlider, &QSlider::valueChanged, 
@@ -202,6 +257,11 @@ void MainWindow::createActions()
     ui->actionResetView = new QAction(tr("&Reset View"), this);
     connect(ui->actionResetView, &QAction::triggered, this, &MainWindow::resetView);
     
+    ui->actionShowAnnotations = new QAction(tr("Show &Annotations"), this);
+    ui->actionShowAnnotations->setCheckable(true);
+    ui->actionShowAnnotations->setChecked(true);
+    connect(ui->actionShowAnnotations, &QAction::toggled, this, &MainWindow::toggleAnnotations);
+    
     // Tools actions
     ui->actionAnalyze = new QAction(tr("&Analyze Fiber"), this);
     ui->actionAnalyze->setEnabled(false);
@@ -211,6 +271,9 @@ void MainWindow::createActions()
     ui->actionLiveMode->setCheckable(true);
     connect(ui->actionLiveMode, &QAction::triggered, this, &MainWindow::toggleLiveMode);
     
+    ui->actionBatchAnalyze = new QAction(tr("&Batch Analyze Folder..."), this);
+    connect(ui->actionBatchAnalyze, &QAction::triggered, this, &MainWindow::analyzeFolder);
+    
     // Settings actions
     ui->actionSettings = new QAction(tr("&Settings..."), this);
     connect(ui->actionSettings, &QAction::triggered, this, &MainWindow::showSettings);
@@ -235,11 +298,14 @@ void MainWindow::createMenus()
     ui->menuView->addAction(ui->actionZoomIn);
     ui->menuView->addAction(ui->actionZoomOut);
     ui->menuView->addAction(ui->actionResetView);
+    ui->menuView->addSeparator();
+    ui->menuView->addAction(ui->actionShowAnnotations);
     
     // Tools menu
     ui->menuTools = menuBar()->addMenu(tr("&Tools"));
     ui->menuTools->addAction(ui->actionAnalyze);
     ui->menuTools->addAction(ui->actionLiveMode);
+    ui->menuTools->addAction(ui->actionBatchAnalyze);
     
     // Settings menu
     ui->menuSettings = menuBar()->addMenu(tr("&Settings"));
@@ -288,6 +354,7 @@ void MainWindow::openImage()
         if (m_imageProcessor->loadImage(filePath)) {
             m_currentFilePath = filePath;
             m_currentImage = QImage(filePath);
+            m_fiberRoi = QRect();
             m_processedImage = m_currentImage;
             
             updateImageDisplay();
@@ -331,7 +398,31 @@ void MainWindow::applyFilter(int filterIndex)
     
     FilterType filterType = static_cast<FilterType>(m_filterComboBox->itemData(filterIndex).toInt());
     
-    m_processedImage = m_imageProcessor->applyFilter(m_currentImage, filterType);
+    m_processedImage = m_imageProcessor->applyFilter(m_currentImage, filterType, m_fiberRoi);
+    updateImageDisplay();
+}
+
+void MainWindow::applyDenoise(int denoiseIndex)
+{
+    if (m_currentImage.isNull()) {
+        return;
+    }
+    
+    // Re-apply the current filter first so denoisers do not stack on each other
+    FilterType filterType = static_cast<FilterType>(m_filterComboBox->itemData(m_filterComboBox->currentIndex()).toInt());
+    m_processedImage = m_imageProcessor->applyFilter(m_currentImage, filterType, m_fiberRoi);
+    
+    int methodValue = m_denoiseComboBox->itemData(denoiseIndex).toInt();
+    if (methodValue >= 0) {
+        DenoiseMethod method = static_cast<DenoiseMethod>(methodValue);
+        m_processedImage = m_imageProcessor->removeNoise(m_processedImage, method, m_fiberRoi);
+        
+        // Report timing so operators can pick a denoiser that fits their latency budget
+        statusBar()->showMessage(tr("Denoised with %1 in %2 ms")
+                               .arg(m_imageProcessor->denoiseMethodName(method))
+                               .arg(m_imageProcessor->lastDenoiseTimeMs(), 0, 'f', 1), 5000);
+    }
+    
     updateImageDisplay();
 }
 
@@ -358,6 +449,10 @@ void MainWindow::analyzeFiber()
             
             // Perform the actual analysis
             FiberAnalysisResult result = m_fiberAnalyzer->analyzeImage(m_processedImage);
+            m_overlay = result.overlay();
+            m_fiberRoi = result.roi;
+            setShownDefects(result.defects);
+            updateImageDisplay();
             
             // Display results
             updateResultsPanel();
@@ -425,22 +520,227 @@ void MainWindow::resetView()
     updateImageDisplay();
 }
 
+void MainWindow::setShownDefects(const QVector<FiberDefect> &defects)
+{
+    // Rebuilt once per result so hovering never scans the whole defect list
+    m_shownDefects = defects;
+    std::vector<cv::Rect> boxes;
+    boxes.reserve(defects.size());
+    for (const FiberDefect &defect : defects) {
+        const QRect &box = defect.boundingBox;
+        boxes.emplace_back(box.x(), box.y(), box.width(), box.height());
+    }
+    m_defectIndex.build(boxes);
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_imageLabel && event->type() == QEvent::MouseMove &&
+        m_showAnnotations && !m_defectIndex.empty() && !m_processedImage.isNull()) {
+        // The label shows the image scaled to its own size; allow a few screen pixels of slack
+        QMouseEvent *mouseEvent = static_cast<QMouseEvent *>(event);
+        double scale = static_cast<double>(m_imageLabel->width()) / m_processedImage.width();
+        cv::Point imagePoint(static_cast<int>(std::floor(mouseEvent->pos().x() / scale)),
+                             static_cast<int>(std::floor(mouseEvent->pos().y() / scale)));
+        int tolerance = static_cast<int>(std::ceil(3.0 / scale));
+    
+        int hit = m_defectIndex.hitTest(imagePoint, tolerance);
+        if (hit >= 0) {
+            const FiberDefect &defect = m_shownDefects[hit];
+            QToolTip::showText(mouseEvent->globalPos(),
+                               tr("%1\nSeverity: %2\nSize: %3 x %4 px")
+                                   .arg(tr(defect.description()))
+                                   .arg(defect.severity, 0, 'f', 2)
+                                   .arg(defect.boundingBox.width())
+                                   .arg(defect.boundingBox.height()),
+                               m_imageLabel);
+        } else {
+            QToolTip::hideText();
+        }
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::toggleAnnotations(bool visible)
+{
+    // The overlay is vector data, so toggling only recomposites the display
+    m_showAnnotations = visible;
+    updateImageDisplay();
+}
+
 void MainWindow::toggleLiveMode()
 {
     m_isLiveMode = !m_isLiveMode;
     
     if (m_isLiveMode) {
-        statusBar()->showMessage(tr("Live mode activated"));
-        // In a real app, this would connect to a camera feed
+        QString sourceSpec = m_liveSourceSpec.isEmpty() ? QString("camera") : m_liveSourceSpec;
+        if (!m_livePipeline->start(createFrameSource(sourceSpec.toStdString()))) {
+            m_isLiveMode = false;
+            ui->actionLiveMode->setChecked(false);
+            QMessageBox::warning(this, tr("Live Mode"),
+                tr("Could not open live source: %1").arg(sourceSpec));
+            return;
+        }
+        
+        m_liveDisplayTimer->start();
+        statusBar()->showMessage(tr("Live mode activated (%1)").arg(sourceSpec));
     } else {
+        m_liveDisplayTimer->stop();
+        m_livePipeline->stop();
         statusBar()->showMessage(tr("Live mode deactivated"));
     }
 }
 
+void MainWindow::updateLiveDisplay()
+{
+    LiveResult liveResult;
+    if (m_livePipeline->takeLatestResult(liveResult)) {
+        m_processedImage = liveResult.displayImage;
+        m_overlay = liveResult.analysis.overlay();
+        setShownDefects(liveResult.analysis.defects);
+        updateImageDisplay();
+        
+        LivePipelineStats stats = m_livePipeline->statistics();
+        statusBar()->showMessage(tr("Live: %1%2 | %3 defects | %4 fps | latency %5 ms | %6 averaged | %7 dropped")
+                               .arg(liveResult.analysis.qualityIssue != FrameQualityIssue::None
+                                    ? tr(ImageQualityChecker::issueDescription(liveResult.analysis.qualityIssue))
+                                    : (liveResult.analysis.isAcceptable ? tr("PASS") : tr("FAIL")))
+                               .arg(liveResult.reusedAnalysis ? tr(" (held)")
+                                    : (liveResult.analysis.degraded ? tr(" (degraded)") : QString()))
+                               .arg(liveResult.analysis.defects.size())
+                               .arg(stats.analysisFps, 0, 'f', 1)
+                               .arg(liveResult.latencyMs, 0, 'f', 0)
+                               .arg(liveResult.averagedFrames)
+                               .arg(stats.framesDropped));
+    }
+    
+    // A file-based source that ran out of frames ends live mode
+    if (!m_livePipeline->isRunning() && m_isLiveMode) {
+        toggleLiveMode();
+        ui->actionLiveMode->setChecked(false);
+    }
+}
+
+void MainWindow::updateResourcePlan()
+{
+    ResourcePlan plan = m_resourceGovernor.update();
+    if (plan == m_resourcePlan) {
+        return;
+    }
+    
+    // The live pipeline applies process limits itself while it runs
+    if (!m_isLiveMode) {
+        ResourceGovernor::applyProcessLimits(plan);
+    }
+    m_imageProcessor->setCacheBudget(plan.cacheBytes);
+    
+    if (plan.level != m_resourcePlan.level) {
+        qDebug() << "Memory" << ResourceGovernor::levelName(plan.level) << ":"
+                 << plan.usedBytes / (1024 * 1024) << "of" << plan.budgetBytes / (1024 * 1024) << "MB,"
+                 << plan.workers << "workers," << plan.inFlightImages << "images in flight";
+        if (plan.level != ResourceLevel::Normal && !m_isLiveMode) {
+            statusBar()->showMessage(tr("Memory %1: reduced to %2 workers")
+                                   .arg(ResourceGovernor::levelName(plan.level)).arg(plan.workers), 5000);
+        }
+    }
+    m_resourcePlan = plan;
+}
+
+void MainWindow::setMemoryBudget(qint64 megabytes)
+{
+    m_resourceGovernor.setMemoryBudget(static_cast<size_t>(std::max<qint64>(0, megabytes)) * 1024 * 1024);
+    updateResourcePlan();
+}
+
+void MainWindow::setLiveSource(const QString &sourceSpec)
+{
+    m_liveSourceSpec = sourceSpec;
+}
+
+void MainWindow::analyzeFolder()
+{
+    QString directory = QFileDialog::getExistingDirectory(this, tr("Batch Analyze Folder"), QDir::homePath());
+    if (!directory.isEmpty()) {
+        runBatch(directory);
+    }
+}
+
+void MainWindow::runBatch(const QString &directory)
+{
+    if (m_batchThread.joinable()) {
+        statusBar()->showMessage(tr("A batch is already running"), 3000);
+        return;
+    }
+    
+    QStringList files;
+    for (const std::string &file : BatchPipeline::listImages(directory.toStdString())) {
+        files.append(QString::fromStdString(file));
+    }
+    if (files.isEmpty()) {
+        QMessageBox::warning(this, tr("Batch Analysis"), tr("No images found in: %1").arg(directory));
+        return;
+    }
+    
+    m_batchDirectory = directory;
+    m_batchFiles = files.size();
+    m_batchDone = false;
+    m_batchResults.clear();
+    
+    // Workers follow the memory plan; reading and decoding overlap with analysis
+    const int workers = std::max(1, m_resourceGovernor.update().workers);
+    m_batchThread = std::thread([this, files, workers] {
+        m_batchResults = m_fiberAnalyzer->analyzeBatch(*m_batchPipeline, files, workers);
+        m_batchDone = true;
+    });
+    
+    ui->actionBatchAnalyze->setEnabled(false);
+    m_progressBar->setRange(0, m_batchFiles);
+    m_progressBar->setValue(0);
+    m_progressBar->setVisible(true);
+    m_batchTimer->start();
+}
+
+void MainWindow::updateBatchProgress()
+{
+    if (!m_batchDone) {
+        BatchStats stats = m_batchPipeline->stats();
+        m_progressBar->setValue(std::min<int>(m_batchFiles, static_cast<int>(stats.analysis.items)));
+        statusBar()->showMessage(tr("Batch: %1 analyzed | read %2 MB/s | decode %3/s | analysis %4/s")
+                               .arg(stats.analysis.items)
+                               .arg(stats.read.megabytesPerSecond(stats.elapsedMs), 0, 'f', 1)
+                               .arg(stats.decode.itemsPerSecond(stats.elapsedMs), 0, 'f', 1)
+                               .arg(stats.analysis.itemsPerSecond(stats.elapsedMs), 0, 'f', 1));
+        return;
+    }
+    
+    m_batchTimer->stop();
+    m_batchThread.join();
+    m_progressBar->setVisible(false);
+    ui->actionBatchAnalyze->setEnabled(true);
+    
+    BatchStats stats = m_batchPipeline->stats();
+    double seconds = stats.elapsedMs / 1000.0;
+    qDebug() << "Batch:" << stats.files << "files in" << seconds << "s using"
+             << (stats.ioUring ? "io_uring," : "reader threads,") << "read blocked" << stats.read.blockedMs
+             << "ms, decode blocked" << stats.decode.blockedMs << "ms, peak queues"
+             << stats.peakReadQueue << "/" << stats.peakFrameQueue;
+    
+    QString csvPath = QDir(m_batchDirectory).filePath("batch_results.csv");
+    if (m_resultsManager->exportToCSV(m_batchResults, csvPath)) {
+        statusBar()->showMessage(tr("Batch complete: %1 images in %2 s, %3 failed. Results: %4")
+                               .arg(m_batchResults.size())
+                               .arg(seconds, 0, 'f', 1)
+                               .arg(stats.failures)
+                               .arg(csvPath));
+    } else {
+        QMessageBox::warning(this, tr("Batch Analysis"), tr("Could not write results to: %1").arg(csvPath));
+    }
+}
+
 void MainWindow::exportReport()
 {
     QString filePath = QFileDialog::getSaveFileName(this, tr("Export Report"),
-        QDir::homePath(), tr("PDF Files (*.pdf);;CSV Files (*.csv);;JSON Files (*.json)"));
+        QDir::homePath(), tr("PDF Files (*.pdf);;CSV Files (*.csv);;JSON Files (*.json);;Annotated Image (*.png)"));
     
     if (!filePath.isEmpty()) {
         QString extension = QFileInfo(filePath).suffix().toLower();
@@ -456,6 +756,9 @@ void MainWindow::exportReport()
             success = m_resultsManager->exportToCSV(results, filePath);
         } else if (extension == "json") {
             success = m_resultsManager->exportToJSON(result, filePath);
+        } else if (extension == "png") {
+            // The only place annotations are burned into a copy of the frame
+            success = m_fiberAnalyzer->createAnnotatedImage(m_processedImage, result).save(filePath);
         }
         
         if (success) {
@@ -496,6 +799,12 @@ void MainWindow::updateImageDisplay()
         pixmap = pixmap.scaled(scaledSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
     
+    // Composite the annotation overlay on the display pixmap; the image itself stays untouched
+    if (m_showAnnotations && !m_overlay.isEmpty()) {
+        QPainter painter(&pixmap);
+        m_overlay.paint(painter, AllLayers, static_cast<double>(pixmap.width()) / m_processedImage.width());
+    }
+    
     m_imageLabel->setPixmap(pixmap);
     m_imageLabel->resize(pixmap.size());
 }
@@ -508,12 +817,8 @@ void MainWindow::scaleImage(double factor)
     QSize newSize = m_processedImage.size() * m_zoomFactor;
     m_imageLabel->resize(newSize);
     
-    // Create a scaled version of the image
-    QPixmap scaledPixmap = QPixmap::fromImage(m_processedImage)
-                          .scaled(newSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    
-    // Set the scaled image to the label
-    m_imageLabel->setPixmap(scaledPixmap);
+    // Redraw the image and its overlay at the new scale
+    updateImageDisplay();
     
     // Adjust scrollbars
     adjustScrollBar(m_scrollArea->horizontalScrollBar(), factor);
@@ -571,27 +876,24 @@ void MainWindow::updateResultsPanel()
 
 bool MainWindow::checkSystemResources()
 {
-#ifdef Q_OS_LINUX
-    // Check system memory
-    struct sysinfo info;
-    if (sysinfo(&info) == 0) {
-        unsigned long totalRam = info.totalram * info.mem_unit;
-        unsigned long freeRam = info.freeram * info.mem_unit;
-        
-        // Convert to MB for display
-        double totalRamMB = totalRam / (1024.0 * 1024.0);
-        double freeRamMB = freeRam / (1024.0 * 1024.0);
-        
-        qDebug() << "Memory: Total:" << totalRamMB << "MB, Free:" << freeRamMB << "MB";
-        
-        // Check if we have enough RAM
-        if (freeRamMB < 500) {
-            QMessageBox::warning(this, tr("Low Memory Warning"),
-                tr("System is low on memory (%.1f MB). Application may perform slowly.").arg(freeRamMB));
-            return false;
-        }
+    // Memory: budget from the container limit or the configured value, not just free RAM
+    m_resourcePlan = m_resourceGovernor.update();
+    ResourceGovernor::applyProcessLimits(m_resourcePlan);
+    m_imageProcessor->setCacheBudget(m_resourcePlan.cacheBytes);
+    
+    double usedMB = m_resourcePlan.usedBytes / (1024.0 * 1024.0);
+    double budgetMB = m_resourcePlan.budgetBytes / (1024.0 * 1024.0);
+    qDebug() << "Memory: Used:" << usedMB << "MB, Budget:" << budgetMB << "MB,"
+             << ResourceGovernor::levelName(m_resourcePlan.level);
+    
+    if (m_resourcePlan.level == ResourceLevel::Critical) {
+        QMessageBox::warning(this, tr("Low Memory Warning"),
+            tr("Memory is nearly exhausted (%1 of %2 MB in use). Images will be processed one at a time.")
+                .arg(usedMB, 0, 'f', 0).arg(budgetMB, 0, 'f', 0));
+        return false;
     }
     
+#ifdef Q_OS_LINUX
     // Check disk space
     struct statvfs stat;
     if (statvfs("/", &stat) == 0) {
@@ -649,6 +951,9 @@ void MainWindow::loadImage(const QString &imagePath)
     m_currentImage = image;
     m_processedImage = image;
     m_currentFilePath = imagePath;
+    m_overlay.clear();
+    m_fiberRoi = QRect();
+    setShownDefects(QVector<FiberDefect>());
     
     // Reset UI elements
     m_filterComboBox->setCurrentIndex(0);
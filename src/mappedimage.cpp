@@ -0,0 +1,574 @@
+#include "mappedimage.h"
+#include "scratchpool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPEDIMAGE_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct FileMapping {
+    uint8_t *data = nullptr;
+    size_t length = 0;
+#if defined(MAPPEDIMAGE_POSIX)
+    int fd = -1;
+    
+    ~FileMapping()
+    {
+        if (data) {
+            munmap(data, length);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#else
+    // Without mmap the file is read once; pages are still views of this buffer
+    std::vector<uint8_t> buffer;
+#endif
+};
+
+namespace {
+const int kDefaultReadAhead = 2;
+
+// TIFF tags used to locate uncompressed grayscale strips
+enum TiffTag : uint32_t {
+    ImageWidth = 256,
+    ImageLength = 257,
+    BitsPerSample = 258,
+    Compression = 259,
+    PhotometricInterpretation = 262,
+    StripOffsets = 273,
+    SamplesPerPixel = 277,
+    RowsPerStrip = 278,
+    StripByteCounts = 279,
+    PlanarConfiguration = 284,
+    TileWidth = 322,
+    SampleFormat = 339
+};
+
+bool isHostLittleEndian()
+{
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+void swapBytes16(cv::Mat &image)
+{
+    for (int y = 0; y < image.rows; ++y) {
+        uint16_t *row = image.ptr<uint16_t>(y);
+        for (int x = 0; x < image.cols; ++x) {
+            row[x] = static_cast<uint16_t>((row[x] << 8) | (row[x] >> 8));
+        }
+    }
+}
+
+// Next token of a PGM header, skipping comments; consumes the whitespace after it
+bool readPgmToken(const uint8_t *data, size_t length, size_t &position, std::string &token)
+{
+    token.clear();
+    while (position < length) {
+        const char c = static_cast<char>(data[position]);
+        if (c == '#') {
+            while (position < length && data[position] != '\n') {
+                ++position;
+            }
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            ++position;
+        } else {
+            break;
+        }
+    }
+    while (position < length && !std::isspace(data[position])) {
+        token.push_back(static_cast<char>(data[position++]));
+    }
+    if (position < length) {
+        ++position;
+    }
+    return !token.empty();
+}
+
+// Mats referencing a mapping hold a reference to it through UMatData::userdata,
+// the same way OpenCV's Python bindings keep numpy arrays alive
+class MappingAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           ScratchAccessFlags flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        // Only used if a view is re-created with another size
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    
+    bool allocate(cv::UMatData *data, ScratchAccessFlags accessFlags,
+                  cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+    
+    void deallocate(cv::UMatData *data) const override
+    {
+        if (!data) {
+            return;
+        }
+        delete static_cast<std::shared_ptr<FileMapping> *>(data->userdata);
+        delete data;
+    }
+};
+
+cv::Mat viewOf(const std::shared_ptr<FileMapping> &mapping, size_t offset, cv::Size size, int type)
+{
+    // Never destroyed: views may outlive static destruction
+    static MappingAllocator *allocator = new MappingAllocator();
+    
+    uint8_t *data = mapping->data + offset;
+    cv::Mat view(size, type, data);
+    
+    cv::UMatData *shared = new cv::UMatData(allocator);
+    shared->data = shared->origdata = data;
+    shared->size = view.total() * view.elemSize();
+    shared->refcount = 1;
+    shared->userdata = new std::shared_ptr<FileMapping>(mapping);
+    view.u = shared;
+    return view;
+}
+}
+
+MappedImageFile::MappedImageFile()
+    : m_access(MappedAccess::Normal)
+    , m_readAhead(kDefaultReadAhead)
+{
+}
+
+MappedImageFile::~MappedImageFile()
+{
+    close();
+}
+
+bool MappedImageFile::open(const std::string &filePath)
+{
+    close();
+    if (!map(filePath)) {
+        return false;
+    }
+    
+    const uint8_t *data = m_mapping->data;
+    const bool parsed = (data[0] == 'P' && m_mapping->length > 2 && data[1] == '5') ? parsePgm() : parseTiff();
+    if (!parsed) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedImageFile::openRaw(const std::string &filePath, cv::Size frameSize, int type, size_t headerBytes)
+{
+    close();
+    const size_t frameBytes = static_cast<size_t>(frameSize.area()) * CV_ELEM_SIZE(type);
+    if (frameBytes == 0 || !map(filePath) || m_mapping->length < headerBytes + frameBytes) {
+        close();
+        return false;
+    }
+    
+    // Trailing bytes short of a whole frame are ignored
+    const size_t frames = (m_mapping->length - headerBytes) / frameBytes;
+    for (size_t i = 0; i < frames; ++i) {
+        Page page;
+        page.offset = headerBytes + i * frameBytes;
+        page.bytes = frameBytes;
+        page.size = frameSize;
+        page.type = type;
+        m_pages.push_back(page);
+    }
+    return true;
+}
+
+void MappedImageFile::close()
+{
+    // Views handed out keep their own reference to the mapping
+    m_mapping.reset();
+    m_pages.clear();
+    m_filePath.clear();
+}
+
+bool MappedImageFile::isOpen() const
+{
+    return m_mapping != nullptr;
+}
+
+const std::string &MappedImageFile::filePath() const
+{
+    return m_filePath;
+}
+
+size_t MappedImageFile::pageCount() const
+{
+    return m_pages.size();
+}
+
+cv::Size MappedImageFile::pageSize(size_t index) const
+{
+    return index < m_pages.size() ? m_pages[index].size : cv::Size();
+}
+
+int MappedImageFile::pageType(size_t index) const
+{
+    return index < m_pages.size() ? m_pages[index].type : -1;
+}
+
+bool MappedImageFile::isZeroCopy(size_t index) const
+{
+    return index < m_pages.size() && m_pages[index].strips.empty() && !m_pages[index].swapBytes;
+}
+
+cv::Mat MappedImageFile::page(size_t index)
+{
+    if (index >= m_pages.size()) {
+        return cv::Mat();
+    }
+    
+    // Keep the kernel reading ahead of the consumer and drop what it has finished with
+    if (m_access == MappedAccess::Sequential) {
+        for (size_t ahead = index; ahead < m_pages.size() && ahead <= index + m_readAhead; ++ahead) {
+            prefetch(ahead);
+        }
+        if (index >= 2) {
+            release(index - 2);
+        }
+    }
+    
+    const Page &page = m_pages[index];
+    if (isZeroCopy(index)) {
+        return viewOf(m_mapping, page.offset, page.size, page.type);
+    }
+    
+    // Assemble scattered strips, then fix the byte order
+    cv::Mat copy(page.size, page.type);
+    if (page.strips.empty()) {
+        std::memcpy(copy.data, m_mapping->data + page.offset, page.bytes);
+    } else {
+        size_t filled = 0;
+        for (const auto &strip : page.strips) {
+            const size_t bytes = std::min(strip.second, page.bytes - filled);
+            std::memcpy(copy.data + filled, m_mapping->data + strip.first, bytes);
+            filled += bytes;
+        }
+    }
+    if (page.swapBytes) {
+        swapBytes16(copy);
+    }
+    return copy;
+}
+
+void MappedImageFile::setAccessPattern(MappedAccess access)
+{
+    m_access = access;
+    if (!m_mapping) {
+        return;
+    }
+#if defined(MAPPEDIMAGE_POSIX)
+    const int advice = access == MappedAccess::Sequential ? MADV_SEQUENTIAL :
+                       access == MappedAccess::Random ? MADV_RANDOM : MADV_NORMAL;
+    advise(0, m_mapping->length, advice);
+#endif
+}
+
+MappedAccess MappedImageFile::accessPattern() const
+{
+    return m_access;
+}
+
+void MappedImageFile::setReadAhead(int pages)
+{
+    m_readAhead = std::max(0, pages);
+}
+
+void MappedImageFile::prefetch(size_t index)
+{
+#if defined(MAPPEDIMAGE_POSIX)
+    if (index < m_pages.size()) {
+        advise(m_pages[index].offset, m_pages[index].bytes, MADV_WILLNEED);
+    }
+#else
+    (void)index;
+#endif
+}
+
+void MappedImageFile::release(size_t index)
+{
+#if defined(MAPPEDIMAGE_POSIX)
+    if (index >= m_pages.size()) {
+        return;
+    }
+    
+    // Pages are marked for reclaim rather than discarded: a consumer may still
+    // hold a view it modified, and MADV_DONTNEED would throw its changes away.
+    // Clean pages go first, which keeps a long batch run from filling memory
+    // with old frames.
+    const Page &page = m_pages[index];
+#if defined(MADV_COLD)
+    advise(page.offset, page.bytes, MADV_COLD);
+#endif
+#if defined(__linux__)
+    posix_fadvise(m_mapping->fd, static_cast<off_t>(page.offset), static_cast<off_t>(page.bytes),
+                  POSIX_FADV_DONTNEED);
+#endif
+#else
+    (void)index;
+#endif
+}
+
+size_t MappedImageFile::mappedBytes() const
+{
+    return m_mapping ? m_mapping->length : 0;
+}
+
+bool MappedImageFile::isSupported(const std::string &filePath)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    char magic[4] = {};
+    if (!file.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return (magic[0] == 'P' && magic[1] == '5' && std::isspace(static_cast<unsigned char>(magic[2]))) ||
+           std::memcmp(magic, "II*\0", 4) == 0 || std::memcmp(magic, "MM\0*", 4) == 0;
+}
+
+bool MappedImageFile::map(const std::string &filePath)
+{
+    auto mapping = std::make_shared<FileMapping>();
+    
+#if defined(MAPPEDIMAGE_POSIX)
+    mapping->fd = ::open(filePath.c_str(), O_RDONLY);
+    struct stat status;
+    if (mapping->fd < 0 || fstat(mapping->fd, &status) != 0 || status.st_size <= 0) {
+        return false;
+    }
+    
+    // Private and writable: consumers may modify pages in place, copy-on-write
+    mapping->length = static_cast<size_t>(status.st_size);
+    void *address = mmap(nullptr, mapping->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, mapping->fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    mapping->data = static_cast<uint8_t *>(address);
+#else
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file || file.tellg() <= 0) {
+        return false;
+    }
+    mapping->buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(mapping->buffer.data()), mapping->buffer.size())) {
+        return false;
+    }
+    mapping->data = mapping->buffer.data();
+    mapping->length = mapping->buffer.size();
+#endif
+    
+    m_mapping = mapping;
+    m_filePath = filePath;
+    setAccessPattern(m_access);
+    return true;
+}
+
+bool MappedImageFile::parsePgm()
+{
+    const uint8_t *data = m_mapping->data;
+    const size_t length = m_mapping->length;
+    size_t position = 0;
+    
+    // A PGM file may hold several images back to back
+    while (position + 2 < length && data[position] == 'P' && data[position + 1] == '5') {
+        position += 2;
+        std::string width, height, maxValue;
+        if (!readPgmToken(data, length, position, width) || !readPgmToken(data, length, position, height) ||
+            !readPgmToken(data, length, position, maxValue)) {
+            break;
+        }
+    
+        Page page;
+        page.size = cv::Size(std::atoi(width.c_str()), std::atoi(height.c_str()));
+        const int maxSample = std::atoi(maxValue.c_str());
+        if (page.size.width <= 0 || page.size.height <= 0 || maxSample <= 0 || maxSample > 65535) {
+            break;
+        }
+        page.type = maxSample > 255 ? CV_16UC1 : CV_8UC1;
+        page.offset = position;
+        page.bytes = static_cast<size_t>(page.size.area()) * CV_ELEM_SIZE(page.type);
+        if (page.offset + page.bytes > length) {
+            break;
+        }
+    
+        // 16-bit PGM samples are big-endian
+        page.swapBytes = page.type == CV_16UC1 && isHostLittleEndian();
+        m_pages.push_back(page);
+    
+        // Whitespace between images is tolerated
+        position = page.offset + page.bytes;
+        while (position < length && std::isspace(data[position])) {
+            ++position;
+        }
+    }
+    
+    return !m_pages.empty();
+}
+
+bool MappedImageFile::parseTiff()
+{
+    const uint8_t *data = m_mapping->data;
+    const size_t length = m_mapping->length;
+    if (length < 8) {
+        return false;
+    }
+    
+    bool littleEndian;
+    if (data[0] == 'I' && data[1] == 'I') {
+        littleEndian = true;
+    } else if (data[0] == 'M' && data[1] == 'M') {
+        littleEndian = false;
+    } else {
+        return false;
+    }
+    
+    // Out of range reads return 0, which every caller treats as invalid
+    auto read16 = [&](size_t at) -> uint32_t {
+        if (at + 2 > length) {
+            return 0;
+        }
+        return littleEndian ? (data[at] | (data[at + 1] << 8)) : ((data[at] << 8) | data[at + 1]);
+    };
+    auto read32 = [&](size_t at) -> uint32_t {
+        if (at + 4 > length) {
+            return 0;
+        }
+        return littleEndian ? (read16(at) | (read16(at + 2) << 16)) : ((read16(at) << 16) | read16(at + 2));
+    };
+    
+    // Classic TIFF only; BigTIFF (43) stacks would need 64-bit offsets
+    if (read16(2) != 42) {
+        return false;
+    }
+    
+    // Directories already seen end the chain, so a corrupt file cannot loop
+    std::set<size_t> visited;
+    size_t directory = read32(4);
+    while (directory != 0 && visited.insert(directory).second) {
+        const uint32_t entries = read16(directory);
+        if (entries == 0 || directory + 2 + entries * 12 + 4 > length) {
+            return false;
+        }
+    
+        uint32_t width = 0, height = 0, bits = 1, compression = 1, photometric = 1;
+        uint32_t samples = 1, planar = 1, sampleFormat = 1;
+        bool tiled = false;
+        std::vector<size_t> stripOffsets, stripBytes;
+    
+        for (uint32_t entry = 0; entry < entries; ++entry) {
+            const size_t at = directory + 2 + entry * 12;
+            const uint32_t tag = read16(at);
+            const uint32_t fieldType = read16(at + 2);
+            const uint32_t count = read32(at + 4);
+    
+            // BYTE, SHORT and LONG are the only field types these tags use
+            const size_t typeSize = fieldType == 3 ? 2 : fieldType == 4 ? 4 : 1;
+            const size_t valueAt = count * typeSize <= 4 ? at + 8 : read32(at + 8);
+            auto value = [&](size_t index) -> uint32_t {
+                return fieldType == 3 ? read16(valueAt + index * 2) :
+                       fieldType == 4 ? read32(valueAt + index * 4) :
+                       (valueAt + index < length ? data[valueAt + index] : 0);
+            };
+    
+            switch (tag) {
+                case ImageWidth:                width = value(0); break;
+                case ImageLength:               height = value(0); break;
+                case BitsPerSample:             bits = value(0); break;
+                case Compression:               compression = value(0); break;
+                case PhotometricInterpretation: photometric = value(0); break;
+                case SamplesPerPixel:           samples = value(0); break;
+                case PlanarConfiguration:       planar = value(0); break;
+                case SampleFormat:              sampleFormat = value(0); break;
+                case TileWidth:                 tiled = true; break;
+                case StripOffsets:
+                case StripByteCounts: {
+                    if (count > length / typeSize) {
+                        return false;
+                    }
+                    std::vector<size_t> &values = tag == StripOffsets ? stripOffsets : stripBytes;
+                    values.resize(count);
+                    for (uint32_t i = 0; i < count; ++i) {
+                        values[i] = value(i);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    
+        // Uncompressed, single-sample, black-is-zero unsigned 8/16-bit strips only
+        if (compression != 1 || samples != 1 || planar != 1 || photometric != 1 || sampleFormat != 1 ||
+            tiled || (bits != 8 && bits != 16) || width == 0 || height == 0 ||
+            stripOffsets.empty() || stripOffsets.size() != stripBytes.size()) {
+            return false;
+        }
+    
+        Page page;
+        page.size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+        page.type = bits == 16 ? CV_16UC1 : CV_8UC1;
+        page.bytes = static_cast<size_t>(width) * height * (bits / 8);
+        page.offset = stripOffsets[0];
+        page.swapBytes = bits == 16 && littleEndian != isHostLittleEndian();
+    
+        size_t total = 0;
+        bool contiguous = true;
+        for (size_t i = 0; i < stripOffsets.size(); ++i) {
+            if (stripOffsets[i] + stripBytes[i] > length) {
+                return false;
+            }
+            contiguous = contiguous && stripOffsets[i] == page.offset + total;
+            total += stripBytes[i];
+        }
+        if (total < page.bytes) {
+            return false;
+        }
+        if (!contiguous) {
+            for (size_t i = 0; i < stripOffsets.size(); ++i) {
+                page.strips.emplace_back(stripOffsets[i], stripBytes[i]);
+            }
+        }
+        m_pages.push_back(page);
+    
+        directory = read32(directory + 2 + entries * 12);
+    }
+    
+    return !m_pages.empty();
+}
+
+void MappedImageFile::advise(size_t offset, size_t bytes, int advice)
+{
+#if defined(MAPPEDIMAGE_POSIX)
+    if (!m_mapping || bytes == 0) {
+        return;
+    }
+    
+    // madvise works on whole pages
+    static const size_t pageBytes = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t start = offset / pageBytes * pageBytes;
+    const size_t end = std::min(offset + bytes, m_mapping->length);
+    madvise(m_mapping->data + start, end - start, advice);
+#else
+    (void)offset;
+    (void)bytes;
+    (void)advice;
+#endif
+}
@@ -0,0 +1,68 @@
+#include "pixelkernels.h"
+
+#include <algorithm>
+
+namespace {
+// Rows handed to one kernel call; keeps absDifference's int total in range
+const int kMaxRowLength = 1 << 22;
+
+// Iterates an image as (row, length) pairs, merging rows when continuous
+template <typename Function>
+void forEachRow(const cv::Mat &image, bool continuous, Function function)
+{
+    if (continuous) {
+        const size_t total = image.total();
+        for (size_t offset = 0; offset < total; offset += kMaxRowLength) {
+            function(0, offset, static_cast<int>(std::min<size_t>(kMaxRowLength, total - offset)));
+        }
+    } else {
+        for (int y = 0; y < image.rows; ++y) {
+            function(y, 0, image.cols);
+        }
+    }
+}
+}
+
+void accumulateFrame(cv::Mat &sum, const cv::Mat &added, const cv::Mat *removed)
+{
+    CV_Assert(sum.type() == CV_16UC1 && added.type() == CV_8UC1 && added.size() == sum.size());
+    CV_Assert(!removed || (removed->type() == CV_8UC1 && removed->size() == sum.size()));
+    
+    const PixelKernels &kernels = pixelKernels();
+    const bool continuous = sum.isContinuous() && added.isContinuous() && (!removed || removed->isContinuous());
+    
+    forEachRow(sum, continuous, [&](int y, size_t offset, int count) {
+        kernels.accumulate(sum.ptr<uint16_t>(y) + offset, added.ptr<uint8_t>(y) + offset,
+                           removed ? removed->ptr<uint8_t>(y) + offset : nullptr, count);
+    });
+}
+
+int64_t absDifference(const cv::Mat &a, const cv::Mat &b, int &maxDifference)
+{
+    CV_Assert(a.type() == CV_8UC1 && b.type() == CV_8UC1 && a.size() == b.size());
+    
+    const PixelKernels &kernels = pixelKernels();
+    int64_t total = 0;
+    maxDifference = 0;
+    
+    forEachRow(a, a.isContinuous() && b.isContinuous(), [&](int y, size_t offset, int count) {
+        total += kernels.absDifference(a.ptr<uint8_t>(y) + offset, b.ptr<uint8_t>(y) + offset, count, &maxDifference);
+    });
+    return total;
+}
+
+void scaleTo8Bit(const cv::Mat &src, cv::Mat &dst, double scale)
+{
+    CV_Assert(src.type() == CV_16UC1);
+    
+    // Holds the input alive when dst is the same object as src
+    cv::Mat source = src;
+    dst.create(source.size(), CV_8UC1);
+    
+    const PixelKernels &kernels = pixelKernels();
+    const float factor = static_cast<float>(scale);
+    
+    forEachRow(source, source.isContinuous() && dst.isContinuous(), [&](int y, size_t offset, int count) {
+        kernels.scaleTo8Bit(source.ptr<uint16_t>(y) + offset, dst.ptr<uint8_t>(y) + offset, count, factor);
+    });
+}
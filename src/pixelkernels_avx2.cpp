@@ -0,0 +1,6 @@
+// AVX2 variant of the pixel kernels; CMakeLists.txt sets the target flags for
+// this file and cpudispatch.cpp only selects it on CPUs that support them
+#include "pixelkernelsimpl.h"
+
+extern const PixelKernels avx2PixelKernels;
+const PixelKernels avx2PixelKernels = FIBERCORE_PIXEL_KERNELS(CpuIsa::AVX2);
@@ -0,0 +1,7 @@
+// AVX-512 F/BW variant of the pixel kernels; CMakeLists.txt sets the target
+// flags for this file and cpudispatch.cpp only selects it on CPUs that
+// support them
+#include "pixelkernelsimpl.h"
+
+extern const PixelKernels avx512PixelKernels;
+const PixelKernels avx512PixelKernels = FIBERCORE_PIXEL_KERNELS(CpuIsa::AVX512);
@@ -0,0 +1,6 @@
+// NEON variant of the pixel kernels; CMakeLists.txt sets the target flags for
+// this file and cpudispatch.cpp only selects it on CPUs that support them
+#include "pixelkernelsimpl.h"
+
+extern const PixelKernels neonPixelKernels;
+const PixelKernels neonPixelKernels = FIBERCORE_PIXEL_KERNELS(CpuIsa::NEON);
@@ -0,0 +1,6 @@
+// SSE4.2 variant of the pixel kernels; CMakeLists.txt sets the target flags for
+// this file and cpudispatch.cpp only selects it on CPUs that support them
+#include "pixelkernelsimpl.h"
+
+extern const PixelKernels sse42PixelKernels;
+const PixelKernels sse42PixelKernels = FIBERCORE_PIXEL_KERNELS(CpuIsa::SSE42);
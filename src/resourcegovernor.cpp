@@ -0,0 +1,341 @@
+#include "resourcegovernor.h"
+#include "scratchpool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+// Fraction of a container limit, or of the memory the host could give us,
+// that the process plans to use; the rest absorbs allocator slack
+const double kCgroupBudgetFraction = 0.85;
+const double kHostBudgetFraction = 0.75;
+
+// Budget usage and PSI avg10 thresholds for each level
+const double kConstrainedUsage = 0.80;
+const double kCriticalUsage = 0.95;
+const double kConstrainedPressureSome = 20.0;
+const double kCriticalPressureFull = 10.0;
+
+// Calm samples needed before relaxing one level
+const int kRelaxSamples = 3;
+
+const std::chrono::milliseconds kDefaultSampleInterval(1000);
+const size_t kDefaultImageBytes = 64 * 1024 * 1024;
+const size_t kDefaultMaxCacheBytes = 256 * 1024 * 1024;
+const int kDefaultMaxInFlightImages = 8;
+
+// Cache allowances move in steps so that small RSS changes keep the plan stable
+const size_t kCacheGranularity = 16 * 1024 * 1024;
+
+// cgroup v1 reports "unlimited" as a huge page-aligned number
+const size_t kUnlimitedThreshold = size_t(1) << 60;
+
+bool readFirstLine(const std::string &path, std::string &line)
+{
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+bool readBytes(const std::string &path, size_t &bytes)
+{
+    std::string line;
+    if (!readFirstLine(path, line) || line.empty() || line == "max") {
+        return false;
+    }
+    bytes = std::strtoull(line.c_str(), nullptr, 10);
+    return true;
+}
+
+// Value of "key value" (memory.stat) or "key: value kB" (meminfo) lines
+bool readKeyedValue(const std::string &path, const std::string &key, size_t &value)
+{
+    std::ifstream file(path);
+    std::string name;
+    size_t number;
+    while (file >> name >> number) {
+        if (name == key) {
+            value = number;
+            return true;
+        }
+        file.ignore(256, '\n');
+    }
+    return false;
+}
+
+// "some avg10=1.23 avg60=..." and "full avg10=..." lines
+bool readPressure(const std::string &path, double &some, double &full)
+{
+    std::ifstream file(path);
+    std::string line;
+    bool found = false;
+    while (std::getline(file, line)) {
+        size_t position = line.find("avg10=");
+        if (position == std::string::npos) {
+            continue;
+        }
+        double value = std::strtod(line.c_str() + position + 6, nullptr);
+        if (line.compare(0, 4, "some") == 0) {
+            some = value;
+            found = true;
+        } else if (line.compare(0, 4, "full") == 0) {
+            full = value;
+        }
+    }
+    return found;
+}
+
+size_t budgetFromEnvironment()
+{
+    const char *value = std::getenv("FIBERCORE_MEMORY_BUDGET_MB");
+    return value ? std::strtoull(value, nullptr, 10) * 1024 * 1024 : 0;
+}
+}
+
+ResourceGovernor::ResourceGovernor()
+    : m_configuredBudget(budgetFromEnvironment())
+    , m_maxWorkers(std::max(1u, std::thread::hardware_concurrency()))
+    , m_maxInFlightImages(kDefaultMaxInFlightImages)
+    , m_maxCacheBytes(kDefaultMaxCacheBytes)
+    , m_imageBytesEstimate(kDefaultImageBytes)
+    , m_sampleInterval(kDefaultSampleInterval)
+    , m_cgroupV1(false)
+    , m_sampled(false)
+    , m_calmSamples(0)
+{
+    // cgroup v2: "0::/path" names our directory under the unified hierarchy
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            std::string dir = "/sys/fs/cgroup" + line.substr(3);
+            if (std::ifstream(dir + "/memory.max")) {
+                m_cgroupDir = dir;
+            } else if (std::ifstream("/sys/fs/cgroup/memory.max")) {
+                m_cgroupDir = "/sys/fs/cgroup";     // Namespaced: our cgroup is the root
+            }
+        }
+    }
+    if (m_cgroupDir.empty() && std::ifstream("/sys/fs/cgroup/memory/memory.limit_in_bytes")) {
+        m_cgroupDir = "/sys/fs/cgroup/memory";
+        m_cgroupV1 = true;
+    }
+    
+    m_plan = makePlan(ResourceLevel::Normal, 0, 0);
+}
+
+void ResourceGovernor::setMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_configuredBudget = bytes;
+    m_sampled = false;
+}
+
+size_t ResourceGovernor::configuredMemoryBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_configuredBudget;
+}
+
+void ResourceGovernor::setMaxWorkers(int workers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxWorkers = std::max(1, workers);
+}
+
+void ResourceGovernor::setMaxInFlightImages(int images)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxInFlightImages = std::max(1, images);
+}
+
+void ResourceGovernor::setMaxCacheBytes(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxCacheBytes = bytes;
+}
+
+void ResourceGovernor::setImageBytesEstimate(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_imageBytesEstimate = std::max<size_t>(1, bytes);
+}
+
+void ResourceGovernor::setSampleInterval(std::chrono::milliseconds interval)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sampleInterval = interval;
+}
+
+ResourceSample ResourceGovernor::sample() const
+{
+    ResourceSample sample;
+    
+#ifdef __linux__
+    // Resident pages are the second field of statm
+    std::ifstream statm("/proc/self/statm");
+    size_t sizePages = 0, residentPages = 0;
+    if (statm >> sizePages >> residentPages) {
+        sample.rssBytes = residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    
+    size_t availableKb = 0;
+    if (readKeyedValue("/proc/meminfo", "MemAvailable:", availableKb)) {
+        sample.availableBytes = availableKb * 1024;
+    }
+    
+    if (!m_cgroupDir.empty()) {
+        const std::string limitFile = m_cgroupV1 ? "/memory.limit_in_bytes" : "/memory.max";
+        const std::string usageFile = m_cgroupV1 ? "/memory.usage_in_bytes" : "/memory.current";
+        const std::string inactiveKey = m_cgroupV1 ? "total_inactive_file" : "inactive_file";
+    
+        size_t limit = 0;
+        if (readBytes(m_cgroupDir + limitFile, limit) && limit < kUnlimitedThreshold) {
+            sample.cgroupLimitBytes = limit;
+        }
+    
+        // Inactive page cache is reclaimed before the OOM killer runs
+        size_t usage = 0, inactive = 0;
+        if (readBytes(m_cgroupDir + usageFile, usage)) {
+            readKeyedValue(m_cgroupDir + "/memory.stat", inactiveKey, inactive);
+            sample.cgroupUsageBytes = usage > inactive ? usage - inactive : 0;
+        }
+    }
+    
+    // The cgroup's own pressure is what matters inside a container
+    sample.pressureAvailable =
+        (!m_cgroupDir.empty() && !m_cgroupV1 &&
+         readPressure(m_cgroupDir + "/memory.pressure", sample.pressureSome, sample.pressureFull)) ||
+        readPressure("/proc/pressure/memory", sample.pressureSome, sample.pressureFull);
+#endif
+    
+    return sample;
+}
+
+ResourcePlan ResourceGovernor::update()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (m_sampled && now - m_lastSampleTime < m_sampleInterval) {
+            return m_plan;
+        }
+        m_lastSampleTime = now;
+        m_sampled = true;
+    }
+    
+    // File reads happen outside the lock
+    return evaluate(sample());
+}
+
+ResourcePlan ResourceGovernor::evaluate(const ResourceSample &sample)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastSample = sample;
+    
+    const size_t budget = effectiveBudget(sample);
+    const size_t used = std::max(sample.rssBytes, sample.cgroupUsageBytes);
+    const double usage = budget > 0 ? static_cast<double>(used) / budget : 0.0;
+    
+    ResourceLevel level = ResourceLevel::Normal;
+    if (usage > kCriticalUsage || sample.pressureFull > kCriticalPressureFull) {
+        level = ResourceLevel::Critical;
+    } else if (usage > kConstrainedUsage || sample.pressureSome > kConstrainedPressureSome) {
+        level = ResourceLevel::Constrained;
+    }
+    
+    // Escalate at once; relax one level after a run of calm samples
+    if (level >= m_plan.level) {
+        m_calmSamples = 0;
+    } else if (++m_calmSamples >= kRelaxSamples) {
+        m_calmSamples = 0;
+        level = static_cast<ResourceLevel>(static_cast<int>(m_plan.level) - 1);
+    } else {
+        level = m_plan.level;
+    }
+    
+    m_plan = makePlan(level, budget, used);
+    return m_plan;
+}
+
+ResourcePlan ResourceGovernor::currentPlan() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_plan;
+}
+
+ResourceSample ResourceGovernor::lastSample() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastSample;
+}
+
+void ResourceGovernor::applyProcessLimits(const ResourcePlan &plan)
+{
+    cv::setNumThreads(plan.workers);
+    ScratchPool::instance().setRetainLimit(plan.cacheBytes);
+}
+
+const char *ResourceGovernor::levelName(ResourceLevel level)
+{
+    switch (level) {
+        case ResourceLevel::Normal:      return "normal";
+        case ResourceLevel::Constrained: return "constrained";
+        case ResourceLevel::Critical:    return "critical";
+    }
+    return "unknown";
+}
+
+size_t ResourceGovernor::effectiveBudget(const ResourceSample &sample) const
+{
+    if (m_configuredBudget > 0) {
+        // An explicit budget can only tighten a container limit
+        return sample.cgroupLimitBytes > 0 ? std::min(m_configuredBudget, sample.cgroupLimitBytes)
+                                           : m_configuredBudget;
+    }
+    if (sample.cgroupLimitBytes > 0) {
+        return static_cast<size_t>(sample.cgroupLimitBytes * kCgroupBudgetFraction);
+    }
+    if (sample.availableBytes > 0) {
+        return static_cast<size_t>((sample.rssBytes + sample.availableBytes) * kHostBudgetFraction);
+    }
+    return 0;   // Unknown: no limit
+}
+
+ResourcePlan ResourceGovernor::makePlan(ResourceLevel level, size_t budget, size_t used) const
+{
+    ResourcePlan plan;
+    plan.level = level;
+    plan.budgetBytes = budget;
+    plan.usedBytes = used;
+    
+    const size_t headroom = budget > used ? budget - used : 0;
+    const size_t imagesThatFit = headroom / (2 * m_imageBytesEstimate);
+    
+    switch (level) {
+        case ResourceLevel::Normal:
+            plan.workers = m_maxWorkers;
+            plan.inFlightImages = m_maxInFlightImages;
+            plan.cacheBytes = budget > 0 ? std::min(m_maxCacheBytes, headroom / 4) : m_maxCacheBytes;
+            break;
+        case ResourceLevel::Constrained:
+            plan.workers = std::max(1, m_maxWorkers / 2);
+            plan.inFlightImages = static_cast<int>(std::max<size_t>(1, std::min<size_t>(m_maxInFlightImages, imagesThatFit)));
+            plan.cacheBytes = std::min(m_maxCacheBytes, headroom / 8);
+            break;
+        case ResourceLevel::Critical:
+            plan.workers = 1;
+            plan.inFlightImages = 1;
+            plan.cacheBytes = 0;
+            break;
+    }
+    plan.cacheBytes = plan.cacheBytes / kCacheGranularity * kCacheGranularity;
+    return plan;
+}
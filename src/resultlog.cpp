@@ -0,0 +1,630 @@
+#include "resultlog.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RESULTLOG_POSIX 1
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+// Append-only file handle; writes report how much reached the file so a
+// failed commit can resume where it stopped
+struct LogFile {
+#if defined(RESULTLOG_POSIX)
+    int fd = -1;
+#else
+    std::FILE *file = nullptr;
+#endif
+    
+    ~LogFile()
+    {
+#if defined(RESULTLOG_POSIX)
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#else
+        if (file) {
+            std::fclose(file);
+        }
+#endif
+    }
+    
+    bool open(const std::string &path, bool truncate)
+    {
+#if defined(RESULTLOG_POSIX)
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+        return fd >= 0;
+#else
+        file = std::fopen(path.c_str(), truncate ? "wb" : "ab");
+        return file != nullptr;
+#endif
+    }
+    
+    size_t write(const void *data, size_t size)
+    {
+        size_t written = 0;
+#if defined(RESULTLOG_POSIX)
+        while (written < size) {
+            const ssize_t result = ::write(fd, static_cast<const char *>(data) + written, size - written);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(result);
+        }
+#else
+        written = std::fwrite(data, 1, size, file);
+#endif
+        return written;
+    }
+    
+    // Exclusive advisory lock on a file opened for it; false while another
+    // open file holds it. The lock goes with the descriptor.
+    bool lock(const std::string &path)
+    {
+#if defined(RESULTLOG_POSIX)
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        return fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0;
+#else
+        // Without POSIX locks the single writer is up to the caller
+        file = std::fopen(path.c_str(), "ab");
+        return file != nullptr;
+#endif
+    }
+    
+    bool sync()
+    {
+#if defined(__linux__)
+        return fdatasync(fd) == 0;
+#elif defined(RESULTLOG_POSIX)
+        return fsync(fd) == 0;
+#else
+        // Without POSIX the data is handed to the OS but not forced to disk
+        return std::fflush(file) == 0;
+#endif
+    }
+};
+
+namespace {
+const char kSegmentMagic[8] = {'F', 'I', 'R', 'S', 'E', 'G', '0', '1'};
+const char kIndexMagic[8] = {'F', 'I', 'R', 'I', 'D', 'X', '0', '1'};
+const char kIndexName[] = "results.idx";
+const char kLockName[] = "results.lock";
+
+// Both files start with their magic and a 64-bit field: the first sequence
+// number of a segment, reserved in the index
+const uint64_t kFileHeaderBytes = 16;
+
+// A longer length field is corruption, not a record
+const uint32_t kMaxRecordBytes = 64u << 20;
+
+// Records and index entries are stored in native byte order (little-endian on the station PCs)
+struct RecordHeader {
+    uint32_t length;
+    uint32_t crc;                   // Over this header with crc = 0, then the payload
+    uint64_t sequence;
+    int64_t timestampMs;
+};
+
+struct IndexEntry {
+    uint64_t sequence;
+    uint32_t segment;
+    uint32_t length;
+    uint64_t offset;                // Of the record header in the segment
+    int64_t timestampMs;
+};
+
+static_assert(sizeof(RecordHeader) == 24 && sizeof(IndexEntry) == 32, "the log layout must not depend on padding");
+
+const std::array<uint32_t, 256> &crcTable()
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+    return table;
+}
+
+// CRC-32C (Castagnoli), continuing from crc
+uint32_t crc32c(uint32_t crc, const void *data, size_t size)
+{
+    const std::array<uint32_t, 256> &table = crcTable();
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t recordCrc(RecordHeader header, const void *payload)
+{
+    header.crc = 0;
+    return crc32c(crc32c(0, &header, sizeof(header)), payload, header.length);
+}
+
+// Reads the record at the stream's position; false where the valid data ends
+bool readRecord(std::istream &in, uint64_t expectedSequence, RecordHeader &header, std::vector<uint8_t> &payload)
+{
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false;
+    }
+    if (header.length > kMaxRecordBytes || header.sequence != expectedSequence) {
+        return false;
+    }
+    payload.resize(header.length);
+    if (header.length > 0 && !in.read(reinterpret_cast<char *>(payload.data()), header.length)) {
+        return false;
+    }
+    return recordCrc(header, payload.data()) == header.crc;
+}
+
+bool readIndexEntry(const std::string &indexPath, uint64_t sequence, IndexEntry &entry)
+{
+    std::ifstream index(indexPath, std::ios::binary);
+    index.seekg(static_cast<std::streamoff>(kFileHeaderBytes + (sequence - 1) * sizeof(IndexEntry)));
+    return index.read(reinterpret_cast<char *>(&entry), sizeof(entry)) && entry.sequence == sequence;
+}
+
+bool parseSegmentName(const std::string &name, uint32_t &segment)
+{
+    // segment-NNNNNNNN.log
+    if (name.size() != 20 || name.compare(0, 8, "segment-") != 0 || name.compare(16, 4, ".log") != 0 ||
+        !std::all_of(name.begin() + 8, name.begin() + 16, [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    segment = static_cast<uint32_t>(std::stoul(name.substr(8, 8)));
+    return segment > 0;
+}
+
+void writeFileHeader(char (&header)[kFileHeaderBytes], const char (&magic)[8], uint64_t field)
+{
+    std::memcpy(header, magic, sizeof(magic));
+    std::memcpy(header + sizeof(magic), &field, sizeof(field));
+}
+
+// New directory entries survive a crash only once the directory itself is synced
+void syncDirectory(const std::string &directory)
+{
+#if defined(RESULTLOG_POSIX)
+    const int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)directory;
+#endif
+}
+
+// Writes out as much of buffer as the file takes and drops that part
+bool drain(LogFile &file, std::vector<uint8_t> &buffer)
+{
+    const size_t written = file.write(buffer.data(), buffer.size());
+    buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(written));
+    return buffer.empty();
+}
+}
+
+ResultLog::ResultLog(const ResultLogOptions &options)
+    : m_options(options)
+    , m_segment(0)
+    , m_segmentSize(0)
+    , m_lastSequence(0)
+    , m_committedSequence(0)
+    , m_pendingRecords(0)
+{
+    m_options.segmentBytes = std::max<uint64_t>(m_options.segmentBytes, kFileHeaderBytes + sizeof(RecordHeader));
+    m_options.groupCommitRecords = std::max(1, m_options.groupCommitRecords);
+    m_options.groupCommitMs = std::max(0.0, m_options.groupCommitMs);
+}
+
+ResultLog::~ResultLog()
+{
+    close();
+}
+
+bool ResultLog::open(const std::string &directory)
+{
+    close();
+    
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory, error)) {
+        return false;
+    }
+    
+    // A second writer would interleave records with colliding sequence
+    // numbers, and the next recovery would cut the log at the first of them
+    auto lockFile = std::make_unique<LogFile>();
+    if (!lockFile->lock(directory + "/" + kLockName)) {
+        return false;
+    }
+    
+    m_directory = directory;
+    m_stats = ResultLogStats();
+    if (!recover()) {
+        m_segmentFile.reset();
+        m_indexFile.reset();
+        m_directory.clear();
+        return false;
+    }
+    m_lockFile = std::move(lockFile);
+    return true;
+}
+
+void ResultLog::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    
+    sync();
+    m_segmentFile.reset();
+    m_indexFile.reset();
+    m_lockFile.reset();
+    m_directory.clear();
+    m_buffer.clear();
+    m_indexBuffer.clear();
+    m_pendingRecords = 0;
+    m_segment = 0;
+    m_segmentSize = 0;
+    m_lastSequence = 0;
+    m_committedSequence = 0;
+}
+
+bool ResultLog::isOpen() const
+{
+    return m_segmentFile && m_indexFile;
+}
+
+const std::string &ResultLog::directory() const
+{
+    return m_directory;
+}
+
+uint64_t ResultLog::append(const void *data, size_t size, int64_t timestampMs)
+{
+    if (!isOpen() || size > kMaxRecordBytes) {
+        return 0;
+    }
+    
+    // A full segment is committed and closed before the record that would overflow it
+    const uint64_t recordBytes = sizeof(RecordHeader) + size;
+    if (m_segmentSize > kFileHeaderBytes && m_segmentSize + recordBytes > m_options.segmentBytes) {
+        if (!startSegment(m_segment + 1)) {
+            return 0;
+        }
+    }
+    
+    RecordHeader header;
+    header.length = static_cast<uint32_t>(size);
+    header.crc = 0;
+    header.sequence = m_lastSequence + 1;
+    header.timestampMs = timestampMs;
+    header.crc = recordCrc(header, data);
+    
+    IndexEntry entry;
+    entry.sequence = header.sequence;
+    entry.segment = m_segment;
+    entry.length = header.length;
+    entry.offset = m_segmentSize;
+    entry.timestampMs = timestampMs;
+    
+    const uint8_t *headerBytes = reinterpret_cast<const uint8_t *>(&header);
+    const uint8_t *payload = static_cast<const uint8_t *>(data);
+    const uint8_t *entryBytes = reinterpret_cast<const uint8_t *>(&entry);
+    m_buffer.insert(m_buffer.end(), headerBytes, headerBytes + sizeof(header));
+    m_buffer.insert(m_buffer.end(), payload, payload + size);
+    m_indexBuffer.insert(m_indexBuffer.end(), entryBytes, entryBytes + sizeof(entry));
+    
+    if (m_pendingRecords == 0) {
+        m_oldestPending = std::chrono::steady_clock::now();
+    }
+    ++m_pendingRecords;
+    m_segmentSize += recordBytes;
+    m_lastSequence = header.sequence;
+    ++m_stats.records;
+    
+    // Group commit: one write and one fsync for the whole group
+    const double pendingMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_oldestPending).count();
+    if (m_pendingRecords >= static_cast<size_t>(m_options.groupCommitRecords) || pendingMs >= m_options.groupCommitMs) {
+        sync();
+    }
+    return header.sequence;
+}
+
+bool ResultLog::sync()
+{
+    if (!isOpen()) {
+        return false;
+    }
+    if (m_pendingRecords == 0) {
+        return true;
+    }
+    
+    // Records before the index entries pointing at them, so a durable entry
+    // never points at a record that is not
+    if (!drain(*m_segmentFile, m_buffer) || !m_segmentFile->sync()) {
+        return false;
+    }
+    if (!drain(*m_indexFile, m_indexBuffer) || !m_indexFile->sync()) {
+        return false;
+    }
+    
+    m_committedSequence = m_lastSequence;
+    m_pendingRecords = 0;
+    ++m_stats.commits;
+    return true;
+}
+
+size_t ResultLog::pendingRecords() const
+{
+    return m_pendingRecords;
+}
+
+uint64_t ResultLog::lastSequence() const
+{
+    return m_lastSequence;
+}
+
+bool ResultLog::read(uint64_t sequence, ResultLogRecord &record)
+{
+    if (!isOpen() || sequence == 0 || sequence > m_lastSequence) {
+        return false;
+    }
+    if (sequence > m_committedSequence && !sync()) {
+        return false;
+    }
+    
+    IndexEntry entry;
+    if (!readIndexEntry(indexPath(), sequence, entry)) {
+        return false;
+    }
+    std::ifstream segment(segmentPath(entry.segment), std::ios::binary);
+    segment.seekg(static_cast<std::streamoff>(entry.offset));
+    RecordHeader header;
+    if (!readRecord(segment, sequence, header, record.payload)) {
+        return false;
+    }
+    record.sequence = sequence;
+    record.timestampMs = header.timestampMs;
+    return true;
+}
+
+bool ResultLog::scan(uint64_t first, const std::function<bool(const ResultLogRecord &)> &visitor)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    first = std::max<uint64_t>(first, 1);
+    if (first > m_lastSequence) {
+        return true;
+    }
+    if (m_committedSequence < m_lastSequence && !sync()) {
+        return false;
+    }
+    
+    // The index finds the first record; from there the segments are read in order
+    IndexEntry entry;
+    if (!readIndexEntry(indexPath(), first, entry)) {
+        return false;
+    }
+    ResultLogRecord record;
+    RecordHeader header;
+    uint64_t expected = first;
+    for (uint32_t segment = entry.segment; expected <= m_committedSequence; ++segment) {
+        std::ifstream in(segmentPath(segment), std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(segment == entry.segment ? entry.offset : kFileHeaderBytes));
+        const uint64_t segmentFirst = expected;
+        while (expected <= m_committedSequence && readRecord(in, expected, header, record.payload)) {
+            record.sequence = expected;
+            record.timestampMs = header.timestampMs;
+            if (!visitor(record)) {
+                return true;
+            }
+            ++expected;
+        }
+        if (expected == segmentFirst && expected <= m_committedSequence) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const ResultLogStats &ResultLog::stats() const
+{
+    return m_stats;
+}
+
+bool ResultLog::recover()
+{
+    namespace fs = std::filesystem;
+    std::error_code error;
+    
+    std::vector<uint32_t> segments;
+    for (const auto &entry : fs::directory_iterator(m_directory, error)) {
+        uint32_t segment = 0;
+        if (entry.is_regular_file(error) && parseSegmentName(entry.path().filename().string(), segment)) {
+            segments.push_back(segment);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    
+    // Index entries that point past what the segments hold were written
+    // before a crash cut the segment short; they are dropped
+    const std::string index = indexPath();
+    uint64_t indexed = 0;
+    IndexEntry last{};
+    bool indexValid = false;
+    {
+        std::ifstream in(index, std::ios::binary);
+        char header[kFileHeaderBytes];
+        if (in.read(header, sizeof(header)) && std::memcmp(header, kIndexMagic, sizeof(kIndexMagic)) == 0) {
+            indexValid = true;
+            indexed = (fs::file_size(index, error) - kFileHeaderBytes) / sizeof(IndexEntry);
+        }
+        for (; indexed > 0; --indexed) {
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(kFileHeaderBytes + (indexed - 1) * sizeof(IndexEntry)));
+            if (!in.read(reinterpret_cast<char *>(&last), sizeof(last)) || last.sequence != indexed) {
+                continue;
+            }
+            const uint64_t segmentSize = fs::file_size(segmentPath(last.segment), error);
+            if (!error && last.offset + sizeof(RecordHeader) + last.length <= segmentSize) {
+                break;
+            }
+            error.clear();
+        }
+    }
+    
+    char fileHeader[kFileHeaderBytes];
+    if (indexValid) {
+        fs::resize_file(index, kFileHeaderBytes + indexed * sizeof(IndexEntry), error);
+    }
+    m_indexFile = std::make_unique<LogFile>();
+    if (error || !m_indexFile->open(index, !indexValid)) {
+        return false;
+    }
+    if (!indexValid) {
+        writeFileHeader(fileHeader, kIndexMagic, 0);
+        if (m_indexFile->write(fileHeader, sizeof(fileHeader)) != sizeof(fileHeader)) {
+            return false;
+        }
+    }
+    
+    // Records after the last indexed one are verified and indexed again. The
+    // first bad record or segment header ends the log: that segment is cut
+    // there and any later segments are set aside as .orphan files.
+    const uint32_t resumeSegment = indexed > 0 ? last.segment : (segments.empty() ? 0 : segments.front());
+    const uint64_t resumeOffset = indexed > 0 ? last.offset + sizeof(RecordHeader) + last.length : kFileHeaderBytes;
+    uint64_t expected = indexed + 1;
+    uint32_t current = 0;
+    uint64_t currentSize = 0;
+    bool ended = false;
+    std::vector<uint8_t> payload;
+    for (uint32_t segment : segments) {
+        if (segment < resumeSegment) {
+            current = segment;
+            continue;
+        }
+        const std::string path = segmentPath(segment);
+        const uint64_t size = fs::file_size(path, error);
+        if (ended) {
+            fs::rename(path, path + ".orphan", error);
+            m_stats.truncatedBytes += size;
+            continue;
+        }
+    
+        std::ifstream in(path, std::ios::binary);
+        uint64_t offset = segment == resumeSegment ? resumeOffset : kFileHeaderBytes;
+        bool headerValid = true;
+        if (offset == kFileHeaderBytes) {
+            uint64_t first = 0;
+            headerValid = in.read(fileHeader, sizeof(fileHeader)) &&
+                          std::memcmp(fileHeader, kSegmentMagic, sizeof(kSegmentMagic)) == 0 &&
+                          (std::memcpy(&first, fileHeader + sizeof(kSegmentMagic), sizeof(first)), first == expected);
+        }
+        in.seekg(static_cast<std::streamoff>(offset));
+    
+        RecordHeader header;
+        while (headerValid && readRecord(in, expected, header, payload)) {
+            IndexEntry entry{expected, segment, header.length, offset, header.timestampMs};
+            const uint8_t *entryBytes = reinterpret_cast<const uint8_t *>(&entry);
+            m_indexBuffer.insert(m_indexBuffer.end(), entryBytes, entryBytes + sizeof(entry));
+            offset += sizeof(RecordHeader) + header.length;
+            ++expected;
+            ++m_stats.recoveredRecords;
+        }
+    
+        // A segment whose header did not survive is started over
+        if (offset < size || !headerValid) {
+            ended = true;
+            m_stats.truncatedBytes += size - (headerValid ? offset : 0);
+            if (headerValid) {
+                fs::resize_file(path, offset, error);
+            } else {
+                std::ofstream rewritten(path, std::ios::binary | std::ios::trunc);
+                writeFileHeader(fileHeader, kSegmentMagic, expected);
+                rewritten.write(fileHeader, sizeof(fileHeader));
+                offset = kFileHeaderBytes;
+            }
+        }
+        current = segment;
+        currentSize = offset;
+    }
+    
+    // The recovered entries are committed before anything new is appended
+    m_lastSequence = m_committedSequence = expected - 1;
+    m_stats.records = m_lastSequence;
+    if (!drain(*m_indexFile, m_indexBuffer) || !m_indexFile->sync()) {
+        return false;
+    }
+    
+    if (current == 0) {
+        return startSegment(1);
+    }
+    if (current < resumeSegment || currentSize == 0) {
+        currentSize = fs::file_size(segmentPath(current), error);
+    }
+    m_segmentFile = std::make_unique<LogFile>();
+    if (!m_segmentFile->open(segmentPath(current), false)) {
+        return false;
+    }
+    m_segment = current;
+    m_segmentSize = currentSize;
+    m_stats.segments = static_cast<uint32_t>(std::count_if(segments.begin(), segments.end(),
+                                                           [&](uint32_t segment) { return segment <= current; }));
+    return true;
+}
+
+bool ResultLog::startSegment(uint32_t segment)
+{
+    // The full segment is committed before the next one begins
+    if (m_segmentFile && !sync()) {
+        return false;
+    }
+    
+    auto file = std::make_unique<LogFile>();
+    char header[kFileHeaderBytes];
+    writeFileHeader(header, kSegmentMagic, m_lastSequence + 1);
+    if (!file->open(segmentPath(segment), true) || file->write(header, sizeof(header)) != sizeof(header) || !file->sync()) {
+        return false;
+    }
+    syncDirectory(m_directory);
+    
+    m_segmentFile = std::move(file);
+    m_segment = segment;
+    m_segmentSize = kFileHeaderBytes;
+    ++m_stats.segments;
+    return true;
+}
+
+std::string ResultLog::segmentPath(uint32_t segment) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%08u.log", segment);
+    return m_directory + "/" + name;
+}
+
+std::string ResultLog::indexPath() const
+{
+    return m_directory + "/" + kIndexName;
+}
@@ -1,6 +1,8 @@
 #include "resultsmanager.h"
 
 #include <QDebug>
+#include <QCborMap>
+#include <QCborValue>
 #include <QFile>
 #include <QDir>
 #include <QFileInfo>
@@ -12,17 +14,26 @@
 #include <QStandardPaths>
 #include <QProcess>
 
+#include <utility>
+
 ResultsManager::ResultsManager(QObject *parent)
     : QObject(parent)
     , m_isSessionActive(false)
     , m_defaultSaveLocation(QDir::homePath() + "/FiberInspector/Results")
     , m_autoSaveEnabled(false)
+    , m_commitTimer(new QTimer(this))
+    , m_lastSavedSequence(0)
 {
     // Create default save directory if it doesn't exist
     QDir dir(m_defaultSaveLocation);
     if (!dir.exists()) {
         dir.mkpath(".");
     }
+    
+    m_commitTimer->setSingleShot(true);
+    m_commitTimer->setInterval(static_cast<int>(ResultLogOptions().groupCommitMs));
+    connect(m_commitTimer, &QTimer::timeout, this, &ResultsManager::flushResults);
+    openResultLog();
 }
 
 ResultsManager::~ResultsManager()
@@ -30,15 +41,52 @@ ResultsManager::~ResultsManager()
     if (m_isSessionActive) {
         endSession();
     }
+    m_resultLog.close();
 }
 
 bool ResultsManager::saveResult(const FiberAnalysisResult &result, const QString &imagePath)
 {
-    QString filename = generateResultFilename(m_defaultSaveLocation);
-    return saveResultAs(result, filename);
+    return saveResult(FiberAnalysisResult(result), imagePath);
+}
+
+bool ResultsManager::saveResult(FiberAnalysisResult &&result, const QString &imagePath)
+{
+    if (!m_resultLog.isOpen()) {
+        qWarning() << "Result log is not open in:" << m_defaultSaveLocation;
+        return false;
+    }
+    
+    // One record per result: the JSON mapping saveResultAs writes, as CBOR
+    QJsonObject resultJson = resultToJson(result);
+    resultJson["image_path"] = imagePath;
+    const QByteArray record = QCborValue(QCborMap::fromJsonObject(resultJson)).toCbor();
+    const quint64 sequence = m_resultLog.append(record.constData(), static_cast<size_t>(record.size()),
+                                                QDateTime::currentMSecsSinceEpoch());
+    if (sequence == 0) {
+        qWarning() << "Could not append result to log in:" << m_defaultSaveLocation;
+        return false;
+    }
+    m_lastSavedSequence = sequence;
+    
+    // A group still open when saves stop is committed by the timer
+    if (m_resultLog.pendingRecords() > 0 && !m_commitTimer->isActive()) {
+        m_commitTimer->start();
+    }
+    
+    // If we're in a session, add this result to the session
+    if (m_isSessionActive) {
+        addToSession(std::move(result), imagePath);
+    }
+    
+    return true;
 }
 
 bool ResultsManager::saveResultAs(const FiberAnalysisResult &result, const QString &filePath)
+{
+    return saveResultAs(FiberAnalysisResult(result), filePath);
+}
+
+bool ResultsManager::saveResultAs(FiberAnalysisResult &&result, const QString &filePath)
 {
     // Convert result to JSON and save
     QJsonObject resultJson = resultToJson(result);
@@ -55,7 +103,7 @@ bool ResultsManager::saveResultAs(const FiberAnalysisResult &result, const QStri
     
     // If we're in a session, add this result to the session
     if (m_isSessionActive) {
-        addToSession(result, filePath);
+        addToSession(std::move(result), filePath);
     }
     
     return true;
@@ -84,6 +132,39 @@ FiberAnalysisResult ResultsManager::loadResult(const QString &filePath)
     return jsonToResult(obj);
 }
 
+quint64 ResultsManager::lastSavedSequence() const
+{
+    return m_lastSavedSequence;
+}
+
+FiberAnalysisResult ResultsManager::loadLoggedResult(quint64 sequence, QString *imagePath)
+{
+    ResultLogRecord record;
+    if (!m_resultLog.read(sequence, record)) {
+        qWarning() << "Could not read result" << sequence << "from log in:" << m_defaultSaveLocation;
+        return FiberAnalysisResult();
+    }
+    
+    const QByteArray data(reinterpret_cast<const char *>(record.payload.data()), static_cast<int>(record.payload.size()));
+    QJsonObject obj = QCborValue::fromCbor(data).toMap().toJsonObject();
+    if (imagePath) {
+        *imagePath = obj["image_path"].toString();
+    }
+    return jsonToResult(obj);
+}
+
+bool ResultsManager::flushResults()
+{
+    m_commitTimer->stop();
+    if (m_resultLog.sync()) {
+        return true;
+    }
+    
+    // Still buffered; the next save or flush tries again
+    qWarning() << "Could not commit results to log in:" << m_defaultSaveLocation;
+    return false;
+}
+
 void ResultsManager::startNewSession(const QString &operatorName)
 {
     // End current session if active
@@ -117,6 +198,11 @@ void ResultsManager::endSession()
 }
 
 void ResultsManager::addToSession(const FiberAnalysisResult &result, const QString &imagePath)
+{
+    addToSession(FiberAnalysisResult(result), imagePath);
+}
+
+void ResultsManager::addToSession(FiberAnalysisResult &&result, const QString &imagePath)
 {
     if (!m_isSessionActive) {
         qWarning() << "No active session to add result to";
@@ -124,7 +210,7 @@ void ResultsManager::addToSession(const FiberAnalysisResult &result, const QStri
     }
     
     m_currentSession.imagePath = imagePath;
-    m_currentSession.result = result;
+    m_currentSession.result = std::move(result);
     
     qDebug() << "Added result to session, image path:" << imagePath;
 }
@@ -160,13 +246,13 @@ bool ResultsManager::exportToPDF(const FiberAnalysisResult &result, const QStrin
     out << "-------------\n";
     for (int i = 0; i < result.defects.size(); ++i) {
         const FiberDefect &defect = result.defects[i];
-        out << (i + 1) << ". " << defect.description 
+        out << (i + 1) << ". " << defect.description()
             << " (Severity: " << defect.severity << ")\n";
     }
     
     out << "\nSUMMARY\n";
     out << "-------\n";
-    out << result.summary << "\n";
+    out << result.summary() << "\n";
     
     file.close();
     
@@ -349,6 +435,9 @@ void ResultsManager::setDefaultSaveLocation(const QString &location)
     if (!dir.exists()) {
         dir.mkpath(".");
     }
+    
+    // New results go to the log in the new location
+    openResultLog();
 }
 
 QString ResultsManager::getDefaultSaveLocation() const
@@ -366,13 +455,21 @@ bool ResultsManager::isAutoSaveEnabled() const
     return m_autoSaveEnabled;
 }
 
-QString ResultsManager::generateResultFilename(const QString &basePath)
+void ResultsManager::openResultLog()
 {
-    // Create a filename based on current date/time
-    QString timestamp = QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss");
-    QString filename = basePath + "/fiber_analysis_" + timestamp + ".fir";
+    // Closing the previous log commits what it still buffers
+    m_commitTimer->stop();
+    m_lastSavedSequence = 0;
+    if (!m_resultLog.open(QFile::encodeName(QDir(m_defaultSaveLocation).absolutePath()).toStdString())) {
+        qWarning() << "Could not open result log, or another instance is writing to it, in:" << m_defaultSaveLocation;
+        return;
+    }
     
-    return filename;
+    const ResultLogStats &stats = m_resultLog.stats();
+    if (stats.recoveredRecords > 0 || stats.truncatedBytes > 0) {
+        qWarning() << "Result log recovered" << stats.recoveredRecords << "records and cut"
+                   << stats.truncatedBytes << "torn bytes in:" << m_defaultSaveLocation;
+    }
 }
 
 QJsonObject ResultsManager::resultToJson(const FiberAnalysisResult &result)
@@ -384,7 +481,23 @@ QJsonObject ResultsManager::resultToJson(const FiberAnalysisResult &result)
     resultObj["core_clad_ratio"] = result.coreCladRatio;
     resultObj["concentricity"] = result.concentricity;
     resultObj["overall_quality"] = result.overallQuality;
-    resultObj["summary"] = result.summary;
+    resultObj["summary"] = result.summary();
+    resultObj["ideal_core_clad_ratio"] = result.idealCoreCladRatio;
+    if (!result.error.isEmpty()) {
+        resultObj["error"] = result.error;
+    }
+    resultObj["quality_issue"] = static_cast<int>(result.qualityIssue);
+    resultObj["degraded"] = result.degraded;
+    resultObj["analysis_time_ms"] = result.analysisTimeMs;
+    
+    // Geometry is enough to redraw the annotation overlay after loading
+    QJsonObject geometryObj;
+    geometryObj["center_x"] = result.geometry.center.x;
+    geometryObj["center_y"] = result.geometry.center.y;
+    geometryObj["cladding_radius"] = result.geometry.claddingRadius;
+    geometryObj["core_radius"] = result.geometry.coreRadius;
+    geometryObj["confidence"] = result.geometry.confidence;
+    resultObj["geometry"] = geometryObj;
     
     // Convert defects to JSON array
     QJsonArray defectsArray;
@@ -400,7 +513,12 @@ QJsonObject ResultsManager::resultToJson(const FiberAnalysisResult &result)
         
         defectObj["bounding_box"] = boundingBoxObj;
         defectObj["severity"] = defect.severity;
-        defectObj["description"] = defect.description;
+        defectObj["description"] = QString::fromLatin1(defect.description());
+        if (defect.trackId > 0) {
+            defectObj["track_id"] = defect.trackId;
+            defectObj["hits"] = defect.hits;
+            defectObj["confidence"] = defect.confidence;
+        }
         
         defectsArray.append(defectObj);
     }
@@ -419,7 +537,18 @@ FiberAnalysisResult ResultsManager::jsonToResult(const QJsonObject &json)
     result.coreCladRatio = json["core_clad_ratio"].toDouble();
     result.concentricity = json["concentricity"].toDouble();
     result.overallQuality = json["overall_quality"].toDouble();
-    result.summary = json["summary"].toString();
+    result.idealCoreCladRatio = json["ideal_core_clad_ratio"].toDouble();
+    result.error = json["error"].toString();
+    result.qualityIssue = static_cast<FrameQualityIssue>(json["quality_issue"].toInt());
+    result.degraded = json["degraded"].toBool();
+    result.analysisTimeMs = json["analysis_time_ms"].toDouble();
+    
+    QJsonObject geometryObj = json["geometry"].toObject();
+    result.geometry.center = cv::Point2f(static_cast<float>(geometryObj["center_x"].toDouble()),
+                                         static_cast<float>(geometryObj["center_y"].toDouble()));
+    result.geometry.claddingRadius = static_cast<float>(geometryObj["cladding_radius"].toDouble());
+    result.geometry.coreRadius = static_cast<float>(geometryObj["core_radius"].toDouble());
+    result.geometry.confidence = static_cast<float>(geometryObj["confidence"].toDouble());
     
     // Extract defects from JSON array
     QJsonArray defectsArray = json["defects"].toArray();
@@ -438,7 +567,9 @@ FiberAnalysisResult ResultsManager::jsonToResult(const QJsonObject &json)
         );
         
         defect.severity = defectObj["severity"].toDouble();
-        defect.description = defectObj["description"].toString();
+        defect.trackId = defectObj["track_id"].toInt();
+        defect.hits = defectObj["hits"].toInt(1);
+        defect.confidence = static_cast<float>(defectObj["confidence"].toDouble(1.0));
         
         result.defects.append(defect);
     }
@@ -0,0 +1,336 @@
+#include "scratchdetector.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Rows filtered and steered per parallel task
+const int kStripeRows = 64;
+
+// The noise level is estimated on every kNoiseSampleStep-th pixel and row
+const int kNoiseSampleStep = 4;
+
+// MAD of a normal distribution times this is its standard deviation
+const double kMadToSigma = 1.4826;
+
+// Collinear pieces: direction and sideways offset tolerances
+const float kJoinAngleDegrees = 8.0f;
+const float kJoinOffset = 4.0f;
+
+float angleDifference(float a, float b)
+{
+    float difference = std::fmod(std::abs(a - b), 180.0f);
+    return std::min(difference, 180.0f - difference);
+}
+
+float segmentAngle(const cv::Point &start, const cv::Point &end)
+{
+    float angle = static_cast<float>(std::atan2(end.y - start.y, end.x - start.x) * 180.0 / CV_PI);
+    return angle < 0.0f ? angle + 180.0f : (angle >= 180.0f ? angle - 180.0f : angle);
+}
+}
+
+void makeGaussianDerivativeKernels(double sigma, cv::Mat &gaussian, cv::Mat &firstDerivative, cv::Mat &secondDerivative)
+{
+    const int radius = static_cast<int>(std::ceil(3.0 * sigma));
+    gaussian.create(2 * radius + 1, 1, CV_32F);
+    firstDerivative.create(2 * radius + 1, 1, CV_32F);
+    secondDerivative.create(2 * radius + 1, 1, CV_32F);
+    double gaussianSum = 0.0;
+    for (int i = -radius; i <= radius; ++i) {
+        gaussianSum += std::exp(-i * i / (2.0 * sigma * sigma));
+    }
+    double secondSum = 0.0;
+    for (int i = -radius; i <= radius; ++i) {
+        double g = std::exp(-i * i / (2.0 * sigma * sigma)) / gaussianSum;
+        gaussian.at<float>(i + radius) = static_cast<float>(g);
+        firstDerivative.at<float>(i + radius) = static_cast<float>(-i / (sigma * sigma) * g);
+        secondDerivative.at<float>(i + radius) = static_cast<float>((i * i / (sigma * sigma) - 1.0) / (sigma * sigma) * g);
+        secondSum += secondDerivative.at<float>(i + radius);
+    }
+    
+    // Remove the sampled kernel's residual DC response
+    for (int i = 0; i <= 2 * radius; ++i) {
+        secondDerivative.at<float>(i) -= static_cast<float>(secondSum * gaussian.at<float>(i));
+    }
+}
+
+ScratchDetector::ScratchDetector(const ScratchOptions &options)
+    : m_options(options)
+{
+    buildKernels();
+}
+
+void ScratchDetector::setOptions(const ScratchOptions &options)
+{
+    m_options = options;
+    buildKernels();
+}
+
+const ScratchOptions &ScratchDetector::options() const
+{
+    return m_options;
+}
+
+const cv::Mat &ScratchDetector::response() const
+{
+    return m_response;
+}
+
+const cv::Mat &ScratchDetector::orientation() const
+{
+    return m_orientation;
+}
+
+void ScratchDetector::buildKernels()
+{
+    m_options.sigma = std::max(0.5, m_options.sigma);
+    m_options.orientations = std::max(2, std::min(m_options.orientations, 32));
+    m_options.minLength = std::max(2, m_options.minLength);
+    
+    makeGaussianDerivativeKernels(m_options.sigma, m_gaussian, m_firstDerivative, m_secondDerivative);
+    
+    // Filter normals spread over half a turn, with the neighbour step used for thinning
+    m_cos.resize(m_options.orientations);
+    m_sin.resize(m_options.orientations);
+    m_normalStep.resize(m_options.orientations);
+    for (int k = 0; k < m_options.orientations; ++k) {
+        double theta = k * CV_PI / m_options.orientations;
+        m_cos[k] = static_cast<float>(std::cos(theta));
+        m_sin[k] = static_cast<float>(std::sin(theta));
+        m_normalStep[k] = cv::Point(cvRound(m_cos[k]), cvRound(m_sin[k]));
+    }
+}
+
+std::vector<ScratchSegment> ScratchDetector::detect(const cv::Mat &gray, const cv::Mat &mask)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == gray.size()));
+    
+    std::vector<ScratchSegment> segments;
+    if (gray.empty()) {
+        return segments;
+    }
+    
+    m_dx.create(gray.size(), CV_32F);
+    m_dy.create(gray.size(), CV_32F);
+    m_dxx.create(gray.size(), CV_32F);
+    m_dyy.create(gray.size(), CV_32F);
+    m_dxy.create(gray.size(), CV_32F);
+    m_response.create(gray.size(), CV_32F);
+    m_orientation.create(gray.size(), CV_8U);
+    m_ridges.create(gray.size(), CV_8U);
+    
+    // Basis filters and the steered bank, stripe by stripe
+    const int stripes = (gray.rows + kStripeRows - 1) / kStripeRows;
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        for (int stripe = range.start; stripe < range.end; ++stripe) {
+            filterStripe(gray, cv::Range(stripe * kStripeRows, std::min(gray.rows, (stripe + 1) * kStripeRows)));
+        }
+    });
+    
+    // The ridge threshold follows the frame's own response noise
+    const float threshold = ridgeThreshold(mask);
+    
+    // Thinning reads the neighbouring rows, so it waits for the whole response
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        for (int stripe = range.start; stripe < range.end; ++stripe) {
+            thinStripe(mask, threshold, cv::Range(stripe * kStripeRows, std::min(gray.rows, (stripe + 1) * kStripeRows)));
+        }
+    });
+    
+    // Segments on the thinned ridges; Hough bridges short gaps along a line
+    std::vector<cv::Vec4i> lines;
+    cv::HoughLinesP(m_ridges, lines, 1.0, CV_PI / 180.0, std::max(1, m_options.minLength / 2),
+                    m_options.minLength, m_options.maxLineGap);
+    segments.reserve(lines.size());
+    for (const cv::Vec4i &line : lines) {
+        ScratchSegment segment;
+        segment.start = cv::Point(line[0], line[1]);
+        segment.end = cv::Point(line[2], line[3]);
+        segment.angle = segmentAngle(segment.start, segment.end);
+        segment.strength = meanResponse(segment.start, segment.end);
+        segments.push_back(segment);
+    }
+    
+    return joinCollinear(std::move(segments));
+}
+
+void ScratchDetector::filterStripe(const cv::Mat &gray, const cv::Range &rows)
+{
+    // Views of a larger image read their border from the real neighbouring
+    // pixels, so stripes join without seams
+    const cv::Mat source = gray.rowRange(rows);
+    cv::Mat dx = m_dx.rowRange(rows);
+    cv::Mat dy = m_dy.rowRange(rows);
+    cv::Mat dxx = m_dxx.rowRange(rows);
+    cv::Mat dyy = m_dyy.rowRange(rows);
+    cv::Mat dxy = m_dxy.rowRange(rows);
+    cv::sepFilter2D(source, dx, CV_32F, m_firstDerivative, m_gaussian);
+    cv::sepFilter2D(source, dy, CV_32F, m_gaussian, m_firstDerivative);
+    cv::sepFilter2D(source, dxx, CV_32F, m_secondDerivative, m_gaussian);
+    cv::sepFilter2D(source, dyy, CV_32F, m_gaussian, m_secondDerivative);
+    cv::sepFilter2D(source, dxy, CV_32F, m_firstDerivative, m_firstDerivative);
+    
+    // Steer every orientation from the basis: scale-normalized second
+    // derivative across the line, less the gradient along the same normal
+    const float lineScale = static_cast<float>(m_options.sigma * m_options.sigma);
+    const float edgeScale = static_cast<float>(m_options.sigma * m_options.edgeRejection);
+    const int orientations = m_options.orientations;
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *rowDx = m_dx.ptr<float>(y);
+        const float *rowDy = m_dy.ptr<float>(y);
+        const float *rowDxx = m_dxx.ptr<float>(y);
+        const float *rowDyy = m_dyy.ptr<float>(y);
+        const float *rowDxy = m_dxy.ptr<float>(y);
+        float *response = m_response.ptr<float>(y);
+        uint8_t *orientation = m_orientation.ptr<uint8_t>(y);
+        std::fill(response, response + m_response.cols, -FLT_MAX);
+    
+        // One orientation at a time over the row keeps the inner loop branch-free
+        for (int k = 0; k < orientations; ++k) {
+            const float cc = lineScale * m_cos[k] * m_cos[k];
+            const float cs = lineScale * 2.0f * m_cos[k] * m_sin[k];
+            const float ss = lineScale * m_sin[k] * m_sin[k];
+            const float ec = edgeScale * m_cos[k];
+            const float es = edgeScale * m_sin[k];
+            const uint8_t label = static_cast<uint8_t>(k);
+            for (int x = 0; x < m_response.cols; ++x) {
+                float line = cc * rowDxx[x] + cs * rowDxy[x] + ss * rowDyy[x];
+                float edge = ec * rowDx[x] + es * rowDy[x];
+                float score = std::abs(line) - std::abs(edge);
+                bool better = score > response[x];
+                response[x] = better ? score : response[x];
+                orientation[x] = better ? label : orientation[x];
+            }
+        }
+    }
+}
+
+void ScratchDetector::thinStripe(const cv::Mat &mask, float threshold, const cv::Range &rows)
+{
+    // Keep ridge pixels at least as strong as both neighbours across the line
+    const int width = m_response.cols;
+    const int height = m_response.rows;
+    for (int y = rows.start; y < rows.end; ++y) {
+        const float *response = m_response.ptr<float>(y);
+        const uint8_t *orientation = m_orientation.ptr<uint8_t>(y);
+        const uint8_t *allowed = mask.empty() ? nullptr : mask.ptr<uint8_t>(y);
+        uint8_t *ridges = m_ridges.ptr<uint8_t>(y);
+        for (int x = 0; x < width; ++x) {
+            const float value = response[x];
+            bool ridge = value > threshold && (!allowed || allowed[x]);
+            if (ridge) {
+                const cv::Point &step = m_normalStep[orientation[x]];
+                for (int side = -1; side <= 1 && ridge; side += 2) {
+                    const int nx = x + side * step.x;
+                    const int ny = y + side * step.y;
+                    if (nx >= 0 && ny >= 0 && nx < width && ny < height && m_response.at<float>(ny, nx) > value) {
+                        ridge = false;
+                    }
+                }
+            }
+            ridges[x] = ridge ? 255 : 0;
+        }
+    }
+}
+
+std::vector<ScratchSegment> ScratchDetector::joinCollinear(std::vector<ScratchSegment> segments) const
+{
+    // Hough reports a scratch with gaps longer than maxLineGap as several
+    // pieces; join pieces on the same line, longest first, until none is left
+    std::sort(segments.begin(), segments.end(), [](const ScratchSegment &a, const ScratchSegment &b) {
+        return a.length() > b.length();
+    });
+    
+    bool joined = true;
+    while (joined) {
+        joined = false;
+        for (size_t i = 0; i < segments.size() && !joined; ++i) {
+            for (size_t j = i + 1; j < segments.size() && !joined; ++j) {
+                ScratchSegment &a = segments[i];
+                const ScratchSegment &b = segments[j];
+                if (angleDifference(a.angle, b.angle) > kJoinAngleDegrees) {
+                    continue;
+                }
+    
+                // Position of b's ends along a's direction, and their distance from a's line
+                const cv::Point2f origin(a.start);
+                cv::Point2f direction = cv::Point2f(a.end - a.start);
+                const float lengthA = std::max(1.0f, static_cast<float>(cv::norm(direction)));
+                direction *= 1.0f / lengthA;
+                const cv::Point2f toStart = cv::Point2f(b.start) - origin;
+                const cv::Point2f toEnd = cv::Point2f(b.end) - origin;
+                const float offsetStart = std::abs(toStart.x * direction.y - toStart.y * direction.x);
+                const float offsetEnd = std::abs(toEnd.x * direction.y - toEnd.y * direction.x);
+                const float alongStart = toStart.dot(direction);
+                const float alongEnd = toEnd.dot(direction);
+                const float gap = std::max(std::min(alongStart, alongEnd) - lengthA, -std::max(alongStart, alongEnd));
+                if (offsetStart > kJoinOffset || offsetEnd > kJoinOffset || gap > m_options.maxJoinGap) {
+                    continue;
+                }
+    
+                // The joined segment spans the outermost of the four ends
+                const cv::Point ends[4] = {a.start, a.end, b.start, b.end};
+                const float along[4] = {0.0f, lengthA, alongStart, alongEnd};
+                const int first = static_cast<int>(std::min_element(along, along + 4) - along);
+                const int last = static_cast<int>(std::max_element(along, along + 4) - along);
+                const double lengthB = b.length();
+                a.strength = static_cast<float>((a.strength * lengthA + b.strength * lengthB) / (lengthA + lengthB));
+                a.start = ends[first];
+                a.end = ends[last];
+                a.angle = segmentAngle(a.start, a.end);
+                segments.erase(segments.begin() + j);
+                joined = true;
+            }
+        }
+    }
+    
+    std::sort(segments.begin(), segments.end(), [](const ScratchSegment &a, const ScratchSegment &b) {
+        return a.length() > b.length();
+    });
+    return segments;
+}
+
+float ScratchDetector::ridgeThreshold(const cv::Mat &mask) const
+{
+    // Median and MAD over a sparse sample: a strong edge or a long scratch
+    // covers few pixels, so unlike the standard deviation they barely move it
+    std::vector<float> samples;
+    for (int y = 0; y < m_response.rows; y += kNoiseSampleStep) {
+        const float *response = m_response.ptr<float>(y);
+        const uint8_t *allowed = mask.empty() ? nullptr : mask.ptr<uint8_t>(y);
+        for (int x = 0; x < m_response.cols; x += kNoiseSampleStep) {
+            if (!allowed || allowed[x]) {
+                samples.push_back(response[x]);
+            }
+        }
+    }
+    if (samples.empty()) {
+        return static_cast<float>(m_options.minResponse);
+    }
+    
+    const size_t middle = samples.size() / 2;
+    std::nth_element(samples.begin(), samples.begin() + middle, samples.end());
+    const float median = samples[middle];
+    for (float &sample : samples) {
+        sample = std::abs(sample - median);
+    }
+    std::nth_element(samples.begin(), samples.begin() + middle, samples.end());
+    const double sigma = kMadToSigma * samples[middle];
+    return static_cast<float>(std::max(m_options.minResponse, median + m_options.noiseFactor * sigma));
+}
+
+float ScratchDetector::meanResponse(const cv::Point &start, const cv::Point &end) const
+{
+    cv::LineIterator it(m_response, start, end, 8);
+    double sum = 0.0;
+    for (int i = 0; i < it.count; ++i, ++it) {
+        sum += std::max(0.0f, m_response.at<float>(it.pos()));
+    }
+    return it.count > 0 ? static_cast<float>(sum / it.count) : 0.0f;
+}
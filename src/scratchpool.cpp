@@ -0,0 +1,236 @@
+#include "scratchpool.h"
+
+#include <algorithm>
+
+namespace {
+// Smaller matrices (kernels, thumbnails, per-contour data) are not worth a lock
+const size_t kMinPooledBytes = 16 * 1024;
+
+// Four classes per power of two, up to 2^63
+const int kClassesPerOctave = 4;
+const int kSizeClasses = 64 * kClassesPerOctave;
+
+const size_t kDefaultRetainLimit = 256 * 1024 * 1024;
+
+int floorLog2(size_t value)
+{
+    int log = 0;
+    while (value >>= 1) {
+        ++log;
+    }
+    return log;
+}
+}
+
+ScratchPool &ScratchPool::instance()
+{
+    // Never destroyed: matrices still alive during static destruction must
+    // be able to return their buffers
+    static ScratchPool *pool = new ScratchPool();
+    return *pool;
+}
+
+ScratchPool::ScratchPool()
+    : m_installed(false)
+    , m_freeBuffers(kSizeClasses)
+    , m_retainLimit(kDefaultRetainLimit)
+{
+}
+
+ScratchPool::~ScratchPool()
+{
+    trim();
+}
+
+void ScratchPool::install()
+{
+    cv::Mat::setDefaultAllocator(this);
+    m_installed = true;
+}
+
+void ScratchPool::uninstall()
+{
+    cv::Mat::setDefaultAllocator(cv::Mat::getStdAllocator());
+    m_installed = false;
+}
+
+bool ScratchPool::isInstalled() const
+{
+    return m_installed;
+}
+
+void ScratchPool::setRetainLimit(size_t bytes)
+{
+    std::vector<void *> released;
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retainLimit = bytes;
+    
+        // Drop the largest free buffers first until the pool fits
+        for (int index = kSizeClasses - 1; index >= 0 && m_stats.retainedBytes > m_retainLimit; --index) {
+            std::vector<void *> &bin = m_freeBuffers[index];
+            while (!bin.empty() && m_stats.retainedBytes > m_retainLimit) {
+                released.push_back(bin.back());
+                bin.pop_back();
+                m_stats.retainedBytes -= classBytes(index);
+            }
+        }
+    }
+    
+    for (void *buffer : released) {
+        cv::fastFree(buffer);
+    }
+}
+
+size_t ScratchPool::retainLimit() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_retainLimit;
+}
+
+void ScratchPool::trim()
+{
+    std::vector<std::vector<void *>> released(kSizeClasses);
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        released.swap(m_freeBuffers);
+        m_stats.retainedBytes = 0;
+    }
+    
+    for (const std::vector<void *> &bin : released) {
+        for (void *buffer : bin) {
+            cv::fastFree(buffer);
+        }
+    }
+}
+
+ScratchPoolStats ScratchPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void ScratchPool::resetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.passThrough = 0;
+    m_stats.peakBytesInUse = m_stats.bytesInUse;
+}
+
+cv::UMatData *ScratchPool::allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                                    ScratchAccessFlags flags, cv::UMatUsageFlags usageFlags) const
+{
+    cv::MatAllocator *standard = cv::Mat::getStdAllocator();
+    
+    // Caller-owned memory is only wrapped, never pooled
+    if (data) {
+        return standard->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i) {
+        if (step) {
+            step[i] = total;
+        }
+        total *= sizes[i];
+    }
+    
+    if (total < kMinPooledBytes) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.passThrough;
+        }
+        return standard->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    
+    const int index = sizeClass(total);
+    const size_t bytes = classBytes(index);
+    void *buffer = nullptr;
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<void *> &bin = m_freeBuffers[index];
+        if (!bin.empty()) {
+            buffer = bin.back();
+            bin.pop_back();
+            m_stats.retainedBytes -= bytes;
+            ++m_stats.hits;
+        } else {
+            ++m_stats.misses;
+        }
+        m_stats.bytesInUse += bytes;
+        m_stats.peakBytesInUse = std::max(m_stats.peakBytesInUse, m_stats.bytesInUse);
+    }
+    
+    if (!buffer) {
+        try {
+            buffer = cv::fastMalloc(bytes);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.bytesInUse -= bytes;
+            throw;
+        }
+    }
+    
+    cv::UMatData *matData = new cv::UMatData(this);
+    matData->data = matData->origdata = static_cast<uchar *>(buffer);
+    matData->size = total;
+    return matData;
+}
+
+bool ScratchPool::allocate(cv::UMatData *data, ScratchAccessFlags, cv::UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void ScratchPool::deallocate(cv::UMatData *data) const
+{
+    if (!data) {
+        return;
+    }
+    
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    
+    // Only pooled buffers carry this allocator; everything else went to OpenCV's
+    const int index = sizeClass(data->size);
+    const size_t bytes = classBytes(index);
+    void *buffer = data->origdata;
+    delete data;
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.bytesInUse -= bytes;
+        if (m_stats.retainedBytes + bytes <= m_retainLimit) {
+            m_freeBuffers[index].push_back(buffer);
+            m_stats.retainedBytes += bytes;
+            buffer = nullptr;
+        }
+    }
+    
+    if (buffer) {
+        cv::fastFree(buffer);
+    }
+}
+
+int ScratchPool::sizeClass(size_t bytes)
+{
+    const int octave = floorLog2(bytes);
+    const size_t base = size_t(1) << octave;
+    
+    // Quarter steps within the octave, rounded up
+    const size_t quarter = std::max<size_t>(1, base / kClassesPerOctave);
+    const int step = static_cast<int>((bytes - base + quarter - 1) / quarter);
+    return octave * kClassesPerOctave + step;
+}
+
+size_t ScratchPool::classBytes(int sizeClass)
+{
+    const int octave = sizeClass / kClassesPerOctave;
+    const int step = sizeClass % kClassesPerOctave;
+    const size_t base = size_t(1) << octave;
+    return base + step * std::max<size_t>(1, base / kClassesPerOctave);
+}
@@ -0,0 +1,642 @@
+#include "tiledprocessor.h"
+#include "pixelkernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <tuple>
+
+namespace {
+// Defect detection thresholds with an 11x11 Gaussian neighborhood, so five
+// pixels of context make every tile's binary image exact
+const int kThresholdBlockSize = 11;
+const double kThresholdOffset = 2.0;
+const int kThresholdHalo = kThresholdBlockSize / 2;
+
+// Same size filter as FiberCore::detectDefectRegions
+const int kMinDefectArea = 20;
+const int kMaxDefectArea = 500;
+
+const int kMinTileSize = 16;
+
+// Tile pixel, gray copy, binary image and 32-bit labels during detection
+const size_t kDetectionBytesPerPixel = 8;
+
+// Part of a blob inside one tile
+struct BlobFragment {
+    int area;
+    cv::Rect bounds;
+};
+
+struct TileBlobs {
+    std::vector<CoreDefect> finished;       // Blobs clear of every seam, already filtered
+    std::vector<BlobFragment> fragments;    // Blobs touching a seam
+    
+    // Fragment index + 1 of each pixel along a seam (0 = none); empty on image borders
+    std::vector<int> left, right, top, bottom;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+cv::Rect withHalo(const cv::Rect &core, int halo, const cv::Size &imageSize)
+{
+    return cv::Rect(core.x - halo, core.y - halo, core.width + 2 * halo, core.height + 2 * halo) &
+           cv::Rect(cv::Point(), imageSize);
+}
+
+bool isHostLittleEndian()
+{
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+void swapBytes16(uint16_t *samples, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<uint16_t>((samples[i] << 8) | (samples[i] >> 8));
+    }
+}
+
+// Next header token of a PGM file, skipping comments
+bool readPgmToken(std::istream &stream, std::string &token)
+{
+    token.clear();
+    char c;
+    while (stream.get(c)) {
+        if (c == '#') {
+            stream.ignore(4096, '\n');
+        } else if (!std::isspace(static_cast<unsigned char>(c))) {
+            token.push_back(c);
+            break;
+        }
+    }
+    while (stream.get(c) && !std::isspace(static_cast<unsigned char>(c))) {
+        token.push_back(c);
+    }
+    return !token.empty();
+}
+
+int findRoot(std::vector<int> &parent, int index)
+{
+    while (parent[index] != index) {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+void unite(std::vector<int> &parent, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a != b) {
+        parent[std::max(a, b)] = std::min(a, b);
+    }
+}
+}
+
+double TileSource::maxValue() const
+{
+    return CV_MAT_DEPTH(type()) == CV_16U ? 65535.0 : 255.0;
+}
+
+MatTileSource::MatTileSource(const cv::Mat &image)
+    : m_image(image)
+{
+}
+
+cv::Size MatTileSource::size() const
+{
+    return m_image.size();
+}
+
+int MatTileSource::type() const
+{
+    return m_image.type();
+}
+
+bool MatTileSource::read(const cv::Rect &region, cv::Mat &tile)
+{
+    tile = m_image(region);
+    return true;
+}
+
+MatTileSink::MatTileSink(cv::Mat &image)
+    : m_image(image)
+{
+}
+
+bool MatTileSink::write(const cv::Rect &region, const cv::Mat &tile)
+{
+    if (tile.size() != region.size() || tile.type() != m_image.type()) {
+        return false;
+    }
+    tile.copyTo(m_image(region));
+    return true;
+}
+
+FileTileSource::FileTileSource(const std::string &pgmPath)
+    : m_file(pgmPath, std::ios::binary)
+    , m_type(CV_8UC1)
+    , m_maxValue(0.0)
+    , m_dataOffset(0)
+    , m_bigEndian(true)
+{
+    std::string magic, width, height, maxValue;
+    if (!readPgmToken(m_file, magic) || magic != "P5" ||
+        !readPgmToken(m_file, width) || !readPgmToken(m_file, height) ||
+        !readPgmToken(m_file, maxValue)) {
+        m_file.close();
+        return;
+    }
+    
+    // Exactly one whitespace character separates the header from the samples,
+    // and readPgmToken has consumed it
+    m_size = cv::Size(std::atoi(width.c_str()), std::atoi(height.c_str()));
+    m_maxValue = std::atof(maxValue.c_str());
+    m_type = m_maxValue > 255.0 ? CV_16UC1 : CV_8UC1;
+    m_dataOffset = static_cast<size_t>(m_file.tellg());
+    
+    if (m_size.width <= 0 || m_size.height <= 0 || m_maxValue <= 0.0 || m_maxValue > 65535.0) {
+        m_file.close();
+    }
+}
+
+FileTileSource::FileTileSource(const std::string &rawPath, cv::Size size, int type, size_t headerBytes)
+    : m_file(rawPath, std::ios::binary)
+    , m_size(size)
+    , m_type(type)
+    , m_maxValue(CV_MAT_DEPTH(type) == CV_16U ? 65535.0 : 255.0)
+    , m_dataOffset(headerBytes)
+    , m_bigEndian(!isHostLittleEndian())
+{
+}
+
+bool FileTileSource::isOpen() const
+{
+    return m_file.is_open();
+}
+
+cv::Size FileTileSource::size() const
+{
+    return m_size;
+}
+
+int FileTileSource::type() const
+{
+    return m_type;
+}
+
+double FileTileSource::maxValue() const
+{
+    return m_maxValue;
+}
+
+bool FileTileSource::read(const cv::Rect &region, cv::Mat &tile)
+{
+    if (!isOpen() || (region & cv::Rect(cv::Point(), m_size)) != region) {
+        return false;
+    }
+    
+    tile.create(region.size(), m_type);
+    const size_t elementSize = tile.elemSize();
+    const size_t rowBytes = region.width * elementSize;
+    
+    {
+        // One stream shared by all workers; reading is a small part of a tile's time
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int y = 0; y < region.height; ++y) {
+            const size_t offset = m_dataOffset +
+                (static_cast<size_t>(region.y + y) * m_size.width + region.x) * elementSize;
+            m_file.seekg(static_cast<std::streamoff>(offset));
+            if (!m_file.read(reinterpret_cast<char *>(tile.ptr(y)), static_cast<std::streamsize>(rowBytes))) {
+                m_file.clear();
+                return false;
+            }
+        }
+    }
+    
+    if (elementSize == 2 && m_bigEndian == isHostLittleEndian()) {
+        for (int y = 0; y < region.height; ++y) {
+            swapBytes16(tile.ptr<uint16_t>(y), region.width);
+        }
+    }
+    return true;
+}
+
+FileTileSink::FileTileSink(const std::string &pgmPath, cv::Size size, int type)
+    : m_file(pgmPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc)
+    , m_size(size)
+    , m_type(type)
+    , m_dataOffset(0)
+{
+    if (!m_file.is_open()) {
+        return;
+    }
+    
+    const int maxValue = CV_MAT_DEPTH(type) == CV_16U ? 65535 : 255;
+    m_file << "P5\n" << size.width << " " << size.height << "\n" << maxValue << "\n";
+    m_dataOffset = static_cast<size_t>(m_file.tellp());
+    
+    // Size the file up front so tiles can land in any order
+    const size_t dataBytes = static_cast<size_t>(size.width) * size.height * CV_ELEM_SIZE(type);
+    if (dataBytes > 0) {
+        m_file.seekp(static_cast<std::streamoff>(m_dataOffset + dataBytes - 1));
+        m_file.put('\0');
+    }
+    if (!m_file) {
+        m_file.close();
+    }
+}
+
+bool FileTileSink::isOpen() const
+{
+    return m_file.is_open();
+}
+
+bool FileTileSink::write(const cv::Rect &region, const cv::Mat &tile)
+{
+    if (!isOpen() || tile.size() != region.size() || tile.type() != m_type ||
+        (region & cv::Rect(cv::Point(), m_size)) != region) {
+        return false;
+    }
+    
+    const size_t elementSize = tile.elemSize();
+    const size_t rowBytes = region.width * elementSize;
+    
+    // PGM samples are big-endian; swap a copy of the tile before taking the lock
+    cv::Mat samples = tile;
+    if (elementSize == 2 && isHostLittleEndian()) {
+        samples = tile.clone();
+        for (int y = 0; y < samples.rows; ++y) {
+            swapBytes16(samples.ptr<uint16_t>(y), samples.cols);
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int y = 0; y < region.height; ++y) {
+        const size_t offset = m_dataOffset +
+            (static_cast<size_t>(region.y + y) * m_size.width + region.x) * elementSize;
+        m_file.seekp(static_cast<std::streamoff>(offset));
+        m_file.write(reinterpret_cast<const char *>(samples.ptr(y)), static_cast<std::streamsize>(rowBytes));
+    }
+    m_file.flush();
+    return static_cast<bool>(m_file);
+}
+
+TiledProcessor::TiledProcessor(const TiledOptions &options)
+    : m_options(options)
+{
+}
+
+void TiledProcessor::setOptions(const TiledOptions &options)
+{
+    m_options = options;
+}
+
+const TiledOptions &TiledProcessor::options() const
+{
+    return m_options;
+}
+
+const TiledStats &TiledProcessor::lastStats() const
+{
+    return m_stats;
+}
+
+int TiledProcessor::tileSizeForBudget(size_t budgetBytes, int workers, int type)
+{
+    const size_t bytesPerPixel = CV_ELEM_SIZE(type) + kDetectionBytesPerPixel;
+    const double pixelsPerTile = static_cast<double>(budgetBytes) / std::max(1, workers) / bytesPerPixel;
+    
+    // Whole multiples of 64 keep rows aligned for the vectorized filters
+    const int side = static_cast<int>(std::sqrt(pixelsPerTile)) / 64 * 64;
+    return std::max(kMinTileSize, side);
+}
+
+std::vector<cv::Rect> TiledProcessor::tileGrid(const cv::Size &imageSize, int tileSize)
+{
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < imageSize.height; y += tileSize) {
+        for (int x = 0; x < imageSize.width; x += tileSize) {
+            tiles.push_back(cv::Rect(x, y,
+                                     std::min(tileSize, imageSize.width - x),
+                                     std::min(tileSize, imageSize.height - y)));
+        }
+    }
+    return tiles;
+}
+
+int TiledProcessor::effectiveTileSize() const
+{
+    return std::max(kMinTileSize, m_options.tileSize);
+}
+
+cv::Mat TiledProcessor::toGray8(const cv::Mat &tile, double maxValue)
+{
+    cv::Mat gray;
+    if (tile.channels() == 3 || tile.channels() == 4) {
+        cv::cvtColor(tile, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = tile;
+    }
+    
+    if (gray.depth() == CV_16U) {
+        cv::Mat scaled;
+        scaleTo8Bit(gray, scaled, 255.0 / maxValue);
+        return scaled;
+    }
+    return gray;
+}
+
+bool TiledProcessor::filter(TileSource &source, TileSink &sink, int halo, const TileFunction &function)
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    const cv::Size imageSize = source.size();
+    const std::vector<cv::Rect> tiles = tileGrid(imageSize, effectiveTileSize());
+    std::vector<size_t> tileBytes(tiles.size(), 0);
+    std::atomic<bool> succeeded(true);
+    
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end && succeeded; ++i) {
+            const cv::Rect &core = tiles[i];
+            const cv::Rect region = withHalo(core, halo, imageSize);
+    
+            try {
+                cv::Mat tile;
+                if (!source.read(region, tile)) {
+                    succeeded = false;
+                    break;
+                }
+    
+                cv::Mat result = function(tile);
+                tileBytes[i] = tile.total() * tile.elemSize() + result.total() * result.elemSize();
+    
+                // Only the interior is written; the halo was context
+                if (result.size() != tile.size() ||
+                    !sink.write(core, result(cv::Rect(core.tl() - region.tl(), core.size())))) {
+                    succeeded = false;
+                }
+            } catch (const cv::Exception &) {
+                succeeded = false;
+            }
+        }
+    });
+    
+    m_stats = TiledStats();
+    m_stats.complete = succeeded;
+    m_stats.tiles = static_cast<int>(tiles.size());
+    m_stats.peakTileBytes = tiles.empty() ? 0 : *std::max_element(tileBytes.begin(), tileBytes.end());
+    m_stats.elapsedMs = elapsedMs(start);
+    
+    return succeeded;
+}
+
+std::vector<CoreDefect> TiledProcessor::detectDefects(TileSource &source)
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    const cv::Size imageSize = source.size();
+    const int tileSize = effectiveTileSize();
+    const std::vector<cv::Rect> tiles = tileGrid(imageSize, tileSize);
+    const int tilesPerRow = (imageSize.width + tileSize - 1) / tileSize;
+    const double maxValue = source.maxValue();
+    
+    std::vector<TileBlobs> blobs(tiles.size());
+    std::vector<size_t> tileBytes(tiles.size(), 0);
+    std::atomic<bool> succeeded(true);
+    
+    // Label each tile interior on its own
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end && succeeded; ++i) {
+            const cv::Rect &core = tiles[i];
+            const cv::Rect region = withHalo(core, kThresholdHalo, imageSize);
+            TileBlobs &tileBlobs = blobs[i];
+    
+            try {
+                cv::Mat tile;
+                if (!source.read(region, tile)) {
+                    succeeded = false;
+                    break;
+                }
+    
+                cv::Mat binary;
+                cv::adaptiveThreshold(toGray8(tile, maxValue), binary, 255,
+                                      cv::ADAPTIVE_THRESH_GAUSSIAN_C,
+                                      cv::THRESH_BINARY_INV, kThresholdBlockSize, kThresholdOffset);
+    
+                cv::Mat labels, stats, centroids;
+                const int count = cv::connectedComponentsWithStats(
+                    binary(cv::Rect(core.tl() - region.tl(), core.size())), labels, stats, centroids, 8, CV_32S);
+                tileBytes[i] = region.area() * (tile.elemSize() + kDetectionBytesPerPixel);
+    
+                // Borders shared with another tile; the image border is not a seam
+                const bool seamLeft = core.x > 0;
+                const bool seamTop = core.y > 0;
+                const bool seamRight = core.br().x < imageSize.width;
+                const bool seamBottom = core.br().y < imageSize.height;
+    
+                std::vector<int> fragmentOf(count, 0);
+                for (int label = 1; label < count; ++label) {
+                    const int *blob = stats.ptr<int>(label);
+                    const cv::Rect local(blob[cv::CC_STAT_LEFT], blob[cv::CC_STAT_TOP],
+                                         blob[cv::CC_STAT_WIDTH], blob[cv::CC_STAT_HEIGHT]);
+                    const int area = blob[cv::CC_STAT_AREA];
+                    const cv::Rect bounds(local.tl() + core.tl(), local.size());
+    
+                    const bool onSeam = (seamLeft && local.x == 0) || (seamTop && local.y == 0) ||
+                                        (seamRight && local.br().x == core.width) ||
+                                        (seamBottom && local.br().y == core.height);
+                    if (onSeam) {
+                        tileBlobs.fragments.push_back({area, bounds});
+                        fragmentOf[label] = static_cast<int>(tileBlobs.fragments.size());
+                    } else if (area > kMinDefectArea && area < kMaxDefectArea) {
+                        tileBlobs.finished.push_back(FiberCore::createDefect(
+                            bounds, FiberCore::classifyBounds(bounds.width, bounds.height)));
+                    }
+                }
+    
+                // Keep only the labels along the seams; the label image is dropped with the tile
+                if (seamLeft) {
+                    tileBlobs.left.resize(core.height);
+                    for (int y = 0; y < core.height; ++y) {
+                        tileBlobs.left[y] = fragmentOf[labels.at<int>(y, 0)];
+                    }
+                }
+                if (seamRight) {
+                    tileBlobs.right.resize(core.height);
+                    for (int y = 0; y < core.height; ++y) {
+                        tileBlobs.right[y] = fragmentOf[labels.at<int>(y, core.width - 1)];
+                    }
+                }
+                if (seamTop) {
+                    const int *row = labels.ptr<int>(0);
+                    tileBlobs.top.resize(core.width);
+                    for (int x = 0; x < core.width; ++x) {
+                        tileBlobs.top[x] = fragmentOf[row[x]];
+                    }
+                }
+                if (seamBottom) {
+                    const int *row = labels.ptr<int>(core.height - 1);
+                    tileBlobs.bottom.resize(core.width);
+                    for (int x = 0; x < core.width; ++x) {
+                        tileBlobs.bottom[x] = fragmentOf[row[x]];
+                    }
+                }
+            } catch (const cv::Exception &) {
+                succeeded = false;
+            }
+        }
+    });
+    
+    m_stats = TiledStats();
+    m_stats.complete = succeeded;
+    m_stats.tiles = static_cast<int>(tiles.size());
+    m_stats.peakTileBytes = tiles.empty() ? 0 : *std::max_element(tileBytes.begin(), tileBytes.end());
+    
+    std::vector<CoreDefect> defects;
+    if (!succeeded) {
+        m_stats.elapsedMs = elapsedMs(start);
+        return defects;
+    }
+    
+    // Number the seam fragments of all tiles consecutively
+    std::vector<int> firstFragment(tiles.size() + 1, 0);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        firstFragment[i + 1] = firstFragment[i] + static_cast<int>(blobs[i].fragments.size());
+    }
+    const int fragmentCount = firstFragment.back();
+    std::vector<int> parent(fragmentCount);
+    std::iota(parent.begin(), parent.end(), 0);
+    
+    auto join = [&](int tileA, int fragmentA, int tileB, int fragmentB) {
+        if (fragmentA > 0 && fragmentB > 0) {
+            unite(parent, firstFragment[tileA] + fragmentA - 1, firstFragment[tileB] + fragmentB - 1);
+        }
+    };
+    
+    // Pixels touching across a seam, including diagonal neighbors (8-connectivity)
+    for (int i = 0; i < static_cast<int>(tiles.size()); ++i) {
+        const TileBlobs &a = blobs[i];
+        const int column = i % tilesPerRow;
+        const bool hasRight = column + 1 < tilesPerRow;
+        const bool hasBelow = i + tilesPerRow < static_cast<int>(tiles.size());
+    
+        if (hasRight) {
+            const std::vector<int> &neighbor = blobs[i + 1].left;
+            for (int y = 0; y < static_cast<int>(a.right.size()); ++y) {
+                for (int dy = -1; dy <= 1; ++dy) {
+                    if (y + dy >= 0 && y + dy < static_cast<int>(neighbor.size())) {
+                        join(i, a.right[y], i + 1, neighbor[y + dy]);
+                    }
+                }
+            }
+        }
+        if (hasBelow) {
+            const std::vector<int> &neighbor = blobs[i + tilesPerRow].top;
+            for (int x = 0; x < static_cast<int>(a.bottom.size()); ++x) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if (x + dx >= 0 && x + dx < static_cast<int>(neighbor.size())) {
+                        join(i, a.bottom[x], i + tilesPerRow, neighbor[x + dx]);
+                    }
+                }
+            }
+    
+            // Corners shared with the diagonal tiles
+            if (hasRight) {
+                join(i, a.bottom.back(), i + tilesPerRow + 1, blobs[i + tilesPerRow + 1].top.front());
+            }
+            if (column > 0) {
+                join(i, a.bottom.front(), i + tilesPerRow - 1, blobs[i + tilesPerRow - 1].top.back());
+            }
+        }
+    }
+    
+    // Accumulate every fragment into its root
+    std::vector<BlobFragment> merged(fragmentCount, BlobFragment{0, cv::Rect()});
+    std::vector<int> pieces(fragmentCount, 0);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        for (size_t f = 0; f < blobs[i].fragments.size(); ++f) {
+            const BlobFragment &fragment = blobs[i].fragments[f];
+            const int root = findRoot(parent, firstFragment[i] + static_cast<int>(f));
+            BlobFragment &blob = merged[root];
+            blob.bounds = pieces[root] == 0 ? fragment.bounds : (blob.bounds | fragment.bounds);
+            blob.area += fragment.area;
+            ++pieces[root];
+        }
+    }
+    
+    for (const TileBlobs &tileBlobs : blobs) {
+        defects.insert(defects.end(), tileBlobs.finished.begin(), tileBlobs.finished.end());
+    }
+    
+    for (int root = 0; root < fragmentCount; ++root) {
+        if (pieces[root] == 0) {
+            continue;
+        }
+        if (pieces[root] > 1) {
+            ++m_stats.mergedBlobs;
+        }
+        const BlobFragment &blob = merged[root];
+        if (blob.area > kMinDefectArea && blob.area < kMaxDefectArea) {
+            defects.push_back(FiberCore::createDefect(
+                blob.bounds, FiberCore::classifyBounds(blob.bounds.width, blob.bounds.height)));
+        }
+    }
+    
+    // Report in reading order regardless of tiling and thread timing
+    std::sort(defects.begin(), defects.end(), [](const CoreDefect &a, const CoreDefect &b) {
+        return std::tie(a.bounds.y, a.bounds.x, a.bounds.height, a.bounds.width) <
+               std::tie(b.bounds.y, b.bounds.x, b.bounds.height, b.bounds.width);
+    });
+    
+    m_stats.seamBlobs = fragmentCount;
+    m_stats.elapsedMs = elapsedMs(start);
+    return defects;
+}
+
+cv::Mat TiledProcessor::overview(TileSource &source, int maxSide)
+{
+    const cv::Size imageSize = source.size();
+    if (imageSize.area() == 0 || maxSide <= 0) {
+        return cv::Mat();
+    }
+    
+    const double scale = std::min(1.0, static_cast<double>(maxSide) / std::max(imageSize.width, imageSize.height));
+    const cv::Size previewSize(std::max(1, cvRound(imageSize.width * scale)),
+                               std::max(1, cvRound(imageSize.height * scale)));
+    cv::Mat preview(previewSize, CV_8UC1, cv::Scalar(0));
+    
+    // Tile edges map to whole preview pixels so neighboring tiles never overlap
+    auto toPreviewX = [&](int x) { return static_cast<int>(static_cast<int64_t>(x) * previewSize.width / imageSize.width); };
+    auto toPreviewY = [&](int y) { return static_cast<int>(static_cast<int64_t>(y) * previewSize.height / imageSize.height); };
+    
+    const std::vector<cv::Rect> tiles = tileGrid(imageSize, effectiveTileSize());
+    const double maxValue = source.maxValue();
+    
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const cv::Rect &core = tiles[i];
+            const cv::Rect target(cv::Point(toPreviewX(core.x), toPreviewY(core.y)),
+                                  cv::Point(toPreviewX(core.br().x), toPreviewY(core.br().y)));
+            cv::Mat tile;
+            if (target.area() == 0 || !source.read(core, tile)) {
+                continue;
+            }
+    
+            cv::Mat shrunk;
+            cv::resize(toGray8(tile, maxValue), shrunk, target.size(), 0, 0, cv::INTER_AREA);
+            shrunk.copyTo(preview(target));
+        }
+    });
+    
+    return preview;
+}
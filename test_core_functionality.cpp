@@ -3,12 +3,44 @@
 #include <QCoreApplication>
 #include <QImage>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QDebug>
 #include <QPainter>
 
 #include "imageprocessor.h"
 #include "fiberanalyzer.h"
 #include "resultsmanager.h"
+#include "frameaverager.h"
+#include "framesource.h"
+#include "livepipeline.h"
+#include "framering.h"
+#include "fibertracker.h"
+#include "framechangegate.h"
+#include "imagequality.h"
+#include "defecttracker.h"
+#include "fibercoreapi.h"
+#include "analysispipeline.h"
+#include "pixelkernels.h"
+#include "scratchpool.h"
+#include "resourcegovernor.h"
+#include "tiledprocessor.h"
+#include "mappedimage.h"
+#include "batchpipeline.h"
+#include "bitmask.h"
+#include "defectindex.h"
+#include "scratchdetector.h"
+#include "crackdetector.h"
+#include "resultlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <utility>
 
 int main(int argc, char *argv[]) {
     QCoreApplication app(argc, argv);
@@ -18,6 +50,9 @@ int main(int argc, char *argv[]) {
         std::cout << qPrintable(msg) << std::endl;
     });
     
+    // Same allocation path as the application
+    ScratchPool::instance().install();
+    
     std::cout << "===== Testing FiberInspector Core Functionality =====" << std::endl;
     
     // Initialize components
@@ -53,6 +88,196 @@ int main(int argc, char *argv[]) {
     std::cout << "Applied edge detection: " << 
         (processedImage.isNull() ? "FAILED" : "SUCCESS") << std::endl;
     
+    // Test denoising methods and report their timing
+    const DenoiseMethod denoiseMethods[] = {
+        DenoiseMethod::NonLocalMeansTiled,
+        DenoiseMethod::Bilateral,
+        DenoiseMethod::Guided
+    };
+    for (DenoiseMethod method : denoiseMethods) {
+        processedImage = imageProcessor.removeNoise(testImage, method);
+        std::cout << "Denoised with " << imageProcessor.denoiseMethodName(method).toStdString() << ": "
+            << (processedImage.isNull() ? "FAILED" : "SUCCESS")
+            << " (" << imageProcessor.lastDenoiseTimeMs() << " ms)" << std::endl;
+    }
+    
+    // Test custom filters against a direct filter2D reference (separable and DFT paths)
+    cv::Mat gaussian1D = cv::getGaussianKernel(15, 3.0, CV_32F);
+    cv::Mat separableKernel = gaussian1D * gaussian1D.t();
+    cv::Mat diskKernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(31, 31));
+    diskKernel.convertTo(diskKernel, CV_32F, 1.0 / cv::countNonZero(diskKernel));
+    for (const cv::Mat &kernel : {separableKernel, diskKernel}) {
+        QVector<float> kernelData(kernel.begin<float>(), kernel.end<float>());
+        QImage filtered = imageProcessor.applyCustomFilter(testImage, kernelData, kernel.rows);
+        
+        cv::Mat reference;
+        cv::filter2D(imageProcessor.qImageToMat(testImage), reference, -1, kernel);
+        cv::Mat difference;
+        cv::absdiff(imageProcessor.qImageToMat(filtered), reference, difference);
+        double maxDifference = 0.0;
+        cv::minMaxLoc(difference.reshape(1), nullptr, &maxDifference);
+        
+        std::cout << "Custom " << kernel.rows << "x" << kernel.cols << " filter matches filter2D: "
+            << (maxDifference <= 1.0 ? "SUCCESS" : "FAILED") << std::endl;
+    }
+    
+    // Test temporal averaging over a few noisy, slightly shifted frames
+    FrameAverager frameAverager(4);
+    cv::Mat baseFrame = imageProcessor.qImageToMat(testImage);
+    cv::Mat averagedFrame;
+    for (int i = 0; i < 6; ++i) {
+        cv::Mat noisy(baseFrame.size(), baseFrame.type());
+        cv::randn(noisy, cv::Scalar::all(0), cv::Scalar::all(20));
+        cv::Mat shifted;
+        cv::Mat transform = (cv::Mat_<double>(2, 3) << 1, 0, i % 2, 0, 1, 0);
+        cv::warpAffine(baseFrame, shifted, transform, baseFrame.size());
+        cv::add(shifted, noisy, noisy);
+        averagedFrame = frameAverager.addFrame(noisy);
+    }
+    std::cout << "Temporal averaging: " 
+        << (!averagedFrame.empty() && frameAverager.frameCount() == 4 ? "SUCCESS" : "FAILED")
+        << " (last shift " << frameAverager.lastShift().x << ", " << frameAverager.lastShift().y << ")" << std::endl;
+    
+    // A raw16 ramp through the live averager comes out as a ramp, not white
+    FrameAverager rawAverager(2);
+    cv::Mat rawRamp(240, 256, CV_16UC1);
+    for (int y = 0; y < rawRamp.rows; ++y) {
+        for (int x = 0; x < rawRamp.cols; ++x) {
+            rawRamp.at<uint16_t>(y, x) = static_cast<uint16_t>(x * 256 + 128);
+        }
+    }
+    cv::Mat rawAveraged = rawAverager.addFrame(rawRamp);
+    double rawMin = 0.0, rawMax = 0.0;
+    cv::minMaxLoc(rawAveraged, &rawMin, &rawMax);
+    std::cout << "16-bit averaging input: "
+        << (rawAveraged.type() == CV_8UC1 && rawMin <= 1.0 && rawMax >= 254.0 && std::abs(cv::mean(rawAveraged)[0] - 127.5) < 2.0
+            ? "SUCCESS" : "FAILED")
+        << " (mean " << cv::mean(rawAveraged)[0] << ")" << std::endl;
+    
+    // Every kernel variant this CPU can run must match the baseline exactly
+    cv::Mat kernelA(97, 131, CV_8UC1), kernelB(97, 131, CV_8UC1), kernelWide(97, 131, CV_16UC1);
+    cv::randu(kernelA, 0, 256);
+    cv::randu(kernelB, 0, 256);
+    cv::randu(kernelWide, 0, 65536);
+    auto runKernels = [&](CpuIsa isa, cv::Mat &sum, cv::Mat &narrow, int64_t &total, int &maxDifference) {
+        forceCpuIsa(isa);
+        sum = cv::Mat(kernelA.size(), CV_16UC1, cv::Scalar(1000));
+        accumulateFrame(sum, kernelA, &kernelB);
+        total = absDifference(kernelA, kernelB, maxDifference);
+        scaleTo8Bit(kernelWide, narrow, 1.0 / 256.0);
+    };
+    cv::Mat baselineSum, baselineNarrow;
+    int64_t baselineTotal = 0;
+    int baselineMax = 0;
+    runKernels(CpuIsa::Baseline, baselineSum, baselineNarrow, baselineTotal, baselineMax);
+    for (CpuIsa isa : {CpuIsa::SSE42, CpuIsa::AVX2, CpuIsa::AVX512, CpuIsa::NEON}) {
+        if (!isCpuIsaSupported(isa)) {
+            continue;
+        }
+        cv::Mat variantSum, variantNarrow;
+        int64_t variantTotal = 0;
+        int variantMax = 0;
+        runKernels(isa, variantSum, variantNarrow, variantTotal, variantMax);
+        std::cout << "Kernel variant " << cpuIsaName(isa) << ": "
+            << (cv::countNonZero(variantSum != baselineSum) == 0 && cv::countNonZero(variantNarrow != baselineNarrow) == 0
+                && variantTotal == baselineTotal && variantMax == baselineMax ? "SUCCESS" : "FAILED") << std::endl;
+    }
+    resetCpuIsa();
+    std::cout << "CPU dispatch: " << (activeCpuIsa() == detectCpuIsa() ? "SUCCESS" : "FAILED")
+        << " (" << cpuIsaName(activeCpuIsa()) << ")" << std::endl;
+    
+    // Test bit-packed masks against 8-bit mask operations, on an odd width so
+    // row padding is exercised, and the same counts from every kernel variant
+    cv::Mat maskA(37, 301, CV_8UC1), maskB(37, 301, CV_8UC1);
+    cv::randu(maskA, 0, 4);
+    cv::randu(maskB, 0, 3);
+    maskA.setTo(0, maskA < 2);
+    bool bitMasksMatch = true;
+    for (CpuIsa isa : {CpuIsa::Baseline, CpuIsa::SSE42, CpuIsa::AVX2, CpuIsa::AVX512, CpuIsa::NEON}) {
+        if (!isCpuIsaSupported(isa)) {
+            continue;
+        }
+        forceCpuIsa(isa);
+        BitMask bitsA(maskA), bitsB(maskB);
+        BitMask combined = bitsA | bitsB;
+        combined.andNot(bitsA & bitsB);
+        bitMasksMatch = bitMasksMatch &&
+            cv::countNonZero(bitsA.toMat() != (maskA != 0)) == 0 &&
+            bitsA.count() == static_cast<uint64_t>(cv::countNonZero(maskA)) &&
+            bitsA.countAnd(bitsB) == static_cast<uint64_t>(cv::countNonZero((maskA != 0) & (maskB != 0))) &&
+            bitsA.countAndNot(bitsB) == static_cast<uint64_t>(cv::countNonZero(maskA & (maskB == 0))) &&
+            combined.count() == static_cast<uint64_t>(cv::countNonZero((maskA != 0) ^ (maskB != 0)));
+    }
+    resetCpuIsa();
+    
+    // Zone coverage by popcount agrees with the masks drawn by OpenCV to within the rim pixels
+    FiberGeometry zoneGeometry;
+    zoneGeometry.center = cv::Point2f(150.0f, 120.0f);
+    zoneGeometry.claddingRadius = 100.0f;
+    zoneGeometry.coreRadius = 40.0f;
+    cv::Rect zoneRoi = zoneGeometry.roi(cv::Size(640, 480));
+    cv::Mat spots = cv::Mat::zeros(zoneRoi.size(), CV_8UC1);
+    cv::circle(spots, zoneGeometry.center - cv::Point2f(zoneRoi.tl()), 10, cv::Scalar(255), cv::FILLED);
+    ZoneBitMasks zoneMasks;
+    zoneMasks.update(zoneGeometry, zoneRoi);
+    ZoneCoverage coreCoverage = zoneMasks.coreCoverage(BitMask(spots));
+    ZoneCoverage claddingCoverage = zoneMasks.claddingCoverage(BitMask(spots));
+    double expectedCore = CV_PI * 10 * 10 / (CV_PI * 40 * 40);
+    std::cout << "Bit-packed masks: "
+        << (bitMasksMatch && std::abs(coreCoverage.fraction() - expectedCore) < 0.01 && claddingCoverage.coveredPixels == 0
+            ? "SUCCESS" : "FAILED")
+        << " (core coverage " << coreCoverage.fraction() << ")" << std::endl;
+    
+    // Test the defect index against brute force over a contaminated-looking scatter of boxes
+    cv::RNG indexRng(47);
+    std::vector<cv::Rect> scatter;
+    for (int i = 0; i < 400; ++i) {
+        scatter.emplace_back(indexRng.uniform(0, 600), indexRng.uniform(0, 450), indexRng.uniform(2, 25), indexRng.uniform(2, 25));
+    }
+    DefectIndex defectIndex;
+    defectIndex.build(scatter);
+    bool indexMatches = true;
+    for (int q = 0; q < 50 && indexMatches; ++q) {
+        cv::Rect area(indexRng.uniform(-20, 600), indexRng.uniform(-20, 450), indexRng.uniform(1, 120), indexRng.uniform(1, 120));
+        cv::Point probe(indexRng.uniform(0, 620), indexRng.uniform(0, 470));
+        std::vector<int> expected;
+        int expectedHit = -1;
+        for (int i = 0; i < static_cast<int>(scatter.size()); ++i) {
+            if ((scatter[i] & area).area() > 0) {
+                expected.push_back(i);
+            }
+            if (scatter[i].contains(probe) && (expectedHit < 0 || scatter[i].area() < scatter[expectedHit].area())) {
+                expectedHit = i;
+            }
+        }
+        indexMatches = defectIndex.intersecting(area) == expected && defectIndex.hitTest(probe) == expectedHit;
+    }
+    
+    // A scratch broken into three dashes becomes one defect; a blob further away stays separate
+    std::vector<cv::Rect> fragments = {cv::Rect(10, 10, 20, 3), cv::Rect(32, 11, 20, 3), cv::Rect(54, 12, 20, 3),
+                                       cv::Rect(100, 10, 6, 6)};
+    std::vector<cv::Rect> mergedFragments = DefectIndex::mergeFragments(fragments, 2);
+    
+    // Dense contamination, spots 2 px apart, keeps its count and type
+    std::vector<cv::Rect> contamination;
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 10; ++x) {
+            contamination.push_back(cv::Rect(200 + 8 * x, 200 + 8 * y, 6, 6));
+        }
+    }
+    std::vector<cv::Rect> mergedContamination = DefectIndex::mergeFragments(contamination, 2);
+    bool contaminationKept = mergedContamination.size() == contamination.size() &&
+        std::all_of(mergedContamination.begin(), mergedContamination.end(), [](const cv::Rect &box) {
+            return FiberCore::classifyBounds(box.width, box.height) == DefectType::Contamination;
+        });
+    DefectIndex fragmentIndex;
+    fragmentIndex.build(fragments);
+    std::cout << "Defect spatial index: "
+        << (indexMatches && mergedFragments.size() == 2 && mergedFragments[0] == cv::Rect(10, 10, 64, 5) && contaminationKept &&
+            fragmentIndex.withinRadius(cv::Point2f(110, 13), 5).size() == 1 &&
+            fragmentIndex.withinAnnulus(cv::Point2f(42, 12), 5, 25).size() == 2 ? "SUCCESS" : "FAILED")
+        << " (" << defectIndex.size() << " boxes, cell " << defectIndex.cellSize() << " px)" << std::endl;
+    
     // Test fiber analysis
     std::cout << "\nTesting fiber analysis..." << std::endl;
     FiberAnalysisResult result = fiberAnalyzer.analyzeImage(testImage);
@@ -63,6 +288,380 @@ int main(int argc, char *argv[]) {
     std::cout << "- Defects found: " << result.defects.size() << std::endl;
     std::cout << "- Quality score: " << result.overallQuality << std::endl;
     std::cout << "- Is acceptable: " << (result.isAcceptable ? "Yes" : "No") << std::endl;
+    std::cout << "- Analysis time: " << result.analysisTimeMs << " ms" << std::endl;
+    
+    // Annotations are vector data on the result; a raster only exists once exported
+    QImage annotatedExport = fiberAnalyzer.createAnnotatedImage(testImage, result);
+    std::cout << "Annotation overlay: "
+        << (!result.overlay().isEmpty() && annotatedExport.size() == testImage.size() ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // Test the C interface on the gray pixels of the test image, without copying them
+    QImage grayTestImage = testImage.convertToFormat(QImage::Format_Grayscale8);
+    fibercore_analyzer *coreAnalyzer = fibercore_create();
+    fibercore_result coreResult;
+    fibercore_defect coreDefects[64];
+    int coreStatus = fibercore_analyze(coreAnalyzer, grayTestImage.constBits(), grayTestImage.width(),
+                                       grayTestImage.height(), grayTestImage.bytesPerLine(),
+                                       FIBERCORE_FORMAT_GRAY8, &coreResult, coreDefects, 64);
+    std::cout << "C API analysis: "
+        << (coreStatus == FIBERCORE_OK && coreResult.cladding_radius > 0 ? "SUCCESS" : "FAILED")
+        << " (" << coreResult.defect_count << " defects)" << std::endl;
+    fibercore_destroy(coreAnalyzer);
+    
+    // Test the compile-time pipelines: 8-bit and 16-bit versions of a frame must agree,
+    // grades included
+    PipelineConfig pipelineConfig;
+    RuntimePipeline pipeline8(pipelineConfig);
+    pipelineConfig.depth = CV_16U;
+    RuntimePipeline pipeline16(pipelineConfig);
+    cv::Mat pipelineGray(grayTestImage.height(), grayTestImage.width(), CV_8UC1,
+                         const_cast<uchar *>(grayTestImage.constBits()), grayTestImage.bytesPerLine());
+    cv::Mat pipelineGray16;
+    pipelineGray.convertTo(pipelineGray16, CV_16U, 256.0);
+    CoreAnalysisResult pipelineResult8 = pipeline8.analyze(pipelineGray);
+    CoreAnalysisResult pipelineResult16 = pipeline16.analyze(pipelineGray16);
+    std::cout << "Policy pipelines: "
+        << (pipelineResult8.error.empty() && pipelineResult16.error.empty()
+            && pipelineResult8.defects.size() == pipelineResult16.defects.size()
+            && pipelineResult8.concentricity == pipelineResult16.concentricity
+            && pipelineResult8.geometry.isValid() ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // A repeated frame should be served almost entirely from recycled buffers
+    fiberAnalyzer.analyzeImage(testImage);
+    ScratchPool::instance().resetStats();
+    fiberAnalyzer.analyzeImage(testImage);
+    ScratchPoolStats poolStats = ScratchPool::instance().stats();
+    std::cout << "Scratch pool reuse: " << (poolStats.hits > 0 && poolStats.misses < poolStats.hits ? "SUCCESS" : "FAILED")
+        << " (" << poolStats.hits << " hits, " << poolStats.misses << " misses, peak "
+        << poolStats.peakBytesInUse / 1024 << " KB)" << std::endl;
+    
+    // The governor must shed work at the budget and relax only after calm samples
+    ResourceGovernor governor;
+    governor.setMemoryBudget(1024 * 1024 * 1024);
+    governor.setMaxWorkers(8);
+    ResourceSample tightSample;
+    tightSample.rssBytes = 1000 * 1024 * 1024;
+    ResourcePlan tightPlan = governor.evaluate(tightSample);
+    ResourceSample calmSample;
+    calmSample.rssBytes = 100 * 1024 * 1024;
+    ResourcePlan firstCalmPlan = governor.evaluate(calmSample);
+    for (int i = 0; i < 8; ++i) {
+        governor.evaluate(calmSample);
+    }
+    ResourcePlan relaxedPlan = governor.currentPlan();
+    std::cout << "Resource governor: "
+        << (tightPlan.level == ResourceLevel::Critical && tightPlan.workers == 1 && tightPlan.inFlightImages == 1
+            && tightPlan.cacheBytes == 0 && firstCalmPlan.level == ResourceLevel::Critical
+            && relaxedPlan.level == ResourceLevel::Normal && relaxedPlan.workers == 8 ? "SUCCESS" : "FAILED")
+        << " (live sample: " << ResourceGovernor::levelName(ResourceGovernor().update().level) << ")" << std::endl;
+    
+    // A budget far below the measured cost must downgrade optional stages
+    fiberAnalyzer.setFrameBudget(0.001);
+    FiberAnalysisResult budgetResult = fiberAnalyzer.analyzeImage(testImage);
+    fiberAnalyzer.setFrameBudget(0.0);
+    std::cout << "Deadline-aware analysis: " << (budgetResult.degraded ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // Test geometry tracking: the second frame should be refined locally, not re-detected
+    FiberTracker tracker;
+    cv::Mat trackingFrame;
+    cv::cvtColor(imageProcessor.qImageToMat(testImage), trackingFrame, cv::COLOR_BGR2GRAY);
+    FiberGeometry firstGeometry = tracker.update(trackingFrame);
+    FiberGeometry trackedGeometry = tracker.update(trackingFrame);
+    std::cout << "Geometry tracking: "
+        << (firstGeometry.isValid() && tracker.lastUpdateWasTracked() && tracker.fullDetectionCount() == 1 ? "SUCCESS" : "FAILED")
+        << " (radius " << trackedGeometry.claddingRadius << ", confidence " << trackedGeometry.confidence << ")" << std::endl;
+    
+    // Test the early fiber ROI: detection only sees the padded cladding square,
+    // and defects come back in image coordinates
+    cv::Mat roiFrame = trackingFrame.clone();
+    cv::circle(roiFrame, cv::Point(300, 230), 6, cv::Scalar(0), cv::FILLED);
+    cv::rectangle(roiFrame, cv::Rect(10, 10, 60, 60), cv::Scalar(128), cv::FILLED);
+    cv::circle(roiFrame, cv::Point(40, 40), 6, cv::Scalar(0), cv::FILLED);
+    FiberCore roiCore;
+    roiCore.setQualityCheck(false);
+    CoreAnalysisResult roiResult = roiCore.analyze(roiFrame);
+    auto coversPoint = [](const std::vector<CoreDefect> &defects, const cv::Point &point) {
+        return std::any_of(defects.begin(), defects.end(), [&](const CoreDefect &d) { return d.bounds.contains(point); });
+    };
+    std::vector<CoreDefect> fullFrameDefects;
+    for (const cv::Rect &region : FiberCore::detectDefectRegions(roiFrame)) {
+        fullFrameDefects.push_back(FiberCore::createDefect(region, DefectType::Unknown));
+    }
+    bool defectsInRoi = std::all_of(roiResult.defects.begin(), roiResult.defects.end(),
+                                    [&](const CoreDefect &d) { return (d.bounds & roiResult.roi) == d.bounds; });
+    QRect qRoi(roiResult.roi.x, roiResult.roi.y, roiResult.roi.width, roiResult.roi.height);
+    QImage roiFiltered = imageProcessor.applyFilter(testImage, FilterType::GaussianBlur, qRoi);
+    bool filterStayedInRoi = roiFiltered.size() == testImage.size() &&
+                             roiFiltered.pixelColor(2, 2) == testImage.pixelColor(2, 2);
+    std::cout << "Fiber ROI crop: "
+        << (roiResult.roi.area() < roiFrame.size().area() / 2 && coversPoint(roiResult.defects, cv::Point(300, 230)) &&
+            !coversPoint(roiResult.defects, cv::Point(40, 40)) && coversPoint(fullFrameDefects, cv::Point(40, 40)) &&
+            defectsInRoi && filterStayedInRoi ? "SUCCESS" : "FAILED")
+        << " (ROI " << roiResult.roi.width << "x" << roiResult.roi.height << " of "
+        << roiFrame.cols << "x" << roiFrame.rows << ")" << std::endl;
+    
+    // Test the scratch filter bank: a faint 1 px scratch with a gap, which has no
+    // area for the blob threshold, comes back as one line; sensor noise alone and
+    // the clean fiber's edges give none
+    cv::Mat scratchNoise(240, 320, CV_8UC1);
+    cv::randn(scratchNoise, cv::Scalar(128), cv::Scalar(4));
+    cv::Mat scratchLine = cv::Mat::zeros(scratchNoise.size(), CV_8UC1);
+    cv::line(scratchLine, cv::Point(40, 60), cv::Point(152, 144), cv::Scalar(20));
+    cv::line(scratchLine, cv::Point(168, 156), cv::Point(240, 210), cv::Scalar(20));
+    cv::Mat scratchFrame = scratchNoise - scratchLine;
+    ScratchDetector scratchDetector;
+    auto scratchStart = std::chrono::steady_clock::now();
+    std::vector<ScratchSegment> scratchSegments = scratchDetector.detect(scratchFrame);
+    double scratchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scratchStart).count();
+    bool scratchFound = !scratchSegments.empty() && scratchSegments[0].length() > 180 &&
+                        std::abs(scratchSegments[0].angle - 36.87f) < 3.0f;
+    bool noiseIgnored = scratchDetector.detect(scratchNoise).empty();
+    bool edgesIgnored = scratchDetector.detect(trackingFrame).empty();
+    
+    // In the full analysis the scratch across the core is reported as one scratch defect
+    cv::Mat scratchedFiber = trackingFrame.clone();
+    cv::line(scratchedFiber, cv::Point(270, 200), cv::Point(370, 280), cv::Scalar(108));
+    FiberCore scratchCore;
+    scratchCore.setQualityCheck(false);
+    CoreAnalysisResult scratchResult = scratchCore.analyze(scratchedFiber);
+    bool scratchDefect = std::any_of(scratchResult.defects.begin(), scratchResult.defects.end(), [](const CoreDefect &d) {
+        return d.type == DefectType::Scratch && d.bounds.contains(cv::Point(320, 240));
+    });
+    std::cout << "Scratch filter bank: "
+        << (scratchFound && noiseIgnored && edgesIgnored && scratchDefect && scratchResult.scratches.size() == 1
+            ? "SUCCESS" : "FAILED")
+        << " (" << scratchSegments.size() << " segments, " << scratchMs << " ms)" << std::endl;
+    
+    // Test the crack ridge filter: a kinked crack two pixels wide comes back as one
+    // crack defect in place of its threshold blobs; round spots and the clean
+    // fiber's edges are no cracks
+    cv::Mat crackedFiber = trackingFrame.clone();
+    std::vector<std::vector<cv::Point>> crackPath = {{cv::Point(290, 210), cv::Point(305, 228), cv::Point(300, 250), cv::Point(315, 268)}};
+    cv::polylines(crackedFiber, crackPath, false, cv::Scalar(110), 2);
+    FiberCore crackCore;
+    crackCore.setQualityCheck(false);
+    CoreAnalysisResult crackResult = crackCore.analyze(crackedFiber);
+    long crackDefects = std::count_if(crackResult.defects.begin(), crackResult.defects.end(), [](const CoreDefect &d) {
+        return d.type == DefectType::Crack && d.bounds.contains(cv::Point(305, 228));
+    });
+    bool crackAlone = std::none_of(crackResult.defects.begin(), crackResult.defects.end(), [](const CoreDefect &d) {
+        return d.type != DefectType::Crack && d.bounds.contains(cv::Point(305, 228));
+    });
+    CrackDetector crackDetector;
+    bool spotsIgnored = crackDetector.detect(roiFrame).empty();
+    bool fiberEdgesIgnored = crackDetector.detect(trackingFrame).empty();
+    std::cout << "Crack ridge filter: "
+        << (crackDefects == 1 && crackAlone && spotsIgnored && fiberEdgesIgnored ? "SUCCESS" : "FAILED")
+        << " (" << crackCore.lastTimings().crackDetectionMs << " ms)" << std::endl;
+    
+    // Test the frame change gate: identical frames are skipped, a new blob is not
+    FrameChangeGate changeGate;
+    bool firstAnalyzed = changeGate.shouldAnalyze(trackingFrame);
+    bool repeatSkipped = !changeGate.shouldAnalyze(trackingFrame);
+    cv::Mat changedFrame = trackingFrame.clone();
+    cv::circle(changedFrame, cv::Point(320, 200), 15, cv::Scalar(0), cv::FILLED);
+    bool changeDetected = changeGate.shouldAnalyze(changedFrame);
+    
+    // Debris far smaller than a 32x32-grid cell, falling between sparse sample points
+    FrameChangeGate debrisGate;
+    debrisGate.setMaxSkippedFrames(0);
+    cv::Mat debrisFrame = trackingFrame.clone();
+    debrisFrame(cv::Rect(328, 156, 4, 3)).setTo(cv::Scalar(0));
+    bool debrisDetected = debrisGate.shouldAnalyze(trackingFrame) && debrisGate.shouldAnalyze(debrisFrame);
+    std::cout << "Frame change gate: "
+        << (firstAnalyzed && repeatSkipped && changeDetected && debrisDetected ? "SUCCESS" : "FAILED")
+        << " (max cell difference " << changeGate.lastMaxCellDifference() << ", debris "
+        << debrisGate.lastMaxCellDifference() << ")" << std::endl;
+    
+    // Test defect tracking: identities persist, single-frame flickers are not confirmed
+    DefectTracker defectTracker;
+    defectTracker.update({cv::Rect(100, 100, 10, 10), cv::Rect(300, 200, 30, 6)});
+    std::vector<int> trackIndices = defectTracker.update({cv::Rect(102, 101, 10, 10), cv::Rect(500, 400, 8, 8)});
+    const DefectTrack &persistentTrack = defectTracker.tracks()[trackIndices[0]];
+    const DefectTrack &flickerTrack = defectTracker.tracks()[trackIndices[1]];
+    std::cout << "Defect tracking: "
+        << (persistentTrack.id == 1 && defectTracker.isConfirmed(persistentTrack) && !defectTracker.isConfirmed(flickerTrack)
+            ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // Test the quality pre-check on a good, a defocused and a dark frame
+    ImageQualityChecker qualityChecker;
+    cv::Mat defocusedFrame, darkFrame;
+    cv::GaussianBlur(trackingFrame, defocusedFrame, cv::Size(0, 0), 12.0);
+    darkFrame = trackingFrame * 0.1;
+    FrameQuality goodQuality = qualityChecker.check(trackingFrame);
+    FrameQuality defocusedQuality = qualityChecker.check(defocusedFrame);
+    FrameQuality darkQuality = qualityChecker.check(darkFrame);
+    std::cout << "Quality pre-check: "
+        << (goodQuality.isUsable() && defocusedQuality.issue == FrameQualityIssue::OutOfFocus &&
+            darkQuality.issue == FrameQualityIssue::Underexposed ? "SUCCESS" : "FAILED")
+        << " (focus " << goodQuality.focusScore << " vs " << defocusedQuality.focusScore
+        << ", " << goodQuality.elapsedMs << " ms)" << std::endl;
+    
+    // Test tiled processing: seams must change neither filter output nor defect blobs
+    TiledOptions smallTiles;
+    smallTiles.tileSize = 61;
+    TiledOptions singleTile;
+    singleTile.tileSize = std::max(trackingFrame.cols, trackingFrame.rows);
+    TiledProcessor tiledProcessor(smallTiles);
+    MatTileSource mosaicSource(trackingFrame);
+    cv::Mat tiledBlur(trackingFrame.size(), CV_8UC1), wholeBlur;
+    MatTileSink blurSink(tiledBlur);
+    bool tiledFiltered = tiledProcessor.filter(mosaicSource, blurSink, 2, [](const cv::Mat &tile) {
+        cv::Mat dst;
+        cv::GaussianBlur(tile, dst, cv::Size(5, 5), 0);
+        return dst;
+    });
+    cv::GaussianBlur(trackingFrame, wholeBlur, cv::Size(5, 5), 0);
+    std::vector<CoreDefect> tiledDefects = tiledProcessor.detectDefects(mosaicSource);
+    TiledStats tiledStats = tiledProcessor.lastStats();
+    std::vector<CoreDefect> wholeDefects = TiledProcessor(singleTile).detectDefects(mosaicSource);
+    bool sameDefects = tiledDefects.size() == wholeDefects.size();
+    for (size_t i = 0; sameDefects && i < tiledDefects.size(); ++i) {
+        sameDefects = tiledDefects[i].bounds == wholeDefects[i].bounds && tiledDefects[i].type == wholeDefects[i].type;
+    }
+    std::cout << "Tiled processing: "
+        << (tiledFiltered && cv::norm(tiledBlur, wholeBlur, cv::NORM_INF) == 0 && sameDefects ? "SUCCESS" : "FAILED")
+        << " (" << tiledStats.tiles << " tiles, " << tiledDefects.size() << " defects, "
+        << tiledStats.mergedBlobs << " merged across seams)" << std::endl;
+    
+    // Test streaming a mosaic through a PGM file and back
+    const std::string mosaicPath = QDir::temp().filePath("tiled_mosaic_test.pgm").toStdString();
+    bool mosaicWritten = false;
+    {
+        FileTileSink mosaicSink(mosaicPath, trackingFrame.size(), CV_8UC1);
+        mosaicWritten = mosaicSink.isOpen() && tiledProcessor.filter(mosaicSource, mosaicSink, 0,
+                                                                      [](const cv::Mat &tile) { return tile.clone(); });
+    }
+    FileTileSource mosaicFile(mosaicPath);
+    cv::Mat streamedTile;
+    cv::Rect probeRegion(37, 23, 101, 77);
+    bool streamedMatches = mosaicWritten && mosaicFile.isOpen() && mosaicFile.size() == trackingFrame.size() &&
+                           mosaicFile.read(probeRegion, streamedTile) &&
+                           cv::norm(streamedTile, trackingFrame(probeRegion), cv::NORM_INF) == 0;
+    std::cout << "Tiled mosaic file: " << (streamedMatches ? "SUCCESS" : "FAILED") << std::endl;
+    std::remove(mosaicPath.c_str());
+    
+    // Test memory-mapped ingest: raw frames are zero-copy views that outlive the file object
+    const std::string dumpPath = QDir::temp().filePath("mapped_dump_test.raw").toStdString();
+    cv::Mat invertedFrame = 255 - trackingFrame;
+    {
+        std::ofstream dump(dumpPath, std::ios::binary);
+        for (const cv::Mat &frame : {trackingFrame, invertedFrame}) {
+            dump.write(reinterpret_cast<const char *>(frame.data), frame.total() * frame.elemSize());
+        }
+    }
+    cv::Mat mappedPage;
+    MappedImageFile dumpFile;
+    bool dumpMapped = dumpFile.openRaw(dumpPath, trackingFrame.size(), CV_8UC1) && dumpFile.pageCount() == 2 &&
+                      dumpFile.isZeroCopy(1);
+    if (dumpMapped) {
+        mappedPage = dumpFile.page(1);
+        dumpFile.close();
+    }
+    bool dumpMatches = dumpMapped && cv::norm(mappedPage, invertedFrame, cv::NORM_INF) == 0;
+    mappedPage.release();
+    std::remove(dumpPath.c_str());
+    
+    // Two binary PGM images back to back map as a two-page stack
+    const std::string stackPath = QDir::temp().filePath("mapped_stack_test.pgm").toStdString();
+    {
+        std::vector<uchar> encoded;
+        std::ofstream stack(stackPath, std::ios::binary);
+        for (const cv::Mat &frame : {trackingFrame, invertedFrame}) {
+            cv::imencode(".pgm", frame, encoded);
+            stack.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+        }
+    }
+    MappedFileFrameSource stackSource(stackPath);
+    cv::Mat firstPage, secondPage;
+    bool stackPlayed = stackSource.open() && stackSource.frameCount() == 2 &&
+                       stackSource.readFrame(firstPage) && stackSource.readFrame(secondPage) &&
+                       cv::norm(firstPage, trackingFrame, cv::NORM_INF) == 0 &&
+                       cv::norm(secondPage, invertedFrame, cv::NORM_INF) == 0;
+    stackSource.close();
+    std::remove(stackPath.c_str());
+    std::cout << "Memory-mapped ingest: " << (dumpMatches && stackPlayed ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // Test the batch pipeline: PNG files are read and decoded ahead, a PGM
+    // stack is mapped page by page, and the analyzers see every frame once
+    QDir batchDir(QDir::temp().filePath("batch_pipeline_test"));
+    batchDir.removeRecursively();
+    QDir::temp().mkpath("batch_pipeline_test");
+    for (int i = 0; i < 5; ++i) {
+        cv::imwrite(batchDir.filePath(QString("frame_%1.png").arg(i)).toStdString(), i % 2 ? invertedFrame : trackingFrame);
+    }
+    {
+        std::vector<uchar> encoded;
+        std::ofstream stack(batchDir.filePath("stack.pgm").toStdString(), std::ios::binary);
+        for (const cv::Mat &frame : {trackingFrame, invertedFrame}) {
+            cv::imencode(".pgm", frame, encoded);
+            stack.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+        }
+    }
+    std::vector<std::string> batchFiles = BatchPipeline::listImages(batchDir.path().toStdString());
+    BatchOptions batchOptions;
+    batchOptions.readAhead = 2;
+    batchOptions.decodedFrames = 2;
+    BatchPipeline batchPipeline(batchOptions);
+    std::atomic<int> batchFrames(0);
+    std::atomic<int> batchMismatches(0);
+    BatchStats batchStats = batchPipeline.run(batchFiles, 2, [&](BatchFrame &frame, int) {
+        const cv::Mat &expected = (frame.page == 1 || frame.path.find("frame_1") != std::string::npos ||
+                                   frame.path.find("frame_3") != std::string::npos) ? invertedFrame : trackingFrame;
+        if (!frame.error.empty() || cv::norm(frame.image, expected, cv::NORM_INF) != 0) {
+            ++batchMismatches;
+        }
+        ++batchFrames;
+    });
+    
+    // Reduced-resolution decoding for previews
+    batchOptions.previewScale = 2;
+    BatchPipeline previewPipeline(batchOptions);
+    cv::Size previewSize(trackingFrame.cols / 2, trackingFrame.rows / 2);
+    std::atomic<int> previewMismatches(0);
+    previewPipeline.run(batchFiles, 1, [&](BatchFrame &frame, int) {
+        if (frame.image.size() != previewSize) {
+            ++previewMismatches;
+        }
+    });
+    batchDir.removeRecursively();
+    std::cout << "Batch pipeline: "
+        << (batchFiles.size() == 6 && batchFrames == 7 && batchMismatches == 0 && batchStats.failures == 0 &&
+            batchStats.decode.items == 7 && previewMismatches == 0
+            ? "SUCCESS" : "FAILED")
+        << " (" << batchStats.read.items << " read" << (batchStats.ioUring ? " via io_uring" : "") << ", "
+        << batchStats.decode.items << " decoded, " << batchStats.elapsedMs << " ms)" << std::endl;
+    
+    // Test the live pipeline with a still image standing in for the camera
+    std::cout << "\nTesting live pipeline..." << std::endl;
+    
+    // A consumer that falls behind gets the newest frame, not the oldest queued one
+    FrameRing<int> frameRing;
+    for (int i = 1; i <= 10; ++i) {
+        frameRing.push(i);
+    }
+    int latestFrame = 0;
+    bool gotLatest = frameRing.popLatest(latestFrame);
+    bool ringEmpty = !frameRing.popLatest(latestFrame);
+    frameRing.push(11);
+    int nextFrame = 0;
+    bool gotNext = frameRing.popLatest(nextFrame);
+    std::cout << "Frame ring keeps newest: "
+        << (gotLatest && latestFrame == 10 && ringEmpty && gotNext && nextFrame == 11 && frameRing.droppedCount() == 9
+            ? "SUCCESS" : "FAILED") << std::endl;
+    
+    std::unique_ptr<FrameSource> liveSource = createFrameSource(testImagePath.toStdString());
+    liveSource->setFrameRate(30.0);
+    LivePipeline livePipeline(&fiberAnalyzer, &imageProcessor);
+    bool liveStarted = livePipeline.start(std::move(liveSource));
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    LiveResult liveResult;
+    bool gotLiveResult = livePipeline.takeLatestResult(liveResult);
+    LivePipelineStats liveStats = livePipeline.statistics();
+    livePipeline.stop();
+    std::cout << "Live pipeline: " << (liveStarted && gotLiveResult ? "SUCCESS" : "FAILED")
+        << " (" << liveStats.framesCaptured << " captured, " << liveStats.framesAnalyzed << " analyzed, "
+        << liveStats.framesDropped << " dropped, " << liveStats.framesSkipped << " unchanged)" << std::endl;
     
     // Test results saving
     std::cout << "\nTesting results management..." << std::endl;
@@ -75,6 +674,84 @@ int main(int argc, char *argv[]) {
     bool pdfSuccess = resultsManager.exportToPDF(result, pdfPath);
     std::cout << "Exported PDF report: " << (pdfSuccess ? "SUCCESS" : "FAILED") << std::endl;
     
+    // Test the round trip and the move hand-off into a session
+    FiberAnalysisResult loadedResult = resultsManager.loadResult(resultPath);
+    bool roundTrip = loadedResult.defects.size() == result.defects.size()
+        && loadedResult.summary() == result.summary();
+    resultsManager.startNewSession("test");
+    resultsManager.addToSession(std::move(loadedResult), resultPath);
+    resultsManager.endSession();
+    std::cout << "Compact result round trip: "
+        << (roundTrip && resultsManager.getSessionHistory().size() == 1 ? "SUCCESS" : "FAILED") << std::endl;
+    
+    // Result log: group-committed appends across several segments, reads by
+    // sequence number after reopening, and recovery from a simulated crash that
+    // cut the index short and tore the last record
+    QDir logDir(QDir::currentPath() + "/test_result_log");
+    logDir.removeRecursively();
+    ResultLogOptions logOptions;
+    logOptions.segmentBytes = 256 << 10;
+    bool logOk = true;
+    double logRate = 0.0;
+    std::string logPayload(200, 'r');
+    {
+        ResultLog log(logOptions);
+        logOk = log.open(logDir.absolutePath().toStdString());
+        auto logStart = std::chrono::steady_clock::now();
+        for (int i = 1; logOk && i <= 20000; ++i) {
+            logPayload.replace(0, 8, std::to_string(10000000 + i));
+            logOk = log.append(logPayload.data(), logPayload.size(), i) == static_cast<uint64_t>(i);
+        }
+        logOk = logOk && log.sync();
+        logRate = 20000.0 / std::chrono::duration<double>(std::chrono::steady_clock::now() - logStart).count();
+        for (int i = 0; logOk && i < 10; ++i) {
+            logOk = log.append("tail", 4, 0) != 0;
+        }
+    }
+    uint32_t logSegments = 0;
+    {
+        ResultLog log(logOptions);
+        ResultLogRecord record;
+        logOk = logOk && log.open(logDir.absolutePath().toStdString()) && log.lastSequence() == 20010
+            && log.read(12345, record) && record.timestampMs == 12345
+            && std::string(record.payload.begin(), record.payload.begin() + 8) == std::to_string(10012345);
+        logSegments = log.stats().segments;
+    }
+    QStringList segmentFiles = logDir.entryList(QStringList() << "segment-*.log", QDir::Files, QDir::Name);
+    QString indexFile = logDir.filePath("results.idx");
+    QString lastSegment = segmentFiles.isEmpty() ? QString() : logDir.filePath(segmentFiles.last());
+    QFile::resize(indexFile, QFileInfo(indexFile).size() - 100 * 32);
+    QFile::resize(lastSegment, QFileInfo(lastSegment).size() - 5);
+    ResultLogStats recoveryStats;
+    {
+        ResultLog log(logOptions);
+        ResultLogRecord record;
+        logOk = logOk && log.open(logDir.absolutePath().toStdString()) && log.lastSequence() == 20009
+            && log.read(20009, record) && log.append("next", 4, 0) == 20010;
+        recoveryStats = log.stats();
+        
+        // A second writer on the same directory is refused while the first holds it
+        ResultLog secondWriter(logOptions);
+        logOk = logOk && !secondWriter.open(logDir.absolutePath().toStdString());
+    }
+    logOk = logOk && logSegments > 1 && recoveryStats.recoveredRecords == 99 && recoveryStats.truncatedBytes > 0;
+    logDir.removeRecursively();
+    
+    // Two saves in the same second no longer overwrite each other
+    QDir savedDir(QDir::currentPath() + "/test_results");
+    savedDir.removeRecursively();
+    resultsManager.setDefaultSaveLocation(savedDir.absolutePath());
+    bool savedOk = resultsManager.saveResult(result, "first.png");
+    quint64 firstSequence = resultsManager.lastSavedSequence();
+    savedOk = savedOk && resultsManager.saveResult(result, "second.png") && resultsManager.flushResults();
+    QString loggedImage;
+    FiberAnalysisResult loggedResult = resultsManager.loadLoggedResult(firstSequence, &loggedImage);
+    savedOk = savedOk && resultsManager.lastSavedSequence() == firstSequence + 1 && loggedImage == "first.png"
+        && loggedResult.summary() == result.summary();
+    std::cout << "Result log: " << (logOk && savedOk ? "SUCCESS" : "FAILED")
+        << " (" << static_cast<long long>(logRate) << " records/s, " << logSegments << " segments, "
+        << recoveryStats.recoveredRecords << " reindexed, " << recoveryStats.truncatedBytes << " bytes cut)" << std::endl;
+    
     std::cout << "\n===== Core Functionality Test Complete =====" << std::endl;
     
     return 0;